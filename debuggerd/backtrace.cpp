@@ -23,14 +23,15 @@
 #include <time.h>
 #include <errno.h>
 #include <limits.h>
-#include <dirent.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ptrace.h>
 
 #include <memory>
+#include <vector>
 
 #include <backtrace/Backtrace.h>
+#include <backtrace/BacktraceMap.h>
 
 #include <log/log.h>
 
@@ -67,7 +68,7 @@ static void dump_process_footer(log_t* log, pid_t pid) {
   _LOG(log, logtype::BACKTRACE, "\n----- end %d -----\n", pid);
 }
 
-static void dump_thread(log_t* log, pid_t pid, pid_t tid, bool attached,
+static void dump_thread(log_t* log, pid_t pid, pid_t tid, BacktraceMap* map, bool attached,
                         bool* detach_failed, int* total_sleep_time_usec) {
   char path[PATH_MAX];
   char threadnamebuf[1024];
@@ -88,17 +89,27 @@ static void dump_thread(log_t* log, pid_t pid, pid_t tid, bool attached,
 
   _LOG(log, logtype::BACKTRACE, "\n\"%s\" sysTid=%d\n", threadname ? threadname : "<unknown>", tid);
 
-  if (!attached && !ptrace_attach_thread(pid, tid)) {
-    _LOG(log, logtype::BACKTRACE, "Could not attach to thread: %s\n", strerror(errno));
-    return;
-  }
+  if (!attached) {
+    phase_timer timer(&log->timing.attach_ns);
+
+    if (!ptrace_attach_thread(pid, tid)) {
+      _LOG(log, logtype::BACKTRACE, "Could not attach to thread: %s\n", strerror(errno));
+      return;
+    }
 
-  if (!attached && wait_for_sigstop(tid, total_sleep_time_usec, detach_failed) == -1) {
-    return;
+    if (wait_for_sigstop(tid, total_sleep_time_usec, detach_failed) == -1) {
+      return;
+    }
   }
 
-  std::unique_ptr<Backtrace> backtrace(Backtrace::Create(tid, BACKTRACE_CURRENT_THREAD));
-  if (backtrace->Unwind(0)) {
+  std::unique_ptr<Backtrace> backtrace(Backtrace::Create(pid, tid, map));
+  bool unwound;
+  {
+    phase_timer timer(&log->timing.unwind_ns);
+    unwound = backtrace->Unwind(0);
+  }
+  if (unwound) {
+    phase_timer timer(&log->timing.symbolize_ns);
     dump_backtrace_to_log(backtrace.get(), log, "  ");
   } else {
     ALOGE("Unwind failed: tid = %d", tid);
@@ -112,35 +123,29 @@ static void dump_thread(log_t* log, pid_t pid, pid_t tid, bool attached,
 
 void dump_backtrace(int fd, int amfd, pid_t pid, pid_t tid, bool* detach_failed,
                     int* total_sleep_time_usec) {
+  uint64_t start_ns = dump_time_ns();
   log_t log;
   log.tfd = fd;
   log.amfd = amfd;
 
-  dump_process_header(&log, pid);
-  dump_thread(&log, pid, tid, true, detach_failed, total_sleep_time_usec);
-
-  char task_path[64];
-  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
-  DIR* d = opendir(task_path);
-  if (d != NULL) {
-    struct dirent* de = NULL;
-    while ((de = readdir(d)) != NULL) {
-      if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
-        continue;
-      }
-
-      char* end;
-      pid_t new_tid = strtoul(de->d_name, &end, 10);
-      if (*end || new_tid == tid) {
-        continue;
-      }
+  // One map for all the threads, rather than one read per thread.
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(pid));
 
-      dump_thread(&log, pid, new_tid, false, detach_failed, total_sleep_time_usec);
-    }
-    closedir(d);
+  dump_process_header(&log, pid);
+  dump_thread(&log, pid, tid, map.get(), true, detach_failed, total_sleep_time_usec);
+
+  std::vector<pid_t> tids;
+  if (get_sibling_tids(pid, tid, &tids)) {
+    BacktraceMap* shared_map = map.get();
+    dump_threads(&log, tids, get_tracer_count(), detach_failed, total_sleep_time_usec,
+                 [pid, shared_map](log_t* log, pid_t new_tid, bool* detach_failed,
+                                   int* total_sleep_time_usec) {
+      dump_thread(log, pid, new_tid, shared_map, false, detach_failed, total_sleep_time_usec);
+    });
   }
 
   dump_process_footer(&log, pid);
+  log_dump_timing("backtrace", pid, log.timing, dump_time_ns() - start_ns);
 }
 
 void dump_backtrace_to_log(Backtrace* backtrace, log_t* log, const char* prefix) {
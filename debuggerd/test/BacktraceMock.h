@@ -35,6 +35,7 @@ class BacktraceMapMock : public BacktraceMap {
 
   void AddMap(backtrace_map_t& map) {
     maps_.push_back(map);
+    BuildIndex();
   }
 };
 
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <base/file.h>
+#include <base/stringprintf.h>
+
+#include "log_fake.h"
+#include "utility.h"
+
+class DumpThreadsTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    char tmp_file[256];
+    const char data_template[] = "/data/local/tmp/debuggerd_threads_testXXXXXX";
+    memcpy(tmp_file, data_template, sizeof(data_template));
+    int tombstone_fd = mkstemp(tmp_file);
+    if (tombstone_fd == -1) {
+      const char tmp_template[] = "/tmp/debuggerd_threads_testXXXXXX";
+      memcpy(tmp_file, tmp_template, sizeof(tmp_template));
+      tombstone_fd = mkstemp(tmp_file);
+      if (tombstone_fd == -1) {
+        abort();
+      }
+    }
+    if (unlink(tmp_file) == -1) {
+      abort();
+    }
+
+    log_.tfd = tombstone_fd;
+    log_.amfd = -1;
+    log_.crashed_tid = 12;
+    log_.current_tid = 12;
+
+    for (pid_t tid = 100; tid < 140; tid++) {
+      tids_.push_back(tid);
+    }
+
+    resetLogs();
+  }
+
+  virtual void TearDown() {
+    if (log_.tfd >= 0) {
+      close(log_.tfd);
+    }
+  }
+
+  std::string Dump(size_t max_tracers, bool* detach_failed, int* total_sleep_time_usec) {
+    dump_threads(&log_, tids_, max_tracers, detach_failed, total_sleep_time_usec,
+                 [](log_t* log, pid_t tid, bool* detach_failed, int* total_sleep_time_usec) {
+      // Later threads finish first, if there is more than one tracer.
+      usleep((140 - tid) * 100);
+      log->current_tid = tid;
+      _LOG(log, logtype::THREAD, "--- %d\n", tid);
+      _LOG(log, logtype::BACKTRACE, "backtrace of %d\n", tid);
+      log->current_tid = log->crashed_tid;
+      log->timing.unwind_ns += 1000;
+      if (tid == 120) {
+        *detach_failed = true;
+        log->should_retrieve_logcat = false;
+      }
+      *total_sleep_time_usec += 10;
+    });
+
+    std::string tombstone_contents;
+    EXPECT_EQ(0, lseek(log_.tfd, 0, SEEK_SET));
+    EXPECT_TRUE(android::base::ReadFdToString(log_.tfd, &tombstone_contents));
+    return tombstone_contents;
+  }
+
+  std::string Expected() {
+    std::string expected;
+    for (pid_t tid : tids_) {
+      expected += android::base::StringPrintf("--- %d\nbacktrace of %d\n", tid, tid);
+    }
+    return expected;
+  }
+
+  // Dumps with some threads failing to attach, the way dump_sibling_thread()
+  // reports it, and returns what reached logcat and the activity manager.
+  std::string DumpErrors(size_t max_tracers, std::string* am_contents) {
+    int am_pipe[2];
+    EXPECT_EQ(0, pipe2(am_pipe, O_NONBLOCK));
+    log_.amfd = am_pipe[1];
+    resetLogs();
+
+    bool detach_failed = false;
+    int total_sleep_time_usec = 0;
+    dump_threads(&log_, tids_, max_tracers, &detach_failed, &total_sleep_time_usec,
+                 [](log_t* log, pid_t tid, bool*, int*) {
+      usleep((140 - tid) * 100);
+      if (tid % 3 == 0) {
+        _LOG(log, logtype::ERROR, "ptrace attach to %d failed\n", tid);
+        return;
+      }
+      log->current_tid = tid;
+      _LOG(log, logtype::BACKTRACE, "backtrace of %d\n", tid);
+      log->current_tid = log->crashed_tid;
+    });
+
+    close(am_pipe[1]);
+    log_.amfd = -1;
+    am_contents->clear();
+    EXPECT_TRUE(android::base::ReadFdToString(am_pipe[0], am_contents));
+    close(am_pipe[0]);
+    return getFakeLogBuf();
+  }
+
+  log_t log_;
+  std::vector<pid_t> tids_;
+};
+
+TEST_F(DumpThreadsTest, one_tracer) {
+  bool detach_failed = false;
+  int total_sleep_time_usec = 0;
+
+  ASSERT_EQ(Expected(), Dump(1, &detach_failed, &total_sleep_time_usec));
+  ASSERT_TRUE(detach_failed);
+  ASSERT_FALSE(log_.should_retrieve_logcat);
+  ASSERT_EQ(400, total_sleep_time_usec);
+  ASSERT_EQ(40000U, log_.timing.unwind_ns);
+}
+
+TEST_F(DumpThreadsTest, tracers_keep_order) {
+  bool detach_failed = false;
+  int total_sleep_time_usec = 1000;
+
+  ASSERT_EQ(Expected(), Dump(4, &detach_failed, &total_sleep_time_usec));
+  ASSERT_TRUE(detach_failed);
+  ASSERT_FALSE(log_.should_retrieve_logcat);
+  // Each tracer waits its own share, starting from what was already spent.
+  ASSERT_LT(1000, total_sleep_time_usec);
+  ASSERT_GE(1400, total_sleep_time_usec);
+  ASSERT_EQ(40000U, log_.timing.unwind_ns);
+
+  // None of the sibling threads' output belongs in the log.
+  ASSERT_STREQ("", getFakeLogBuf().c_str());
+}
+
+TEST_F(DumpThreadsTest, more_tracers_than_threads) {
+  bool detach_failed = false;
+  int total_sleep_time_usec = 0;
+
+  tids_.resize(2);
+  ASSERT_EQ(Expected(), Dump(16, &detach_failed, &total_sleep_time_usec));
+  ASSERT_FALSE(detach_failed);
+  ASSERT_TRUE(log_.should_retrieve_logcat);
+}
+
+TEST_F(DumpThreadsTest, tracers_replay_errors) {
+  std::string one_am;
+  std::string one_logcat = DumpErrors(1, &one_am);
+  std::string expected;
+  for (pid_t tid : tids_) {
+    if (tid % 3 == 0) {
+      expected += android::base::StringPrintf("ptrace attach to %d failed\n", tid);
+    }
+  }
+  ASSERT_EQ(expected, one_am);
+  ASSERT_NE(std::string::npos, one_logcat.find("ptrace attach to 102 failed"));
+
+  // The same lines, in the same order, as with a single tracer.
+  std::string many_am;
+  ASSERT_EQ(one_logcat, DumpErrors(4, &many_am));
+  ASSERT_EQ(one_am, many_am);
+}
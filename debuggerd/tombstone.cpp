@@ -17,7 +17,6 @@
 #define LOG_TAG "DEBUG"
 
 #include <arpa/inet.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -34,6 +33,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <private/android_filesystem_config.h>
 
@@ -420,66 +420,65 @@ static void dump_backtrace_and_stack(Backtrace* backtrace, log_t* log) {
   }
 }
 
-// Return true if some thread is not detached cleanly
-static bool dump_sibling_thread_report(
-    log_t* log, pid_t pid, pid_t tid, int* total_sleep_time_usec, BacktraceMap* map) {
-  char task_path[64];
-
-  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
-
-  DIR* d = opendir(task_path);
-  // Bail early if the task directory cannot be opened
-  if (d == NULL) {
-    ALOGE("Cannot open /proc/%d/task\n", pid);
-    return false;
-  }
-
-  bool detach_failed = false;
-  struct dirent* de;
-  while ((de = readdir(d)) != NULL) {
-    // Ignore "." and ".."
-    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
-      continue;
-    }
-
-    // The main thread at fault has been handled individually
-    char* end;
-    pid_t new_tid = strtoul(de->d_name, &end, 10);
-    if (*end || new_tid == tid) {
-      continue;
-    }
+static void dump_sibling_thread(log_t* log, pid_t pid, pid_t new_tid, BacktraceMap* map,
+                                bool* detach_failed, int* total_sleep_time_usec) {
+  {
+    phase_timer timer(&log->timing.attach_ns);
 
     // Skip this thread if cannot ptrace it
     if (!ptrace_attach_thread(pid, new_tid)) {
       _LOG(log, logtype::ERROR, "ptrace attach to %d failed: %s\n", new_tid, strerror(errno));
-      continue;
+      return;
     }
 
-    if (wait_for_sigstop(new_tid, total_sleep_time_usec, &detach_failed) == -1) {
-      continue;
+    if (wait_for_sigstop(new_tid, total_sleep_time_usec, detach_failed) == -1) {
+      return;
     }
+  }
 
-    log->current_tid = new_tid;
-    _LOG(log, logtype::THREAD, "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
-    dump_thread_info(log, pid, new_tid);
+  log->current_tid = new_tid;
+  _LOG(log, logtype::THREAD, "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
+  dump_thread_info(log, pid, new_tid);
 
-    dump_registers(log, new_tid);
-    std::unique_ptr<Backtrace> backtrace(Backtrace::Create(pid, new_tid, map));
-    if (backtrace->Unwind(0)) {
-      dump_backtrace_and_stack(backtrace.get(), log);
-    } else {
-      ALOGE("Unwind of sibling failed: pid = %d, tid = %d", pid, new_tid);
-    }
+  dump_registers(log, new_tid);
+  std::unique_ptr<Backtrace> backtrace(Backtrace::Create(pid, new_tid, map));
+  bool unwound;
+  {
+    phase_timer timer(&log->timing.unwind_ns);
+    unwound = backtrace->Unwind(0);
+  }
+  if (unwound) {
+    phase_timer timer(&log->timing.symbolize_ns);
+    dump_backtrace_and_stack(backtrace.get(), log);
+  } else {
+    ALOGE("Unwind of sibling failed: pid = %d, tid = %d", pid, new_tid);
+  }
 
-    log->current_tid = log->crashed_tid;
+  log->current_tid = log->crashed_tid;
 
-    if (ptrace(PTRACE_DETACH, new_tid, 0, 0) != 0) {
-      _LOG(log, logtype::ERROR, "ptrace detach from %d failed: %s\n", new_tid, strerror(errno));
-      detach_failed = true;
-    }
+  if (ptrace(PTRACE_DETACH, new_tid, 0, 0) != 0) {
+    _LOG(log, logtype::ERROR, "ptrace detach from %d failed: %s\n", new_tid, strerror(errno));
+    *detach_failed = true;
   }
+}
 
-  closedir(d);
+// Return true if some thread is not detached cleanly
+static bool dump_sibling_thread_report(
+    log_t* log, pid_t pid, pid_t tid, int* total_sleep_time_usec, BacktraceMap* map) {
+  std::vector<pid_t> tids;
+  // Bail early if the task directory cannot be opened
+  if (!get_sibling_tids(pid, tid, &tids)) {
+    ALOGE("Cannot open /proc/%d/task\n", pid);
+    return false;
+  }
+
+  // The map is shared by all the tracers, which only read it.
+  bool detach_failed = false;
+  dump_threads(log, tids, get_tracer_count(), &detach_failed, total_sleep_time_usec,
+               [pid, map](log_t* log, pid_t new_tid, bool* detach_failed,
+                          int* total_sleep_time_usec) {
+    dump_sibling_thread(log, pid, new_tid, map, detach_failed, total_sleep_time_usec);
+  });
   return detach_failed;
 }
 
@@ -607,6 +606,7 @@ static void dump_log_file(
 // Dumps the logs generated by the specified pid to the tombstone, from both
 // "system" and "main" log devices.  Ideally we'd interleave the output.
 static void dump_logs(log_t* log, pid_t pid, unsigned int tail) {
+  phase_timer timer(&log->timing.logs_ns);
   dump_log_file(log, pid, "system", tail);
   dump_log_file(log, pid, "main", tail);
 }
@@ -641,6 +641,8 @@ static void dump_abort_message(Backtrace* backtrace, log_t* log, uintptr_t addre
 static bool dump_crash(log_t* log, pid_t pid, pid_t tid, int signal, int si_code,
                        uintptr_t abort_msg_address, bool dump_sibling_threads,
                        int* total_sleep_time_usec) {
+  uint64_t start_ns = dump_time_ns();
+
   // don't copy log messages to tombstone unless this is a dev device
   char value[PROPERTY_VALUE_MAX];
   property_get("ro.debuggable", value, "0");
@@ -669,7 +671,13 @@ static bool dump_crash(log_t* log, pid_t pid, pid_t tid, int signal, int si_code
   std::unique_ptr<Backtrace> backtrace(Backtrace::Create(pid, tid, map.get()));
   dump_abort_message(backtrace.get(), log, abort_msg_address);
   dump_registers(log, tid);
-  if (backtrace->Unwind(0)) {
+  bool unwound;
+  {
+    phase_timer timer(&log->timing.unwind_ns);
+    unwound = backtrace->Unwind(0);
+  }
+  if (unwound) {
+    phase_timer timer(&log->timing.symbolize_ns);
     dump_backtrace_and_stack(backtrace.get(), log);
   } else {
     ALOGE("Unwind failed: pid = %d, tid = %d", pid, tid);
@@ -701,6 +709,7 @@ static bool dump_crash(log_t* log, pid_t pid, pid_t tid, int signal, int si_code
     TEMP_FAILURE_RETRY( read(log->amfd, &eodMarker, 1) );
   }
 
+  log_dump_timing("tombstone", pid, log->timing, dump_time_ns() - start_ns);
   return detach_failed;
 }
 
@@ -18,10 +18,14 @@
 
 #include "utility.h"
 
+#include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
@@ -29,11 +33,14 @@
 #include <backtrace/Backtrace.h>
 #include <base/file.h>
 #include <base/stringprintf.h>
+#include <cutils/properties.h>
 #include <log/log.h>
 
 const int SLEEP_TIME_USEC = 50000;         // 0.05 seconds
 const int MAX_TOTAL_SLEEP_USEC = 10000000; // 10 seconds
 
+const size_t MAX_TRACERS = 16;
+
 // Whitelist output desired in the logcat output.
 bool is_allowed_in_logcat(enum logtype ltype) {
   if ((ltype == ERROR)
@@ -45,13 +52,29 @@ bool is_allowed_in_logcat(enum logtype ltype) {
   return false;
 }
 
+static void write_to_crash_log(log_t* log, const char* buf, size_t len) {
+  __android_log_buf_write(LOG_ID_CRASH, ANDROID_LOG_FATAL, LOG_TAG, buf);
+  if (log->amfd != -1) {
+    if (!android::base::WriteFully(log->amfd, buf, len)) {
+      // timeout or other failure on write; stop informing the activity manager
+      ALOGE("AM write failed: %s", strerror(errno));
+      log->amfd = -1;
+    }
+  }
+}
+
+void log_held_lines(log_t* log, const std::vector<std::string>& lines) {
+  for (const auto& line : lines) {
+    write_to_crash_log(log, line.c_str(), line.size());
+  }
+}
+
 void _LOG(log_t* log, enum logtype ltype, const char* fmt, ...) {
-  bool write_to_tombstone = (log->tfd != -1);
+  bool write_to_tombstone = (log->tfd != -1 || log->buffer != nullptr);
   bool write_to_logcat = is_allowed_in_logcat(ltype)
                       && log->crashed_tid != -1
                       && log->current_tid != -1
                       && (log->crashed_tid == log->current_tid);
-  bool write_to_activitymanager = (log->amfd != -1);
 
   char buf[512];
   va_list ap;
@@ -65,17 +88,18 @@ void _LOG(log_t* log, enum logtype ltype, const char* fmt, ...) {
   }
 
   if (write_to_tombstone) {
-    TEMP_FAILURE_RETRY(write(log->tfd, buf, len));
+    if (log->buffer != nullptr) {
+      log->buffer->append(buf, len);
+    } else {
+      TEMP_FAILURE_RETRY(write(log->tfd, buf, len));
+    }
   }
 
   if (write_to_logcat) {
-    __android_log_buf_write(LOG_ID_CRASH, ANDROID_LOG_FATAL, LOG_TAG, buf);
-    if (write_to_activitymanager) {
-      if (!android::base::WriteFully(log->amfd, buf, len)) {
-        // timeout or other failure on write; stop informing the activity manager
-        ALOGE("AM write failed: %s", strerror(errno));
-        log->amfd = -1;
-      }
+    if (log->held_lines != nullptr) {
+      log->held_lines->emplace_back(buf, len);
+    } else {
+      write_to_crash_log(log, buf, len);
     }
   }
 }
@@ -236,3 +260,157 @@ bool ptrace_attach_thread(pid_t pid, pid_t tid) {
 
   return true;
 }
+
+uint64_t dump_time_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void log_dump_timing(const char* what, pid_t pid, const dump_timing& timing, uint64_t total_ns) {
+  ALOGI("%s of pid %d took %" PRIu64 "us: attach %" PRIu64 "us, unwind %" PRIu64
+        "us, symbolize %" PRIu64 "us, logs %" PRIu64 "us",
+        what, pid, total_ns / 1000, timing.attach_ns / 1000, timing.unwind_ns / 1000,
+        timing.symbolize_ns / 1000, timing.logs_ns / 1000);
+}
+
+bool get_sibling_tids(pid_t pid, pid_t tid, std::vector<pid_t>* tids) {
+  char task_path[64];
+  snprintf(task_path, sizeof(task_path), "/proc/%d/task", pid);
+
+  DIR* d = opendir(task_path);
+  if (d == NULL) {
+    return false;
+  }
+
+  struct dirent* de;
+  while ((de = readdir(d)) != NULL) {
+    // Ignore "." and ".."
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) {
+      continue;
+    }
+
+    char* end;
+    pid_t new_tid = strtoul(de->d_name, &end, 10);
+    if (*end || new_tid == tid) {
+      continue;
+    }
+    tids->push_back(new_tid);
+  }
+
+  closedir(d);
+  return true;
+}
+
+size_t get_tracer_count() {
+  char value[PROPERTY_VALUE_MAX];
+  property_get("debug.debuggerd.tracers", value, "1");
+  int count = atoi(value);
+  if (count < 1) {
+    return 1;
+  }
+  return static_cast<size_t>(count) > MAX_TRACERS ? MAX_TRACERS : count;
+}
+
+// One thread's part of a dump_threads() call.
+struct thread_dump {
+  log_t log;
+  std::string output;
+  std::vector<std::string> held_lines;
+  bool detach_failed;
+};
+
+struct tracer_state {
+  const std::vector<pid_t>* tids;
+  std::vector<thread_dump>* dumps;
+  const thread_dumper* dumper;
+  // The next index of tids to dump, shared by all the tracers.
+  size_t* next;
+  // This tracer's own count, as if it had done all its waiting alone.
+  int total_sleep_time_usec;
+};
+
+static void* tracer_thread(void* arg) {
+  tracer_state* state = reinterpret_cast<tracer_state*>(arg);
+  size_t i;
+  while ((i = __sync_fetch_and_add(state->next, 1)) < state->tids->size()) {
+    thread_dump& dump = (*state->dumps)[i];
+    (*state->dumper)(&dump.log, (*state->tids)[i], &dump.detach_failed,
+                     &state->total_sleep_time_usec);
+  }
+  return nullptr;
+}
+
+void dump_threads(log_t* log, const std::vector<pid_t>& tids, size_t max_tracers,
+                  bool* detach_failed, int* total_sleep_time_usec, const thread_dumper& dumper) {
+  if (max_tracers > tids.size()) {
+    max_tracers = tids.size();
+  }
+  if (max_tracers <= 1) {
+    for (pid_t tid : tids) {
+      dumper(log, tid, detach_failed, total_sleep_time_usec);
+    }
+    return;
+  }
+
+  std::vector<thread_dump> dumps(tids.size());
+  for (auto& dump : dumps) {
+    dump.log = *log;
+    dump.log.tfd = -1;
+    dump.log.amfd = -1;
+    dump.log.timing = dump_timing();
+    dump.log.buffer = &dump.output;
+    dump.log.held_lines = &dump.held_lines;
+    dump.detach_failed = false;
+  }
+
+  size_t next = 0;
+  std::vector<tracer_state> states(max_tracers);
+  std::vector<pthread_t> threads;
+  for (auto& state : states) {
+    state.tids = &tids;
+    state.dumps = &dumps;
+    state.dumper = &dumper;
+    state.next = &next;
+    state.total_sleep_time_usec = *total_sleep_time_usec;
+  }
+
+  // This thread is the first tracer; carry on with fewer if threads run out.
+  for (size_t i = 1; i < max_tracers; i++) {
+    pthread_t thread;
+    int ret = pthread_create(&thread, nullptr, tracer_thread, &states[i]);
+    if (ret != 0) {
+      ALOGE("failed to start a tracer thread: %s", strerror(ret));
+      break;
+    }
+    threads.push_back(thread);
+  }
+  tracer_thread(&states[0]);
+  for (pthread_t thread : threads) {
+    pthread_join(thread, nullptr);
+  }
+
+  // The tracers waited side by side, so the longest of them is what it cost.
+  for (const auto& state : states) {
+    if (state.total_sleep_time_usec > *total_sleep_time_usec) {
+      *total_sleep_time_usec = state.total_sleep_time_usec;
+    }
+  }
+
+  for (const auto& dump : dumps) {
+    if (log->buffer != nullptr) {
+      log->buffer->append(dump.output);
+    } else if (log->tfd != -1 && !android::base::WriteFully(log->tfd, dump.output.data(),
+                                                            dump.output.size())) {
+      ALOGE("tombstone write failed: %s", strerror(errno));
+    }
+    log_held_lines(log, dump.held_lines);
+    if (dump.detach_failed) {
+      *detach_failed = true;
+    }
+    if (!dump.log.should_retrieve_logcat) {
+      log->should_retrieve_logcat = false;
+    }
+    log->timing.add(dump.log.timing);
+  }
+}
@@ -19,8 +19,13 @@
 #define _DEBUGGERD_UTILITY_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
+#include <functional>
+#include <string>
+#include <vector>
+
 #include <backtrace/Backtrace.h>
 
 // Figure out the abi based on defined macros.
@@ -40,6 +45,22 @@
 #error "Unsupported ABI"
 #endif
 
+// Time spent in each phase of a dump, summed over the threads dumped.
+struct dump_timing {
+    uint64_t attach_ns;
+    uint64_t unwind_ns;
+    uint64_t symbolize_ns;
+    uint64_t logs_ns;
+
+    dump_timing() : attach_ns(0), unwind_ns(0), symbolize_ns(0), logs_ns(0) {}
+
+    void add(const dump_timing& other) {
+        attach_ns += other.attach_ns;
+        unwind_ns += other.unwind_ns;
+        symbolize_ns += other.symbolize_ns;
+        logs_ns += other.logs_ns;
+    }
+};
 
 struct log_t{
     /* tombstone file descriptor */
@@ -52,9 +73,17 @@ struct log_t{
     pid_t current_tid;
     // logd daemon crash, can block asking for logcat data, allow suppression.
     bool should_retrieve_logcat;
+    // Where the time of this dump went.
+    dump_timing timing;
+    // If set, tombstone output is appended here instead of written to tfd.
+    std::string* buffer;
+    // If set, lines for logcat and the activity manager are held here
+    // instead of written, to be replayed by log_held_lines().
+    std::vector<std::string>* held_lines;
 
     log_t()
-        : tfd(-1), amfd(-1), crashed_tid(-1), current_tid(-1), should_retrieve_logcat(true) {}
+        : tfd(-1), amfd(-1), crashed_tid(-1), current_tid(-1), should_retrieve_logcat(true),
+          buffer(nullptr), held_lines(nullptr) {}
 };
 
 // List of types of logs to simplify the logging decision in _LOG
@@ -75,6 +104,10 @@ enum logtype {
 void _LOG(log_t* log, logtype ltype, const char *fmt, ...)
         __attribute__ ((format(printf, 3, 4)));
 
+// Writes lines held back by another log_t to log's logcat and activity
+// manager, as _LOG() would have.
+void log_held_lines(log_t* log, const std::vector<std::string>& lines);
+
 int wait_for_sigstop(pid_t, int*, bool*);
 
 void dump_memory(log_t* log, Backtrace* backtrace, uintptr_t addr, const char* fmt, ...);
@@ -84,4 +117,39 @@ bool pid_contains_tid(pid_t pid, pid_t tid);
 // Attach to a thread, and verify that it's still a member of the given process
 bool ptrace_attach_thread(pid_t pid, pid_t tid);
 
+uint64_t dump_time_ns();
+
+// Adds the time from its construction to its destruction to *total_ns.
+class phase_timer {
+ public:
+  explicit phase_timer(uint64_t* total_ns) : total_ns_(total_ns), start_ns_(dump_time_ns()) {}
+  ~phase_timer() { *total_ns_ += dump_time_ns() - start_ns_; }
+
+ private:
+  uint64_t* total_ns_;
+  uint64_t start_ns_;
+};
+
+// Logs where the time of a dump of pid went.
+void log_dump_timing(const char* what, pid_t pid, const dump_timing& timing, uint64_t total_ns);
+
+// Lists the threads of pid other than tid, in /proc/<pid>/task order.
+bool get_sibling_tids(pid_t pid, pid_t tid, std::vector<pid_t>* tids);
+
+// The number of threads to dump sibling threads on, from the
+// debug.debuggerd.tracers property. Defaults to 1: one at a time, in order.
+size_t get_tracer_count();
+
+// Attaches to, dumps and detaches from one thread.
+typedef std::function<void(log_t* log, pid_t tid, bool* detach_failed,
+                           int* total_sleep_time_usec)> thread_dumper;
+
+// Calls dumper for each of tids, on up to max_tracers threads at once. Only
+// the thread that attached to a tid may trace it, so dumper must attach and
+// detach itself. With more than one tracer, each thread's output, its
+// logcat and activity manager lines included, is held back and written to
+// log in the order of tids once all are done.
+void dump_threads(log_t* log, const std::vector<pid_t>& tids, size_t max_tracers,
+                  bool* detach_failed, int* total_sleep_time_usec, const thread_dumper& dumper);
+
 #endif // _DEBUGGERD_UTILITY_H
@@ -29,8 +29,11 @@
 #include <sys/mman.h>
 #endif
 
+#include <atomic>
 #include <deque>
+#include <memory>
 #include <string>
+#include <vector>
 
 struct backtrace_map_t {
   uintptr_t start = 0;
@@ -90,13 +93,47 @@ public:
     }
   }
 
+  // Function names already looked up for pcs in map, so that frames seen
+  // again skip libunwind. Forgotten whenever the maps are rebuilt.
+  bool GetCachedFunctionName(const backtrace_map_t& map, uintptr_t pc, std::string* name,
+                             uintptr_t* offset);
+  void CacheFunctionName(const backtrace_map_t& map, uintptr_t pc, const std::string& name,
+                         uintptr_t offset);
+
+  // If set, function names are first looked up in a sorted table of the
+  // symbols in the .symtab and .dynsym of each mapped file, read once per
+  // file and process, and only then through libunwind.
+  void SetUseElfSymbols(bool use_elf_symbols) { use_elf_symbols_ = use_elf_symbols; }
+  bool UseElfSymbols() const { return use_elf_symbols_; }
+
 protected:
   BacktraceMap(pid_t pid);
 
   virtual bool ParseLine(const char* line, backtrace_map_t* map);
 
+  // Sorts maps_ and indexes it for FillIn(). Must be called after any
+  // change to maps_, before the map is used again.
+  void BuildIndex();
+
   std::deque<backtrace_map_t> maps_;
   pid_t pid_;
+
+private:
+  bool FindIndex(uintptr_t addr, size_t* index);
+
+  // The start of each map in maps_, to binary search without touching
+  // the maps themselves.
+  std::vector<uintptr_t> starts_;
+  // Set if maps overlap, which only vmmap output does. FillIn() then
+  // scans the maps in order, as the first match wins.
+  bool overlapping_ = false;
+  // Consecutive lookups tend to hit the same map.
+  std::atomic<size_t> last_hit_{0};
+
+  // The function names cache, kept out of this header.
+  struct FunctionNameCache;
+  std::unique_ptr<FunctionNameCache> function_names_;
+  bool use_elf_symbols_ = false;
 };
 
 #endif // _BACKTRACE_BACKTRACE_MAP_H
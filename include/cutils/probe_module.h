@@ -72,6 +72,34 @@ extern int insmod_by_dep(
         int strip,
         const char * base);
 
+/* insmod_batch_by_dep() - load a set of kernel modules with their dependency
+ * Dependency chains of all targets are merged so that a module shared by
+ * several targets is loaded only once, and modules whose dependencies are
+ * all in kernel are loaded in parallel by up to max_threads threads.
+ *
+ * module_names: Array of target module names, see insmod_by_dep().
+ *
+ * count      : Number of entries in module_names.
+ *
+ * dep_name, strip, base : Same as insmod_by_dep().
+ *
+ * max_threads: Maximum number of modules loaded at the same time, the
+ *              calling thread included. 1 or less loads them one by one.
+ *
+ * return     : number of targets which could not be loaded, either
+ *              themselves or because one of their dependencies failed.
+ *
+ * Note:
+ * No module parameters can be passed, use insmod_by_dep() for that.
+ */
+extern int insmod_batch_by_dep(
+        const char * const *module_names,
+        int count,
+        const char *dep_name,
+        int strip,
+        const char *base,
+        int max_threads);
+
 /* rmmod_by_dep() - remove a module (target) from kernel with its dependency
  * The module's dependency must be described in the provided dependency file.
  * This function will try to remove other modules in the dependency chain too
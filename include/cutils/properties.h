@@ -109,6 +109,26 @@ int property_set(const char *key, const char *value);
     
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);    
 
+/* property_batch_open: opens a session with init to set many properties
+** over a single connection, with one permission lookup for the session
+** rather than one per property. Returns NULL if out of memory. When init
+** does not support sessions, property_batch_set() quietly falls back to
+** property_set().
+*/
+struct property_batch;
+struct property_batch *property_batch_open(void);
+
+/* property_batch_set: sets count properties, keys[i] to values[i]. If
+** results is not NULL, results[i] receives 0 or a negative errno for each
+** property; a NULL key or value gets -EINVAL. Returns 0 if all were set,
+** < 0 otherwise.
+*/
+int property_batch_set(struct property_batch *batch, const char * const *keys,
+        const char * const *values, int count, int *results);
+
+/* property_batch_close: closes the session and frees batch. */
+void property_batch_close(struct property_batch *batch);
+
 #if defined(__BIONIC_FORTIFY)
 
 extern int __property_get_real(const char *, char *, const char *)
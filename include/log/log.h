@@ -631,6 +631,19 @@ int __android_log_buf_print(int bufID, int prio, const char *tag, const char *fm
 #endif
     ;
 
+/*
+ * Opt-in asynchronous logging for the process. Records are queued with
+ * their timestamp and tid, and a background thread sends them to logd in
+ * batches. Fatal messages, and records that find the queue full, are still
+ * written directly. Returns 0, or a negative errno.
+ */
+int __android_log_set_async(int enable);
+/*
+ * Send any queued records now. Done on assert, fatal messages and exit,
+ * call it before any other abort() or _exit().
+ */
+void __android_log_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -168,6 +168,16 @@ struct logger_list *android_logger_list_alloc_time(int mode,
                                                    log_time start,
                                                    pid_t pid);
 void android_logger_list_free(struct logger_list *logger_list);
+/*
+ * Optional, before the first read. Have logd drop entries the caller would
+ * filter out anyway. filter is a space separated set of fields:
+ *   tags=<tag>:<pri>[,...] pids=<pid>[,...] uids=<uid>[,...] match=<text>
+ * with logcat filterspec semantics for tags, and %XX escapes in match.
+ * Returns -ENOTSUP if not supported, caller must then filter everything.
+ */
+#define LOGGER_FILTER_MAX 768
+int android_logger_list_set_filter(struct logger_list *logger_list,
+                                   const char *filter);
 /* In the purest sense, the following two are orthogonal interfaces */
 int android_logger_list_read(struct logger_list *logger_list,
                              struct log_msg *log_msg);
@@ -153,6 +153,40 @@ int android_log_printLogLine(
     const AndroidLogEntry *entry);
 
 
+/**
+ * Reusable output buffer for formatting many entries before a write
+ *
+ * Lines are formatted in place and written out with one writev() per
+ * flush. Assumes single threaded execution.
+ */
+typedef struct AndroidLogBuffer_t AndroidLogBuffer;
+
+AndroidLogBuffer *android_log_buffer_new(size_t size);
+
+/* Discards anything not yet flushed */
+void android_log_buffer_free(AndroidLogBuffer *p_buffer);
+
+/**
+ * Formats entry into p_buffer, flushing to fd first if it is full
+ *
+ * Returns count bytes queued, -1 on error. Does not apply the filter.
+ */
+int android_log_bufferLogLine(
+    AndroidLogFormat *p_format,
+    AndroidLogBuffer *p_buffer,
+    int fd,
+    const AndroidLogEntry *entry);
+
+/* Queues a copy of raw text behind the formatted lines */
+int android_log_buffer_append(
+    AndroidLogBuffer *p_buffer,
+    int fd,
+    const char *buf,
+    size_t len);
+
+/* Returns count bytes written, -1 on error */
+ssize_t android_log_buffer_flush(AndroidLogBuffer *p_buffer, int fd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ANDROID_PROPERTY_BATCH_H
+#define _ANDROID_PROPERTY_BATCH_H
+
+/*
+ * Batched property set protocol spoken on the property_service socket.
+ *
+ * A client opens a session by sending a legacy prop_msg whose cmd is
+ * PROP_MSG_BATCH | <version> and whose name and value are ignored. init
+ * answers with the uint32_t version it accepted, then keeps the connection
+ * open; an init without batch support closes it instead, and the client
+ * falls back to one property_set() per property.
+ *
+ * Each batch is a prop_batch_header followed by count prop_batch_item
+ * records (1 <= count <= PROP_BATCH_MAX). init answers with count int32_t
+ * results, 0 or a negative errno, once every item has been applied.
+ * Credentials and security context are those of the session's opener.
+ */
+
+#include <stdint.h>
+#include <sys/system_properties.h>
+
+#define PROP_MSG_BATCH          0x50420000
+#define PROP_MSG_BATCH_MASK     0xffff0000
+#define PROP_BATCH_VERSION      1
+#define PROP_BATCH_MAX          64
+
+struct prop_batch_header {
+    uint32_t count;
+};
+
+struct prop_batch_item {
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+};
+
+#endif /* _ANDROID_PROPERTY_BATCH_H */
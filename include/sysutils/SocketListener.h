@@ -31,12 +31,37 @@ class SocketListener {
     pthread_t               mThread;
     bool                    mUseCmdNum;
 
+    /* epoll mode, see useEpoll() */
+    bool                    mUseEpoll;
+    int                     mEpollFd;
+    /* clients released since the listener last waited, their events may be stale */
+    SocketClientCollection  *mReleased;
+
+    /* worker pool, see useEpoll() */
+    int                     mWorkerCount;
+    pthread_t               *mWorkers;
+    SocketClientCollection  *mWorkQueue;
+    pthread_mutex_t         mWorkLock;
+    pthread_cond_t          mWorkCond;
+    bool                    mWorkShutdown;
+
 public:
     SocketListener(const char *socketName, bool listen);
     SocketListener(const char *socketName, bool listen, bool useCmdNum);
     SocketListener(int socketFd, bool listen);
 
     virtual ~SocketListener();
+    /*
+     * Call before startListener() to wait for clients with epoll rather than
+     * select(). Clients are then registered once rather than on every wakeup,
+     * and are not limited to FD_SETSIZE. If workers is non-zero,
+     * onDataAvailable() runs on that many threads instead of the listener
+     * thread, and must be safe to call for different clients at once. A
+     * client is only ever handled by one thread at a time, so its requests
+     * are still handled in order.
+     */
+    int useEpoll(int workers);
+
     int startListener();
     int startListener(int backlog);
     int stopListener();
@@ -54,6 +79,12 @@ private:
     bool release(SocketClient *c, bool wakeup);
     static void *threadStart(void *obj);
     void runListener();
+    void runEpollListener();
+    bool watchClient(SocketClient *c, int op);
+    void dispatchClient(SocketClient *c);
+    static void *workerStart(void *obj);
+    void runWorker();
+    void stopWorkers();
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
 };
 #endif
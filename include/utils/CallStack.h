@@ -25,6 +25,8 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+class BacktraceMap;
+
 namespace android {
 
 class Printer;
@@ -44,7 +46,10 @@ public:
 
     // Immediately collect the stack traces for the specified thread.
     // The default is to dump the stack of the current call.
-    void update(int32_t ignoreDepth=1, pid_t tid=BACKTRACE_CURRENT_THREAD);
+    // Passing the same map to several updates shares its parsed maps and
+    // the function names already looked up; it is still owned by the caller.
+    void update(int32_t ignoreDepth=1, pid_t tid=BACKTRACE_CURRENT_THREAD,
+                BacktraceMap* map=NULL);
 
     // Dump a stack trace to the log using the supplied logtag.
     void log(const char* logtag,
@@ -29,8 +29,11 @@ LOCAL_SRC_FILES:= \
     init_parser.cpp \
     log.cpp \
     parser.cpp \
+    pattern_matcher.cpp \
+    property_journal.cpp \
     util.cpp \
 
+LOCAL_C_INCLUDES += external/zlib
 LOCAL_STATIC_LIBRARIES := libbase
 LOCAL_MODULE := libinit
 LOCAL_CLANG := $(init_clang)
@@ -121,11 +124,14 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := init_tests
 LOCAL_SRC_FILES := \
     init_parser_test.cpp \
+    pattern_matcher_test.cpp \
+    property_journal_test.cpp \
     util_test.cpp \
 
 LOCAL_SHARED_LIBRARIES += \
     libcutils \
     libbase \
+    libz \
 
 LOCAL_STATIC_LIBRARIES := libinit
 LOCAL_CLANG := $(init_clang)
@@ -27,6 +27,8 @@
 #include <unistd.h>
 #include <string.h>
 
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <linux/netlink.h>
@@ -52,6 +54,13 @@
 #include "property_service.h"
 #include <zlib.h>
 #include "parser.h"
+#include "pattern_matcher.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #define SYSFS_PREFIX    "/sys"
 #if defined(__i386__) || defined(__x86_64__)
@@ -72,6 +81,9 @@ extern char boot_device[PROP_VALUE_MAX];
 
 static int device_fd = -1;
 
+/* In a parallel coldboot worker, the pipe back to the parent */
+static int coldboot_worker_fd = -1;
+
 struct uevent {
     const char *action;
     const char *path;
@@ -126,6 +138,15 @@ static list_declare(modules_aliases_map);
 static list_declare(modules_blacklist);
 static list_declare(deferred_module_loading_list);
 
+/* Indexed views of the lists above, rule numbers follow list order */
+static PatternMatcher sys_perms_matcher(FNM_PATHNAME);
+static std::vector<struct perms_ *> sys_perms_rules;
+static PatternMatcher dev_perms_matcher(FNM_PATHNAME);
+static std::vector<struct perms_ *> dev_perms_rules;
+static PatternMatcher modules_aliases_matcher(0);
+static std::vector<struct module_alias_node *> modules_aliases_rules;
+static std::unordered_map<std::string, struct module_blacklist_node *> modules_blacklist_index;
+
 static int read_modules_aliases();
 static int read_modules_blacklist();
 
@@ -153,10 +174,19 @@ int add_dev_perms(const char *name, const char *attr,
     node->dp.prefix = prefix;
     node->dp.wildcard = wildcard;
 
-    if (attr)
+    PatternMatcher::Kind kind = prefix ? PatternMatcher::PREFIX :
+            wildcard ? PatternMatcher::GLOB : PatternMatcher::EXACT;
+
+    if (attr) {
         list_add_tail(&sys_perms, &node->plist);
-    else
+        /* upaths omit the "/sys" that paths in this list contain */
+        sys_perms_matcher.Add(node->dp.name + 4, kind);
+        sys_perms_rules.push_back(&node->dp);
+    } else {
         list_add_tail(&dev_perms, &node->plist);
+        dev_perms_matcher.Add(node->dp.name, kind);
+        dev_perms_rules.push_back(&node->dp);
+    }
 
     return 0;
 }
@@ -164,24 +194,12 @@ int add_dev_perms(const char *name, const char *attr,
 void fixup_sys_perms(const char *upath)
 {
     char buf[512];
-    struct listnode *node;
+    std::vector<size_t> rules;
     struct perms_ *dp;
 
-    /* upaths omit the "/sys" that paths in this list
-     * contain, so we add 4 when comparing...
-     */
-    list_for_each(node, &sys_perms) {
-        dp = &(node_to_item(node, struct perm_node, plist))->dp;
-        if (dp->prefix) {
-            if (strncmp(upath, dp->name + 4, strlen(dp->name + 4)))
-                continue;
-        } else if (dp->wildcard) {
-            if (fnmatch(dp->name + 4, upath, FNM_PATHNAME) != 0)
-                continue;
-        } else {
-            if (strcmp(upath, dp->name + 4))
-                continue;
-        }
+    sys_perms_matcher.Match(upath, &rules);
+    for (size_t rule : rules) {
+        dp = sys_perms_rules[rule];
 
         if ((strlen(upath) + strlen(dp->attr) + 6) > sizeof(buf))
             break;
@@ -204,57 +222,27 @@ void fixup_sys_perms(const char *upath)
     }
 }
 
-static bool perm_path_matches(const char *path, struct perms_ *dp)
-{
-    if (dp->prefix) {
-        if (strncmp(path, dp->name, strlen(dp->name)) == 0)
-            return true;
-    } else if (dp->wildcard) {
-        if (fnmatch(dp->name, path, FNM_PATHNAME) == 0)
-            return true;
-    } else {
-        if (strcmp(path, dp->name) == 0)
-            return true;
-    }
-
-    return false;
-}
-
 static mode_t get_device_perm(const char *path, const char **links,
                 unsigned *uid, unsigned *gid)
 {
-    struct listnode *node;
-    struct perm_node *perm_node;
     struct perms_ *dp;
+    ssize_t rule;
 
-    /* search the perms list in reverse so that ueventd.$hardware can
+    /* the last matching rule wins so that ueventd.$hardware can
      * override ueventd.rc
      */
-    list_for_each_reverse(node, &dev_perms) {
-        bool match = false;
-
-        perm_node = node_to_item(node, struct perm_node, plist);
-        dp = &perm_node->dp;
-
-        if (perm_path_matches(path, dp)) {
-            match = true;
-        } else {
-            if (links) {
-                int i;
-                for (i = 0; links[i]; i++) {
-                    if (perm_path_matches(links[i], dp)) {
-                        match = true;
-                        break;
-                    }
-                }
-            }
-        }
+    rule = dev_perms_matcher.Last(path);
+    if (links) {
+        int i;
+        for (i = 0; links[i]; i++)
+            rule = std::max(rule, dev_perms_matcher.Last(links[i]));
+    }
 
-        if (match) {
-            *uid = dp->uid;
-            *gid = dp->gid;
-            return dp->perm;
-        }
+    if (rule >= 0) {
+        dp = dev_perms_rules[rule];
+        *uid = dp->uid;
+        *gid = dp->gid;
+        return dp->perm;
     }
     /* Default if nothing found. */
     *uid = 0;
@@ -855,21 +843,18 @@ static void handle_generic_device_event(struct uevent *uevent)
 
 static int is_module_blacklisted_or_deferred(const char *name, bool need_deferred)
 {
-    struct listnode *blklst_node;
     struct module_blacklist_node *blacklist;
     int ret = 0;
 
     if (!name) goto out;
 
     /* See if module is blacklisted, skip if it is */
-    list_for_each(blklst_node, &modules_blacklist) {
-        blacklist = node_to_item(blklst_node,
-                                 struct module_blacklist_node,
-                                 list);
-        if (!strcmp(name, blacklist->name)) {
+    {
+        auto it = modules_blacklist_index.find(name);
+        if (it != modules_blacklist_index.end()) {
+            blacklist = it->second;
             INFO("modules %s is blacklisted\n", name);
             ret = blacklist->deferred ? (need_deferred ? 2 : 0) : 1;
-            goto out;
         }
     }
 
@@ -879,33 +864,30 @@ out:
 
 static int load_module_by_device_modalias(const char *id, bool need_deferred)
 {
-    struct listnode *alias_node;
+    std::vector<size_t> rules;
     struct module_alias_node *alias;
     int ret = -1;
 
-    list_for_each(alias_node, &modules_aliases_map) {
-        alias = node_to_item(alias_node, struct module_alias_node, list);
-
-        if (alias && alias->name && alias->pattern) {
-            if (fnmatch(alias->pattern, id, 0) == 0) {
-                INFO("trying to load module %s due to uevents\n", alias->name);
-
-                ret = is_module_blacklisted_or_deferred(alias->name, need_deferred);
-                if (ret == 0) {
-                    if ((ret = insmod_by_dep(alias->name, "", NULL, 0, NULL))) {
-                        /* cannot load module. try another one since
-                         * there may be another match.
-                         */
-                        NOTICE("failed to load %s for modalias %s\n",
-                             alias->name, id);
-                    } else {
-                        /* loading was successful */
-                        INFO("loaded module %s due to uevents\n", alias->name);
-                    }
-                } else {
-                    NOTICE("blacklisted module %s: %d\n", alias->name, ret);
-                }
+    modules_aliases_matcher.Match(id, &rules);
+    for (size_t rule : rules) {
+        alias = modules_aliases_rules[rule];
+
+        INFO("trying to load module %s due to uevents\n", alias->name);
+
+        ret = is_module_blacklisted_or_deferred(alias->name, need_deferred);
+        if (ret == 0) {
+            if ((ret = insmod_by_dep(alias->name, "", NULL, 0, NULL))) {
+                /* cannot load module. try another one since
+                 * there may be another match.
+                 */
+                NOTICE("failed to load %s for modalias %s\n",
+                     alias->name, id);
+            } else {
+                /* loading was successful */
+                INFO("loaded module %s due to uevents\n", alias->name);
             }
+        } else {
+            NOTICE("blacklisted module %s: %d\n", alias->name, ret);
         }
     }
 
@@ -922,17 +904,47 @@ static void handle_deferred_module_loading()
         struct listnode *next = NULL;
         struct module_alias_node *alias = NULL;
 
+        std::vector<size_t> rules;
+        std::vector<const char*> names;
+        std::unordered_set<std::string> seen;
+
+        /* gather the modules of every queued modalias so that shared
+         * dependencies are loaded once and independent ones in parallel
+         */
         list_for_each_safe(node, next, &deferred_module_loading_list) {
             alias = node_to_item(node, struct module_alias_node, list);
 
             if (alias && alias->pattern) {
                 INFO("deferred loading of module for %s\n", alias->pattern);
-                load_module_by_device_modalias(alias->pattern, false);
+                rules.clear();
+                modules_aliases_matcher.Match(alias->pattern, &rules);
+                for (size_t rule : rules) {
+                    const char* name = modules_aliases_rules[rule]->name;
+                    if (!seen.insert(name).second) {
+                        continue;
+                    }
+                    int ret = is_module_blacklisted_or_deferred(name, false);
+                    if (ret == 0) {
+                        names.push_back(name);
+                    } else {
+                        NOTICE("blacklisted module %s: %d\n", name, ret);
+                    }
+                }
                 free(alias->pattern);
                 list_remove(node);
                 free(alias);
             }
         }
+
+        if (!names.empty()) {
+            int threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+            int failed = insmod_batch_by_dep(names.data(), names.size(),
+                                             NULL, 0, NULL, threads);
+            if (failed) {
+                NOTICE("failed to load %d of %zu deferred modules\n",
+                       failed, names.size());
+            }
+        }
     }
 }
 
@@ -953,10 +965,27 @@ static int is_booting(void)
     return access("/dev/.booting", F_OK) == 0;
 }
 
-static void handle_module_loading(const char *modalias)
+static void queue_deferred_module_loading(const char *modalias)
 {
     struct module_alias_node *node;
 
+    node = (module_alias_node *) calloc(1, sizeof(*node));
+    if (node) {
+        node->pattern = strdup(modalias);
+        if (!node->pattern) {
+            free(node);
+        } else {
+            list_add_tail(&deferred_module_loading_list, &node->list);
+            INFO("add to queue for deferred module loading: %s",
+                    node->pattern);
+        }
+    } else {
+        ERROR("failed to allocate memory to store device id for deferred module loading.\n");
+    }
+}
+
+static void handle_module_loading(const char *modalias)
+{
     /* once modules.alias can be read,
      * we load all the deferred ones
      */
@@ -973,18 +1002,13 @@ static void handle_module_loading(const char *modalias)
         /* if module alias mapping is empty,
          * queue it for loading later
          */
-        node = (module_alias_node *) calloc(1, sizeof(*node));
-        if (node) {
-            node->pattern = strdup(modalias);
-            if (!node->pattern) {
-                free(node);
-            } else {
-                list_add_tail(&deferred_module_loading_list, &node->list);
-                INFO("add to queue for deferred module loading: %s",
-                        node->pattern);
-            }
+        if (coldboot_worker_fd >= 0) {
+            /* the queue lives in the parent, not in this worker */
+            std::string line(modalias);
+            line += '\n';
+            write(coldboot_worker_fd, line.c_str(), line.size());
         } else {
-            ERROR("failed to allocate memory to store device id for deferred module loading.\n");
+            queue_deferred_module_loading(modalias);
         }
     }
 
@@ -1186,6 +1210,9 @@ static void parse_line_module_alias(struct parse_state *state, int nargs, char *
     }
 
     list_add_tail(&modules_aliases_map, &node->list);
+    modules_aliases_matcher.Add(node->pattern,
+                                PatternMatcher::Classify(node->pattern));
+    modules_aliases_rules.push_back(node);
 }
 
 static void parse_line_module_blacklist(struct parse_state *state, int nargs, char **args)
@@ -1219,6 +1246,8 @@ static void parse_line_module_blacklist(struct parse_state *state, int nargs, ch
     node->deferred = deferred;
 
     list_add_tail(&modules_blacklist, &node->list);
+    /* the first entry for a module wins */
+    modules_blacklist_index.insert(std::make_pair(node->name, node));
 }
 
 static int __read_modules_desc_file(int mode)
@@ -1344,7 +1373,7 @@ void handle_device_fd(bool child)
 ** socket's buffer.
 */
 
-static void do_coldboot(DIR *d)
+static void do_coldboot(DIR *d, bool handle = true)
 {
     struct dirent *de;
     int dfd, fd;
@@ -1355,7 +1384,8 @@ static void do_coldboot(DIR *d)
     if(fd >= 0) {
         write(fd, "add\n", 4);
         close(fd);
-        handle_device_fd();
+        if (handle)
+            handle_device_fd();
     }
 
     while((de = readdir(d))) {
@@ -1372,7 +1402,7 @@ static void do_coldboot(DIR *d)
         if(d2 == 0)
             close(fd);
         else {
-            do_coldboot(d2);
+            do_coldboot(d2, handle);
             closedir(d2);
         }
     }
@@ -1387,6 +1417,291 @@ void coldboot(const char *path)
     }
 }
 
+/* Parallel coldboot, enabled with androidboot.coldboot_workers=<n>
+**
+** The same walk split in two phases that each fan out to <n> forked
+** workers. They are processes rather than threads since make_device()
+** switches the egid and the SELinux fscreate context around mknod().
+**
+** Trigger: we poke the uevent files of the top COLDBOOT_SPLIT_DEPTH
+** levels ourselves, the workers take the subtrees below those off a
+** shared counter. Meanwhile we drain the regenerated events from the
+** netlink socket without handling them.
+**
+** Handle: we register every platform device first, as the symlinks of
+** the other events are looked up against them, then the workers take
+** the events off a shared counter to create nodes and load modules.
+** mkdir_recursive() tolerates a racing worker, insmod_by_dep() loads
+** dependencies first and treats EEXIST as success. Modaliases deferred
+** by the blacklist come back to us over a pipe.
+*/
+
+#define COLDBOOT_MAX_WORKERS 16
+#define COLDBOOT_SPLIT_DEPTH 2
+
+static int coldboot_workers;
+
+struct coldboot_work {
+    size_t *next; /* shared with the workers */
+    const std::vector<std::string> *items;
+};
+
+static bool coldboot_claim(struct coldboot_work *work, size_t *i)
+{
+    *i = __atomic_fetch_add(work->next, 1, __ATOMIC_RELAXED);
+    return *i < work->items->size();
+}
+
+static void coldboot_split(const std::string &path, int depth,
+                           std::vector<std::string> *subtrees)
+{
+    struct dirent *de;
+    DIR *d;
+    int fd;
+
+    if (depth == COLDBOOT_SPLIT_DEPTH) {
+        subtrees->push_back(path);
+        return;
+    }
+
+    d = opendir(path.c_str());
+    if (!d)
+        return;
+
+    fd = openat(dirfd(d), "uevent", O_WRONLY);
+    if (fd >= 0) {
+        write(fd, "add\n", 4);
+        close(fd);
+    }
+
+    while ((de = readdir(d))) {
+        if (de->d_type != DT_DIR || de->d_name[0] == '.')
+            continue;
+        coldboot_split(path + "/" + de->d_name, depth + 1, subtrees);
+    }
+    closedir(d);
+}
+
+static void coldboot_trigger_worker(struct coldboot_work *work)
+{
+    size_t i;
+
+    while (coldboot_claim(work, &i)) {
+        DIR *d = opendir((*work->items)[i].c_str());
+        if (d) {
+            do_coldboot(d, false);
+            closedir(d);
+        }
+    }
+}
+
+static void coldboot_handle_worker(struct coldboot_work *work)
+{
+    size_t i;
+
+    while (coldboot_claim(work, &i)) {
+        struct uevent uevent;
+        parse_event((*work->items)[i].c_str(), &uevent);
+
+        if (strncmp(uevent.subsystem, "platform", 8)) {
+            handle_device_event(&uevent);
+            continue;
+        }
+        /* already registered by the parent */
+        if (!strcmp(uevent.action, "add"))
+            handle_module_loading(uevent.modalias);
+        fixup_sys_perms(uevent.path);
+    }
+}
+
+/*
+ * Returns the read end of a pipe that reaches EOF once all the workers
+ * running fn have exited, or -1 if none could be started.
+ */
+static int coldboot_fork(void (*fn)(struct coldboot_work *),
+                         struct coldboot_work *work)
+{
+    int fds[2];
+    int started = 0;
+
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        ERROR("coldboot pipe failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (int i = 0; i < coldboot_workers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            coldboot_worker_fd = fds[1];
+            fn(work);
+            _exit(0);
+        }
+        if (pid < 0) {
+            ERROR("coldboot fork failed: %s\n", strerror(errno));
+            break;
+        }
+        started++;
+    }
+
+    close(fds[1]);
+    if (!started) {
+        close(fds[0]);
+        return -1;
+    }
+    return fds[0];
+}
+
+/*
+ * Drains the netlink socket into events. Returns false if it overflowed,
+ * in which case some of the events are gone and there is no telling which.
+ */
+static bool coldboot_collect(std::vector<std::string> *events)
+{
+    char msg[UEVENT_MSG_LEN+2];
+    bool complete = true;
+    int n;
+    while (true) {
+        n = uevent_kernel_multicast_recv(device_fd, msg, UEVENT_MSG_LEN);
+        if (n < 0 && errno == ENOBUFS) {
+            complete = false;
+            continue;
+        }
+        if (n <= 0)
+            break;
+        if(n >= UEVENT_MSG_LEN)   /* overflow -- discard */
+            continue;
+
+        /* keep the terminating nul, parse_event() stops on two in a row */
+        msg[n] = '\0';
+        events->push_back(std::string(msg, n + 1));
+    }
+    return complete;
+}
+
+/*
+ * Waits for the workers behind rfd to exit, queueing the modaliases they
+ * deferred. With events set also drains the netlink socket into it, and
+ * returns false if any were lost.
+ */
+static bool coldboot_wait(int rfd, std::vector<std::string> *events)
+{
+    bool complete = true;
+    std::string deferred;
+    pollfd ufds[2];
+    nfds_t nfds = events ? 2 : 1;
+
+    ufds[0].fd = rfd;
+    ufds[0].events = POLLIN;
+    ufds[1].fd = device_fd;
+    ufds[1].events = POLLIN;
+
+    while (true) {
+        ufds[0].revents = ufds[1].revents = 0;
+        if (poll(ufds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (events && (ufds[1].revents & POLLIN))
+            complete &= coldboot_collect(events);
+        if (!ufds[0].revents)
+            continue;
+
+        char buf[512];
+        ssize_t n = TEMP_FAILURE_RETRY(read(rfd, buf, sizeof(buf)));
+        if (n <= 0)
+            break;
+        deferred.append(buf, n);
+
+        size_t nl;
+        while ((nl = deferred.find('\n')) != std::string::npos) {
+            deferred[nl] = '\0';
+            queue_deferred_module_loading(deferred.c_str());
+            deferred.erase(0, nl + 1);
+        }
+    }
+    close(rfd);
+
+    if (events)
+        complete &= coldboot_collect(events);
+    return complete;
+}
+
+static void coldboot_parallel()
+{
+    static const char *roots[] = { "/sys/class", "/sys/block", "/sys/devices" };
+    std::vector<std::string> subtrees;
+    std::vector<std::string> events;
+    struct coldboot_work work;
+    bool complete;
+    int rfd;
+
+    work.next = (size_t *) mmap(NULL, sizeof(*work.next), PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (work.next == MAP_FAILED) {
+        ERROR("coldboot mmap failed: %s\n", strerror(errno));
+        for (size_t i = 0; i < ARRAY_SIZE(roots); i++)
+            coldboot(roots[i]);
+        return;
+    }
+
+    /* read modules.alias once here rather than in every worker */
+    handle_module_loading(NULL);
+
+    Timer trigger;
+    for (size_t i = 0; i < ARRAY_SIZE(roots); i++)
+        coldboot_split(roots[i], 0, &subtrees);
+    *work.next = 0;
+    work.items = &subtrees;
+    rfd = coldboot_fork(coldboot_trigger_worker, &work);
+    if (rfd < 0) {
+        coldboot_trigger_worker(&work);
+        complete = coldboot_collect(&events);
+    } else {
+        complete = coldboot_wait(rfd, &events);
+    }
+    NOTICE("Coldboot triggered %zu events in %zu subtrees in %.2fs.\n",
+           events.size(), subtrees.size(), trigger.duration());
+
+    /* The serial walk drains the socket after every uevent file it pokes */
+    if (!complete) {
+        ERROR("Coldboot uevents overflowed the netlink socket, walking /sys again serially\n");
+        munmap(work.next, sizeof(*work.next));
+        for (size_t i = 0; i < ARRAY_SIZE(roots); i++)
+            coldboot(roots[i]);
+        return;
+    }
+
+    Timer handle;
+    if (sehandle && selinux_status_updated() > 0) {
+        struct selabel_handle *sehandle2;
+        sehandle2 = selinux_android_file_context_handle();
+        if (sehandle2) {
+            selabel_close(sehandle);
+            sehandle = sehandle2;
+        }
+    }
+    for (size_t i = 0; i < events.size(); i++) {
+        struct uevent uevent;
+        parse_event(events[i].c_str(), &uevent);
+        if (!strncmp(uevent.subsystem, "platform", 8))
+            handle_platform_device_event(&uevent);
+    }
+    *work.next = 0;
+    work.items = &events;
+    rfd = coldboot_fork(coldboot_handle_worker, &work);
+    if (rfd < 0) {
+        coldboot_handle_worker(&work);
+    } else {
+        coldboot_wait(rfd, NULL);
+    }
+    NOTICE("Coldboot handled %zu events with %d workers in %.2fs.\n",
+           events.size(), coldboot_workers, handle.duration());
+
+    munmap(work.next, sizeof(*work.next));
+}
+
 void device_init(bool child)
 {
     sehandle = NULL;
@@ -1410,11 +1725,21 @@ void device_init(bool child)
         return;
     }
 
+    char workers[PROP_VALUE_MAX];
+    property_get("ro.boot.coldboot_workers", workers);
+    coldboot_workers = std::min(atoi(workers), COLDBOOT_MAX_WORKERS);
+
     Timer t;
-    coldboot("/sys/class");
-    coldboot("/sys/block");
-    coldboot("/sys/devices");
+    if (coldboot_workers > 0) {
+        coldboot_parallel();
+    } else {
+        coldboot("/sys/class");
+        coldboot("/sys/block");
+        coldboot("/sys/devices");
+    }
+    Timer deferred;
     handle_deferred_module_loading();
+    NOTICE("Deferred module loading took %.2fs.\n", deferred.duration());
     close(open(COLDBOOT_DONE, O_WRONLY|O_CREAT|O_CLOEXEC, 0000));
     NOTICE("Coldboot took %.2fs.\n", t.duration());
 }
@@ -101,6 +101,12 @@ void register_epoll_handler(int fd, void (*fn)()) {
     }
 }
 
+void unregister_epoll_handler(int fd) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        ERROR("epoll_ctl failed: %s\n", strerror(errno));
+    }
+}
+
 void service::NotifyStateChange(const char* new_state) {
     if (!properties_initialized()) {
         // If properties aren't available yet, we can't set them.
@@ -1202,6 +1208,11 @@ int main(int argc, char** argv) {
             timeout = 0;
         }
 
+        int sync_timeout = sync_persistent_properties();
+        if (sync_timeout >= 0 && (timeout < 0 || sync_timeout < timeout)) {
+            timeout = sync_timeout;
+        }
+
         bootchart_sample(&timeout);
 
         epoll_event ev;
@@ -42,6 +42,10 @@ struct command
 struct trigger {
     struct listnode nlist;
     const char *name;
+    /* "property:<prop_name>=<prop_value>" split at parse time,
+     * prop_name is NULL for any other trigger */
+    char *prop_name;
+    const char *prop_value;
 };
 
 struct action {
@@ -161,5 +165,6 @@ int selinux_reload_policy(void);
 void zap_stdio(void);
 
 void register_epoll_handler(int fd, void (*fn)());
+void unregister_epoll_handler(int fd);
 
 #endif	/* _INIT_INIT_H */
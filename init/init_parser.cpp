@@ -35,10 +35,18 @@
 #include <cutils/iosched_policy.h>
 #include <cutils/list.h>
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 static list_declare(service_list);
 static list_declare(action_list);
 static list_declare(action_queue);
 
+/* Actions with a property trigger, indexed by the property name, in
+ * action_list order. */
+static std::unordered_map<std::string, std::vector<action*>> property_triggers;
+
 struct import {
     struct listnode list;
     const char *filename;
@@ -567,54 +575,64 @@ void action_for_each_trigger(const char *trigger,
 }
 
 
-void queue_property_triggers(const char *name, const char *value)
+static bool property_trigger_value_matches(const struct trigger *trigger,
+                                           const char *value)
 {
-    struct listnode *node, *node2;
-    struct action *act;
+    return !strcmp(trigger->prop_value, value) ||
+           !strcmp(trigger->prop_value, "*");
+}
+
+/* All triggers of act must be property triggers whose property currently
+ * matches. When name is set, one of them must also match name=value, the
+ * property being changed. */
+static bool property_triggers_match(struct action *act, const char *name,
+                                    const char *value)
+{
+    struct listnode *node;
     struct trigger *cur_trigger;
-    bool match;
-    int name_length;
+    bool match = !name;
 
-    list_for_each(node, &action_list) {
-        act = node_to_item(node, struct action, alist);
-        match = !name;
-        list_for_each(node2, &act->triggers) {
-            cur_trigger = node_to_item(node2, struct trigger, nlist);
-            if (!strncmp(cur_trigger->name, "property:", strlen("property:"))) {
-                const char *test = cur_trigger->name + strlen("property:");
-                if (!match) {
-                    name_length = strlen(name);
-                    if (!strncmp(name, test, name_length) &&
-                        test[name_length] == '=' &&
-                        (!strcmp(test + name_length + 1, value) ||
-                        !strcmp(test + name_length + 1, "*"))) {
-                        match = true;
-                        continue;
-                    }
-                }
-                const char* equals = strchr(test, '=');
-                if (equals) {
-                    char prop_name[PROP_NAME_MAX + 1];
-                    char value[PROP_VALUE_MAX];
-                    int length = equals - test;
-                    if (length <= PROP_NAME_MAX) {
-                        int ret;
-                        memcpy(prop_name, test, length);
-                        prop_name[length] = 0;
-
-                        /* does the property exist, and match the trigger value? */
-                        ret = property_get(prop_name, value);
-                        if (ret > 0 && (!strcmp(equals + 1, value) ||
-                                        !strcmp(equals + 1, "*"))) {
-                            continue;
-                        }
-                    }
-                }
+    list_for_each(node, &act->triggers) {
+        cur_trigger = node_to_item(node, struct trigger, nlist);
+        if (!cur_trigger->prop_name) {
+            return false;
+        }
+        if (!match && !strcmp(cur_trigger->prop_name, name) &&
+            property_trigger_value_matches(cur_trigger, value)) {
+            match = true;
+            continue;
+        }
+
+        /* does the property exist, and match the trigger value? */
+        char prop_value[PROP_VALUE_MAX];
+        if (strlen(cur_trigger->prop_name) > PROP_NAME_MAX ||
+            property_get(cur_trigger->prop_name, prop_value) <= 0 ||
+            !property_trigger_value_matches(cur_trigger, prop_value)) {
+            return false;
+        }
+    }
+    return match;
+}
+
+void queue_property_triggers(const char *name, const char *value)
+{
+    if (!name) {
+        struct listnode *node;
+        list_for_each(node, &action_list) {
+            struct action *act = node_to_item(node, struct action, alist);
+            if (property_triggers_match(act, NULL, NULL)) {
+                action_add_queue_tail(act);
             }
-            match = false;
-            break;
         }
-        if (match) {
+        return;
+    }
+
+    auto it = property_triggers.find(name);
+    if (it == property_triggers.end()) {
+        return;
+    }
+    for (struct action *act : it->second) {
+        if (property_triggers_match(act, name, value)) {
             action_add_queue_tail(act);
         }
     }
@@ -974,6 +992,7 @@ static void *parse_action(struct parse_state *state, int nargs, char **args)
                 parse_error(state, "& is the only symbol allowed to concatenate actions\n");
                 list_for_each_safe(node, node2, &act->triggers) {
                     struct trigger *trigger = node_to_item(node, struct trigger, nlist);
+                    free(trigger->prop_name);
                     free(trigger);
                 }
                 free(act);
@@ -983,13 +1002,34 @@ static void *parse_action(struct parse_state *state, int nargs, char **args)
         }
         cur_trigger = (trigger*) calloc(1, sizeof(*cur_trigger));
         cur_trigger->name = args[i];
+        if (!strncmp(args[i], "property:", strlen("property:"))) {
+            const char *test = args[i] + strlen("property:");
+            const char *equals = strchr(test, '=');
+            if (equals) {
+                cur_trigger->prop_name = strndup(test, equals - test);
+                cur_trigger->prop_value = equals + 1;
+            } else {
+                /* never matches, like any other non-property trigger */
+                parse_error(state, "property trigger '%s' has no value\n", args[i]);
+            }
+        }
         list_add_tail(&act->triggers, &cur_trigger->nlist);
     }
 
     list_init(&act->commands);
     list_init(&act->qlist);
     list_add_tail(&action_list, &act->alist);
-        /* XXX add to hash */
+
+    struct listnode *node;
+    list_for_each(node, &act->triggers) {
+        cur_trigger = node_to_item(node, struct trigger, nlist);
+        if (cur_trigger->prop_name) {
+            std::vector<action*>& actions = property_triggers[cur_trigger->prop_name];
+            if (actions.empty() || actions.back() != act) {
+                actions.push_back(act);
+            }
+        }
+    }
     return act;
 }
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pattern_matcher.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const char kGlobSpecials[] = "*?[\\";
+
+PatternMatcher::Kind PatternMatcher::Classify(const char* pattern) {
+    return strpbrk(pattern, kGlobSpecials) ? GLOB : EXACT;
+}
+
+void PatternMatcher::Insert(Index* index, std::vector<size_t>* lengths,
+                            const std::string& key, size_t rule) {
+    (*index)[key].push_back(rule);
+    auto it = std::lower_bound(lengths->begin(), lengths->end(), key.size());
+    if (it == lengths->end() || *it != key.size()) {
+        lengths->insert(it, key.size());
+    }
+}
+
+size_t PatternMatcher::Add(const char* pattern, Kind kind) {
+    size_t rule = patterns_.size();
+    patterns_.push_back(pattern);
+
+    switch (kind) {
+    case EXACT:
+        exact_[pattern].push_back(rule);
+        break;
+    case PREFIX:
+        Insert(&prefixes_, &prefix_lengths_, pattern, rule);
+        break;
+    case GLOB:
+        Insert(&globs_, &glob_lengths_,
+               std::string(pattern, strcspn(pattern, kGlobSpecials)), rule);
+        break;
+    }
+    return rule;
+}
+
+void PatternMatcher::Match(const char* s, std::vector<size_t>* rules) const {
+    size_t first = rules->size();
+    size_t len = strlen(s);
+    std::string key(s, len);
+
+    auto exact = exact_.find(key);
+    if (exact != exact_.end()) {
+        rules->insert(rules->end(), exact->second.begin(), exact->second.end());
+    }
+
+    for (size_t length : prefix_lengths_) {
+        if (length > len) {
+            break;
+        }
+        key.assign(s, length);
+        auto it = prefixes_.find(key);
+        if (it != prefixes_.end()) {
+            rules->insert(rules->end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    for (size_t length : glob_lengths_) {
+        if (length > len) {
+            break;
+        }
+        key.assign(s, length);
+        auto it = globs_.find(key);
+        if (it == globs_.end()) {
+            continue;
+        }
+        for (size_t rule : it->second) {
+            if (fnmatch(patterns_[rule].c_str(), s, fnmatch_flags_) == 0) {
+                rules->push_back(rule);
+            }
+        }
+    }
+
+    std::sort(rules->begin() + first, rules->end());
+}
+
+ssize_t PatternMatcher::Last(const char* s) const {
+    std::vector<size_t> rules;
+    Match(s, &rules);
+    return rules.empty() ? -1 : static_cast<ssize_t>(rules.back());
+}
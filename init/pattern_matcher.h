@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PATTERN_MATCHER_H_
+#define _INIT_PATTERN_MATCHER_H_
+
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// An index over exact, prefix and fnmatch(3) rules, numbered in the order
+// they are added. Exact and prefix rules are found with one hash lookup per
+// distinct prefix length. Globs are bucketed by the literal text in front of
+// their first wildcard, and only the buckets matching the subject are run
+// through fnmatch(). Lookups therefore do not walk every rule.
+class PatternMatcher {
+public:
+    enum Kind { EXACT, PREFIX, GLOB };
+
+    explicit PatternMatcher(int fnmatch_flags) : fnmatch_flags_(fnmatch_flags) {
+    }
+
+    // Returns the number of the new rule.
+    size_t Add(const char* pattern, Kind kind);
+
+    // Appends the numbers of every rule matching s, in ascending order.
+    void Match(const char* s, std::vector<size_t>* rules) const;
+
+    // Returns the highest numbered rule matching s, or -1 if there is none.
+    ssize_t Last(const char* s) const;
+
+    size_t size() const { return patterns_.size(); }
+
+    // GLOB if the pattern has any fnmatch() special characters, else EXACT.
+    static Kind Classify(const char* pattern);
+
+private:
+    typedef std::unordered_map<std::string, std::vector<size_t>> Index;
+
+    static void Insert(Index* index, std::vector<size_t>* lengths,
+                       const std::string& key, size_t rule);
+
+    const int fnmatch_flags_;
+    std::vector<std::string> patterns_;
+    Index exact_;
+    Index prefixes_;
+    std::vector<size_t> prefix_lengths_;  // sorted, distinct
+    Index globs_;                         // keyed by the literal lead
+    std::vector<size_t> glob_lengths_;    // sorted, distinct
+};
+
+#endif
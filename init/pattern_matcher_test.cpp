@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pattern_matcher.h"
+
+#include <fnmatch.h>
+#include <gtest/gtest.h>
+
+TEST(pattern_matcher, exact_prefix_glob) {
+    PatternMatcher m(FNM_PATHNAME);
+    EXPECT_EQ(0U, m.Add("/dev/null", PatternMatcher::EXACT));
+    EXPECT_EQ(1U, m.Add("/dev/tty", PatternMatcher::PREFIX));
+    EXPECT_EQ(2U, m.Add("/dev/input/event*", PatternMatcher::GLOB));
+    EXPECT_EQ(3U, m.Add("/dev/*", PatternMatcher::GLOB));
+
+    std::vector<size_t> rules;
+    m.Match("/dev/null", &rules);
+    EXPECT_EQ(std::vector<size_t>({0, 3}), rules);
+
+    rules.clear();
+    m.Match("/dev/ttyS0", &rules);
+    EXPECT_EQ(std::vector<size_t>({1, 3}), rules);
+
+    rules.clear();
+    m.Match("/dev/input/event3", &rules);
+    EXPECT_EQ(std::vector<size_t>({2}), rules);  // FNM_PATHNAME stops "/dev/*"
+
+    EXPECT_EQ(-1, m.Last("/sys/null"));
+    EXPECT_EQ(3, m.Last("/dev/tty"));
+}
+
+TEST(pattern_matcher, later_rules_win) {
+    PatternMatcher m(FNM_PATHNAME);
+    m.Add("/dev/block/*", PatternMatcher::GLOB);
+    m.Add("/dev/block/sda", PatternMatcher::EXACT);
+    m.Add("/dev/block/", PatternMatcher::PREFIX);
+
+    EXPECT_EQ(2, m.Last("/dev/block/sda"));
+    EXPECT_EQ(2, m.Last("/dev/block/sdb"));
+}
+
+TEST(pattern_matcher, modalias) {
+    PatternMatcher m(0);
+    const char* aliases[] = {
+        "pci:v00008086d00001234sv*sd*bc*sc*i*",
+        "pci:v00008086d*sv*sd*bc02sc00i*",
+        "usb:v*p*d*dc*dsc*dp*ic03isc01ip01in*",
+        "acpi*:PNP0A03:*",
+        "platform:i8042",
+    };
+    for (const char* alias : aliases) {
+        m.Add(alias, PatternMatcher::Classify(alias));
+    }
+    EXPECT_EQ(PatternMatcher::EXACT, PatternMatcher::Classify("platform:i8042"));
+
+    std::vector<size_t> rules;
+    m.Match("pci:v00008086d00001234sv00001028sd00000001bc02sc00i00", &rules);
+    EXPECT_EQ(std::vector<size_t>({0, 1}), rules);
+
+    EXPECT_EQ(2, m.Last("usb:v046Dp0001d0100dc00dsc00dp00ic03isc01ip01in00"));
+    EXPECT_EQ(3, m.Last("acpi:PNP0A03:"));
+    EXPECT_EQ(4, m.Last("platform:i8042"));
+    EXPECT_EQ(-1, m.Last("platform:i8043"));
+}
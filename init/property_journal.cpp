@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "property_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "log.h"
+
+// The file starts with kMagic and kVersion, then records made of a
+// record_header, the name and the value, neither of them NUL terminated.
+// The crc covers the rest of the header, the name and the value.
+static const uint32_t kMagic = 0x4c4a5250;  // "PRJL"
+static const uint32_t kVersion = 1;
+
+struct file_header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct record_header {
+    uint32_t crc;
+    uint8_t name_len;
+    uint8_t value_len;
+    uint16_t reserved;
+};
+
+// Compaction is not worth it for small journals.
+static const size_t kCompactMinSize = 64 * 1024;
+
+static uint32_t record_crc(const record_header& header, const char* name,
+                           const char* value) {
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(&header.name_len),
+                sizeof(header) - offsetof(record_header, name_len));
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(name), header.name_len);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(value), header.value_len);
+    return crc;
+}
+
+PropertyJournal::~PropertyJournal() {
+    if (fd_ != -1) {
+        Sync();
+        close(fd_);
+    }
+}
+
+size_t PropertyJournal::RecordSize(const std::string& name, const std::string& value) {
+    return sizeof(record_header) + name.size() + value.size();
+}
+
+void PropertyJournal::AppendRecord(std::string* out, const std::string& name,
+                                   const std::string& value) {
+    record_header header;
+    header.name_len = name.size();
+    header.value_len = value.size();
+    header.reserved = 0;
+    header.crc = record_crc(header, name.data(), value.data());
+    out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out->append(name);
+    out->append(value);
+}
+
+bool PropertyJournal::WriteAll(int fd, const std::string& data) {
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, left));
+        if (n <= 0) {
+            ERROR("Unable to write property journal %s: %s\n", path_.c_str(), strerror(errno));
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+// Returns false if the data ends with a record that is torn or corrupt,
+// in which case size_ is where the good records end.
+bool PropertyJournal::Parse(const std::string& data) {
+    size_t pos = sizeof(file_header);
+    properties_.clear();
+    live_size_ = sizeof(file_header);
+
+    while (pos < data.size()) {
+        record_header header;
+        if (data.size() - pos < sizeof(header)) {
+            break;
+        }
+        memcpy(&header, data.data() + pos, sizeof(header));
+        size_t len = sizeof(header) + header.name_len + header.value_len;
+        if (data.size() - pos < len || header.name_len == 0 || header.reserved) {
+            break;
+        }
+        const char* name = data.data() + pos + sizeof(header);
+        const char* value = name + header.name_len;
+        if (record_crc(header, name, value) != header.crc) {
+            break;
+        }
+
+        std::string key(name, header.name_len);
+        auto it = properties_.find(key);
+        if (it != properties_.end()) {
+            live_size_ -= RecordSize(it->first, it->second);
+        }
+        properties_[key].assign(value, header.value_len);
+        live_size_ += len;
+        pos += len;
+    }
+
+    size_ = pos;
+    return pos == data.size();
+}
+
+bool PropertyJournal::Open(bool* created) {
+    fd_ = open(path_.c_str(), O_RDWR | O_APPEND | O_CLOEXEC | O_NOFOLLOW);
+    *created = fd_ == -1 && errno == ENOENT;
+    if (*created) {
+        properties_.clear();
+        return true;
+    }
+    if (fd_ == -1) {
+        ERROR("Unable to open property journal %s: %s\n", path_.c_str(), strerror(errno));
+        return false;
+    }
+
+    // Same rules as for the files of the one-file-per-property layout.
+    struct stat sb;
+    if (fstat(fd_, &sb) == -1 || (sb.st_mode & (S_IRWXG | S_IRWXO)) != 0 ||
+            sb.st_uid != 0 || sb.st_gid != 0 || sb.st_nlink != 1 || !S_ISREG(sb.st_mode)) {
+        ERROR("skipping insecure property journal %s\n", path_.c_str());
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    std::string data;
+    data.resize(sb.st_size);
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd_, &data[0], data.size(), 0));
+    if (n < 0) {
+        ERROR("Unable to read property journal %s: %s\n", path_.c_str(), strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    data.resize(n);
+
+    file_header header;
+    if (data.size() < sizeof(header) ||
+            (memcpy(&header, data.data(), sizeof(header)),
+             header.magic != kMagic || header.version != kVersion)) {
+        // Starting over would drop every property, leave it to the caller.
+        ERROR("property journal %s has a bad header\n", path_.c_str());
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    if (!Parse(data)) {
+        ERROR("property journal %s is torn at %zu of %zu bytes, truncating\n",
+              path_.c_str(), size_, data.size());
+        if (ftruncate(fd_, size_) == -1) {
+            return Compact();
+        }
+    }
+
+    if (size_ > kCompactMinSize && size_ > 2 * live_size_) {
+        return Compact();
+    }
+    return true;
+}
+
+bool PropertyJournal::Create(const std::map<std::string, std::string>& properties) {
+    properties_ = properties;
+    return Compact();
+}
+
+bool PropertyJournal::Set(const std::string& name, const std::string& value) {
+    auto it = properties_.find(name);
+    if (it != properties_.end() && it->second == value) {
+        return true;
+    }
+    if (fd_ == -1) {
+        return false;
+    }
+
+    std::string record;
+    AppendRecord(&record, name, value);
+    bool written = WriteAll(fd_, record);
+
+    if (it != properties_.end()) {
+        live_size_ -= RecordSize(it->first, it->second);
+    }
+    properties_[name] = value;
+    live_size_ += record.size();
+
+    if (!written) {
+        // A partial record would hide everything appended after it, so
+        // start a new file, or stop appending if that fails too.
+        if (!Compact()) {
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+    size_ += record.size();
+    dirty_ = true;
+
+    if (size_ > kCompactMinSize && size_ > 4 * live_size_) {
+        return Compact();
+    }
+    return true;
+}
+
+bool PropertyJournal::Sync() {
+    if (!dirty_) {
+        return true;
+    }
+    dirty_ = false;
+    if (fdatasync(fd_) == -1) {
+        ERROR("Unable to sync property journal %s: %s\n", path_.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool PropertyJournal::Compact() {
+    std::string tmp_path = path_ + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW,
+                  0600);
+    if (fd == -1) {
+        ERROR("Unable to create property journal %s: %s\n", tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+
+    file_header header = { kMagic, kVersion };
+    std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& property : properties_) {
+        AppendRecord(&data, property.first, property.second);
+    }
+
+    if (!WriteAll(fd, data) || fsync(fd) == -1 || rename(tmp_path.c_str(), path_.c_str()) == -1) {
+        ERROR("Unable to replace property journal %s: %s\n", path_.c_str(), strerror(errno));
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    // Make the rename itself durable.
+    std::string dir_path = path_;
+    int dir_fd = open(dirname(&dir_path[0]), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    if (fd_ != -1) {
+        close(fd_);
+    }
+    fd_ = fd;
+    size_ = live_size_ = data.size();
+    dirty_ = false;
+    return true;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PROPERTY_JOURNAL_H_
+#define _INIT_PROPERTY_JOURNAL_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+
+// An append-only file of checksummed name=value records, holding the
+// persistent properties in one place instead of one file each. A set is a
+// single write(); fsyncs are left to the caller, which can group them.
+// Loading is one sequential read that keeps the last value of each name
+// and drops a torn or corrupt tail. Once stale records outweigh live ones
+// the journal is rewritten with only the live ones.
+class PropertyJournal {
+ public:
+  explicit PropertyJournal(const std::string& path) : path_(path) {
+  }
+  ~PropertyJournal();
+
+  // Opens the journal and reads it. Returns false if it cannot be used.
+  // *created tells whether it does not exist yet, in which case nothing is
+  // written until Create().
+  bool Open(bool* created);
+
+  // Durably writes a new journal holding properties, all at once, before
+  // it replaces anything at path.
+  bool Create(const std::map<std::string, std::string>& properties);
+
+  const std::map<std::string, std::string>& properties() const {
+    return properties_;
+  }
+
+  // Appends a record, unless name already has that value.
+  bool Set(const std::string& name, const std::string& value);
+
+  // Makes every appended record durable.
+  bool Sync();
+
+  // Whether records were appended since the last Sync().
+  bool dirty() const { return dirty_; }
+
+  // Rewrites the journal with one record per property.
+  bool Compact();
+
+  size_t size() const { return size_; }
+
+ private:
+  static size_t RecordSize(const std::string& name, const std::string& value);
+  static void AppendRecord(std::string* out, const std::string& name,
+                           const std::string& value);
+  bool Parse(const std::string& data);
+  bool WriteAll(int fd, const std::string& data);
+
+  const std::string path_;
+  int fd_ = -1;
+  std::map<std::string, std::string> properties_;
+  size_t size_ = 0;       // of the file
+  size_t live_size_ = 0;  // of the records compaction would keep
+  bool dirty_ = false;
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "property_journal.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+class property_journal : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/data/local/tmp/property_journal.XXXXXX";
+    char host_dir[] = "/tmp/property_journal.XXXXXX";
+    dir_ = mkdtemp(dir) ?: mkdtemp(host_dir);
+    ASSERT_FALSE(dir_.empty());
+    path_ = dir_ + "/journal";
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  off_t FileSize() {
+    struct stat sb;
+    return stat(path_.c_str(), &sb) == 0 ? sb.st_size : -1;
+  }
+
+  std::string dir_;
+  std::string path_;
+};
+
+TEST_F(property_journal, set_and_reload) {
+  bool created;
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    EXPECT_TRUE(created);
+    EXPECT_EQ(-1, FileSize());
+    EXPECT_FALSE(journal.Set("persist.a", "1"));
+    ASSERT_TRUE(journal.Create({}));
+    EXPECT_TRUE(journal.Set("persist.a", "1"));
+    EXPECT_TRUE(journal.Set("persist.b", ""));
+    EXPECT_TRUE(journal.Set("persist.a", "2"));
+    EXPECT_TRUE(journal.dirty());
+    EXPECT_TRUE(journal.Sync());
+    EXPECT_FALSE(journal.dirty());
+
+    // Setting the current value appends nothing.
+    off_t size = FileSize();
+    EXPECT_TRUE(journal.Set("persist.a", "2"));
+    EXPECT_EQ(size, FileSize());
+  }
+
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  EXPECT_FALSE(created);
+  ASSERT_EQ(2U, journal.properties().size());
+  EXPECT_EQ("2", journal.properties().at("persist.a"));
+  EXPECT_EQ("", journal.properties().at("persist.b"));
+}
+
+TEST_F(property_journal, torn_tail) {
+  bool created;
+  off_t good_size;
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    ASSERT_TRUE(journal.Create({}));
+    EXPECT_TRUE(journal.Set("persist.a", "1"));
+    good_size = FileSize();
+    EXPECT_TRUE(journal.Set("persist.b", "2"));
+  }
+
+  // Lose the end of the last record, as a crash during write() would.
+  ASSERT_EQ(0, truncate(path_.c_str(), FileSize() - 1));
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    EXPECT_EQ(1U, journal.properties().size());
+    EXPECT_EQ(good_size, FileSize());
+    EXPECT_TRUE(journal.Set("persist.c", "3"));
+  }
+
+  // Records appended after the repair are found again.
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  EXPECT_EQ(2U, journal.properties().size());
+  EXPECT_EQ("3", journal.properties().at("persist.c"));
+}
+
+TEST_F(property_journal, corrupt_record) {
+  bool created;
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    ASSERT_TRUE(journal.Create({}));
+    EXPECT_TRUE(journal.Set("persist.a", "1"));
+  }
+
+  int fd = open(path_.c_str(), O_WRONLY);
+  ASSERT_NE(-1, fd);
+  ASSERT_EQ(1, pwrite(fd, "2", 1, FileSize() - 1));
+  close(fd);
+
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  EXPECT_TRUE(journal.properties().empty());
+}
+
+TEST_F(property_journal, compaction) {
+  bool created;
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  ASSERT_TRUE(journal.Create({}));
+
+  for (int i = 0; i < 10000; i++) {
+    EXPECT_TRUE(journal.Set("persist.counter", std::to_string(i)));
+  }
+  EXPECT_LT(journal.size(), 128U * 1024U);
+  EXPECT_EQ(static_cast<off_t>(journal.size()), FileSize());
+
+  PropertyJournal reloaded(path_);
+  ASSERT_TRUE(reloaded.Open(&created));
+  EXPECT_EQ("9999", reloaded.properties().at("persist.counter"));
+}
+
+TEST_F(property_journal, create) {
+  bool created;
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    ASSERT_TRUE(created);
+    std::map<std::string, std::string> properties = {
+      { "persist.a", "1" },
+      { "persist.b", "2" },
+    };
+    ASSERT_TRUE(journal.Create(properties));
+    EXPECT_FALSE(journal.dirty());
+    EXPECT_EQ(static_cast<off_t>(journal.size()), FileSize());
+  }
+
+  // Everything is in the file without any Sync().
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  EXPECT_FALSE(created);
+  ASSERT_EQ(2U, journal.properties().size());
+  EXPECT_EQ("2", journal.properties().at("persist.b"));
+}
+
+TEST_F(property_journal, bad_header) {
+  bool created;
+  {
+    PropertyJournal journal(path_);
+    ASSERT_TRUE(journal.Open(&created));
+    ASSERT_TRUE(journal.Create({ { "persist.a", "1" }, { "persist.b", "2" } }));
+  }
+
+  int fd = open(path_.c_str(), O_RDWR);
+  ASSERT_NE(-1, fd);
+  char magic;
+  ASSERT_EQ(1, pread(fd, &magic, 1, 0));
+  char bad = magic ^ 0xff;
+  ASSERT_EQ(1, pwrite(fd, &bad, 1, 0));
+
+  // The journal is refused, not started over empty.
+  off_t size = FileSize();
+  {
+    PropertyJournal journal(path_);
+    EXPECT_FALSE(journal.Open(&created));
+    EXPECT_FALSE(created);
+    EXPECT_EQ(size, FileSize());
+  }
+
+  // So every property is still there once the header is repaired.
+  ASSERT_EQ(1, pwrite(fd, &magic, 1, 0));
+  close(fd);
+  PropertyJournal journal(path_);
+  ASSERT_TRUE(journal.Open(&created));
+  ASSERT_EQ(2U, journal.properties().size());
+  EXPECT_EQ("1", journal.properties().at("persist.a"));
+  EXPECT_EQ("2", journal.properties().at("persist.b"));
+}
@@ -26,7 +26,10 @@
 #include <errno.h>
 #include <sys/poll.h>
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <cutils/misc.h>
 #include <cutils/sockets.h>
@@ -42,6 +45,7 @@
 #include <netinet/in.h>
 #include <sys/mman.h>
 #include <private/android_filesystem_config.h>
+#include <private/android_property_batch.h>
 
 #include <selinux/selinux.h>
 #include <selinux/label.h>
@@ -50,6 +54,7 @@
 #include <base/file.h>
 #include "bootimg.h"
 
+#include "property_journal.h"
 #include "property_service.h"
 #include "init.h"
 #include "util.h"
@@ -57,10 +62,18 @@
 #include "vendor_init.h"
 
 #define PERSISTENT_PROPERTY_DIR  "/data/property"
+#define PERSISTENT_PROPERTY_JOURNAL PERSISTENT_PROPERTY_DIR "/persistent_properties"
+
+// How long a persistent property set may wait for the next journal fsync,
+// so that sets in quick succession share one.
+#define PERSISTENT_PROPERTY_SYNC_DELAY_MS 100
 #define FSTAB_PREFIX "/fstab."
 #define RECOVERY_MOUNT_POINT "/recovery"
 
 static int persistent_properties_loaded = 0;
+// Set when ro.persistent_properties.journal=1, see load_persistent_properties().
+static PropertyJournal* persistent_journal = nullptr;
+static uint64_t persistent_journal_sync_ns = 0;
 static bool property_area_initialized = false;
 
 static int property_set_fd = -1;
@@ -187,6 +200,16 @@ static void write_persistent_property(const char *name, const char *value)
     char path[PATH_MAX];
     int fd;
 
+    if (persistent_journal) {
+        if (!persistent_journal->Set(name, value)) {
+            ERROR("Unable to write persistent property %s to journal\n", name);
+        } else if (persistent_journal->dirty() && !persistent_journal_sync_ns) {
+            persistent_journal_sync_ns = gettime_ns() +
+                    PERSISTENT_PROPERTY_SYNC_DELAY_MS * UINT64_C(1000000);
+        }
+        return;
+    }
+
     snprintf(tempPath, sizeof(tempPath), "%s/.temp.XXXXXX", PERSISTENT_PROPERTY_DIR);
     fd = mkstemp(tempPath);
     if (fd < 0) {
@@ -291,6 +314,168 @@ int property_set(const char* name, const char* value) {
     return rc;
 }
 
+/* Applies one property set request on behalf of a client */
+static int handle_property_set(const char* name, const char* value,
+                               char* source_ctx, struct ucred* cr)
+{
+    if (!is_legal_property_name(name, strlen(name))) {
+        ERROR("sys_prop: illegal property name. Got: \"%s\"\n", name);
+        return -EINVAL;
+    }
+
+    if (memcmp(name, "ctl.", 4) == 0) {
+        if (!check_control_mac_perms(value, source_ctx, cr)) {
+            ERROR("sys_prop: Unable to %s service ctl [%s] uid:%d gid:%d pid:%d\n",
+                    name + 4, value, cr->uid, cr->gid, cr->pid);
+            return -EPERM;
+        }
+        handle_control_message(name + 4, value);
+        return 0;
+    }
+
+    if (!check_perms(name, source_ctx, cr)) {
+        ERROR("sys_prop: permission denied uid:%d  name:%s\n", cr->uid, name);
+        return -EPERM;
+    }
+    return property_set(name, value) ? -EINVAL : 0;
+}
+
+/* Waits until deadline_ns (CLOCK_MONOTONIC) at most for all len bytes */
+static bool recv_fully(int s, void* buf, size_t len, uint64_t deadline_ns)
+{
+    char* p = reinterpret_cast<char*>(buf);
+
+    while (len) {
+        uint64_t now_ns = gettime_ns();
+        if (now_ns >= deadline_ns) {
+            return false;
+        }
+        int timeout_ms = (deadline_ns - now_ns + 999999) / 1000000;
+        struct pollfd ufds[1] = { { s, POLLIN, 0 } };
+        int nr = TEMP_FAILURE_RETRY(poll(ufds, 1, timeout_ms));
+        if (nr <= 0) {
+            return false;
+        }
+        ssize_t r = TEMP_FAILURE_RETRY(recv(s, p, len, MSG_DONTWAIT));
+        if (r <= 0) {
+            return false;
+        }
+        p += r;
+        len -= r;
+    }
+    return true;
+}
+
+/*
+ * Batch sessions, see <private/android_property_batch.h>. Their sockets all
+ * share handle_property_session_fds(), which polls them to find the ones
+ * with a batch pending.
+ */
+#define PROPERTY_SESSIONS_MAX 16
+#define PROPERTY_SESSIONS_PER_UID_MAX 4   /* so no one uid takes every slot */
+
+struct property_session {
+    int fd;
+    struct ucred cr;
+    char* source_ctx;
+};
+
+static std::vector<property_session> property_sessions;
+
+/* Serves one batch, returns false once the session is over */
+static bool handle_property_batch(property_session* session)
+{
+    // The whole batch has 2 sec to arrive, however it is split up.
+    const uint64_t deadline_ns = gettime_ns() + UINT64_C(2000000000);
+    prop_batch_header header;
+    prop_batch_item items[PROP_BATCH_MAX];
+    int32_t results[PROP_BATCH_MAX];
+
+    if (!recv_fully(session->fd, &header, sizeof(header), deadline_ns)) {
+        return false;
+    }
+    if (header.count == 0 || header.count > PROP_BATCH_MAX) {
+        ERROR("sys_prop: bad batch of %u properties from uid=%d\n",
+              header.count, session->cr.uid);
+        return false;
+    }
+    if (!recv_fully(session->fd, items, sizeof(items[0]) * header.count, deadline_ns)) {
+        ERROR("sys_prop: timeout waiting for uid=%d to send property batch.\n",
+              session->cr.uid);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        items[i].name[PROP_NAME_MAX-1] = 0;
+        items[i].value[PROP_VALUE_MAX-1] = 0;
+        results[i] = handle_property_set(items[i].name, items[i].value,
+                                         session->source_ctx, &session->cr);
+    }
+
+    // As with the legacy protocol, the client only learns about the
+    // results after the properties are written to memory. A client that
+    // leaves them unread until the socket buffer fills is dropped rather
+    // than allowed to block init.
+    size_t len = sizeof(results[0]) * header.count;
+    if (TEMP_FAILURE_RETRY(send(session->fd, results, len, MSG_DONTWAIT | MSG_NOSIGNAL)) !=
+            static_cast<ssize_t>(len)) {
+        ERROR("sys_prop: dropping property session of uid=%d: %s\n",
+              session->cr.uid, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void handle_property_session_fds()
+{
+    std::vector<pollfd> ufds;
+    for (const property_session& session : property_sessions) {
+        ufds.push_back({ session.fd, POLLIN, 0 });
+    }
+    if (TEMP_FAILURE_RETRY(poll(ufds.data(), ufds.size(), 0)) <= 0) {
+        return;
+    }
+
+    // Walk backwards so that closing a session leaves the indexes valid.
+    for (size_t i = ufds.size(); i-- > 0; ) {
+        if (!ufds[i].revents || handle_property_batch(&property_sessions[i])) {
+            continue;
+        }
+        unregister_epoll_handler(property_sessions[i].fd);
+        close(property_sessions[i].fd);
+        freecon(property_sessions[i].source_ctx);
+        property_sessions.erase(property_sessions.begin() + i);
+    }
+}
+
+static void start_property_session(int s, unsigned version, struct ucred* cr)
+{
+    size_t uid_sessions = 0;
+    for (const property_session& session : property_sessions) {
+        uid_sessions += session.cr.uid == cr->uid;
+    }
+    if (version != PROP_BATCH_VERSION ||
+            property_sessions.size() >= PROPERTY_SESSIONS_MAX ||
+            uid_sessions >= PROPERTY_SESSIONS_PER_UID_MAX) {
+        // The client goes back to one connection per property.
+        close(s);
+        return;
+    }
+
+    property_session session = { s, *cr, NULL };
+    uint32_t accepted = PROP_BATCH_VERSION;
+    getpeercon(s, &session.source_ctx);
+    if (TEMP_FAILURE_RETRY(send(s, &accepted, sizeof(accepted),
+                                MSG_DONTWAIT | MSG_NOSIGNAL)) !=
+            sizeof(accepted)) {
+        freecon(session.source_ctx);
+        close(s);
+        return;
+    }
+    property_sessions.push_back(session);
+    register_epoll_handler(s, handle_property_session_fds);
+}
+
 static void handle_property_set_fd()
 {
     prop_msg msg;
@@ -305,7 +490,8 @@ static void handle_property_set_fd()
     const int timeout_ms = 2 * 1000;  /* Default 2 sec timeout for caller to send property. */
     int nr;
 
-    if ((s = accept(property_set_fd, (struct sockaddr *) &addr, &addr_size)) < 0) {
+    if ((s = accept4(property_set_fd, (struct sockaddr *) &addr, &addr_size,
+                     SOCK_CLOEXEC)) < 0) {
         return;
     }
 
@@ -338,6 +524,11 @@ static void handle_property_set_fd()
         return;
     }
 
+    if ((msg.cmd & PROP_MSG_BATCH_MASK) == PROP_MSG_BATCH) {
+        start_property_session(s, msg.cmd & ~PROP_MSG_BATCH_MASK, &cr);
+        return;
+    }
+
     switch(msg.cmd) {
     case PROP_MSG_SETPROP:
         msg.name[PROP_NAME_MAX-1] = 0;
@@ -355,19 +546,9 @@ static void handle_property_set_fd()
             // Keep the old close-socket-early behavior when handling
             // ctl.* properties.
             close(s);
-            if (check_control_mac_perms(msg.value, source_ctx, &cr)) {
-                handle_control_message((char*) msg.name + 4, (char*) msg.value);
-            } else {
-                ERROR("sys_prop: Unable to %s service ctl [%s] uid:%d gid:%d pid:%d\n",
-                        msg.name + 4, msg.value, cr.uid, cr.gid, cr.pid);
-            }
+            handle_property_set(msg.name, msg.value, source_ctx, &cr);
         } else {
-            if (check_perms(msg.name, source_ctx, &cr)) {
-                property_set((char*) msg.name, (char*) msg.value);
-            } else {
-                ERROR("sys_prop: permission denied uid:%d  name:%s\n",
-                      cr.uid, msg.name);
-            }
+            handle_property_set(msg.name, msg.value, source_ctx, &cr);
 
             // Note: bionic's property client code assumes that the
             // property server will not close the socket until *AFTER*
@@ -467,9 +648,21 @@ int load_properties_from_file(const char* filename, const char* filter) {
     return 0;
 }
 
-static void load_persistent_properties() {
-    persistent_properties_loaded = 1;
+int sync_persistent_properties() {
+    if (!persistent_journal_sync_ns) {
+        return -1;
+    }
+    uint64_t now = gettime_ns();
+    if (now < persistent_journal_sync_ns) {
+        return (persistent_journal_sync_ns - now + 999999) / 1000000;
+    }
+    persistent_journal_sync_ns = 0;
+    persistent_journal->Sync();
+    return -1;
+}
 
+/* Reads the one-file-per-property layout */
+static void load_persistent_files(std::map<std::string, std::string>* properties) {
     std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(PERSISTENT_PROPERTY_DIR), closedir);
     if (!dir) {
         ERROR("Unable to open persistent property directory \"%s\": %s\n",
@@ -516,7 +709,7 @@ static void load_persistent_properties() {
         int length = read(fd, value, sizeof(value) - 1);
         if (length >= 0) {
             value[length] = 0;
-            property_set(entry->d_name, value);
+            (*properties)[entry->d_name] = value;
         } else {
             ERROR("Unable to read persistent property file %s: %s\n",
                   entry->d_name, strerror(errno));
@@ -525,6 +718,80 @@ static void load_persistent_properties() {
     }
 }
 
+/*
+ * With the journal, loading is one read of PERSISTENT_PROPERTY_JOURNAL. The
+ * first time, it is built from the per-property files and written durably
+ * before anything relies on it. From then on the files are neither read
+ * nor written; if the journal is later turned off or cannot be read,
+ * retire_persistent_journal() brings them up to date again.
+ */
+static bool load_persistent_journal() {
+    char enabled[PROP_VALUE_MAX];
+    if (property_get("ro.persistent_properties.journal", enabled) <= 0 ||
+            strcmp(enabled, "1")) {
+        return false;
+    }
+
+    std::unique_ptr<PropertyJournal> journal(new PropertyJournal(PERSISTENT_PROPERTY_JOURNAL));
+    bool created;
+    if (!journal->Open(&created)) {
+        ERROR("Unable to use persistent property journal, falling back to files\n");
+        return false;
+    }
+    if (created) {
+        std::map<std::string, std::string> properties;
+        load_persistent_files(&properties);
+        if (!journal->Create(properties)) {
+            ERROR("Unable to create persistent property journal, falling back to files\n");
+            return false;
+        }
+    }
+    persistent_journal = journal.release();
+
+    for (const auto& property : persistent_journal->properties()) {
+        property_set(property.first.c_str(), property.second.c_str());
+    }
+    return true;
+}
+
+/*
+ * The files went stale while the journal was in use: write its values back
+ * to them and remove it, so that it is not trusted again should it be
+ * turned back on. One that cannot be read is moved aside instead.
+ */
+static void retire_persistent_journal() {
+    if (access(PERSISTENT_PROPERTY_JOURNAL, F_OK)) {
+        return;
+    }
+
+    PropertyJournal journal(PERSISTENT_PROPERTY_JOURNAL);
+    bool created;
+    if (!journal.Open(&created)) {
+        ERROR("Moving unreadable persistent property journal aside\n");
+        rename(PERSISTENT_PROPERTY_JOURNAL, PERSISTENT_PROPERTY_JOURNAL ".bad");
+        return;
+    }
+    for (const auto& property : journal.properties()) {
+        property_set(property.first.c_str(), property.second.c_str());
+    }
+    unlink(PERSISTENT_PROPERTY_JOURNAL);
+}
+
+static void load_persistent_properties() {
+    persistent_properties_loaded = 1;
+
+    if (load_persistent_journal()) {
+        return;
+    }
+
+    std::map<std::string, std::string> properties;
+    load_persistent_files(&properties);
+    for (const auto& property : properties) {
+        property_set(property.first.c_str(), property.second.c_str());
+    }
+    retire_persistent_journal();
+}
+
 void property_load_boot_defaults() {
     load_properties_from_file(PROP_PATH_RAMDISK_DEFAULT, NULL);
 }
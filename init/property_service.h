@@ -37,6 +37,9 @@ extern int __property_get(const char *name, char *value);
 extern int property_set(const char *name, const char *value);
 extern bool property_get_bool(const char *name, bool def_value);
 extern bool properties_initialized();
+// Syncs persistent properties once due, returns the ms until the next sync
+// or -1 if none is pending.
+extern int sync_persistent_properties();
 
 #ifndef __clang__
 extern void __property_get_size_error()
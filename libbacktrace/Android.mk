@@ -45,6 +45,7 @@ libbacktrace_src_files := \
 	BacktraceCurrent.cpp \
 	BacktraceMap.cpp \
 	BacktracePtrace.cpp \
+	ElfSymbols.cpp \
 	thread_utils.c \
 	ThreadEntry.cpp \
 	UnwindCurrent.cpp \
@@ -136,6 +137,38 @@ include $(LOCAL_PATH)/Android.build.mk
 build_type := host
 include $(LOCAL_PATH)/Android.build.mk
 
+#-------------------------------------------------------------------------
+# The backtrace_benchmarks executable, sharing liblog's benchmark harness.
+#-------------------------------------------------------------------------
+backtrace_benchmarks_cflags := \
+	-fno-builtin \
+	-O2 \
+
+backtrace_benchmarks_c_includes := \
+	$(LOCAL_PATH)/../liblog/tests \
+
+backtrace_benchmarks_src_files := \
+	backtrace_benchmarks.cpp \
+	../liblog/tests/benchmark_main.cpp \
+
+backtrace_benchmarks_ldlibs_host := \
+	-lpthread \
+	-lrt \
+
+backtrace_benchmarks_shared_libraries := \
+	libbacktrace \
+	libbase \
+	libcutils \
+
+module := backtrace_benchmarks
+module_tag := debug
+build_type := target
+build_target := NATIVE_TEST
+backtrace_benchmarks_multilib := both
+include $(LOCAL_PATH)/Android.build.mk
+build_type := host
+include $(LOCAL_PATH)/Android.build.mk
+
 #----------------------------------------------------------------------------
 # Special truncated libbacktrace library for mac.
 #----------------------------------------------------------------------------
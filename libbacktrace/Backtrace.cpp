@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <ucontext.h>
 
+#include <memory>
 #include <string>
 
 #include <base/stringprintf.h>
@@ -30,12 +31,23 @@
 #include <cutils/threads.h>
 
 #include "BacktraceLog.h"
+#include "ElfSymbols.h"
 #include "thread_utils.h"
 #include "UnwindCurrent.h"
 #include "UnwindPtrace.h"
 
 using android::base::StringPrintf;
 
+static bool GetElfFunctionName(const backtrace_map_t& map, uintptr_t pc, std::string* name,
+                              uintptr_t* offset) {
+  // Only files can be read, and not once deleted.
+  if (!BacktraceMap::IsValid(map) || map.name.empty() || map.name[0] != '/') {
+    return false;
+  }
+  std::shared_ptr<ElfSymbols> symbols = ElfSymbols::Get(map.name);
+  return symbols != nullptr && symbols->FindFunction(map, pc, name, offset);
+}
+
 //-------------------------------------------------------------------------
 // Backtrace functions.
 //-------------------------------------------------------------------------
@@ -55,7 +67,24 @@ Backtrace::~Backtrace() {
 }
 
 std::string Backtrace::GetFunctionName(uintptr_t pc, uintptr_t* offset) {
-  std::string func_name = GetFunctionNameRaw(pc, offset);
+  if (map_ == nullptr) {
+    return GetFunctionNameRaw(pc, offset);
+  }
+
+  backtrace_map_t map;
+  FillInMap(pc, &map);
+  std::string func_name;
+  if (map_->GetCachedFunctionName(map, pc, &func_name, offset)) {
+    return func_name;
+  }
+
+  if (!map_->UseElfSymbols() || !GetElfFunctionName(map, pc, &func_name, offset)) {
+    func_name = GetFunctionNameRaw(pc, offset);
+  }
+  // An empty name is not remembered: libunwind gives none before Unwind().
+  if (!func_name.empty()) {
+    map_->CacheFunctionName(map, pc, func_name, *offset);
+  }
   return func_name;
 }
 
@@ -19,13 +19,44 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
 #include <backtrace/backtrace_constants.h>
 #include <backtrace/BacktraceMap.h>
-#include <log/log.h>
 
+#include "BacktraceLog.h"
 #include "thread_utils.h"
 
-BacktraceMap::BacktraceMap(pid_t pid) : pid_(pid) {
+static constexpr size_t kMaxCachedFunctionNames = 4096;
+
+struct BacktraceMap::FunctionNameCache {
+  // The start of the map and the pc's offset into it.
+  struct Key {
+    uintptr_t map_start;
+    uintptr_t pc_offset;
+
+    bool operator==(const Key& other) const {
+      return map_start == other.map_start && pc_offset == other.pc_offset;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<uintptr_t>()(key.map_start) * 31 + std::hash<uintptr_t>()(key.pc_offset);
+    }
+  };
+  struct Entry {
+    std::string name;
+    uintptr_t offset;
+  };
+
+  std::mutex lock;
+  std::unordered_map<Key, Entry, KeyHash> names;
+};
+
+BacktraceMap::BacktraceMap(pid_t pid) : pid_(pid), function_names_(new FunctionNameCache) {
   if (pid_ < 0) {
     pid_ = getpid();
   }
@@ -34,20 +65,104 @@ BacktraceMap::BacktraceMap(pid_t pid) : pid_(pid) {
 BacktraceMap::~BacktraceMap() {
 }
 
-void BacktraceMap::FillIn(uintptr_t addr, backtrace_map_t* map) {
-  for (BacktraceMap::const_iterator it = begin();
-       it != end(); ++it) {
-    if (addr >= it->start && addr < it->end) {
-      *map = *it;
-      return;
+void BacktraceMap::BuildIndex() {
+  auto by_start = [](const backtrace_map_t& a, const backtrace_map_t& b) {
+    return a.start < b.start;
+  };
+  // Both /proc/<pid>/maps and libunwind already give ascending order.
+  if (!std::is_sorted(maps_.begin(), maps_.end(), by_start)) {
+    std::stable_sort(maps_.begin(), maps_.end(), by_start);
+  }
+
+  starts_.clear();
+  starts_.reserve(maps_.size());
+  overlapping_ = false;
+  for (size_t i = 0; i < maps_.size(); i++) {
+    if (i > 0 && maps_[i].start < maps_[i - 1].end) {
+      overlapping_ = true;
+    }
+    starts_.push_back(maps_[i].start);
+  }
+  last_hit_.store(0, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard(function_names_->lock);
+  function_names_->names.clear();
+}
+
+bool BacktraceMap::FindIndex(uintptr_t addr, size_t* index) {
+  // A lookup never rebuilds the index, other threads may be reading it.
+  if (starts_.size() != maps_.size()) {
+    BACK_LOGW("maps changed without BuildIndex(), ignoring them");
+    return false;
+  }
+
+  size_t hit = last_hit_.load(std::memory_order_relaxed);
+  if (!overlapping_ && hit < maps_.size() && addr >= maps_[hit].start &&
+      addr < maps_[hit].end) {
+    *index = hit;
+    return true;
+  }
+
+  if (overlapping_) {
+    for (size_t i = 0; i < maps_.size(); i++) {
+      if (addr >= maps_[i].start && addr < maps_[i].end) {
+        *index = i;
+        return true;
+      }
     }
+    return false;
+  }
+
+  // The last map starting at or below addr is the only one that can hold it.
+  auto it = std::upper_bound(starts_.begin(), starts_.end(), addr);
+  if (it == starts_.begin()) {
+    return false;
+  }
+  hit = it - starts_.begin() - 1;
+  if (addr >= maps_[hit].end) {
+    return false;
+  }
+  last_hit_.store(hit, std::memory_order_relaxed);
+  *index = hit;
+  return true;
+}
+
+void BacktraceMap::FillIn(uintptr_t addr, backtrace_map_t* map) {
+  size_t index;
+  if (FindIndex(addr, &index)) {
+    *map = maps_[index];
+  } else {
+    *map = {};
+  }
+}
+
+bool BacktraceMap::GetCachedFunctionName(const backtrace_map_t& map, uintptr_t pc,
+                                         std::string* name, uintptr_t* offset) {
+  std::lock_guard<std::mutex> guard(function_names_->lock);
+  auto entry = function_names_->names.find(FunctionNameCache::Key{map.start, pc - map.start});
+  if (entry == function_names_->names.end()) {
+    return false;
   }
-  *map = {};
+  *name = entry->second.name;
+  *offset = entry->second.offset;
+  return true;
+}
+
+void BacktraceMap::CacheFunctionName(const backtrace_map_t& map, uintptr_t pc,
+                                     const std::string& name, uintptr_t offset) {
+  std::lock_guard<std::mutex> guard(function_names_->lock);
+  // Enough for the hot frames of a process; start over rather than grow.
+  if (function_names_->names.size() >= kMaxCachedFunctionNames) {
+    function_names_->names.clear();
+  }
+  function_names_->names[FunctionNameCache::Key{map.start, pc - map.start}] =
+      FunctionNameCache::Entry{name, offset};
 }
 
 bool BacktraceMap::ParseLine(const char* line, backtrace_map_t* map) {
   unsigned long int start;
   unsigned long int end;
+  unsigned long int offset = 0;
   char permissions[5];
   int name_pos;
 
@@ -63,14 +178,15 @@ bool BacktraceMap::ParseLine(const char* line, backtrace_map_t* map) {
 // 6f000000-6f01e000 rwxp 00000000 00:0c 16389419   /system/lib/libcomposer.so\n
 // 012345678901234567890123456789012345678901234567890123456789
 // 0         1         2         3         4         5
-  if (sscanf(line, "%lx-%lx %4s %*x %*x:%*x %*d%n",
-             &start, &end, permissions, &name_pos) != 3) {
+  if (sscanf(line, "%lx-%lx %4s %lx %*x:%*x %*d%n",
+             &start, &end, permissions, &offset, &name_pos) != 4) {
 #endif
     return false;
   }
 
   map->start = start;
   map->end = end;
+  map->offset = offset;
   map->flags = PROT_NONE;
   if (permissions[0] == 'r') {
     map->flags |= PROT_READ;
@@ -129,6 +245,7 @@ bool BacktraceMap::Build() {
   fclose(fp);
 #endif
 
+  BuildIndex();
   return true;
 }
 
@@ -20,6 +20,7 @@
 #include <sys/param.h>
 #include <sys/ptrace.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <ucontext.h>
 #include <unistd.h>
 
@@ -30,6 +31,13 @@
 #include "BacktracePtrace.h"
 #include "thread_utils.h"
 
+// Remote pages kept by each BacktracePtrace. Stack dumps read one word at a
+// time, so with the cache they fetch a page per system call, not a word.
+static constexpr size_t kCachedPages = 8;
+
+// Reads of this many pages or more skip the cache.
+static constexpr size_t kUncachedReadPages = 2;
+
 #if !defined(__APPLE__)
 static bool PtraceRead(pid_t tid, uintptr_t addr, word_t* out_value) {
   // ptrace() returns -1 and sets errno when the operation fails.
@@ -41,44 +49,15 @@ static bool PtraceRead(pid_t tid, uintptr_t addr, word_t* out_value) {
   }
   return true;
 }
-#endif
-
-bool BacktracePtrace::ReadWord(uintptr_t ptr, word_t* out_value) {
-#if defined(__APPLE__)
-  BACK_LOGW("MacOS does not support reading from another pid.");
-  return false;
-#else
-  if (!VerifyReadWordArgs(ptr, out_value)) {
-    return false;
-  }
-
-  backtrace_map_t map;
-  FillInMap(ptr, &map);
-  if (!BacktraceMap::IsValid(map) || !(map.flags & PROT_READ)) {
-    return false;
-  }
-
-  return PtraceRead(Tid(), ptr, out_value);
-#endif
-}
-
-size_t BacktracePtrace::Read(uintptr_t addr, uint8_t* buffer, size_t bytes) {
-#if defined(__APPLE__)
-  BACK_LOGW("MacOS does not support reading from another pid.");
-  return 0;
-#else
-  backtrace_map_t map;
-  FillInMap(addr, &map);
-  if (!BacktraceMap::IsValid(map) || !(map.flags & PROT_READ)) {
-    return 0;
-  }
 
-  bytes = MIN(map.end - addr, bytes);
+// Reads one word per system call, which also works where
+// process_vm_readv() does not.
+static size_t PtraceReadBytes(pid_t tid, uintptr_t addr, uint8_t* buffer, size_t bytes) {
   size_t bytes_read = 0;
   word_t data_word;
   size_t align_bytes = addr & (sizeof(word_t) - 1);
   if (align_bytes != 0) {
-    if (!PtraceRead(Tid(), addr & ~(sizeof(word_t) - 1), &data_word)) {
+    if (!PtraceRead(tid, addr & ~(sizeof(word_t) - 1), &data_word)) {
       return 0;
     }
     size_t copy_bytes = MIN(sizeof(word_t) - align_bytes, bytes);
@@ -91,7 +70,7 @@ size_t BacktracePtrace::Read(uintptr_t addr, uint8_t* buffer, size_t bytes) {
 
   size_t num_words = bytes / sizeof(word_t);
   for (size_t i = 0; i < num_words; i++) {
-    if (!PtraceRead(Tid(), addr, &data_word)) {
+    if (!PtraceRead(tid, addr, &data_word)) {
       return bytes_read;
     }
     memcpy(buffer, &data_word, sizeof(word_t));
@@ -102,12 +81,130 @@ size_t BacktracePtrace::Read(uintptr_t addr, uint8_t* buffer, size_t bytes) {
 
   size_t left_over = bytes & (sizeof(word_t) - 1);
   if (left_over) {
-    if (!PtraceRead(Tid(), addr, &data_word)) {
+    if (!PtraceRead(tid, addr, &data_word)) {
       return bytes_read;
     }
     memcpy(buffer, &data_word, left_over);
     bytes_read += left_over;
   }
   return bytes_read;
+}
+#endif
+
+BacktracePtrace::BacktracePtrace(pid_t pid, pid_t tid, BacktraceMap* map)
+    : Backtrace(pid, tid, map), page_size_(getpagesize()), use_vm_readv_(true) {
+}
+
+void BacktracePtrace::ClearReadCache() {
+  for (auto& entry : cache_) {
+    entry.valid = false;
+  }
+}
+
+// Reads bytes with process_vm_readv(), or with ptrace where that fails.
+// Returns the number of bytes read, which stops short at the first
+// unreadable byte.
+size_t BacktracePtrace::ReadPages(uintptr_t addr, uint8_t* buffer, size_t bytes) {
+#if defined(__APPLE__)
+  return 0;
+#else
+  if (use_vm_readv_) {
+    struct iovec local_io = { buffer, bytes };
+    struct iovec remote_io = { reinterpret_cast<void*>(addr), bytes };
+    ssize_t rc = process_vm_readv(Tid(), &local_io, 1, &remote_io, 1, 0);
+    if (rc == static_cast<ssize_t>(bytes)) {
+      return bytes;
+    }
+    if (rc == -1 && (errno == ENOSYS || errno == EPERM)) {
+      use_vm_readv_ = false;
+    } else if (rc > 0) {
+      // Stopped at an unreadable page, which ptrace may still be able to
+      // read, as it ignores the page's protection.
+      return rc + PtraceReadBytes(Tid(), addr + rc, buffer + rc, bytes - rc);
+    }
+  }
+  return PtraceReadBytes(Tid(), addr, buffer, bytes);
+#endif
+}
+
+const uint8_t* BacktracePtrace::GetCachedPage(uintptr_t page) {
+  if (cache_.empty()) {
+    cache_.resize(kCachedPages);
+    for (auto& entry : cache_) {
+      entry.valid = false;
+      entry.data.resize(page_size_);
+    }
+  }
+
+  CachedPage& entry = cache_[(page / page_size_) % kCachedPages];
+  if (!entry.valid || entry.page != page) {
+    entry.valid = false;
+    if (ReadPages(page, entry.data.data(), page_size_) != page_size_) {
+      return nullptr;
+    }
+    entry.page = page;
+    entry.valid = true;
+  }
+  return entry.data.data();
+}
+
+// Reads memory already known to be in a readable map.
+size_t BacktracePtrace::ReadRemote(uintptr_t addr, uint8_t* buffer, size_t bytes) {
+  if (bytes >= kUncachedReadPages * page_size_) {
+    return ReadPages(addr, buffer, bytes);
+  }
+
+  size_t bytes_read = 0;
+  while (bytes > 0) {
+    uintptr_t page = addr & ~(page_size_ - 1);
+    size_t offset = addr - page;
+    size_t copy_bytes = MIN(page_size_ - offset, bytes);
+    const uint8_t* data = GetCachedPage(page);
+    if (data == nullptr) {
+      // Part of the page may still be readable.
+      return bytes_read + ReadPages(addr, buffer, bytes);
+    }
+    memcpy(buffer, data + offset, copy_bytes);
+    addr += copy_bytes;
+    buffer += copy_bytes;
+    bytes -= copy_bytes;
+    bytes_read += copy_bytes;
+  }
+  return bytes_read;
+}
+
+bool BacktracePtrace::ReadWord(uintptr_t ptr, word_t* out_value) {
+#if defined(__APPLE__)
+  BACK_LOGW("MacOS does not support reading from another pid.");
+  return false;
+#else
+  if (!VerifyReadWordArgs(ptr, out_value)) {
+    return false;
+  }
+
+  backtrace_map_t map;
+  FillInMap(ptr, &map);
+  if (!BacktraceMap::IsValid(map) || !(map.flags & PROT_READ)) {
+    return false;
+  }
+
+  return ReadRemote(ptr, reinterpret_cast<uint8_t*>(out_value), sizeof(word_t)) ==
+      sizeof(word_t);
+#endif
+}
+
+size_t BacktracePtrace::Read(uintptr_t addr, uint8_t* buffer, size_t bytes) {
+#if defined(__APPLE__)
+  BACK_LOGW("MacOS does not support reading from another pid.");
+  return 0;
+#else
+  backtrace_map_t map;
+  FillInMap(addr, &map);
+  if (!BacktraceMap::IsValid(map) || !(map.flags & PROT_READ)) {
+    return 0;
+  }
+
+  bytes = MIN(map.end - addr, bytes);
+  return ReadRemote(addr, buffer, bytes);
 #endif
 }
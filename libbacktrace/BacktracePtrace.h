@@ -20,18 +20,41 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <vector>
+
 #include <backtrace/Backtrace.h>
 
 class BacktraceMap;
 
 class BacktracePtrace : public Backtrace {
 public:
-  BacktracePtrace(pid_t pid, pid_t tid, BacktraceMap* map) : Backtrace(pid, tid, map) {}
+  BacktracePtrace(pid_t pid, pid_t tid, BacktraceMap* map);
   virtual ~BacktracePtrace() {}
 
   size_t Read(uintptr_t addr, uint8_t* buffer, size_t bytes);
 
   bool ReadWord(uintptr_t ptr, word_t* out_value);
+
+protected:
+  // Forgets the remote memory cached so far. The cache assumes memory does
+  // not change while the thread is stopped; call this when it may have run.
+  void ClearReadCache();
+
+private:
+  size_t ReadRemote(uintptr_t addr, uint8_t* buffer, size_t bytes);
+  size_t ReadPages(uintptr_t addr, uint8_t* buffer, size_t bytes);
+  const uint8_t* GetCachedPage(uintptr_t page);
+
+  struct CachedPage {
+    uintptr_t page;
+    bool valid;
+    std::vector<uint8_t> data;
+  };
+
+  size_t page_size_;
+  // Cleared if process_vm_readv() is unavailable, leaving only ptrace.
+  bool use_vm_readv_;
+  std::vector<CachedPage> cache_;
 };
 
 #endif // _LIBBACKTRACE_BACKTRACE_PTRACE_H
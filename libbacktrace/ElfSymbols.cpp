@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ElfSymbols.h"
+
+// The files read so far, never freed, as the maps of a process mostly keep
+// naming the same files.
+static std::mutex g_elf_symbols_lock;
+static std::unordered_map<std::string, std::shared_ptr<ElfSymbols>>* g_elf_symbols;
+
+std::shared_ptr<ElfSymbols> ElfSymbols::Get(const std::string& path) {
+  std::lock_guard<std::mutex> guard(g_elf_symbols_lock);
+  if (g_elf_symbols == nullptr) {
+    g_elf_symbols = new std::unordered_map<std::string, std::shared_ptr<ElfSymbols>>;
+  }
+
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1) {
+    return nullptr;
+  }
+  auto entry = g_elf_symbols->find(path);
+  if (entry != g_elf_symbols->end() && entry->second->dev_ == st.st_dev &&
+      entry->second->ino_ == st.st_ino && entry->second->mtime_ == st.st_mtime) {
+    return entry->second;
+  }
+
+  int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return nullptr;
+  }
+  std::shared_ptr<ElfSymbols> symbols(new ElfSymbols());
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      // A file that is not ELF, or is stripped, is remembered with no
+      // symbols, leaving its pcs to libunwind.
+      symbols->Read(reinterpret_cast<const uint8_t*>(data), st.st_size);
+      munmap(data, st.st_size);
+    }
+  }
+  close(fd);
+
+  symbols->dev_ = st.st_dev;
+  symbols->ino_ = st.st_ino;
+  symbols->mtime_ = st.st_mtime;
+  (*g_elf_symbols)[path] = symbols;
+  return symbols;
+}
+
+bool ElfSymbols::Read(const uint8_t* data, size_t size) {
+  if (size < EI_NIDENT || memcmp(data, ELFMAG, SELFMAG) != 0) {
+    return false;
+  }
+  if (data[EI_CLASS] == ELFCLASS32) {
+    return ReadElf<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Sym>(data, size);
+  }
+#if defined(__LP64__)
+  if (data[EI_CLASS] == ELFCLASS64) {
+    return ReadElf<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Sym>(data, size);
+  }
+#endif
+  return false;
+}
+
+static bool InFile(size_t size, uint64_t offset, uint64_t length) {
+  return offset <= size && length <= size - offset;
+}
+
+template <typename EhdrType, typename PhdrType, typename ShdrType, typename SymType>
+bool ElfSymbols::ReadElf(const uint8_t* data, size_t size) {
+  if (size < sizeof(EhdrType)) {
+    return false;
+  }
+  EhdrType ehdr;
+  memcpy(&ehdr, data, sizeof(ehdr));
+
+  if (ehdr.e_phentsize != sizeof(PhdrType) ||
+      !InFile(size, ehdr.e_phoff, static_cast<uint64_t>(ehdr.e_phnum) * sizeof(PhdrType))) {
+    return false;
+  }
+  for (size_t i = 0; i < ehdr.e_phnum; i++) {
+    PhdrType phdr;
+    memcpy(&phdr, data + ehdr.e_phoff + i * sizeof(PhdrType), sizeof(phdr));
+    if (phdr.p_type == PT_LOAD) {
+      segments_.push_back(LoadSegment{static_cast<uintptr_t>(phdr.p_offset),
+                                      static_cast<uintptr_t>(phdr.p_vaddr),
+                                      static_cast<uintptr_t>(phdr.p_filesz)});
+    }
+  }
+
+  if (ehdr.e_shentsize != sizeof(ShdrType) ||
+      !InFile(size, ehdr.e_shoff, static_cast<uint64_t>(ehdr.e_shnum) * sizeof(ShdrType))) {
+    return false;
+  }
+  const uint8_t* shdrs = data + ehdr.e_shoff;
+  for (size_t i = 0; i < ehdr.e_shnum; i++) {
+    ShdrType shdr;
+    memcpy(&shdr, shdrs + i * sizeof(ShdrType), sizeof(shdr));
+    if ((shdr.sh_type != SHT_SYMTAB && shdr.sh_type != SHT_DYNSYM) ||
+        shdr.sh_entsize != sizeof(SymType) || shdr.sh_link >= ehdr.e_shnum ||
+        !InFile(size, shdr.sh_offset, shdr.sh_size)) {
+      continue;
+    }
+    ShdrType strtab;
+    memcpy(&strtab, shdrs + shdr.sh_link * sizeof(ShdrType), sizeof(strtab));
+    if (!InFile(size, strtab.sh_offset, strtab.sh_size)) {
+      continue;
+    }
+    const char* strings = reinterpret_cast<const char*>(data + strtab.sh_offset);
+
+    for (size_t j = 0; j < shdr.sh_size / sizeof(SymType); j++) {
+      SymType sym;
+      memcpy(&sym, data + shdr.sh_offset + j * sizeof(SymType), sizeof(sym));
+      unsigned type = sym.st_info & 0xf;
+      if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF ||
+          sym.st_size == 0 || sym.st_name >= strtab.sh_size) {
+        continue;
+      }
+      size_t name_len = strnlen(strings + sym.st_name, strtab.sh_size - sym.st_name);
+      if (name_len == 0 || sym.st_name + name_len == strtab.sh_size) {
+        continue;
+      }
+
+      uintptr_t start = sym.st_value;
+      if (ehdr.e_machine == EM_ARM) {
+        // The low bit only marks Thumb code.
+        start &= ~static_cast<uintptr_t>(1);
+      }
+      symbols_.push_back(Symbol{start, start + static_cast<uintptr_t>(sym.st_size),
+                                names_.size()});
+      names_.append(strings + sym.st_name, name_len + 1);
+    }
+  }
+
+  // .dynsym repeats what .symtab has; keep the first of any duplicates.
+  std::stable_sort(symbols_.begin(), symbols_.end(), [](const Symbol& a, const Symbol& b) {
+    return a.start < b.start;
+  });
+  symbols_.erase(std::unique(symbols_.begin(), symbols_.end(),
+                             [](const Symbol& a, const Symbol& b) {
+                               return a.start == b.start && a.end == b.end;
+                             }),
+                 symbols_.end());
+  symbols_.shrink_to_fit();
+  return !symbols_.empty();
+}
+
+bool ElfSymbols::FindFunction(const backtrace_map_t& map, uintptr_t pc, std::string* name,
+                              uintptr_t* offset) const {
+  if (symbols_.empty() || pc < map.start || pc >= map.end) {
+    return false;
+  }
+
+  // From the pc's place in the file to its address in the symbol table.
+  uintptr_t file_offset = pc - map.start + map.offset;
+  uintptr_t vaddr = 0;
+  bool found = false;
+  for (const auto& segment : segments_) {
+    if (file_offset >= segment.offset && file_offset - segment.offset < segment.size) {
+      vaddr = file_offset - segment.offset + segment.vaddr;
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+
+  // The symbol starting last at or below vaddr, if it reaches that far.
+  auto it = std::upper_bound(symbols_.begin(), symbols_.end(), vaddr,
+                             [](uintptr_t addr, const Symbol& symbol) {
+                               return addr < symbol.start;
+                             });
+  if (it == symbols_.begin()) {
+    return false;
+  }
+  --it;
+  if (vaddr >= it->end) {
+    return false;
+  }
+  *name = &names_[it->name];
+  *offset = vaddr - it->start;
+  return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBBACKTRACE_ELF_SYMBOLS_H
+#define _LIBBACKTRACE_ELF_SYMBOLS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <backtrace/BacktraceMap.h>
+
+// The functions in the .symtab and .dynsym of an ELF file, sorted by
+// address so that a pc is named with a binary search.
+class ElfSymbols {
+public:
+  // Returns the symbols of the file at path, read the first time it is
+  // asked for and shared by the whole process after that. Returns nullptr
+  // if the file cannot be opened.
+  static std::shared_ptr<ElfSymbols> Get(const std::string& path);
+
+  // Names the function holding pc, which is in map, a mapping of this file.
+  bool FindFunction(const backtrace_map_t& map, uintptr_t pc, std::string* name,
+                    uintptr_t* offset) const;
+
+private:
+  ElfSymbols() = default;
+
+  bool Read(const uint8_t* data, size_t size);
+
+  template <typename EhdrType, typename PhdrType, typename ShdrType, typename SymType>
+  bool ReadElf(const uint8_t* data, size_t size);
+
+  struct Symbol {
+    uintptr_t start;
+    uintptr_t end;
+    // Into names_.
+    size_t name;
+  };
+
+  struct LoadSegment {
+    uintptr_t offset;
+    uintptr_t vaddr;
+    uintptr_t size;
+  };
+
+  std::vector<Symbol> symbols_;
+  std::string names_;
+  std::vector<LoadSegment> segments_;
+
+  // The file read, to notice it being replaced.
+  dev_t dev_ = 0;
+  ino_t ino_ = 0;
+  time_t mtime_ = 0;
+};
+
+#endif // _LIBBACKTRACE_ELF_SYMBOLS_H
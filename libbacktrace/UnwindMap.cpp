@@ -60,6 +60,7 @@ bool UnwindMap::GenerateMap() {
     maps_.push_front(map);
   }
 
+  BuildIndex();
   return true;
 }
 
@@ -105,10 +106,13 @@ bool UnwindMapLocal::GenerateMap() {
     }
     // Check to see if the map changed while getting the data.
     if (ret != -UNW_EINVAL) {
+      BuildIndex();
       return true;
     }
   }
 
+  // Keep the index in step with whatever was read.
+  BuildIndex();
   BACK_LOGW("Unable to generate the map.");
   return false;
 }
@@ -58,6 +58,9 @@ bool UnwindPtrace::Unwind(size_t num_ignore_frames, ucontext_t* ucontext) {
     return false;
   }
 
+  // The thread may have run since the last unwind.
+  ClearReadCache();
+
   addr_space_ = unw_create_addr_space(&_UPT_accessors, 0);
   if (!addr_space_) {
     BACK_LOGW("unw_create_addr_space failed.");
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <backtrace/Backtrace.h>
+#include <backtrace/BacktraceMap.h>
+
+#include "benchmark.h"
+
+// Number of made up maps added to those of the process, about what a large
+// app has.
+static constexpr size_t kSyntheticMaps = 5000;
+static constexpr size_t kPageSize = 4096;
+static constexpr int kUnwindDepth = 32;
+
+// The maps of this process, plus kSyntheticMaps one page maps in a hole
+// between them, parsed from /proc/<pid>/maps style text.
+class SyntheticMap : public BacktraceMap {
+ public:
+  SyntheticMap() : BacktraceMap(0) {}
+
+  bool Load() {
+    FILE* fp = fopen("/proc/self/maps", "r");
+    if (fp == nullptr) {
+      return false;
+    }
+    std::vector<std::string> lines;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+      lines.push_back(line);
+    }
+    fclose(fp);
+
+    for (const auto& text : lines) {
+      backtrace_map_t map;
+      if (ParseLine(text.c_str(), &map)) {
+        maps_.push_back(map);
+      }
+    }
+
+    // Below the stack, so that a scan in address order passes them all on
+    // the way to the stack.
+    uintptr_t stack = reinterpret_cast<uintptr_t>(&lines);
+    uintptr_t hole = 0;
+    uintptr_t hole_size = 0;
+    for (size_t i = 1; i < maps_.size() && maps_[i].start <= stack; i++) {
+      if (maps_[i].start - maps_[i - 1].end > hole_size) {
+        hole = maps_[i - 1].end;
+        hole_size = maps_[i].start - hole;
+      }
+    }
+    if (hole_size < 2 * kSyntheticMaps * kPageSize) {
+      return false;
+    }
+
+    for (size_t i = 0; i < kSyntheticMaps; i++) {
+      char text[128];
+      uintptr_t start = hole + 2 * i * kPageSize;
+      snprintf(text, sizeof(text), "%" PRIxPTR "-%" PRIxPTR " r--p 00000000 00:00 0   [anon:synthetic]\n",
+               start, start + kPageSize);
+      backtrace_map_t map;
+      if (ParseLine(text, &map)) {
+        maps_.push_back(map);
+      }
+    }
+    BuildIndex();
+    return true;
+  }
+
+  // What FillIn() did before the maps were indexed.
+  void FillInLinear(uintptr_t addr, backtrace_map_t* map) {
+    for (const auto& entry : maps_) {
+      if (addr >= entry.start && addr < entry.end) {
+        *map = entry;
+        return;
+      }
+    }
+    *map = {};
+  }
+};
+
+static SyntheticMap* GetSyntheticMap() {
+  static SyntheticMap* map;
+  if (map == nullptr) {
+    map = new SyntheticMap();
+    if (!map->Load()) {
+      fprintf(stderr, "Unable to build the synthetic map.\n");
+      exit(1);
+    }
+  }
+  return map;
+}
+
+// Addresses like those of a dumped stack: mostly the same few maps, with
+// some pointers into the code and heap maps around.
+static std::vector<uintptr_t> GetStackWords() {
+  std::vector<uintptr_t> words;
+  uintptr_t local = reinterpret_cast<uintptr_t>(&words);
+  uintptr_t code = reinterpret_cast<uintptr_t>(&GetStackWords);
+  uintptr_t heap = reinterpret_cast<uintptr_t>(GetSyntheticMap());
+  for (size_t i = 0; i < 256; i++) {
+    switch (i % 4) {
+      case 0: words.push_back(code + i); break;
+      case 1: words.push_back(heap); break;
+      default: words.push_back(local - i * sizeof(uintptr_t)); break;
+    }
+  }
+  return words;
+}
+
+static void BM_map_fill_in(int iters) {
+  SyntheticMap* map = GetSyntheticMap();
+  std::vector<uintptr_t> words = GetStackWords();
+  backtrace_map_t entry;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    map->FillIn(words[i % words.size()], &entry);
+  }
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_map_fill_in);
+
+static void BM_map_fill_in_linear(int iters) {
+  SyntheticMap* map = GetSyntheticMap();
+  std::vector<uintptr_t> words = GetStackWords();
+  backtrace_map_t entry;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    map->FillInLinear(words[i % words.size()], &entry);
+  }
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_map_fill_in_linear);
+
+static void BM_map_fill_in_random(int iters) {
+  SyntheticMap* map = GetSyntheticMap();
+  std::vector<uintptr_t> addrs;
+  for (auto it = map->begin(); it != map->end(); ++it) {
+    addrs.push_back(it->start);
+  }
+  backtrace_map_t entry;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    map->FillIn(addrs[(i * 7919) % addrs.size()], &entry);
+  }
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_map_fill_in_random);
+
+static int __attribute__((noinline)) Recurse(int depth, Backtrace* backtrace) {
+  if (depth == 0) {
+    return backtrace->Unwind(0) ? backtrace->NumFrames() : 0;
+  }
+  int frames = Recurse(depth - 1, backtrace);
+  // Keep the call from becoming a tail call.
+  __asm__ __volatile__("");
+  return frames;
+}
+
+static void BM_unwind_synthetic_map(int iters) {
+  SyntheticMap* map = GetSyntheticMap();
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map));
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    if (Recurse(kUnwindDepth, backtrace.get()) < kUnwindDepth) {
+      fprintf(stderr, "Unwind failed.\n");
+      exit(1);
+    }
+  }
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_unwind_synthetic_map);
+
+// Every 64th byte of libc's code, more pcs than the function names cache
+// holds, so that each lookup misses it.
+static std::vector<uintptr_t> GetCodePcs(BacktraceMap* map) {
+  backtrace_map_t code;
+  map->FillIn(reinterpret_cast<uintptr_t>(&strlen), &code);
+  std::vector<uintptr_t> pcs;
+  for (uintptr_t pc = code.start; pc < code.end && pcs.size() < 8192; pc += 64) {
+    pcs.push_back(pc);
+  }
+  return pcs;
+}
+
+static void FunctionNames(int iters, bool use_elf_symbols) {
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+  map->SetUseElfSymbols(use_elf_symbols);
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map.get()));
+  // libunwind names nothing before an unwind.
+  backtrace->Unwind(0);
+  std::vector<uintptr_t> pcs = GetCodePcs(map.get());
+  if (pcs.empty()) {
+    fprintf(stderr, "Unable to find libc's code.\n");
+    exit(1);
+  }
+  uintptr_t offset;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    backtrace->GetFunctionName(pcs[i % pcs.size()], &offset);
+  }
+  StopBenchmarkTiming();
+}
+
+static void BM_function_name_libunwind(int iters) {
+  FunctionNames(iters, false);
+}
+BENCHMARK(BM_function_name_libunwind);
+
+static void BM_function_name_elf_symbols(int iters) {
+  FunctionNames(iters, true);
+}
+BENCHMARK(BM_function_name_elf_symbols);
+
+// The same frames named over and over, as repeated CallStack captures do.
+static void BM_function_name_cached(int iters) {
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map.get()));
+  if (Recurse(kUnwindDepth, backtrace.get()) < kUnwindDepth) {
+    fprintf(stderr, "Unwind failed.\n");
+    exit(1);
+  }
+  uintptr_t offset;
+
+  StartBenchmarkTiming();
+  for (int i = 0; i < iters; i++) {
+    backtrace->GetFunctionName(backtrace->GetFrame(i % backtrace->NumFrames())->pc, &offset);
+  }
+  StopBenchmarkTiming();
+}
+BENCHMARK(BM_function_name_cached);
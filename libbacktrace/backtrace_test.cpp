@@ -289,6 +289,142 @@ TEST(libbacktrace, local_max_trace) {
   ASSERT_NE(test_recursive_call(MAX_BACKTRACE_FRAMES+10, VerifyMaxBacktrace, nullptr), 0);
 }
 
+void VerifyLevelElfSymbols(void*) {
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+  ASSERT_TRUE(map.get() != nullptr);
+  map->SetUseElfSymbols(true);
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map.get()));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+  ASSERT_TRUE(backtrace->Unwind(0));
+
+  VerifyLevelDump(backtrace.get());
+}
+
+TEST(libbacktrace, local_trace_elf_symbols) {
+  ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyLevelElfSymbols, nullptr), 0);
+}
+
+void VerifyFunctionNameCache(void*) {
+  std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+  ASSERT_TRUE(map.get() != nullptr);
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map.get()));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+  ASSERT_TRUE(backtrace->Unwind(0));
+  VerifyLevelDump(backtrace.get());
+
+  // The names come from the cache the second time, for this unwind and for
+  // another one sharing the map.
+  std::unique_ptr<Backtrace> other(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD, map.get()));
+  ASSERT_TRUE(other.get() != nullptr);
+  ASSERT_TRUE(other->Unwind(0));
+  for (Backtrace* bt : { backtrace.get(), other.get() }) {
+    for (const auto& frame : *backtrace) {
+      uintptr_t offset = 0;
+      ASSERT_EQ(frame.func_name, bt->GetFunctionName(frame.pc, &offset)) << DumpFrames(bt);
+      if (!frame.func_name.empty()) {
+        ASSERT_EQ(frame.func_offset, offset) << DumpFrames(bt);
+      }
+    }
+  }
+}
+
+TEST(libbacktrace, function_name_cache) {
+  ASSERT_NE(test_level_one(1, 2, 3, 4, VerifyFunctionNameCache, nullptr), 0);
+}
+
+// One map, built by hand rather than read from the process.
+class NameCacheMap : public BacktraceMap {
+ public:
+  NameCacheMap() : BacktraceMap(getpid()) {
+    backtrace_map_t map;
+    map.start = 0x100000;
+    map.end = 0x200000;
+    map.name = "fake";
+    maps_.push_back(map);
+    BuildIndex();
+  }
+
+  void Rebuild() { BuildIndex(); }
+};
+
+// Counts the lookups that get past the cache, where libunwind would be asked.
+class NameCountingBacktrace : public Backtrace {
+ public:
+  NameCountingBacktrace(BacktraceMap* map) : Backtrace(getpid(), gettid(), map) {}
+
+  bool Unwind(size_t, ucontext_t*) override { return false; }
+  bool ReadWord(uintptr_t, word_t*) override { return false; }
+  size_t Read(uintptr_t, uint8_t*, size_t) override { return 0; }
+
+  size_t raw_lookups = 0;
+
+ protected:
+  std::string GetFunctionNameRaw(uintptr_t pc, uintptr_t* offset) override {
+    raw_lookups++;
+    *offset = pc & 0xf;
+    // No name at all for odd pcs, as libunwind gives before an unwind.
+    return (pc & 1) ? "" : android::base::StringPrintf("func_%" PRIxPTR, pc);
+  }
+};
+
+TEST(libbacktrace, function_name_cache_hits) {
+  NameCacheMap map;
+  NameCountingBacktrace backtrace(&map);
+  NameCountingBacktrace other(&map);
+  uintptr_t offset;
+
+  ASSERT_EQ("func_100104", backtrace.GetFunctionName(0x100104, &offset));
+  ASSERT_EQ(4U, offset);
+  ASSERT_EQ(1U, backtrace.raw_lookups);
+
+  // Again, from this backtrace and from another sharing the map.
+  offset = 0;
+  ASSERT_EQ("func_100104", backtrace.GetFunctionName(0x100104, &offset));
+  ASSERT_EQ(4U, offset);
+  offset = 0;
+  ASSERT_EQ("func_100104", other.GetFunctionName(0x100104, &offset));
+  ASSERT_EQ(4U, offset);
+  ASSERT_EQ(1U, backtrace.raw_lookups);
+  ASSERT_EQ(0U, other.raw_lookups);
+
+  // An empty name is asked for every time.
+  ASSERT_EQ("", backtrace.GetFunctionName(0x100101, &offset));
+  ASSERT_EQ("", backtrace.GetFunctionName(0x100101, &offset));
+  ASSERT_EQ(3U, backtrace.raw_lookups);
+
+  // Rebuilding the maps forgets the names.
+  map.Rebuild();
+  ASSERT_EQ("func_100104", backtrace.GetFunctionName(0x100104, &offset));
+  ASSERT_EQ(4U, backtrace.raw_lookups);
+}
+
+TEST(libbacktrace, function_name_cache_limit) {
+  NameCacheMap map;
+  NameCountingBacktrace backtrace(&map);
+  uintptr_t offset;
+
+  // Fill the cache, all of it still hits.
+  static constexpr size_t kLimit = 4096;
+  for (size_t i = 0; i < kLimit; i++) {
+    backtrace.GetFunctionName(0x100000 + i * 0x10, &offset);
+  }
+  ASSERT_EQ(kLimit, backtrace.raw_lookups);
+  backtrace.GetFunctionName(0x100000, &offset);
+  backtrace.GetFunctionName(0x100000 + (kLimit - 1) * 0x10, &offset);
+  ASSERT_EQ(kLimit, backtrace.raw_lookups);
+
+  // One more name starts the cache over, with only that name in it.
+  backtrace.GetFunctionName(0x100000 + kLimit * 0x10, &offset);
+  ASSERT_EQ(kLimit + 1, backtrace.raw_lookups);
+  backtrace.GetFunctionName(0x100000 + kLimit * 0x10, &offset);
+  ASSERT_EQ(kLimit + 1, backtrace.raw_lookups);
+  backtrace.GetFunctionName(0x100000, &offset);
+  ASSERT_EQ(kLimit + 2, backtrace.raw_lookups);
+}
+
 void VerifyProcTest(pid_t pid, pid_t tid, bool share_map,
                     bool (*ReadyFunc)(Backtrace*),
                     void (*VerifyFunc)(Backtrace*)) {
@@ -754,6 +890,41 @@ TEST(libbacktrace, fillin_erases) {
   ASSERT_EQ("", map.name);
 }
 
+TEST(libbacktrace, fillin_matches_scan) {
+  std::unique_ptr<BacktraceMap> back_map(BacktraceMap::Create(getpid(), true));
+  ASSERT_TRUE(back_map.get() != nullptr);
+
+  // Every edge of every map, and the gaps between them, looked up in both
+  // directions so the last hit is of no help.
+  std::vector<uintptr_t> addrs;
+  for (const auto& entry : *back_map) {
+    addrs.push_back(entry.start - 1);
+    addrs.push_back(entry.start);
+    addrs.push_back(entry.end - 1);
+    addrs.push_back(entry.end);
+  }
+  addrs.insert(addrs.end(), addrs.rbegin(), addrs.rend());
+
+  for (uintptr_t addr : addrs) {
+    const backtrace_map_t* expected = nullptr;
+    for (const auto& entry : *back_map) {
+      if (addr >= entry.start && addr < entry.end) {
+        expected = &entry;
+        break;
+      }
+    }
+
+    backtrace_map_t map;
+    back_map->FillIn(addr, &map);
+    if (expected == nullptr) {
+      ASSERT_FALSE(BacktraceMap::IsValid(map)) << "addr " << std::hex << addr;
+    } else {
+      ASSERT_EQ(expected->start, map.start) << "addr " << std::hex << addr;
+      ASSERT_EQ(expected->name, map.name);
+    }
+  }
+}
+
 TEST(libbacktrace, format_test) {
   std::unique_ptr<Backtrace> backtrace(Backtrace::Create(getpid(), BACKTRACE_CURRENT_THREAD));
   ASSERT_TRUE(backtrace.get() != nullptr);
@@ -16,11 +16,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cutils/memory.h>
 #include <cutils/misc.h>
+#include <sys/stat.h>
 #include <sys/utsname.h>
 
 #define LOG_TAG "ProbeModule"
@@ -71,93 +76,6 @@ static void hyphen_to_underscore(char *str)
     }
 }
 
-/* Compare module names, but don't differentiate '_' and '-'.
- * return: 0 when s1 is matched to s2 or size is zero.
- *         non-zero in any other cases.
- */
-static int match_name(const char *s1, const char *s2, const size_t size)
-{
-    size_t i;
-
-    if (!size)
-        return 0;
-
-    for (i = 0; i < size; i++, s1++, s2++) {
-
-        if ((*s1 == '_' || *s1 == '-') && (*s2 == '_' || *s2 == '-'))
-            continue;
-
-        if (*s1 != *s2)
-            return -1;
-
-        if (*s1 == '\0')
-            return 0;
-    }
-
-    return 0;
-}
-
-/* check if a line in dep file is target module's dependency.
- * return 1 when it is, otherwise 0 in any other cases.
- */
-static int is_target_module(char *line, const char *target)
-{
-    char *token;
-    char name[PATH_MAX];
-    const char *suffix = ".ko";
-    const char *delimiter = ":";
-    int ret = 0;
-
-    /* search token */
-    token = strstr(line, delimiter);
-
-    if (!token) {
-        ALOGE("invalid line: no token\n");
-        return 0;
-    }
-
-    /* only take stuff before the token */
-    *token = '\0';
-
-    /* use "module.ko" in comparision */
-    strcat(strcpy(name, target), ".ko");
-
-    ret = !match_name(strip_path(line), name, strlen(name));
-
-    /* restore [single] token, keep line unchanged until we parse it later */
-    *token = *delimiter;
-
-    return ret;
-
-}
-
-/* turn a single string into an array of dependency.
- *
- * return: dependency array's address if it succeeded. Caller
- *         is responsible to free the array's memory.
- *         NULL when any error happens.
- */
-static char** setup_dep(char *line)
-{
-    char *tmp = line;
-    char *brk;
-    int i;
-    char **dep;
-
-    for (i = 2; (tmp = strchr(tmp, ' ')); i++)
-        tmp++;
-
-    dep = malloc(sizeof(char *) * i);
-    if (dep) {
-        i = 0;
-        do {
-            tmp = strtok_r(i ? NULL : line, ": ", &brk);
-        } while ((dep[i++] = tmp));
-    }
-
-    return dep;
-}
-
 static int insmod(const char *path_name, const char *args)
 {
     void *data;
@@ -269,68 +187,339 @@ static int rmmod_s(char *dep[], unsigned int flags)
     return ret;
 }
 
-/* look_up_dep() find and setup target module's dependency in modules.dep
+/* Parsed form of a modules.dep file, and also the layout of the cache
+ * kept next to it in modules.dep.bin: a header, the entries sorted by
+ * key, then the strings they point into.
  *
- * dep_file:    a pointer to module's dep file loaded in memory, its content
- *              will be CHANGED during parsing.
- *
- * return:      a pointer to an array which holds the dependency strings and
- *              terminated by a NULL pointer. Caller is responsible to free the
- *              array's memory.
- *
- *              non-zero in any other cases. Content of dep array is invalid.
+ * key : module name without path or ".ko", with '-' folded to '_'
+ * deps: ndeps nul terminated strings back to back, the line's own module
+ *       first, then its dependencies in modules.dep order
  */
-static char ** look_up_dep(const char *module_name, void *dep_file)
+#define DEP_INDEX_MAGIC     0x5044444d /* "MDDP" */
+#define DEP_INDEX_VERSION   1
+#define DEP_INDEX_SUFFIX    ".bin"
+
+struct dep_index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t dep_size;      /* of the modules.dep it was built from */
+    int64_t dep_mtime;
+    uint32_t count;
+    uint32_t strings_size;
+};
+
+struct dep_index_entry {
+    uint32_t key;           /* offsets into the strings */
+    uint32_t deps;
+    uint32_t ndeps;
+};
+
+#define DEP_INDEX_ENTRIES(h) ((struct dep_index_entry *)((h) + 1))
+#define DEP_INDEX_STRINGS(h) ((char *)(DEP_INDEX_ENTRIES(h) + (h)->count))
+
+/* The most recently used index, kept until its modules.dep changes */
+static pthread_mutex_t dep_index_lock = PTHREAD_MUTEX_INITIALIZER;
+static char dep_index_path[PATH_MAX];
+static struct dep_index_header *dep_index;
+
+static void make_key(char *key, const char *name)
 {
+    size_t len;
 
-    char *line;
-    char *saved_pos;
-    char *start;
-    int ret = -1;
-    char **dep = NULL;
+    strlcpy(key, strip_path((char *)name), PATH_MAX);
+    len = strlen(key);
+    if (len > 3 && !strcmp(key + len - 3, ".ko"))
+        key[len - 3] = '\0';
+    hyphen_to_underscore(key);
+}
+
+/* qsort() has no context argument, only used under dep_index_lock */
+static const char *sort_strings;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct dep_index_entry *ea = a;
+    const struct dep_index_entry *eb = b;
+    int ret = strcmp(sort_strings + ea->key, sort_strings + eb->key);
 
-    if (!dep_file || !module_name || *module_name == '\0')
+    /* deps offsets grow in file order, the first line for a key wins */
+    if (!ret)
+        ret = (ea->deps > eb->deps) - (ea->deps < eb->deps);
+    return ret;
+}
+
+/* build an index from the text of modules.dep, NULL on error */
+static struct dep_index_header *dep_index_parse(const char *path,
+                                                const struct stat *st)
+{
+    struct dep_index_header *header = NULL;
+    struct dep_index_entry *entries = NULL;
+    char *data, *line, *saved_line, *strings = NULL;
+    unsigned int len;
+    uint32_t count = 0, used = 0, i, kept;
+
+    data = load_file(path, &len);
+    if (!data)
         return NULL;
 
-    start = (char *)dep_file;
+    /* every key and token is shorter than the line text it came from */
+    entries = malloc(sizeof(*entries) * (len / 2 + 1));
+    strings = malloc(len * 2 + 2);
+    if (!entries || !strings)
+        goto out;
 
-    /* We expect modules.dep file has a new line char before EOF. */
-    while ((line = strtok_r(start, "\n", &saved_pos)) != NULL) {
+    for (line = strtok_r(data, "\n", &saved_line); line;
+            line = strtok_r(NULL, "\n", &saved_line)) {
+        char *token, *saved_token;
+        struct dep_index_entry *entry = &entries[count];
 
-        start = NULL;
+        if (!strchr(line, ':')) {
+            ALOGE("invalid line: no token\n");
+            continue;
+        }
 
-        if (is_target_module(line, module_name)) {
+        token = strtok_r(line, ": ", &saved_token);
+        if (!token)
+            continue;
 
-            dep = setup_dep(line);
-            /* job done */
-            break;
+        entry->key = used;
+        make_key(strings + used, token);
+        used += strlen(strings + used) + 1;
+
+        entry->deps = used;
+        entry->ndeps = 0;
+        for (; token; token = strtok_r(NULL, ": ", &saved_token)) {
+            strcpy(strings + used, token);
+            used += strlen(token) + 1;
+            entry->ndeps++;
         }
+        count++;
     }
 
-    return dep;
+    sort_strings = strings;
+    qsort(entries, count, sizeof(*entries), compare_entries);
+    for (i = 0, kept = 0; i < count; i++) {
+        if (kept && !strcmp(strings + entries[i].key,
+                            strings + entries[kept - 1].key))
+            continue;
+        entries[kept++] = entries[i];
+    }
+
+    header = malloc(sizeof(*header) + sizeof(*entries) * kept + used);
+    if (!header)
+        goto out;
+    header->magic = DEP_INDEX_MAGIC;
+    header->version = DEP_INDEX_VERSION;
+    header->dep_size = st->st_size;
+    header->dep_mtime = st->st_mtime;
+    header->count = kept;
+    header->strings_size = used;
+    memcpy(DEP_INDEX_ENTRIES(header), entries, sizeof(*entries) * kept);
+    memcpy(DEP_INDEX_STRINGS(header), strings, used);
+
+out:
+    free(strings);
+    free(entries);
+    free(data);
+    return header;
 }
 
-/* load_dep_file() load a dep file (usually it is modules.dep)
- * into memory. Caller is responsible to free the memory.
- *
- * file_name:   dep file's name, if it is NULL or an empty string,
- *              This function will try to load a dep file in the
- *              default path defined in LDM_DEFAULT_DEP_FILE
- *
- * return:      a pointer to the allocated mem which holds all
- *              content of the depfile. a zero pointer will be
- *              returned for any errors.
- * */
-static void *load_dep_file(const char *file_name)
+/* every string an entry points to lies within the strings, which end in a
+ * nul, and the keys are in the sorted order look_up_dep() searches in
+ */
+static int dep_index_valid(const struct dep_index_header *header)
+{
+    const struct dep_index_entry *entries = DEP_INDEX_ENTRIES(header);
+    const char *strings = DEP_INDEX_STRINGS(header);
+    uint32_t size = header->strings_size;
+    uint32_t i, j, offset;
+
+    if (!size || strings[size - 1])
+        return 0;
+
+    for (i = 0; i < header->count; i++) {
+        if ((entries[i].key >= size) || (entries[i].deps >= size)
+                || !entries[i].ndeps
+                || (entries[i].ndeps > size - entries[i].deps))
+            return 0;
+        if (i && (strcmp(strings + entries[i - 1].key,
+                         strings + entries[i].key) >= 0))
+            return 0;
+        for (j = 0, offset = entries[i].deps; j < entries[i].ndeps; j++) {
+            if (offset >= size)
+                return 0;
+            offset += strlen(strings + offset) + 1;
+        }
+    }
+    return 1;
+}
+
+/* load a modules.dep.bin built from st's version of modules.dep */
+static struct dep_index_header *dep_index_load(const char *path,
+                                               const struct stat *st)
 {
+    struct dep_index_header *header;
     unsigned int len;
+
+    header = load_file(path, &len);
+    if (!header)
+        return NULL;
+
+    if ((len < sizeof(*header))
+            || (header->magic != DEP_INDEX_MAGIC)
+            || (header->version != DEP_INDEX_VERSION)
+            || (header->dep_size != (uint64_t)st->st_size)
+            || (header->dep_mtime != (int64_t)st->st_mtime))
+        goto stale;
+
+    if ((header->count > len / sizeof(struct dep_index_entry))
+            || (header->strings_size > len)
+            || (len != sizeof(*header)
+                      + sizeof(struct dep_index_entry) * header->count
+                      + header->strings_size)
+            || !dep_index_valid(header)) {
+        ALOGE("ignoring corrupt %s\n", path);
+        goto stale;
+    }
+    return header;
+
+stale:
+    free(header);
+    return NULL;
+}
+
+/* best effort, modules usually live on a read-only partition */
+static void dep_index_save(const char *path, struct dep_index_header *header)
+{
+    char tmp[PATH_MAX];
+    size_t len = sizeof(*header) + sizeof(struct dep_index_entry) * header->count
+                 + header->strings_size;
+    int fd;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return;
+
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    if (write(fd, header, len) != (ssize_t)len) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    close(fd);
+    if (rename(tmp, path))
+        unlink(tmp);
+}
+
+/* Caller holds dep_index_lock */
+static struct dep_index_header *dep_index_get(const char *dep_name)
+{
     char def_mod_path[PATH_MAX];
-    if (!file_name || *file_name == '\0') {
-        file_name = get_default_mod_path(def_mod_path);
+    char bin_path[PATH_MAX];
+    struct stat st;
+
+    if (!dep_name || *dep_name == '\0') {
+        dep_name = get_default_mod_path(def_mod_path);
         strcat(def_mod_path, "modules.dep");
     }
 
-    return load_file(file_name, &len);
+    if (stat(dep_name, &st))
+        return NULL;
+
+    if (dep_index && !strcmp(dep_index_path, dep_name)
+            && (dep_index->dep_size == (uint64_t)st.st_size)
+            && (dep_index->dep_mtime == (int64_t)st.st_mtime))
+        return dep_index;
+
+    free(dep_index);
+    dep_index = NULL;
+
+    if (snprintf(bin_path, sizeof(bin_path), "%s%s", dep_name,
+                 DEP_INDEX_SUFFIX) >= (int)sizeof(bin_path))
+        return NULL;
+
+    dep_index = dep_index_load(bin_path, &st);
+    if (!dep_index) {
+        dep_index = dep_index_parse(dep_name, &st);
+        if (dep_index)
+            dep_index_save(bin_path, dep_index);
+    }
+    if (dep_index)
+        strlcpy(dep_index_path, dep_name, sizeof(dep_index_path));
+
+    return dep_index;
+}
+
+/* look_up_dep() find target module's dependency in modules.dep
+ *
+ * return:      a pointer to an array which holds the dependency strings,
+ *              the target first, and terminated by a NULL pointer. The
+ *              array and strings are a single allocation the caller is
+ *              responsible to free, and may modify.
+ *
+ *              NULL in any other cases.
+ */
+static char ** look_up_dep(const char *module_name, const char *dep_name)
+{
+    struct dep_index_header *header;
+    struct dep_index_entry *entries;
+    const char *strings;
+    char key[PATH_MAX];
+    char **dep = NULL;
+    uint32_t lo, hi;
+
+    if (!module_name || *module_name == '\0')
+        return NULL;
+
+    make_key(key, module_name);
+
+    pthread_mutex_lock(&dep_index_lock);
+
+    header = dep_index_get(dep_name);
+    if (!header) {
+        ALOGE("cannot load dep file : %s\n", dep_name);
+        goto out;
+    }
+
+    entries = DEP_INDEX_ENTRIES(header);
+    strings = DEP_INDEX_STRINGS(header);
+    lo = 0;
+    hi = header->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(key, strings + entries[mid].key);
+
+        if (cmp > 0) {
+            lo = mid + 1;
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            const char *src = strings + entries[mid].deps;
+            const char *end = src;
+            char *dst;
+            uint32_t i;
+
+            for (i = 0; i < entries[mid].ndeps; i++)
+                end += strlen(end) + 1;
+
+            dep = malloc(sizeof(char *) * (entries[mid].ndeps + 1) + (end - src));
+            if (!dep)
+                break;
+            dst = (char *)(dep + entries[mid].ndeps + 1);
+            memcpy(dst, src, end - src);
+            for (i = 0; i < entries[mid].ndeps; i++) {
+                dep[i] = dst;
+                dst += strlen(dst) + 1;
+            }
+            dep[i] = NULL;
+            break;
+        }
+    }
+
+out:
+    pthread_mutex_unlock(&dep_index_lock);
+    return dep;
 }
 
 /* insmod_by_dep() interface to outside,
@@ -342,7 +531,6 @@ int insmod_by_dep(const char *module_name,
         int strip,
         const char *base)
 {
-    void *dep_file;
     char **dep = NULL;
     int ret = -1;
 
@@ -351,27 +539,17 @@ int insmod_by_dep(const char *module_name,
         return ret;
     }
 
-    dep_file = load_dep_file(dep_name);
-
-    if (!dep_file) {
-        ALOGE("cannot load dep file : %s\n", dep_name);
-        return ret;
-    }
-
-    dep = look_up_dep(module_name, dep_file);
+    dep = look_up_dep(module_name, dep_name);
 
     if (!dep) {
         ALOGE("%s: cannot load module: [%s]\n", __FUNCTION__, module_name);
-        goto free_file;
+        return ret;
     }
 
     ret = insmod_s(dep, args, strip, base);
 
     free(dep);
 
-free_file:
-    free(dep_file);
-
     return ret;
 
 }
@@ -382,7 +560,6 @@ free_file:
 int rmmod_by_dep(const char *module_name,
         const char *dep_name)
 {
-    void *dep_file;
     char **dep = NULL;
     int ret = -1;
 
@@ -391,28 +568,268 @@ int rmmod_by_dep(const char *module_name,
         return ret;
     }
 
-    dep_file = load_dep_file(dep_name);
-
-    if (!dep_file) {
-        ALOGE("cannot load dep file : %s\n", dep_name);
-        return ret;
-    }
-
-    dep = look_up_dep(module_name, dep_file);
+    dep = look_up_dep(module_name, dep_name);
 
     if (!dep) {
         ALOGE("%s: cannot remove module: [%s]\n", __FUNCTION__, module_name);
-        goto free_file;
+        return ret;
     }
 
     ret = rmmod_s(dep, O_NONBLOCK);
 
     free(dep);
 
-free_file:
-    free(dep_file);
-
     return ret;
 }
 
+/* A module of an insmod_batch_by_dep() call, with the modules that
+ * list it as a dependency.
+ */
+struct batch_module {
+    char **dep;             /* own modules.dep line, from look_up_dep() */
+    int pending;            /* dependencies not inserted yet */
+    int done;
+    int failed;
+    int *dependents;
+    int ndependents;
+};
+
+struct batch {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct batch_module *modules;
+    int count;
+    int *ready;
+    int nready;
+    int running;
+    const char *base_dir;
+    int strip;
+};
+
+static int batch_find(struct batch *b, const char *path)
+{
+    int i;
+
+    for (i = 0; i < b->count; i++) {
+        if (!strcmp(b->modules[i].dep[0], path))
+            return i;
+    }
+    return -1;
+}
+
+/* takes ownership of dep, returns the index of its module or -1 */
+static int batch_add(struct batch *b, char **dep, int *capacity)
+{
+    struct batch_module *m;
+    int i = batch_find(b, dep[0]);
+
+    if (i >= 0) {
+        free(dep);
+        return i;
+    }
+
+    if (b->count == *capacity) {
+        int n = *capacity ? *capacity * 2 : 16;
+        m = realloc(b->modules, sizeof(*m) * n);
+        if (!m) {
+            free(dep);
+            return -1;
+        }
+        b->modules = m;
+        *capacity = n;
+    }
+
+    m = &b->modules[b->count];
+    memset(m, 0, sizeof(*m));
+    m->dep = dep;
+    return b->count++;
+}
+
+/* a dependency without its own line in modules.dep is given the rest of
+ * the line that named it, the chain insmod_s() would load it with
+ */
+static char **batch_tail(char * const *tail)
+{
+    size_t size = 0;
+    char **dep;
+    char *str;
+    int n, i;
+
+    for (n = 0; tail[n]; n++)
+        size += strlen(tail[n]) + 1;
+
+    dep = malloc(sizeof(char *) * (n + 1) + size);
+    if (!dep)
+        return NULL;
+
+    str = (char *)(dep + n + 1);
+    for (i = 0; i < n; i++) {
+        dep[i] = strcpy(str, tail[i]);
+        str += strlen(str) + 1;
+    }
+    dep[n] = NULL;
+    return dep;
+}
+
+static void *batch_worker(void *arg)
+{
+    struct batch *b = arg;
+    char path_name[PATH_MAX];
+    size_t len = strlen(strcpy(path_name, b->base_dir));
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+        struct batch_module *m;
+        int failed;
+        int i;
+
+        while (!b->nready && b->running)
+            pthread_cond_wait(&b->cond, &b->lock);
+        /* done, or whatever is left waits on a dependency cycle */
+        if (!b->nready)
+            break;
+
+        m = &b->modules[b->ready[--b->nready]];
+        failed = m->failed;
+        b->running++;
+        pthread_mutex_unlock(&b->lock);
+
+        if (!failed) {
+            strlcpy(path_name + len, b->strip ? strip_path(m->dep[0]) : m->dep[0],
+                    sizeof(path_name) - len);
+            failed = insmod(path_name, "");
+        }
+
+        pthread_mutex_lock(&b->lock);
+        b->running--;
+        m->done = 1;
+        m->failed = failed;
+        for (i = 0; i < m->ndependents; i++) {
+            struct batch_module *d = &b->modules[m->dependents[i]];
+            if (failed)
+                d->failed = 1;
+            if (!--d->pending)
+                b->ready[b->nready++] = m->dependents[i];
+        }
+        pthread_cond_broadcast(&b->cond);
+    }
+    pthread_cond_broadcast(&b->cond);
+    pthread_mutex_unlock(&b->lock);
+
+    return NULL;
+}
+
+/* insmod_batch_by_dep() interface to outside,
+ * refer to its description in probe_module.h
+ */
+int insmod_batch_by_dep(const char * const *module_names,
+        int count,
+        const char *dep_name,
+        int strip,
+        const char *base,
+        int max_threads)
+{
+    struct batch b;
+    char def_mod_path[PATH_MAX];
+    pthread_t *threads = NULL;
+    int *targets = NULL;
+    int capacity = 0;
+    int nthreads = 0;
+    int failures = 0;
+    int i, j;
+
+    memset(&b, 0, sizeof(b));
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+    b.strip = strip;
+    b.base_dir = (base && strlen(base)) ? base : get_default_mod_path(def_mod_path);
+
+    targets = malloc(sizeof(int) * (count > 0 ? count : 1));
+    if (!targets) {
+        failures = count;
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        char **dep = look_up_dep(module_names[i], dep_name);
+
+        targets[i] = dep ? batch_add(&b, dep, &capacity) : -1;
+        if (targets[i] < 0)
+            ALOGE("%s: cannot load module: [%s]\n", __FUNCTION__, module_names[i]);
+    }
+
+    /* pull in every dependency with its own line, growing b.count */
+    for (i = 0; i < b.count; i++) {
+        for (j = 1; b.modules[i].dep[j]; j++) {
+            char **dep = look_up_dep(b.modules[i].dep[j], dep_name);
+            struct batch_module *d;
+            int *dependents;
+            int k;
+
+            if (!dep || strcmp(dep[0], b.modules[i].dep[j])) {
+                free(dep);
+                dep = batch_tail(&b.modules[i].dep[j]);
+            }
+            k = dep ? batch_add(&b, dep, &capacity) : -1;
+            if (k < 0 || k == i) {
+                b.modules[i].failed |= k < 0;
+                continue;
+            }
+
+            d = &b.modules[k];
+            dependents = realloc(d->dependents, sizeof(int) * (d->ndependents + 1));
+            if (!dependents) {
+                b.modules[i].failed = 1;
+                continue;
+            }
+            d->dependents = dependents;
+            d->dependents[d->ndependents++] = i;
+            b.modules[i].pending++;
+        }
+    }
+
+    b.ready = malloc(sizeof(int) * (b.count ? b.count : 1));
+    if (!b.ready) {
+        failures = count;
+        goto out;
+    }
+    for (i = 0; i < b.count; i++) {
+        if (!b.modules[i].pending)
+            b.ready[b.nready++] = i;
+    }
+
+    if (max_threads > b.count)
+        max_threads = b.count;
+    if (max_threads > 1)
+        threads = malloc(sizeof(pthread_t) * (max_threads - 1));
+    for (i = 0; threads && i < max_threads - 1; i++) {
+        if (pthread_create(&threads[nthreads], NULL, batch_worker, &b))
+            break;
+        nthreads++;
+    }
+    batch_worker(&b);
+    for (i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < count; i++) {
+        if (targets[i] < 0 || !b.modules[targets[i]].done
+                || b.modules[targets[i]].failed)
+            failures++;
+    }
+
+out:
+    for (i = 0; i < b.count; i++) {
+        free(b.modules[i].dep);
+        free(b.modules[i].dependents);
+    }
+    free(b.modules);
+    free(b.ready);
+    free(threads);
+    free(targets);
+    pthread_cond_destroy(&b.cond);
+    pthread_mutex_destroy(&b.lock);
+
+    return failures;
+}
+
 /* end of file */
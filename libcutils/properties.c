@@ -28,6 +28,8 @@
 #include <cutils/properties.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <log/log.h>
 
 int8_t property_get_bool(const char *key, int8_t default_value) {
@@ -106,6 +108,7 @@ int32_t property_get_int32(const char *key, int32_t default_value) {
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
+#include <private/android_property_batch.h>
 
 int property_set(const char *key, const char *value)
 {
@@ -154,3 +157,153 @@ int property_list(
     struct property_list_callback_data data = { propfn, cookie };
     return __system_property_foreach(property_list_callback, &data);
 }
+
+#define PROPERTY_BATCH_TIMEOUT_MS 2000
+
+struct property_batch {
+    int fd; /* -1 once init cannot be used, properties are set one by one */
+    struct prop_batch_header header;
+    struct prop_batch_item items[PROP_BATCH_MAX];
+};
+
+static int property_batch_io(int fd, void *buf, size_t len, bool out)
+{
+    char *p = buf;
+
+    while (len) {
+        struct pollfd pfd;
+        ssize_t r;
+
+        pfd.fd = fd;
+        pfd.events = out ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        r = TEMP_FAILURE_RETRY(poll(&pfd, 1, PROPERTY_BATCH_TIMEOUT_MS));
+        if (r <= 0) {
+            return r ? -errno : -ETIMEDOUT;
+        }
+        r = out ? TEMP_FAILURE_RETRY(send(fd, p, len, MSG_NOSIGNAL))
+                : TEMP_FAILURE_RETRY(recv(fd, p, len, 0));
+        if (r <= 0) {
+            return r ? -errno : -EPIPE;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+struct property_batch *property_batch_open(void)
+{
+    struct property_batch *batch = calloc(1, sizeof(*batch));
+    prop_msg msg;
+    uint32_t version;
+
+    if (!batch) {
+        return NULL;
+    }
+
+    batch->fd = socket_local_client(PROP_SERVICE_NAME,
+            ANDROID_SOCKET_NAMESPACE_RESERVED, SOCK_STREAM);
+    if (batch->fd < 0) {
+        return batch;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.cmd = PROP_MSG_BATCH | PROP_BATCH_VERSION;
+    if (property_batch_io(batch->fd, &msg, sizeof(msg), true) ||
+            property_batch_io(batch->fd, &version, sizeof(version), false) ||
+            version != PROP_BATCH_VERSION) {
+        close(batch->fd);
+        batch->fd = -1;
+    }
+    return batch;
+}
+
+/* Sends up to PROP_BATCH_MAX properties, returns -EPIPE when init did
+ * not get them and they still need to be set.
+ */
+static int property_batch_send(struct property_batch *batch,
+        const char * const *keys, const char * const *values, int count,
+        int32_t *results)
+{
+    struct prop_batch_item *item;
+    size_t len;
+    int i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        item = &batch->items[i];
+        memset(item, 0, sizeof(*item));
+        strlcpy(item->name, keys[i], sizeof(item->name));
+        strlcpy(item->value, values[i], sizeof(item->value));
+    }
+    batch->header.count = count;
+    len = sizeof(batch->header) + sizeof(batch->items[0]) * count;
+
+    if (property_batch_io(batch->fd, &batch->header, len, true)) {
+        return -EPIPE;
+    }
+    ret = property_batch_io(batch->fd, results, sizeof(results[0]) * count, false);
+    return ret == -EPIPE ? -EIO : ret;
+}
+
+int property_batch_set(struct property_batch *batch, const char * const *keys,
+        const char * const *values, int count, int *results)
+{
+    int32_t chunk_results[PROP_BATCH_MAX];
+    int ret = 0;
+    int done;
+    int i;
+
+    for (done = 0; done < count; done += i) {
+        int n = count - done < PROP_BATCH_MAX ? count - done : PROP_BATCH_MAX;
+        int chunk_ret = -EPIPE;
+
+        /* properties the service would reject are kept out of the batch */
+        for (i = 0; i < n; i++) {
+            if (!keys[done + i] || strlen(keys[done + i]) >= PROP_NAME_MAX ||
+                    !values[done + i] || strlen(values[done + i]) >= PROP_VALUE_MAX) {
+                break;
+            }
+        }
+        if (i == 0) {
+            if (results) {
+                results[done] = -EINVAL;
+            }
+            ret = -1;
+            i = 1;
+            continue;
+        }
+
+        if (batch->fd >= 0) {
+            chunk_ret = property_batch_send(batch, keys + done, values + done, i,
+                    chunk_results);
+            if (chunk_ret) {
+                close(batch->fd);
+                batch->fd = -1;
+            }
+        }
+        for (n = 0; n < i; n++) {
+            int r = chunk_ret == -EPIPE ?
+                    property_set(keys[done + n], values[done + n]) :
+                    chunk_ret ? chunk_ret : chunk_results[n];
+            if (results) {
+                results[done + n] = r;
+            }
+            if (r) {
+                ret = -1;
+            }
+        }
+    }
+    return ret;
+}
+
+void property_batch_close(struct property_batch *batch)
+{
+    if (batch) {
+        if (batch->fd >= 0) {
+            close(batch->fd);
+        }
+        free(batch);
+    }
+}
@@ -20,6 +20,7 @@ test_src_files := \
 test_target_only_src_files := \
     MemsetTest.cpp \
     PropertiesTest.cpp \
+    probe_module_test.cpp \
 
 test_libraries := libcutils liblog
 
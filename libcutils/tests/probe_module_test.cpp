@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <cutils/probe_module.h>
+#include <gtest/gtest.h>
+
+// Stands in for the system call, each test module's file holds its name
+static pthread_mutex_t loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<std::string> loaded;
+static std::set<std::string> failing;
+
+extern "C" int init_module(void *data, unsigned long len, const char *) {
+    std::string name(static_cast<char *>(data), len);
+
+    pthread_mutex_lock(&loaded_lock);
+    bool fail = failing.count(name);
+    if (!fail) {
+        loaded.push_back(name);
+    }
+    pthread_mutex_unlock(&loaded_lock);
+
+    errno = fail ? EIO : 0;
+    return fail ? -1 : 0;
+}
+
+extern "C" int delete_module(const char *, unsigned int) {
+    return 0;
+}
+
+static const char dep_text[] =
+    "kernel/drivers/a.ko: kernel/drivers/b.ko kernel/lib/c.ko\n"
+    "kernel/drivers/b.ko: kernel/lib/c.ko\n"
+    "kernel/lib/c.ko:\n"
+    "kernel/drivers/d.ko:\n"
+    "kernel/drivers/e-f.ko: kernel/lib/c.ko\n";
+
+static const char * const module_files[] = { "a", "b", "c", "d", "e-f" };
+
+// Header (32 bytes), then 12 byte entries of key, deps and ndeps offsets
+static const off_t first_entry = 32;
+static const off_t entry_size = 12;
+
+class probe_module : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/data/local/tmp/probe_module.XXXXXX";
+    char host_dir[] = "/tmp/probe_module.XXXXXX";
+    dir_ = mkdtemp(dir) ?: mkdtemp(host_dir);
+    ASSERT_FALSE(dir_.empty());
+    base_ = dir_ + "/";
+    dep_ = base_ + "modules.dep";
+    bin_ = dep_ + ".bin";
+
+    Write(dep_, dep_text);
+    for (size_t i = 0; i < sizeof(module_files) / sizeof(module_files[0]); ++i) {
+      Write(base_ + module_files[i] + ".ko", module_files[i]);
+    }
+
+    loaded.clear();
+    failing.clear();
+  }
+
+  void TearDown() override {
+    unlink(dep_.c_str());
+    unlink(bin_.c_str());
+    unlink((base_ + "other.dep").c_str());
+    unlink((base_ + "other.dep.bin").c_str());
+    for (size_t i = 0; i < sizeof(module_files) / sizeof(module_files[0]); ++i) {
+      unlink((base_ + module_files[i] + ".ko").c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  static void Write(const std::string &path, const std::string &text) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ASSERT_LE(0, fd);
+    ASSERT_EQ(static_cast<ssize_t>(text.size()), write(fd, text.data(), text.size()));
+    close(fd);
+  }
+
+  static std::string Read(const std::string &path) {
+    std::string text;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    char buf[256];
+    ssize_t len;
+    while (fd >= 0 && (len = read(fd, buf, sizeof(buf))) > 0) {
+      text.append(buf, len);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+    return text;
+  }
+
+  // Replaces the index cached in the process by another modules.dep's,
+  // so that the next look up of dep_ loads its modules.dep.bin again
+  void Forget() {
+    std::string other = base_ + "other.dep";
+    Write(other, "kernel/drivers/d.ko:\n");
+    ASSERT_EQ(0, insmod_by_dep("d", "", other.c_str(), 1, base_.c_str()));
+  }
+
+  size_t Position(const std::string &name) {
+    return std::find(loaded.begin(), loaded.end(), name) - loaded.begin();
+  }
+
+  std::string dir_;
+  std::string base_;
+  std::string dep_;
+  std::string bin_;
+};
+
+TEST_F(probe_module, insmod_by_dep) {
+  ASSERT_EQ(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str()));
+  std::vector<std::string> expect = { "c", "b", "a" };
+  EXPECT_EQ(expect, loaded);
+
+  // modules.ko names and hyphens match the underscored module names
+  loaded.clear();
+  ASSERT_EQ(0, insmod_by_dep("e_f.ko", "", dep_.c_str(), 1, base_.c_str()));
+  expect = { "c", "e-f" };
+  EXPECT_EQ(expect, loaded);
+
+  EXPECT_NE(0, insmod_by_dep("missing", "", dep_.c_str(), 1, base_.c_str()));
+
+  // a failing dependency stops the chain
+  loaded.clear();
+  failing.insert("b");
+  EXPECT_NE(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str()));
+  expect = { "c" };
+  EXPECT_EQ(expect, loaded);
+}
+
+TEST_F(probe_module, index_cache) {
+  ASSERT_EQ(0, insmod_by_dep("b", "", dep_.c_str(), 1, base_.c_str()));
+  std::string index = Read(bin_);
+  ASSERT_LT(static_cast<size_t>(first_entry + 5 * entry_size), index.size());
+
+  // the saved index is used as is
+  Forget();
+  loaded.clear();
+  ASSERT_EQ(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str()));
+  std::vector<std::string> expect = { "c", "b", "a" };
+  EXPECT_EQ(expect, loaded);
+  EXPECT_EQ(index, Read(bin_));
+
+  // and rebuilt once modules.dep changes
+  Write(dep_, std::string(dep_text) + "kernel/drivers/g.ko: kernel/lib/c.ko\n");
+  struct timespec times[2] = { { 0, UTIME_OMIT }, { time(NULL) + 10, 0 } };
+  ASSERT_EQ(0, utimensat(AT_FDCWD, dep_.c_str(), times, 0));
+  Forget();
+  loaded.clear();
+  ASSERT_EQ(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str()));
+  EXPECT_EQ(expect, loaded);
+  EXPECT_NE(index, Read(bin_));
+}
+
+TEST_F(probe_module, corrupt_index) {
+  ASSERT_EQ(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str()));
+  std::string index = Read(bin_);
+  ASSERT_LT(static_cast<size_t>(first_entry + 5 * entry_size), index.size());
+
+  struct corruption {
+    off_t offset;
+    uint32_t value;
+  };
+  static const corruption corruptions[] = {
+    { first_entry + 8, 0xFFFFFFFF },                // ndeps
+    { first_entry + 8, 0x7FFFFFFF },
+    { first_entry + 8, 100 },                       // walks off the strings
+    { first_entry + 8, 0 },
+    { first_entry + 4, 0xFFFFFFF0 },                // deps
+    { first_entry, 0xFFFFFFF0 },                    // key
+    { first_entry + entry_size, 0 },                // keys out of order
+    { 28, 0xFFFFFFF0 },                             // strings_size
+    { 24, 0xFFFFFFF0 },                             // count
+  };
+
+  for (size_t i = 0; i < sizeof(corruptions) / sizeof(corruptions[0]); ++i) {
+    std::string bad(index);
+    memcpy(&bad[corruptions[i].offset], &corruptions[i].value,
+           sizeof(corruptions[i].value));
+    Write(bin_, bad);
+
+    // modules.dep is parsed again, and the index saved over the corrupt one
+    Forget();
+    loaded.clear();
+    ASSERT_EQ(0, insmod_by_dep("a", "", dep_.c_str(), 1, base_.c_str())) << i;
+    std::vector<std::string> expect = { "c", "b", "a" };
+    EXPECT_EQ(expect, loaded) << i;
+    EXPECT_EQ(index, Read(bin_)) << i;
+  }
+}
+
+TEST_F(probe_module, insmod_batch_by_dep) {
+  static const char * const names[] = { "a", "d", "e-f", "b" };
+
+  for (int threads = 1; threads <= 4; threads *= 2) {
+    loaded.clear();
+    ASSERT_EQ(0, insmod_batch_by_dep(names, 4, dep_.c_str(), 1, base_.c_str(),
+                                     threads)) << threads;
+
+    // every module once, dependencies first
+    std::vector<std::string> sorted(loaded);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<std::string> expect = { "a", "b", "c", "d", "e-f" };
+    EXPECT_EQ(expect, sorted) << threads;
+    EXPECT_LT(Position("c"), Position("b")) << threads;
+    EXPECT_LT(Position("b"), Position("a")) << threads;
+    EXPECT_LT(Position("c"), Position("e-f")) << threads;
+  }
+}
+
+TEST_F(probe_module, insmod_batch_by_dep_failure) {
+  static const char * const names[] = { "a", "d", "e-f", "missing" };
+
+  // a fails with its dependency b, the unknown module counts as failed
+  failing.insert("b");
+  EXPECT_EQ(2, insmod_batch_by_dep(names, 4, dep_.c_str(), 1, base_.c_str(), 4));
+  EXPECT_EQ(loaded.size(), Position("a"));
+  EXPECT_EQ(loaded.size(), Position("b"));
+  EXPECT_LT(Position("c"), Position("e-f"));
+  EXPECT_GT(loaded.size(), Position("d"));
+
+  // a shared dependency failing takes down every target using it
+  loaded.clear();
+  failing.clear();
+  failing.insert("c");
+  EXPECT_EQ(3, insmod_batch_by_dep(names, 4, dep_.c_str(), 1, base_.c_str(), 4));
+  std::vector<std::string> expect = { "d" };
+  EXPECT_EQ(expect, loaded);
+}
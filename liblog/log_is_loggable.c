@@ -16,6 +16,7 @@
 
 #include <ctype.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
@@ -51,113 +52,204 @@ static void refresh_cache(struct cache *cache, const char *key)
 
 static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 
-static int __android_log_level(const char *tag, int def)
+/*
+ * Per-tag cache of the resolved property character, open addressed and
+ * never freed so readers can walk it without holding the lock. Each
+ * entry packs the property area serial it was resolved against into the
+ * upper half of state, and the character in the lower half. Any property
+ * change bumps the area serial and invalidates every entry at once.
+ */
+#define TAG_CACHE_SIZE 512 /* power of two */
+#define TAG_CACHE_PROBE 32
+
+struct tag_cache {
+    atomic_uint_least64_t state;
+    uint32_t hash;
+    struct cache cache[2]; /* persist.log.tag.<tag>, log.tag.<tag> */
+    char tag[];
+};
+
+static struct tag_cache *_Atomic tag_caches[TAG_CACHE_SIZE];
+static struct cache global_cache[2] = {
+    { NULL, -1, 0 },
+    { NULL, -1, 0 }
+};
+static uint32_t global_serial = -1;
+
+static uint32_t tag_hash(const char *tag, size_t taglen)
+{
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < taglen; ++i) {
+        hash = (hash ^ (unsigned char)tag[i]) * 16777619U;
+    }
+    return hash;
+}
+
+static int valid_level(char c)
+{
+    switch (toupper(c)) {
+    case 'V':
+    case 'D':
+    case 'I':
+    case 'W':
+    case 'E':
+    case 'F': /* Not officially supported */
+    case 'A':
+    case 'S':
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Priorities are:
+ *    log.tag.<tag>
+ *    persist.log.tag.<tag>
+ *    log.tag
+ *    persist.log.tag
+ * Where the missing tag matches all tags and becomes the
+ * system global default. We do not support ro.log.tag* .
+ * Caller holds lock, entry may be NULL if the table is full.
+ */
+static char refresh_level_locked(struct tag_cache *entry, const char *tag,
+                                 size_t taglen, uint32_t serial)
 {
     /* sizeof() is used on this array below */
     static const char log_namespace[] = "persist.log.tag.";
     static const size_t base_offset = 8; /* skip "persist." */
-    /* calculate the size of our key temporary buffer */
-    const size_t taglen = (tag && *tag) ? strlen(tag) : 0;
     /* sizeof(log_namespace) = strlen(log_namespace) + 1 */
     char key[sizeof(log_namespace) + taglen];
-    char *kp;
-    size_t i;
-    char c = 0;
-    /*
-     * Single layer cache of four properties. Priorities are:
-     *    log.tag.<tag>
-     *    persist.log.tag.<tag>
-     *    log.tag
-     *    persist.log.tag
-     * Where the missing tag matches all tags and becomes the
-     * system global default. We do not support ro.log.tag* .
-     */
-    static char *last_tag;
-    static uint32_t global_serial;
-    uint32_t current_global_serial;
-    static struct cache tag_cache[2] = {
-        { NULL, -1, 0 },
-        { NULL, -1, 0 }
-    };
-    static struct cache global_cache[2] = {
+    struct cache uncached[2] = {
         { NULL, -1, 0 },
         { NULL, -1, 0 }
     };
+    struct cache *cache = entry ? entry->cache : uncached;
+    char *kp;
+    size_t i;
+    char c = 0;
 
     strcpy(key, log_namespace);
 
-    pthread_mutex_lock(&lock);
-
-    current_global_serial = __system_property_area_serial();
-
     if (taglen) {
-        uint32_t current_local_serial = current_global_serial;
-
-        if (!last_tag || (last_tag[0] != tag[0]) || strcmp(last_tag + 1, tag + 1)) {
-            /* invalidate log.tag.<tag> cache */
-            for(i = 0; i < (sizeof(tag_cache) / sizeof(tag_cache[0])); ++i) {
-                tag_cache[i].pinfo = NULL;
-                tag_cache[i].serial = -1;
-                tag_cache[i].c = '\0';
-            }
-            free(last_tag);
-            last_tag = NULL;
-            current_global_serial = -1;
-        }
-        if (!last_tag) {
-            last_tag = strdup(tag);
-        }
         strcpy(key + sizeof(log_namespace) - 1, tag);
 
         kp = key;
-        for(i = 0; i < (sizeof(tag_cache) / sizeof(tag_cache[0])); ++i) {
-            if (current_local_serial != global_serial) {
-                refresh_cache(&tag_cache[i], kp);
-            }
-
-            if (tag_cache[i].c) {
-                c = tag_cache[i].c;
+        for (i = 0; i < 2; ++i) {
+            refresh_cache(&cache[i], kp);
+            if (cache[i].c) {
+                c = cache[i].c;
                 break;
             }
-
             kp = key + base_offset;
         }
     }
 
-    switch (toupper(c)) { /* if invalid, resort to global */
-    case 'V':
-    case 'D':
-    case 'I':
-    case 'W':
-    case 'E':
-    case 'F': /* Not officially supported */
-    case 'A':
-    case 'S':
-        break;
-    default:
+    if (!valid_level(c)) { /* if invalid, resort to global */
         /* clear '.' after log.tag */
         key[sizeof(log_namespace) - 2] = '\0';
 
+        c = 0;
         kp = key;
-        for(i = 0; i < (sizeof(global_cache) / sizeof(global_cache[0])); ++i) {
-            if (current_global_serial != global_serial) {
+        for (i = 0; i < (sizeof(global_cache) / sizeof(global_cache[0])); ++i) {
+            if (serial != global_serial) {
                 refresh_cache(&global_cache[i], kp);
             }
-
             if (global_cache[i].c) {
                 c = global_cache[i].c;
                 break;
             }
-
             kp = key + base_offset;
         }
-        break;
+        global_serial = serial;
+    }
+
+    if (entry) {
+        atomic_store_explicit(&entry->state,
+                              ((uint64_t)serial << 32) | (unsigned char)c,
+                              memory_order_release);
+    }
+    return c;
+}
+
+static int __android_log_level(const char *tag, int def)
+{
+    const size_t taglen = (tag && *tag) ? strlen(tag) : 0;
+    const uint32_t hash = tag_hash(tag, taglen);
+    const uint32_t serial = __system_property_area_serial();
+    struct tag_cache *entry = NULL;
+    uint64_t state;
+    size_t i;
+    char c;
+
+    /* Fast path, a few loads and no lock while the property area is idle */
+    for (i = 0; i < TAG_CACHE_PROBE; ++i) {
+        struct tag_cache *probe = atomic_load_explicit(
+            &tag_caches[(hash + i) & (TAG_CACHE_SIZE - 1)],
+            memory_order_acquire);
+        if (!probe) {
+            break;
+        }
+        if ((probe->hash == hash) && !strncmp(probe->tag, taglen ? tag : "",
+                                              taglen + 1)) {
+            entry = probe;
+            break;
+        }
+    }
+
+    if (entry) {
+        state = atomic_load_explicit(&entry->state, memory_order_acquire);
+        if ((uint32_t)(state >> 32) == serial) {
+            c = (char)state;
+            goto done;
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+
+    if (!entry) {
+        /* Insertions only happen under lock, the probe cannot race another */
+        for (i = 0; i < TAG_CACHE_PROBE; ++i) {
+            struct tag_cache *_Atomic *slot =
+                &tag_caches[(hash + i) & (TAG_CACHE_SIZE - 1)];
+            struct tag_cache *probe = atomic_load_explicit(slot,
+                                                           memory_order_relaxed);
+            if (probe) {
+                if ((probe->hash == hash) &&
+                        !strncmp(probe->tag, taglen ? tag : "", taglen + 1)) {
+                    entry = probe;
+                    break;
+                }
+                continue;
+            }
+            probe = malloc(sizeof(*probe) + taglen + 1);
+            if (!probe) {
+                break;
+            }
+            atomic_init(&probe->state, (uint64_t)(uint32_t)(serial + 1) << 32);
+            probe->hash = hash;
+            memset(probe->cache, 0, sizeof(probe->cache));
+            probe->cache[0].serial = probe->cache[1].serial = -1;
+            memcpy(probe->tag, taglen ? tag : "", taglen + 1);
+            atomic_store_explicit(slot, probe, memory_order_release);
+            entry = probe;
+            break;
+        }
     }
 
-    global_serial = current_global_serial;
+    /* Another thread may have refreshed the entry while we waited */
+    state = entry ? atomic_load_explicit(&entry->state, memory_order_relaxed)
+                  : 0;
+    if (entry && ((uint32_t)(state >> 32) == serial)) {
+        c = (char)state;
+    } else {
+        c = refresh_level_locked(entry, tag, taglen, serial);
+    }
 
     pthread_mutex_unlock(&lock);
 
+done:
     switch (toupper(c)) {
     case 'V': return ANDROID_LOG_VERBOSE;
     case 'D': return ANDROID_LOG_DEBUG;
@@ -249,6 +249,7 @@ struct logger_list {
     unsigned int tail;
     log_time start;
     pid_t pid;
+    char *filter;
     int sock;
 };
 
@@ -568,6 +569,32 @@ struct logger_list *android_logger_list_alloc_time(int mode,
     return logger_list;
 }
 
+/* Hand client side filtering over to logd, see logd/LogFilter.h */
+int android_logger_list_set_filter(struct logger_list *logger_list,
+                                   const char *filter)
+{
+    char *dup = NULL;
+
+    if (!logger_list) {
+        return -EINVAL;
+    }
+    if (logger_list->sock >= 0) {
+        return -EBUSY;
+    }
+    if (filter && *filter) {
+        if (strlen(filter) >= LOGGER_FILTER_MAX) {
+            return -E2BIG;
+        }
+        dup = strdup(filter);
+        if (!dup) {
+            return -ENOMEM;
+        }
+    }
+    free(logger_list->filter);
+    logger_list->filter = dup;
+    return 0;
+}
+
 /* android_logger_list_register unimplemented, no use case */
 /* android_logger_list_unregister unimplemented, no use case */
 
@@ -761,7 +788,7 @@ int android_logger_list_read(struct logger_list *logger_list,
     }
 
     if (logger_list->sock < 0) {
-        char buffer[256], *cp, c;
+        char buffer[256 + LOGGER_FILTER_MAX], *cp, c;
 
         int sock = socket_local_client("logdr",
                                        ANDROID_SOCKET_NAMESPACE_RESERVED,
@@ -812,6 +839,13 @@ int android_logger_list_read(struct logger_list *logger_list,
             cp += ret;
         }
 
+        if (logger_list->filter) {
+            ret = snprintf(cp, remaining, " %s", logger_list->filter);
+            ret = min(ret, remaining);
+            remaining -= ret;
+            cp += ret;
+        }
+
         if (logger_list->mode & ANDROID_LOG_NONBLOCK) {
             /* Deal with an unresponsive logd */
             sigaction(SIGALRM, &ignore, &old_sigaction);
@@ -896,5 +930,6 @@ void android_logger_list_free(struct logger_list *logger_list)
         close (logger_list->sock);
     }
 
+    free(logger_list->filter);
     free(logger_list);
 }
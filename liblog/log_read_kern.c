@@ -312,6 +312,13 @@ struct logger_list *android_logger_list_alloc_time(int mode,
     return android_logger_list_alloc(mode, 0, pid);
 }
 
+/* No server side filtering, the caller filters everything it reads */
+int android_logger_list_set_filter(struct logger_list *logger_list __unused,
+                                   const char *filter __unused)
+{
+    return -ENOTSUP;
+}
+
 /* android_logger_list_register unimplemented, no use case */
 /* android_logger_list_unregister unimplemented, no use case */
 
@@ -21,6 +21,10 @@
 #if !defined(_WIN32)
 #include <pthread.h>
 #endif
+#if (FAKE_LOG_DEVICE == 0)
+#include <semaphore.h>
+#include <signal.h>
+#endif
 #include <stdarg.h>
 #include <stdatomic.h>
 #include <stdio.h>
@@ -67,6 +71,9 @@ static int log_fds[(int)LOG_ID_MAX] = { -1, -1, -1, -1, -1 };
 #else
 static int logd_fd = -1;
 static int pstore_fd = -1;
+static uid_t last_uid = AID_ROOT; /* logd *always* starts up as AID_ROOT */
+static pid_t last_pid = (pid_t) -1;
+static atomic_int_fast32_t dropped;
 #endif
 
 /*
@@ -133,6 +140,43 @@ static int __write_to_log_initialize()
     return ret;
 }
 
+#if (FAKE_LOG_DEVICE == 0)
+/*
+ * Report the entries logd refused with EAGAIN since we last got through.
+ * Uses the tid and realtime of header, and clobbers its id.
+ */
+static void __write_to_log_dropped(android_log_header_t *header)
+{
+    struct iovec vec[2];
+    android_log_event_int_t buffer;
+    int32_t snapshot;
+    ssize_t ret;
+
+    if (logd_fd <= 0) {
+        return;
+    }
+    snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (!snapshot) {
+        return;
+    }
+
+    header->id = LOG_ID_EVENTS;
+    buffer.header.tag = htole32(LIBLOG_LOG_TAG);
+    buffer.payload.type = EVENT_TYPE_INT;
+    buffer.payload.data = htole32(snapshot);
+
+    vec[0].iov_base = header;
+    vec[0].iov_len  = sizeof(*header);
+    vec[1].iov_base = &buffer;
+    vec[1].iov_len  = sizeof(buffer);
+
+    ret = TEMP_FAILURE_RETRY(writev(logd_fd, vec, 2));
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
+        atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
+    }
+}
+#endif
+
 static int __write_to_log_daemon(log_id_t log_id, struct iovec *vec, size_t nr)
 {
     ssize_t ret;
@@ -157,9 +201,6 @@ static int __write_to_log_daemon(log_id_t log_id, struct iovec *vec, size_t nr)
     android_pmsg_log_header_t pmsg_header;
     struct timespec ts;
     size_t i, payload_size;
-    static uid_t last_uid = AID_ROOT; /* logd *always* starts up as AID_ROOT */
-    static pid_t last_pid = (pid_t) -1;
-    static atomic_int_fast32_t dropped;
 
     if (!nr) {
         return -EINVAL;
@@ -207,25 +248,7 @@ static int __write_to_log_daemon(log_id_t log_id, struct iovec *vec, size_t nr)
     newVec[1].iov_base   = (unsigned char *) &header;
     newVec[1].iov_len    = sizeof(header);
 
-    if (logd_fd > 0) {
-        int32_t snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
-        if (snapshot) {
-            android_log_event_int_t buffer;
-
-            header.id = LOG_ID_EVENTS;
-            buffer.header.tag = htole32(LIBLOG_LOG_TAG);
-            buffer.payload.type = EVENT_TYPE_INT;
-            buffer.payload.data = htole32(snapshot);
-
-            newVec[2].iov_base = &buffer;
-            newVec[2].iov_len  = sizeof(buffer);
-
-            ret = TEMP_FAILURE_RETRY(writev(logd_fd, newVec + 1, 2));
-            if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
-                atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
-            }
-        }
-    }
+    __write_to_log_dropped(&header);
 
     header.id = log_id;
 
@@ -355,6 +378,336 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
     return write_to_log(log_id, vec, nr);
 }
 
+#if (FAKE_LOG_DEVICE == 0)
+/*
+ * Asynchronous writer, opt-in with __android_log_set_async(). Callers copy
+ * their record, timestamp and tid into a bounded lock-free ring (Vyukov's
+ * queue, each slot carries the sequence number it is ready for). A single
+ * flusher thread hands runs of ready slots to logd with one sendmmsg().
+ * Records that do not fit in a slot, or that find the ring full, and all
+ * fatal messages, are written directly as before.
+ */
+#define LOG_ASYNC_SLOTS     128  /* power of two */
+#define LOG_ASYNC_PAYLOAD   1088 /* covers prio, tag and LOG_BUF_SIZE text */
+#define LOG_ASYNC_BATCH     32   /* records per sendmmsg */
+#define LOG_ASYNC_WINDOW_US 2000 /* let a burst collect before sending */
+
+struct log_async_slot {
+    atomic_uint sequence;
+    android_log_header_t header;
+    size_t len;
+    char payload[LOG_ASYNC_PAYLOAD];
+};
+
+static struct log_async_slot *async_ring;
+static atomic_uint async_head;
+static unsigned int async_tail; /* async_flush_lock assumed */
+static atomic_int async_signalled;
+static sem_t async_sem;
+static int async_flusher;
+static pthread_mutex_t async_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Send count records, with the pmsg copies if enabled */
+static void __write_to_log_batch(struct mmsghdr *msgs, size_t count)
+{
+    android_pmsg_log_header_t pmsg_header;
+    android_log_header_t header;
+    struct iovec vec[3];
+    size_t i, sent;
+    int ret, reconnected = 0;
+
+    if (pstore_fd >= 0) {
+        pmsg_header.magic = LOGGER_MAGIC;
+        pmsg_header.uid = last_uid;
+        pmsg_header.pid = last_pid;
+        vec[0].iov_base = &pmsg_header;
+        vec[0].iov_len = sizeof(pmsg_header);
+        for (i = 0; i < count; ++i) {
+            vec[1] = msgs[i].msg_hdr.msg_iov[0];
+            vec[2] = msgs[i].msg_hdr.msg_iov[1];
+            pmsg_header.len = sizeof(pmsg_header) + vec[1].iov_len
+                            + vec[2].iov_len;
+            TEMP_FAILURE_RETRY(writev(pstore_fd, vec, 3));
+        }
+    }
+
+    if (last_uid == AID_LOGD) {
+        return;
+    }
+
+    memcpy(&header, msgs[0].msg_hdr.msg_iov[0].iov_base, sizeof(header));
+    __write_to_log_dropped(&header);
+
+    for (sent = 0; sent < count; ) {
+        ret = TEMP_FAILURE_RETRY(sendmmsg(logd_fd, msgs + sent,
+                                          count - sent, 0));
+        if (ret > 0) {
+            sent += ret;
+            continue;
+        }
+        ret = (ret < 0) ? -errno : -EAGAIN;
+        if ((ret == -ENOTCONN) && !reconnected) {
+            reconnected = 1;
+            pthread_mutex_lock(&log_init_lock);
+            close(logd_fd);
+            logd_fd = -1;
+            ret = __write_to_log_initialize();
+            pthread_mutex_unlock(&log_init_lock);
+            if (ret >= 0) {
+                continue;
+            }
+        }
+        if (ret == -EAGAIN) {
+            atomic_fetch_add_explicit(&dropped, count - sent,
+                                      memory_order_relaxed);
+        }
+        break;
+    }
+}
+
+/* async_flush_lock assumed, returns with the ring empty */
+static void __write_to_log_drain(void)
+{
+    struct mmsghdr msgs[LOG_ASYNC_BATCH];
+    struct iovec vec[LOG_ASYNC_BATCH][2];
+    struct log_async_slot *slot;
+    size_t i, count;
+
+    for (;;) {
+        for (count = 0; count < LOG_ASYNC_BATCH; ++count) {
+            unsigned int pos = async_tail + count;
+            slot = &async_ring[pos & (LOG_ASYNC_SLOTS - 1)];
+            if (atomic_load_explicit(&slot->sequence, memory_order_acquire)
+                    != (pos + 1)) {
+                break;
+            }
+            vec[count][0].iov_base = &slot->header;
+            vec[count][0].iov_len = sizeof(slot->header);
+            vec[count][1].iov_base = slot->payload;
+            vec[count][1].iov_len = slot->len;
+            memset(&msgs[count], 0, sizeof(msgs[count]));
+            msgs[count].msg_hdr.msg_iov = vec[count];
+            msgs[count].msg_hdr.msg_iovlen = 2;
+        }
+        if (!count) {
+            return;
+        }
+
+        __write_to_log_batch(msgs, count);
+
+        for (i = 0; i < count; ++i, ++async_tail) {
+            slot = &async_ring[async_tail & (LOG_ASYNC_SLOTS - 1)];
+            atomic_store_explicit(&slot->sequence,
+                                  async_tail + LOG_ASYNC_SLOTS,
+                                  memory_order_release);
+        }
+    }
+}
+
+void __android_log_flush(void)
+{
+    if (!async_ring) {
+        return;
+    }
+    pthread_mutex_lock(&async_flush_lock);
+    __write_to_log_drain();
+    pthread_mutex_unlock(&async_flush_lock);
+}
+
+static void *__write_to_log_flusher(void *arg __unused)
+{
+    sigset_t mask;
+
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    pthread_setname_np(pthread_self(), "liblog.flush");
+
+    for (;;) {
+        if (sem_wait(&async_sem)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        usleep(LOG_ASYNC_WINDOW_US);
+        /* writers from here on signal us again */
+        atomic_store_explicit(&async_signalled, 0, memory_order_release);
+        __android_log_flush();
+    }
+
+    return NULL;
+}
+
+static int __write_to_log_async(log_id_t log_id, struct iovec *vec, size_t nr)
+{
+    struct log_async_slot *slot;
+    struct timespec ts;
+    unsigned int pos, seq;
+    size_t i, len;
+
+    /* Fatal messages go out right away, behind everything queued so far */
+    if ((log_id != LOG_ID_EVENTS) && nr && vec[0].iov_len
+            && (*(unsigned char *)vec[0].iov_base >= ANDROID_LOG_FATAL)) {
+        __android_log_flush();
+        return __write_to_log_daemon(log_id, vec, nr);
+    }
+
+    for (len = 0, i = 0; i < nr; ++i) {
+        len += vec[i].iov_len;
+    }
+    if (!nr || (len > LOG_ASYNC_PAYLOAD)) {
+        return __write_to_log_daemon(log_id, vec, nr);
+    }
+
+    pos = atomic_load_explicit(&async_head, memory_order_relaxed);
+    for (;;) {
+        slot = &async_ring[pos & (LOG_ASYNC_SLOTS - 1)];
+        seq = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (seq == pos) {
+            if (atomic_compare_exchange_weak_explicit(&async_head, &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if ((int)(seq - pos) < 0) {
+            /* ring is full, the flusher is behind */
+            return __write_to_log_daemon(log_id, vec, nr);
+        } else {
+            pos = atomic_load_explicit(&async_head, memory_order_relaxed);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot->header.id = log_id;
+    slot->header.tid = gettid();
+    slot->header.realtime.tv_sec = ts.tv_sec;
+    slot->header.realtime.tv_nsec = ts.tv_nsec;
+    for (slot->len = 0, i = 0; i < nr; ++i) {
+        memcpy(slot->payload + slot->len, vec[i].iov_base, vec[i].iov_len);
+        slot->len += vec[i].iov_len;
+    }
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+    /* one wakeup per flusher pass, not one per record */
+    if (!atomic_exchange_explicit(&async_signalled, 1, memory_order_acq_rel)) {
+        sem_post(&async_sem);
+    }
+
+    return len;
+}
+
+/* The flusher does not survive fork, nor should the parent's records */
+static void __write_to_log_async_child(void)
+{
+    unsigned int i;
+
+    if (write_to_log == __write_to_log_async) {
+        write_to_log = __write_to_log_daemon;
+    }
+    pthread_mutex_init(&async_flush_lock, NULL);
+    for (i = 0; i < LOG_ASYNC_SLOTS; ++i) {
+        atomic_init(&async_ring[i].sequence, i);
+    }
+    atomic_init(&async_head, 0);
+    async_tail = 0;
+    atomic_init(&async_signalled, 0);
+    sem_init(&async_sem, 0, 0);
+    async_flusher = 0;
+}
+
+/* log_init_lock assumed */
+static int __write_to_log_async_start(void)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    unsigned int i;
+    int ret;
+
+    if (!async_ring) {
+        async_ring = calloc(LOG_ASYNC_SLOTS, sizeof(*async_ring));
+        if (!async_ring) {
+            return -ENOMEM;
+        }
+        for (i = 0; i < LOG_ASYNC_SLOTS; ++i) {
+            atomic_init(&async_ring[i].sequence, i);
+        }
+        sem_init(&async_sem, 0, 0);
+        pthread_atfork(NULL, NULL, __write_to_log_async_child);
+        atexit(__android_log_flush);
+    }
+
+    if (async_flusher) {
+        return 0;
+    }
+    ret = pthread_attr_init(&attr);
+    if (ret) {
+        return -ret;
+    }
+    ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (!ret) {
+        ret = pthread_create(&thread, &attr, __write_to_log_flusher, NULL);
+    }
+    pthread_attr_destroy(&attr);
+    if (ret) {
+        return -ret;
+    }
+    async_flusher = 1;
+    return 0;
+}
+#endif
+
+int __android_log_set_async(int enable)
+{
+#if FAKE_LOG_DEVICE
+    return enable ? -ENOTSUP : 0;
+#else
+    int ret = 0;
+
+    pthread_mutex_lock(&log_init_lock);
+
+    if (!enable) {
+        if (write_to_log == __write_to_log_async) {
+            write_to_log = __write_to_log_daemon;
+        }
+        pthread_mutex_unlock(&log_init_lock);
+        __android_log_flush();
+        return 0;
+    }
+
+    if (write_to_log == __write_to_log_init) {
+        ret = __write_to_log_initialize();
+        if (ret < 0) {
+            goto unlock;
+        }
+        write_to_log = __write_to_log_daemon;
+    }
+
+    ret = __write_to_log_async_start();
+    if (ret < 0) {
+        goto unlock;
+    }
+
+    if (last_uid == AID_ROOT) {
+        last_uid = getuid();
+    }
+    if (last_pid == (pid_t) -1) {
+        last_pid = getpid();
+    }
+    write_to_log = __write_to_log_async;
+
+unlock:
+    pthread_mutex_unlock(&log_init_lock);
+    return ret;
+#endif
+}
+
+#if FAKE_LOG_DEVICE
+void __android_log_flush(void)
+{
+}
+#endif
+
 int __android_log_write(int prio, const char *tag, const char *msg)
 {
     return __android_log_buf_write(LOG_ID_MAIN, prio, tag, msg);
@@ -456,6 +809,7 @@ void __android_log_assert(const char *cond, const char *tag,
     }
 
     __android_log_write(ANDROID_LOG_FATAL, tag, buf);
+    __android_log_flush();
     abort(); /* abort so we have a chance to debug the situation */
     /* NOTREACHED */
 }
@@ -139,6 +139,16 @@ static int __write_to_log_init(log_id_t log_id, struct iovec *vec, size_t nr)
     return write_to_log(log_id, vec, nr);
 }
 
+/* The kernel logger is written synchronously */
+int __android_log_set_async(int enable)
+{
+    return enable ? -ENOTSUP : 0;
+}
+
+void __android_log_flush(void)
+{
+}
+
 int __android_log_write(int prio, const char *tag, const char *msg)
 {
     return __android_log_buf_write(LOG_ID_MAIN, prio, tag, msg);
@@ -28,9 +28,11 @@
 #include <string.h>
 #include <inttypes.h>
 #include <sys/param.h>
+#include <unistd.h>
 
 #include <log/logd.h>
 #include <log/logprint.h>
+#include <log/uio.h>
 
 /* open coded fragment, prevent circular dependencies */
 #define WEAK static
@@ -50,6 +52,31 @@ struct AndroidLogFormat_t {
     bool printable_output;
 };
 
+/*
+ * The date part of the last timestamp formatted, so that localtime() and
+ * strftime() are only run once per second of output. Kept by callers that
+ * format many lines in a row, AndroidLogFormat may be shared by threads.
+ */
+typedef struct LogTimeCache_t {
+    time_t sec;
+    char text[32];
+} LogTimeCache;
+
+/*
+ * Entries are formatted straight into buf, oversized lines are queued
+ * as their own iovec from the heap and released on flush.
+ */
+#define LOG_BUFFER_IOV 64
+
+struct AndroidLogBuffer_t {
+    char *buf;
+    size_t size;
+    size_t used;
+    int iovcnt;
+    struct iovec iov[LOG_BUFFER_IOV];
+    LogTimeCache time;
+};
+
 /*
  *  gnome-terminal color tags
  *    See http://misc.flogisoft.com/bash/tip_colors_and_formatting
@@ -868,16 +895,10 @@ static size_t convertPrintable(char *p, const char *message, size_t messageLen)
     return p - begin;
 }
 
-/**
- * Formats a log message into a buffer
- *
- * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
- * If return value != defaultBuffer, caller must call free()
- * Returns NULL on malloc error
- */
-
-char *android_log_formatLogLine (
+/* android_log_formatLogLine(), reusing the date in p_time if not NULL */
+static char *formatLogLine(
     AndroidLogFormat *p_format,
+    LogTimeCache *p_time,
     char *defaultBuffer,
     size_t defaultBufferSize,
     const AndroidLogEntry *entry,
@@ -906,13 +927,21 @@ char *android_log_formatLogLine (
      * in the time stamp.  Don't use forward slashes, parenthesis,
      * brackets, asterisks, or other special chars here.
      */
+    if (p_time && (entry->tv_sec == p_time->sec)) {
+        strcpy(timeBuf, p_time->text);
+    } else {
 #if !defined(_WIN32)
-    ptm = localtime_r(&(entry->tv_sec), &tmBuf);
+        ptm = localtime_r(&(entry->tv_sec), &tmBuf);
 #else
-    ptm = localtime(&(entry->tv_sec));
+        ptm = localtime(&(entry->tv_sec));
 #endif
-    /* strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", ptm); */
-    strftime(timeBuf, sizeof(timeBuf), "%m-%d %H:%M:%S", ptm);
+        /* strftime(timeBuf, sizeof(timeBuf), "%Y-%m-%d %H:%M:%S", ptm); */
+        strftime(timeBuf, sizeof(timeBuf), "%m-%d %H:%M:%S", ptm);
+        if (p_time) {
+            strcpy(p_time->text, timeBuf);
+            p_time->sec = entry->tv_sec;
+        }
+    }
     len = strlen(timeBuf);
     if (p_format->usec_time_output) {
         snprintf(timeBuf + len, sizeof(timeBuf) - len,
@@ -1094,6 +1123,25 @@ char *android_log_formatLogLine (
     return ret;
 }
 
+/**
+ * Formats a log message into a buffer
+ *
+ * Uses defaultBuffer if it can, otherwise malloc()'s a new buffer
+ * If return value != defaultBuffer, caller must call free()
+ * Returns NULL on malloc error
+ */
+
+char *android_log_formatLogLine (
+    AndroidLogFormat *p_format,
+    char *defaultBuffer,
+    size_t defaultBufferSize,
+    const AndroidLogEntry *entry,
+    size_t *p_outLength)
+{
+    return formatLogLine(p_format, NULL, defaultBuffer, defaultBufferSize,
+                         entry, p_outLength);
+}
+
 /**
  * Either print or do not print log line, based on filter
  *
@@ -1139,3 +1187,178 @@ done:
 
     return ret;
 }
+
+AndroidLogBuffer *android_log_buffer_new(size_t size)
+{
+    AndroidLogBuffer *p_buffer;
+
+    p_buffer = calloc(1, sizeof(AndroidLogBuffer));
+    if (!p_buffer) {
+        return NULL;
+    }
+    p_buffer->buf = malloc(size);
+    if (!p_buffer->buf) {
+        free(p_buffer);
+        return NULL;
+    }
+    p_buffer->size = size;
+    p_buffer->time.sec = (time_t)-1;
+
+    return p_buffer;
+}
+
+static void android_log_buffer_reset(AndroidLogBuffer *p_buffer)
+{
+    int i;
+
+    for (i = 0; i < p_buffer->iovcnt; ++i) {
+        char *base = p_buffer->iov[i].iov_base;
+        if ((base < p_buffer->buf) || (base >= (p_buffer->buf + p_buffer->size))) {
+            free(base);
+        }
+    }
+    p_buffer->iovcnt = 0;
+    p_buffer->used = 0;
+}
+
+void android_log_buffer_free(AndroidLogBuffer *p_buffer)
+{
+    if (!p_buffer) {
+        return;
+    }
+    android_log_buffer_reset(p_buffer);
+    free(p_buffer->buf);
+    free(p_buffer);
+}
+
+/* Extend the last iovec if it ends where the new data starts */
+static void android_log_buffer_queue(AndroidLogBuffer *p_buffer,
+                                     char *base, size_t len)
+{
+    if (p_buffer->iovcnt && (base >= p_buffer->buf)
+            && (base < (p_buffer->buf + p_buffer->size))) {
+        struct iovec *last = &p_buffer->iov[p_buffer->iovcnt - 1];
+        if (((char *)last->iov_base + last->iov_len) == base) {
+            last->iov_len += len;
+            return;
+        }
+    }
+    p_buffer->iov[p_buffer->iovcnt].iov_base = base;
+    p_buffer->iov[p_buffer->iovcnt].iov_len = len;
+    ++p_buffer->iovcnt;
+}
+
+ssize_t android_log_buffer_flush(AndroidLogBuffer *p_buffer, int fd)
+{
+    /* Stepped through a copy, reset still needs the heap lines' pointers */
+    struct iovec pending[LOG_BUFFER_IOV];
+    struct iovec *iov = pending;
+    int iovcnt = p_buffer->iovcnt;
+    ssize_t total = 0;
+
+    memcpy(pending, p_buffer->iov, iovcnt * sizeof(pending[0]));
+
+    while (iovcnt) {
+        ssize_t ret;
+
+        do {
+            ret = writev(fd, iov, iovcnt);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret <= 0) {
+            fprintf(stderr, "+++ LOG: write failed (errno=%d)\n", errno);
+            android_log_buffer_reset(p_buffer);
+            return -1;
+        }
+        total += ret;
+
+        /* Step over whatever made it out, and retry any partial write */
+        while (iovcnt && ((size_t)ret >= iov->iov_len)) {
+            ret -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt) {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    android_log_buffer_reset(p_buffer);
+    return total;
+}
+
+int android_log_bufferLogLine(
+    AndroidLogFormat *p_format,
+    AndroidLogBuffer *p_buffer,
+    int fd,
+    const AndroidLogEntry *entry)
+{
+    char *start;
+    char *outBuffer;
+    size_t totalLen;
+
+    if (p_buffer->iovcnt >= LOG_BUFFER_IOV) {
+        if (android_log_buffer_flush(p_buffer, fd) < 0) {
+            return -1;
+        }
+    }
+
+    start = p_buffer->buf + p_buffer->used;
+    outBuffer = formatLogLine(p_format, &p_buffer->time, start,
+            p_buffer->size - p_buffer->used, entry, &totalLen);
+    if (!outBuffer) {
+        return -1;
+    }
+
+    if (outBuffer != start) {
+        if (totalLen > p_buffer->size) {
+            /* Too large for any buffer, hand over the heap copy as is */
+            android_log_buffer_queue(p_buffer, outBuffer, totalLen);
+            return totalLen;
+        }
+        /* Start over with an empty buffer */
+        if (android_log_buffer_flush(p_buffer, fd) < 0) {
+            free(outBuffer);
+            return -1;
+        }
+        start = p_buffer->buf;
+        memcpy(start, outBuffer, totalLen);
+        free(outBuffer);
+    }
+
+    p_buffer->used += totalLen;
+    android_log_buffer_queue(p_buffer, start, totalLen);
+
+    return totalLen;
+}
+
+int android_log_buffer_append(
+    AndroidLogBuffer *p_buffer,
+    int fd,
+    const char *buf,
+    size_t len)
+{
+    char *start;
+
+    if ((p_buffer->iovcnt >= LOG_BUFFER_IOV)
+            || (len > (p_buffer->size - p_buffer->used))) {
+        if (android_log_buffer_flush(p_buffer, fd) < 0) {
+            return -1;
+        }
+    }
+
+    if (len > p_buffer->size) {
+        start = malloc(len);
+        if (!start) {
+            return -1;
+        }
+    } else {
+        start = p_buffer->buf + p_buffer->used;
+        p_buffer->used += len;
+    }
+    memcpy(start, buf, len);
+    android_log_buffer_queue(p_buffer, start, len);
+
+    return len;
+}
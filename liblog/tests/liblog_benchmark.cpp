@@ -14,11 +14,15 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <stdio.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <cutils/sockets.h>
 #include <log/log.h>
 #include <log/logger.h>
 #include <log/log_read.h>
+#include <log/logprint.h>
 
 #include "benchmark.h"
 
@@ -267,6 +271,116 @@ static void BM_log_delay(int iters) {
 }
 BENCHMARK(BM_log_delay);
 
+static const int delay_readers = 8;
+static volatile bool delay_readers_stop;
+
+// Drain all the log buffers from the beginning, as logcat -b all would
+static void *delay_reader(void *) {
+    struct logger_list *logger_list = android_logger_list_alloc(
+        ANDROID_LOG_RDONLY, 0, 0);
+    if (!logger_list) {
+        return NULL;
+    }
+    for (int id = LOG_ID_MIN; id < LOG_ID_MAX; ++id) {
+        android_logger_open(logger_list, static_cast<log_id_t>(id));
+    }
+
+    while (!delay_readers_stop) {
+        log_msg log_msg;
+        if (android_logger_list_read(logger_list, &log_msg) <= 0) {
+            break;
+        }
+    }
+
+    android_logger_list_free(logger_list);
+    return NULL;
+}
+
+/*
+ *	Measure the time it takes for the logd posting call to make it into
+ * the logs while eight other readers are busy draining every buffer. The
+ * writer should not be held up behind the readers, expect this to be close
+ * to BM_log_delay.
+ */
+static void BM_log_delay_readers(int iters) {
+    pid_t pid = getpid();
+
+    struct logger_list * logger_list = android_logger_list_open(LOG_ID_EVENTS,
+        ANDROID_LOG_RDONLY, 0, pid);
+
+    if (!logger_list) {
+        fprintf(stderr, "Unable to open events log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    delay_readers_stop = false;
+    pthread_t readers[delay_readers];
+    int started = 0;
+    for (; started < delay_readers; ++started) {
+        if (pthread_create(&readers[started], NULL, delay_reader, NULL)) {
+            break;
+        }
+    }
+
+    signal(SIGALRM, caught_delay);
+    alarm(alarm_time);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        log_time ts(CLOCK_REALTIME);
+
+        LOG_FAILURE_RETRY(
+            android_btWriteLog(0, EVENT_TYPE_LONG, &ts, sizeof(ts)));
+
+        for (;;) {
+            log_msg log_msg;
+            int ret = android_logger_list_read(logger_list, &log_msg);
+            alarm(alarm_time);
+
+            if (ret <= 0) {
+                iters = i;
+                break;
+            }
+            if ((log_msg.entry.len != (4 + 1 + 8))
+             || (log_msg.id() != LOG_ID_EVENTS)) {
+                continue;
+            }
+
+            char* eventData = log_msg.msg();
+
+            if (eventData[4] != EVENT_TYPE_LONG) {
+                continue;
+            }
+            log_time tx(eventData + 4 + 1);
+            if (ts != tx) {
+                if (0xDEADBEEFA55A5AA6ULL == caught_convert(eventData + 4 + 1)) {
+                    iters = i;
+                    break;
+                }
+                continue;
+            }
+
+            break;
+        }
+    }
+
+    StopBenchmarkTiming();
+
+    // Wake up the readers with one last entry so they notice the stop
+    delay_readers_stop = true;
+    caught_delay(0);
+    for (int i = 0; i < started; ++i) {
+        pthread_join(readers[i], NULL);
+    }
+
+    signal(SIGALRM, SIG_DFL);
+    alarm(0);
+
+    android_logger_list_free(logger_list);
+}
+BENCHMARK(BM_log_delay_readers);
+
 /*
  *	Measure the time it takes for __android_log_is_loggable.
  */
@@ -280,3 +394,100 @@ static void BM_is_loggable(int iters) {
     StopBenchmarkTiming();
 }
 BENCHMARK(BM_is_loggable);
+
+/*
+ *	Measure the time it takes for __android_log_is_loggable when
+ *	cycling through a few hundred distinct tags.
+ */
+static void BM_is_loggable_tags(int iters) {
+    char tags[256][16];
+
+    for (size_t i = 0; i < (sizeof(tags) / sizeof(tags[0])); ++i) {
+        snprintf(tags[i], sizeof(tags[i]), "tag%zu", i);
+    }
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        __android_log_is_loggable(ANDROID_LOG_WARN,
+                                  tags[i % (sizeof(tags) / sizeof(tags[0]))],
+                                  ANDROID_LOG_VERBOSE);
+    }
+
+    StopBenchmarkTiming();
+}
+BENCHMARK(BM_is_loggable_tags);
+
+/*
+ *	Measure the time it takes to format a line and write it out, for
+ *	each AndroidLogPrintFormat, one write(2) per line.
+ */
+static const char format_tag[] = "BM_format";
+static const char format_message[] =
+    "The quick brown fox jumps over the lazy dog 0123456789";
+
+static void format_entry(AndroidLogEntry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->tv_sec = time(NULL);
+    entry->priority = ANDROID_LOG_INFO;
+    entry->pid = getpid();
+    entry->tid = gettid();
+    entry->tag = format_tag;
+    entry->messageLen = sizeof(format_message) - 1;
+    entry->message = format_message;
+}
+
+static void BM_printLogLine(int iters, int format) {
+    AndroidLogFormat *p_format = android_log_format_new();
+    android_log_setPrintFormat(p_format, (AndroidLogPrintFormat)format);
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    AndroidLogEntry entry;
+    format_entry(&entry);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        entry.tv_nsec = i;
+        android_log_printLogLine(p_format, fd, &entry);
+    }
+
+    StopBenchmarkTiming();
+
+    close(fd);
+    android_log_format_free(p_format);
+}
+BENCHMARK(BM_printLogLine)->Arg(FORMAT_BRIEF)->Arg(FORMAT_PROCESS)
+                          ->Arg(FORMAT_TAG)->Arg(FORMAT_THREAD)
+                          ->Arg(FORMAT_RAW)->Arg(FORMAT_TIME)
+                          ->Arg(FORMAT_THREADTIME)->Arg(FORMAT_LONG);
+
+/*
+ *	Measure the same through an AndroidLogBuffer, one writev(2) per
+ *	buffer full.
+ */
+static void BM_bufferLogLine(int iters, int format) {
+    AndroidLogFormat *p_format = android_log_format_new();
+    android_log_setPrintFormat(p_format, (AndroidLogPrintFormat)format);
+    AndroidLogBuffer *p_buffer = android_log_buffer_new(128 * 1024);
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    AndroidLogEntry entry;
+    format_entry(&entry);
+
+    StartBenchmarkTiming();
+
+    for (int i = 0; i < iters; ++i) {
+        entry.tv_nsec = i;
+        android_log_bufferLogLine(p_format, p_buffer, fd, &entry);
+    }
+    android_log_buffer_flush(p_buffer, fd);
+
+    StopBenchmarkTiming();
+
+    close(fd);
+    android_log_buffer_free(p_buffer);
+    android_log_format_free(p_format);
+}
+BENCHMARK(BM_bufferLogLine)->Arg(FORMAT_BRIEF)->Arg(FORMAT_PROCESS)
+                           ->Arg(FORMAT_TAG)->Arg(FORMAT_THREAD)
+                           ->Arg(FORMAT_RAW)->Arg(FORMAT_TIME)
+                           ->Arg(FORMAT_THREADTIME)->Arg(FORMAT_LONG);
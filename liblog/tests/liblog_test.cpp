@@ -18,6 +18,7 @@
 #include <inttypes.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/wait.h>
 
 #include <cutils/properties.h>
 #include <gtest/gtest.h>
@@ -164,6 +165,82 @@ TEST(liblog, __android_log_btwrite__android_logger_list_read) {
     android_logger_list_close(logger_list);
 }
 
+// More than the asynchronous writer's ring holds, so it wraps a few times
+#define ASYNC_BURSTS 4
+#define ASYNC_BURST 100
+#define ASYNC_AT_EXIT 17
+#define ASYNC_MAGIC 0xA5A5000000000000ULL
+
+TEST(liblog, __android_log_set_async__android_logger_list_read) {
+    // A child, so that async mode stays out of the rest of the tests and
+    // the last records depend on the flush at exit.
+    pid_t pid = fork();
+    ASSERT_LE(0, pid);
+    if (!pid) {
+        if (__android_log_set_async(1)) {
+            _exit(2);
+        }
+        unsigned long long v = ASYNC_MAGIC;
+        for (int i = 0; i < ASYNC_BURSTS; ++i) {
+            for (int j = 0; j < ASYNC_BURST; ++j, ++v) {
+                __android_log_btwrite(0, EVENT_TYPE_LONG, &v, sizeof(v));
+            }
+            usleep(20000);
+        }
+        for (int j = 0; j < ASYNC_AT_EXIT; ++j, ++v) {
+            __android_log_btwrite(0, EVENT_TYPE_LONG, &v, sizeof(v));
+        }
+        exit(0);
+    }
+
+    int status;
+    ASSERT_EQ(pid, TEMP_FAILURE_RETRY(waitpid(pid, &status, 0)));
+    ASSERT_TRUE(WIFEXITED(status));
+    if (WEXITSTATUS(status) == 2) {
+        return; // no logd, kernel logger
+    }
+    ASSERT_EQ(0, WEXITSTATUS(status));
+    usleep(1000000);
+
+    struct logger_list *logger_list;
+    ASSERT_TRUE(NULL != (logger_list = android_logger_list_open(
+        LOG_ID_EVENTS, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 0, pid)));
+
+    unsigned long long expect = ASYNC_MAGIC;
+    int count = 0;
+    for (;;) {
+        log_msg log_msg;
+        if (android_logger_list_read(logger_list, &log_msg) <= 0) {
+            break;
+        }
+
+        if ((log_msg.entry.pid != pid)
+         || (log_msg.entry.len != (4 + 1 + 8))
+         || (log_msg.id() != LOG_ID_EVENTS)) {
+            continue;
+        }
+
+        char *eventData = log_msg.msg();
+        if (eventData[4] != EVENT_TYPE_LONG) {
+            continue;
+        }
+
+        unsigned long long v;
+        memcpy(&v, eventData + 4 + 1, sizeof(v));
+        if ((v & 0xFFFF000000000000ULL) != ASYNC_MAGIC) {
+            continue;
+        }
+        // in order, none missing
+        EXPECT_EQ(expect, v);
+        expect = v + 1;
+        ++count;
+    }
+
+    android_logger_list_close(logger_list);
+
+    EXPECT_EQ(ASYNC_BURSTS * ASYNC_BURST + ASYNC_AT_EXIT, count);
+}
+
 static unsigned signaled;
 log_time signal_time;
 
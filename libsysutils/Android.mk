@@ -28,3 +28,5 @@ LOCAL_MODULE:= libsysutils
 LOCAL_CFLAGS := -Werror
 LOCAL_SHARED_LIBRARIES := $(common_shared_libraries)
 include $(BUILD_STATIC_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
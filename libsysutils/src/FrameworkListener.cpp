@@ -175,7 +175,8 @@ void FrameworkListener::dispatchCommand(SocketClient *cli, char *data) {
         goto out;
     }
 
-    if (errorRate && (++mCommandCount % errorRate == 0)) {
+    // Commands may come in on several SocketListener worker threads
+    if (errorRate && (__sync_add_and_fetch(&mCommandCount, 1) % errorRate == 0)) {
         /* ignore this command - let the timeout handler handle it */
         SLOGE("Faking a timeout");
         goto out;
@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/select.h>
 #include <sys/time.h>
@@ -32,6 +33,8 @@
 #define CtrlPipe_Shutdown 0
 #define CtrlPipe_Wakeup   1
 
+#define MAX_EPOLL_EVENTS 16
+
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
 }
@@ -51,6 +54,15 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mUseCmdNum = useCmdNum;
     pthread_mutex_init(&mClientsLock, NULL);
     mClients = new SocketClientCollection();
+    mUseEpoll = false;
+    mEpollFd = -1;
+    mReleased = new SocketClientCollection();
+    mWorkerCount = 0;
+    mWorkers = NULL;
+    mWorkQueue = new SocketClientCollection();
+    pthread_mutex_init(&mWorkLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    mWorkShutdown = false;
 }
 
 SocketListener::~SocketListener() {
@@ -61,12 +73,32 @@ SocketListener::~SocketListener() {
         close(mCtrlPipe[0]);
         close(mCtrlPipe[1]);
     }
+    if (mEpollFd != -1)
+        close(mEpollFd);
+
     SocketClientCollection::iterator it;
     for (it = mClients->begin(); it != mClients->end();) {
         (*it)->decRef();
         it = mClients->erase(it);
     }
     delete mClients;
+    for (it = mReleased->begin(); it != mReleased->end();) {
+        (*it)->decRef();
+        it = mReleased->erase(it);
+    }
+    delete mReleased;
+    delete mWorkQueue;
+    delete[] mWorkers;
+}
+
+int SocketListener::useEpoll(int workers) {
+    if (workers < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    mUseEpoll = true;
+    mWorkerCount = workers;
+    return 0;
 }
 
 int SocketListener::startListener() {
@@ -100,6 +132,48 @@ int SocketListener::startListener(int backlog) {
         return -1;
     }
 
+    if (mUseEpoll) {
+        struct epoll_event ev;
+
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (mEpollFd == -1) {
+            SLOGE("epoll_create1 failed (%s)", strerror(errno));
+            return -1;
+        }
+
+        // The control pipe and the listening socket are told apart from
+        // clients by their data pointers.
+        ev.events = EPOLLIN;
+        ev.data.ptr = mCtrlPipe;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mCtrlPipe[0], &ev) ||
+                (mListen && (ev.data.ptr = &mSock,
+                             epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSock, &ev)))) {
+            SLOGE("epoll_ctl failed (%s)", strerror(errno));
+            return -1;
+        }
+
+        SocketClientCollection::iterator it;
+        for (it = mClients->begin(); it != mClients->end(); ++it) {
+            if (!watchClient(*it, EPOLL_CTL_ADD)) {
+                SLOGE("epoll_ctl failed (%s)", strerror(errno));
+                return -1;
+            }
+        }
+
+        if (mWorkerCount) {
+            mWorkShutdown = false;
+            mWorkers = new pthread_t[mWorkerCount];
+            for (int i = 0; i < mWorkerCount; i++) {
+                if (pthread_create(&mWorkers[i], NULL, SocketListener::workerStart, this)) {
+                    SLOGE("pthread_create (%s)", strerror(errno));
+                    mWorkerCount = i;
+                    stopWorkers();
+                    return -1;
+                }
+            }
+        }
+    }
+
     if (pthread_create(&mThread, NULL, SocketListener::threadStart, this)) {
         SLOGE("pthread_create (%s)", strerror(errno));
         return -1;
@@ -123,6 +197,7 @@ int SocketListener::stopListener() {
         SLOGE("Error joining to listener thread (%s)", strerror(errno));
         return -1;
     }
+    stopWorkers();
     close(mCtrlPipe[0]);
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
@@ -133,11 +208,20 @@ int SocketListener::stopListener() {
         mSock = -1;
     }
 
+    if (mEpollFd != -1) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
     SocketClientCollection::iterator it;
     for (it = mClients->begin(); it != mClients->end();) {
         delete (*it);
         it = mClients->erase(it);
     }
+    for (it = mReleased->begin(); it != mReleased->end();) {
+        (*it)->decRef();
+        it = mReleased->erase(it);
+    }
     return 0;
 }
 
@@ -153,6 +237,11 @@ void SocketListener::runListener() {
 
     SocketClientCollection pendingList;
 
+    if (mUseEpoll) {
+        runEpollListener();
+        return;
+    }
+
     while(1) {
         SocketClientCollection::iterator it;
         fd_set read_fds;
@@ -249,6 +338,171 @@ void SocketListener::runListener() {
     }
 }
 
+/*
+ * Clients are registered with EPOLLONESHOT, so once one is reported it stays
+ * quiet until dispatchClient() has handled it and re-armed it.
+ */
+bool SocketListener::watchClient(SocketClient *c, int op) {
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = c;
+    return epoll_ctl(mEpollFd, op, c->getSocket(), &ev) == 0;
+}
+
+void SocketListener::dispatchClient(SocketClient *c) {
+    if (!onDataAvailable(c)) {
+        release(c, false);
+    }
+    // A released client is no longer registered
+    if (!watchClient(c, EPOLL_CTL_MOD) && errno != ENOENT) {
+        SLOGE("epoll_ctl failed (%s)", strerror(errno));
+    }
+    c->decRef();
+}
+
+void SocketListener::runEpollListener() {
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    SocketClientCollection released;
+    bool shutdown = false;
+
+    while (!shutdown) {
+        SocketClientCollection::iterator it;
+
+        /* Events returned by the last wait are handled, drop released clients */
+        pthread_mutex_lock(&mClientsLock);
+        for (it = mReleased->begin(); it != mReleased->end();) {
+            released.push_back(*it);
+            it = mReleased->erase(it);
+        }
+        pthread_mutex_unlock(&mClientsLock);
+        for (it = released.begin(); it != released.end();) {
+            (*it)->decRef();
+            it = released.erase(it);
+        }
+
+        int rc = epoll_wait(mEpollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
+            sleep(1);
+            continue;
+        }
+
+        for (int i = 0; i < rc && !shutdown; i++) {
+            if (events[i].data.ptr == mCtrlPipe) {
+                char c = CtrlPipe_Shutdown;
+                TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
+                shutdown = c == CtrlPipe_Shutdown;
+                continue;
+            }
+
+            if (events[i].data.ptr == &mSock) {
+                struct sockaddr addr;
+                socklen_t alen = sizeof(addr);
+                int fd = TEMP_FAILURE_RETRY(accept(mSock, &addr, &alen));
+                SLOGV("%s got %d from accept", mSocketName, fd);
+                if (fd < 0) {
+                    SLOGE("accept failed (%s)", strerror(errno));
+                    sleep(1);
+                    continue;
+                }
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+                SocketClient *c = new SocketClient(fd, true, mUseCmdNum);
+                pthread_mutex_lock(&mClientsLock);
+                bool watched = watchClient(c, EPOLL_CTL_ADD);
+                if (watched) {
+                    mClients->push_back(c);
+                }
+                pthread_mutex_unlock(&mClientsLock);
+                if (!watched) {
+                    SLOGE("epoll_ctl failed (%s)", strerror(errno));
+                    c->decRef();
+                }
+                continue;
+            }
+
+            /* A client released since the wait is still alive, but not ours to handle */
+            SocketClient *c = reinterpret_cast<SocketClient *>(events[i].data.ptr);
+            bool live = true;
+            pthread_mutex_lock(&mClientsLock);
+            for (it = mReleased->begin(); it != mReleased->end(); ++it) {
+                if (*it == c) {
+                    live = false;
+                    break;
+                }
+            }
+            if (live) {
+                c->incRef();
+            }
+            pthread_mutex_unlock(&mClientsLock);
+            if (!live) {
+                continue;
+            }
+
+            if (mWorkerCount) {
+                pthread_mutex_lock(&mWorkLock);
+                mWorkQueue->push_back(c);
+                pthread_cond_signal(&mWorkCond);
+                pthread_mutex_unlock(&mWorkLock);
+            } else {
+                dispatchClient(c);
+            }
+        }
+    }
+}
+
+void *SocketListener::workerStart(void *obj) {
+    SocketListener *me = reinterpret_cast<SocketListener *>(obj);
+
+    me->runWorker();
+    return NULL;
+}
+
+void SocketListener::runWorker() {
+    pthread_mutex_lock(&mWorkLock);
+    while (!mWorkShutdown) {
+        if (mWorkQueue->empty()) {
+            pthread_cond_wait(&mWorkCond, &mWorkLock);
+            continue;
+        }
+        SocketClientCollection::iterator it = mWorkQueue->begin();
+        SocketClient *c = *it;
+        mWorkQueue->erase(it);
+        pthread_mutex_unlock(&mWorkLock);
+
+        dispatchClient(c);
+
+        pthread_mutex_lock(&mWorkLock);
+    }
+    pthread_mutex_unlock(&mWorkLock);
+}
+
+void SocketListener::stopWorkers() {
+    if (!mWorkers) {
+        return;
+    }
+
+    pthread_mutex_lock(&mWorkLock);
+    mWorkShutdown = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mWorkLock);
+
+    for (int i = 0; i < mWorkerCount; i++) {
+        pthread_join(mWorkers[i], NULL);
+    }
+    delete[] mWorkers;
+    mWorkers = NULL;
+
+    /* Clients that were never handed out */
+    SocketClientCollection::iterator it;
+    for (it = mWorkQueue->begin(); it != mWorkQueue->end();) {
+        (*it)->decRef();
+        it = mWorkQueue->erase(it);
+    }
+}
+
 bool SocketListener::release(SocketClient* c, bool wakeup) {
     bool ret = false;
     /* if our sockets are connection-based, remove and destroy it */
@@ -264,8 +518,20 @@ bool SocketListener::release(SocketClient* c, bool wakeup) {
                 break;
             }
         }
+        if (ret && mUseEpoll) {
+            /* The listener may hold an event for c, it drops the reference once it waits again */
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, c->getSocket(), NULL);
+            mReleased->push_back(c);
+        }
         pthread_mutex_unlock(&mClientsLock);
-        if (ret) {
+        if (ret && mUseEpoll) {
+            ret = false;
+            /* Get the socket closed soon, unless the listener is about to wait anyway */
+            if (wakeup || !pthread_equal(pthread_self(), mThread)) {
+                char b = CtrlPipe_Wakeup;
+                TEMP_FAILURE_RETRY(write(mCtrlPipe[1], &b, 1));
+            }
+        } else if (ret) {
             ret = c->decRef();
             if (wakeup) {
                 char b = CtrlPipe_Wakeup;
@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sysutils/SocketListener.h>
+
+// Fixed size, so that an echo is never split or merged with another
+#define MSG_SIZE 8
+
+// Echoes every message back. "hold" does not return from onDataAvailable()
+// until the test lets it go, as a long running command would. "kick"
+// releases the last client that sent "join".
+class EchoListener : public SocketListener {
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    bool mHeld;
+    bool mLetGo;
+    SocketClient *mJoined;
+
+public:
+    explicit EchoListener(int sock) :
+            SocketListener(sock, true),
+            mHeld(false),
+            mLetGo(false),
+            mJoined(NULL) {
+        pthread_mutex_init(&mLock, NULL);
+        pthread_cond_init(&mCond, NULL);
+    }
+
+    void waitHeld() {
+        pthread_mutex_lock(&mLock);
+        while (!mHeld) {
+            pthread_cond_wait(&mCond, &mLock);
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+
+    void letGo() {
+        pthread_mutex_lock(&mLock);
+        mLetGo = true;
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+    }
+
+protected:
+    virtual bool onDataAvailable(SocketClient *c) {
+        char buf[MSG_SIZE];
+        ssize_t n = TEMP_FAILURE_RETRY(read(c->getSocket(), buf, sizeof(buf)));
+        if (n <= 0) {
+            return false;
+        }
+
+        if ((n == MSG_SIZE) && !memcmp(buf, "hold....", MSG_SIZE)) {
+            pthread_mutex_lock(&mLock);
+            mHeld = true;
+            pthread_cond_broadcast(&mCond);
+            while (!mLetGo) {
+                pthread_cond_wait(&mCond, &mLock);
+            }
+            pthread_mutex_unlock(&mLock);
+        } else if ((n == MSG_SIZE) && !memcmp(buf, "join....", MSG_SIZE)) {
+            mJoined = c;
+        } else if ((n == MSG_SIZE) && !memcmp(buf, "kick....", MSG_SIZE)) {
+            release(mJoined);
+        }
+
+        // Fails once the client has gone, which is not an error here
+        c->sendData(buf, n);
+        return true;
+    }
+};
+
+class SocketListenerTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        memset(&mAddr, 0, sizeof(mAddr));
+        mAddr.sun_family = AF_UNIX;
+        // abstract namespace, nothing to clean up
+        snprintf(mAddr.sun_path + 1, sizeof(mAddr.sun_path) - 1,
+                 "SocketListenerTest.%d", getpid());
+
+        mSock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ASSERT_LE(0, mSock);
+        ASSERT_EQ(0, bind(mSock, reinterpret_cast<struct sockaddr *>(&mAddr),
+                          sizeof(mAddr)));
+    }
+
+    virtual void TearDown() {
+        close(mSock);
+    }
+
+public:
+    int connectClient() {
+        // A message the listener never answers fails the test, not hang it
+        struct timeval timeout = { 10, 0 };
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if ((fd >= 0) && (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+                || connect(fd, reinterpret_cast<struct sockaddr *>(&mAddr), sizeof(mAddr)))) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Sends a message and checks it comes back
+    static bool echo(int fd, const char *msg) {
+        char buf[MSG_SIZE];
+        if (TEMP_FAILURE_RETRY(write(fd, msg, MSG_SIZE)) != MSG_SIZE) {
+            return false;
+        }
+        ssize_t n = 0;
+        while (n < MSG_SIZE) {
+            ssize_t ret = TEMP_FAILURE_RETRY(read(fd, buf + n, MSG_SIZE - n));
+            if (ret <= 0) {
+                return false;
+            }
+            n += ret;
+        }
+        return !memcmp(buf, msg, MSG_SIZE);
+    }
+
+    struct sockaddr_un mAddr;
+    int mSock;
+};
+
+struct client_args {
+    SocketListenerTest *test;
+    int id;
+    int failures;
+};
+
+static void *run_client(void *obj) {
+    client_args *args = reinterpret_cast<client_args *>(obj);
+
+    int fd = args->test->connectClient();
+    if (fd < 0) {
+        args->failures++;
+        return NULL;
+    }
+    for (int i = 0; i < 20; ++i) {
+        char msg[MSG_SIZE + 1];
+        snprintf(msg, sizeof(msg), "%03d:%03d", args->id, i);
+        if (!SocketListenerTest::echo(fd, msg)) {
+            args->failures++;
+            break;
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void run_clients(SocketListenerTest *test, int count) {
+    std::vector<pthread_t> threads(count);
+    std::vector<client_args> args(count);
+
+    for (int i = 0; i < count; ++i) {
+        args[i].test = test;
+        args[i].id = i;
+        args[i].failures = 0;
+        ASSERT_EQ(0, pthread_create(&threads[i], NULL, run_client, &args[i]));
+    }
+    for (int i = 0; i < count; ++i) {
+        pthread_join(threads[i], NULL);
+        EXPECT_EQ(0, args[i].failures) << "client " << i;
+    }
+}
+
+TEST_F(SocketListenerTest, concurrent_clients) {
+    static const int workers[] = { 0, 4 };
+
+    for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); ++i) {
+        EchoListener listener(mSock);
+        ASSERT_EQ(0, listener.useEpoll(workers[i]));
+        ASSERT_EQ(0, listener.startListener(64));
+
+        // Every client gets each of its messages back, in order
+        run_clients(this, 50);
+
+        EXPECT_EQ(0, listener.stopListener());
+    }
+}
+
+TEST_F(SocketListenerTest, disconnect_while_running) {
+    static const int workers[] = { 0, 4 };
+
+    for (size_t i = 0; i < sizeof(workers) / sizeof(workers[0]); ++i) {
+        EchoListener listener(mSock);
+        ASSERT_EQ(0, listener.useEpoll(workers[i]));
+        ASSERT_EQ(0, listener.startListener(64));
+
+        int held = connectClient();
+        ASSERT_LE(0, held);
+        ASSERT_EQ(MSG_SIZE, write(held, "hold....", MSG_SIZE));
+        listener.waitHeld();
+
+        // The client goes away while its command is still running
+        ASSERT_EQ(0, shutdown(held, SHUT_WR));
+        if (workers[i]) {
+            // and the other clients do not wait for it
+            run_clients(this, 10);
+        }
+        listener.letGo();
+
+        // Once the command returns, the listener sees the disconnect and
+        // closes its end
+        char buf[MSG_SIZE];
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(read(held, buf, sizeof(buf)))) > 0) {
+        }
+        EXPECT_EQ(0, n);
+        close(held);
+
+        // and carries on with new clients
+        run_clients(this, 10);
+
+        EXPECT_EQ(0, listener.stopListener());
+    }
+}
+
+TEST_F(SocketListenerTest, release_with_event_pending) {
+    EchoListener listener(mSock);
+    ASSERT_EQ(0, listener.useEpoll(0));
+    ASSERT_EQ(0, listener.startListener(64));
+
+    int kicker = connectClient();
+    int kicked = connectClient();
+    int held = connectClient();
+    ASSERT_LE(0, kicker);
+    ASSERT_LE(0, kicked);
+    ASSERT_LE(0, held);
+    ASSERT_TRUE(echo(kicked, "join...."));
+
+    // With the listener busy, both clients become ready, so they come back
+    // from the same wait and kicked is released with its event pending
+    ASSERT_EQ(MSG_SIZE, write(held, "hold....", MSG_SIZE));
+    listener.waitHeld();
+    ASSERT_EQ(MSG_SIZE, write(kicker, "kick....", MSG_SIZE));
+    ASSERT_EQ(MSG_SIZE, write(kicked, "data....", MSG_SIZE));
+    listener.letGo();
+
+    // The pending event is dropped, kicked is closed without an answer
+    char buf[MSG_SIZE];
+    EXPECT_EQ(MSG_SIZE, read(held, buf, sizeof(buf)));
+    EXPECT_EQ(MSG_SIZE, read(kicker, buf, sizeof(buf)));
+    // closed with data unread, which resets rather than ends the stream
+    ssize_t n = read(kicked, buf, sizeof(buf));
+    EXPECT_TRUE((n == 0) || ((n == -1) && (errno == ECONNRESET))) << strerror(errno);
+    EXPECT_TRUE(echo(kicker, "more...."));
+
+    close(kicker);
+    close(kicked);
+    close(held);
+    EXPECT_EQ(0, listener.stopListener());
+}
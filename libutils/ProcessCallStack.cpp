@@ -28,6 +28,9 @@
 
 #include <limits.h>
 
+#include <backtrace/BacktraceMap.h>
+#include <UniquePtr.h>
+
 namespace android {
 
 enum {
@@ -154,6 +157,10 @@ void ProcessCallStack::update() {
         mTimeUpdated = tm;
     }
 
+    // One map for all the threads, so each library is looked up once and a
+    // function named for one thread is not looked up again for the next.
+    UniquePtr<BacktraceMap> map(BacktraceMap::Create(selfPid));
+
     /*
      * Each tid is a directory inside of /proc/self/task
      * - Read every file in directory => get every tid
@@ -186,7 +193,7 @@ void ProcessCallStack::update() {
         int ignoreDepth = (selfPid == tid) ? IGNORE_DEPTH_CURRENT_THREAD : 0;
 
         // Update thread's call stacks
-        threadInfo.callStack.update(ignoreDepth, tid);
+        threadInfo.callStack.update(ignoreDepth, tid, map.get());
 
         // Read/save thread name
         threadInfo.threadName = getThreadName(tid);
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "lowmemorykiller"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+#include "lmk_engine.h"
+
+/* Big enough for the zoneinfo of several nodes */
+#define ZONEINFO_BUF_SIZE (16 * 1024)
+#define STATM_BUF_SIZE 128
+/* Leave most of the fd limit to everything else */
+#define MAX_STATM_FDS 512
+/* Most processes planned for one memory pressure event */
+#define MAX_KILL_SET 32
+
+int lowmem_adj[MAX_TARGETS];
+int lowmem_minfree[MAX_TARGETS];
+int lowmem_targets_size;
+
+#define PIDHASH_SZ 1024
+static struct proc *pidhash[PIDHASH_SZ];
+#define pid_hashfn(x) ((((x) >> 8) ^ (x)) & (PIDHASH_SZ - 1))
+
+#define ADJTOSLOT(adj) (adj + -OOM_ADJUST_MIN)
+static struct adjslot_list procadjslot_list[ADJTOSLOT(OOM_ADJUST_MAX) + 1];
+
+static int statm_fds;
+
+void lmk_engine_init(void) {
+    int i;
+
+    for (i = 0; i <= ADJTOSLOT(OOM_ADJUST_MAX); i++) {
+        procadjslot_list[i].next = &procadjslot_list[i];
+        procadjslot_list[i].prev = &procadjslot_list[i];
+    }
+}
+
+/*
+ * Reads the whole of fd from offset 0, leaving it open for the next sample.
+ * Returns the length read, or -1.
+ */
+static ssize_t pread_all(int fd, char *buf, size_t max_len)
+{
+    ssize_t ret = 0;
+
+    while (max_len > 0) {
+        ssize_t r = TEMP_FAILURE_RETRY(pread(fd, buf, max_len, ret));
+        if (r == 0) {
+            break;
+        }
+        if (r == -1) {
+            return -1;
+        }
+        ret += r;
+        buf += r;
+        max_len -= r;
+    }
+
+    return ret;
+}
+
+/* Parses a decimal number after optional blanks, leaving *cpp past it. */
+static int parse_uint(const char **cpp) {
+    const char *cp = *cpp;
+    int val = 0;
+
+    while (*cp == ' ' || *cp == '\t')
+        cp++;
+    while (*cp >= '0' && *cp <= '9')
+        val = val * 10 + (*cp++ - '0');
+
+    *cpp = cp;
+    return val;
+}
+
+static bool match_field(const char **cpp, const char *field, size_t len) {
+    if (strncmp(*cpp, field, len))
+        return false;
+    *cpp += len;
+    return true;
+}
+
+#define MATCH_FIELD(cpp, field) match_field(cpp, field, sizeof(field) - 1)
+
+static int zoneinfo_parse_protection(const char *cp) {
+    int max = 0;
+    int zoneval;
+
+    /* "(0, 1234, 5678)" */
+    while (*cp && *cp != '\n') {
+        if (*cp < '0' || *cp > '9') {
+            cp++;
+            continue;
+        }
+        zoneval = parse_uint(&cp);
+        if (zoneval > max)
+            max = zoneval;
+    }
+
+    return max;
+}
+
+/*
+ * Only the handful of fields lmkd uses are looked at, dispatched on their
+ * first character, without tokenizing or copying the lines.
+ */
+void zoneinfo_parse_buf(const char *buf, size_t len, struct sysmeminfo *mip) {
+    const char *cp = buf;
+    const char *end = buf + len;
+
+    memset(mip, 0, sizeof(struct sysmeminfo));
+
+    while (cp < end) {
+        const char *eol;
+
+        while (*cp == ' ')
+            cp++;
+
+        switch (*cp) {
+        case 'n':
+            if (MATCH_FIELD(&cp, "nr_free_pages "))
+                mip->nr_free_pages += parse_uint(&cp);
+            else if (MATCH_FIELD(&cp, "nr_file_pages "))
+                mip->nr_file_pages += parse_uint(&cp);
+            else if (MATCH_FIELD(&cp, "nr_shmem "))
+                mip->nr_shmem += parse_uint(&cp);
+            break;
+        case 'h':
+            if (MATCH_FIELD(&cp, "high "))
+                mip->totalreserve_pages += parse_uint(&cp);
+            break;
+        case 'p':
+            if (MATCH_FIELD(&cp, "protection: "))
+                mip->totalreserve_pages += zoneinfo_parse_protection(cp);
+            break;
+        }
+
+        eol = memchr(cp, '\n', end - cp);
+        if (!eol)
+            break;
+        cp = eol + 1;
+    }
+}
+
+int zoneinfo_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1)
+        ALOGE("%s open: errno=%d", path, errno);
+    return fd;
+}
+
+int zoneinfo_read(int fd, struct sysmeminfo *mip) {
+    /* lmkd runs with its memory locked, keep this off its stack */
+    static char buf[ZONEINFO_BUF_SIZE];
+    ssize_t size;
+
+    size = pread_all(fd, buf, sizeof(buf) - 1);
+    if (size < 0) {
+        ALOGE("zoneinfo read: errno=%d", errno);
+        return -1;
+    }
+    if ((size_t)size == sizeof(buf) - 1)
+        ALOGE("zoneinfo larger than %zu bytes, ignoring the rest", sizeof(buf) - 1);
+    buf[size] = 0;
+
+    zoneinfo_parse_buf(buf, size, mip);
+    return 0;
+}
+
+struct proc *pid_lookup(int pid) {
+    struct proc *procp;
+
+    for (procp = pidhash[pid_hashfn(pid)]; procp && procp->pid != pid;
+         procp = procp->pidhash_next)
+            ;
+
+    return procp;
+}
+
+static void adjslot_insert(struct adjslot_list *head, struct adjslot_list *new)
+{
+    struct adjslot_list *next = head->next;
+    new->prev = head;
+    new->next = next;
+    next->prev = new;
+    head->next = new;
+}
+
+static void adjslot_remove(struct adjslot_list *old)
+{
+    struct adjslot_list *prev = old->prev;
+    struct adjslot_list *next = old->next;
+    next->prev = prev;
+    prev->next = next;
+}
+
+static void proc_slot(struct proc *procp) {
+    int adjslot = ADJTOSLOT(procp->oomadj);
+
+    adjslot_insert(&procadjslot_list[adjslot], &procp->asl);
+}
+
+static void proc_unslot(struct proc *procp) {
+    adjslot_remove(&procp->asl);
+}
+
+static void proc_insert(struct proc *procp) {
+    int hval = pid_hashfn(procp->pid);
+
+    procp->pidhash_next = pidhash[hval];
+    pidhash[hval] = procp;
+    proc_slot(procp);
+}
+
+struct proc *proc_update(int pid, uid_t uid, int oomadj) {
+    struct proc *procp = pid_lookup(pid);
+
+    if (!procp) {
+        procp = malloc(sizeof(struct proc));
+        if (!procp)
+            return NULL;
+
+        procp->pid = pid;
+        procp->uid = uid;
+        procp->oomadj = oomadj;
+        procp->rss = 0;
+        procp->statm_fd = -1;
+        proc_insert(procp);
+    } else {
+        proc_unslot(procp);
+        procp->oomadj = oomadj;
+        proc_slot(procp);
+    }
+
+    return procp;
+}
+
+int pid_remove(int pid) {
+    int hval = pid_hashfn(pid);
+    struct proc *procp;
+    struct proc *prevp;
+
+    for (procp = pidhash[hval], prevp = NULL; procp && procp->pid != pid;
+         procp = procp->pidhash_next)
+            prevp = procp;
+
+    if (!procp)
+        return -1;
+
+    if (!prevp)
+        pidhash[hval] = procp->pidhash_next;
+    else
+        prevp->pidhash_next = procp->pidhash_next;
+
+    proc_unslot(procp);
+    if (procp->statm_fd >= 0) {
+        close(procp->statm_fd);
+        statm_fds--;
+    }
+    free(procp);
+    return 0;
+}
+
+/*
+ * The statm file stays open for the life of the process. The open file is
+ * tied to the process rather than to the pid, so it fails once the process
+ * is gone instead of describing a process that reused the pid.
+ */
+int proc_sample_rss(struct proc *procp) {
+    char path[32];
+    char line[STATM_BUF_SIZE];
+    const char *cp = line;
+    ssize_t ret;
+    int fd = procp->statm_fd;
+
+    if (fd < 0) {
+        snprintf(path, sizeof(path), "/proc/%d/statm", procp->pid);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            return -1;
+    }
+
+    ret = pread_all(fd, line, sizeof(line) - 1);
+    if (ret <= 0) {
+        if (fd != procp->statm_fd)
+            close(fd);
+        return -1;
+    }
+    line[ret] = 0;
+
+    if (fd != procp->statm_fd) {
+        if (statm_fds < MAX_STATM_FDS) {
+            procp->statm_fd = fd;
+            statm_fds++;
+        } else {
+            close(fd);
+        }
+    }
+
+    /* "size resident shared ..." */
+    parse_uint(&cp);
+    procp->rss = parse_uint(&cp);
+    return procp->rss;
+}
+
+static struct proc *proc_adj_lru(int oomadj) {
+    struct adjslot_list *head = &procadjslot_list[ADJTOSLOT(oomadj)];
+
+    return head->prev == head ? NULL : (struct proc *)head->prev;
+}
+
+static struct proc *proc_adj_prev(struct proc *procp) {
+    struct adjslot_list *head = &procadjslot_list[ADJTOSLOT(procp->oomadj)];
+
+    return procp->asl.prev == head ? NULL : (struct proc *)procp->asl.prev;
+}
+
+int lowmem_min_score_adj(int other_free, int other_file, int *minfree) {
+    int i;
+
+    for (i = 0; i < lowmem_targets_size; i++) {
+        if (other_free < lowmem_minfree[i] && other_file < lowmem_minfree[i]) {
+            *minfree = lowmem_minfree[i];
+            return lowmem_adj[i];
+        }
+    }
+
+    return OOM_ADJUST_MAX + 1;
+}
+
+int select_kill_set(int other_free, int other_file, struct kill_target *set, int max)
+{
+    int count = 0;
+    int minfree = 0;
+    int min_score_adj = lowmem_min_score_adj(other_free, other_file, &minfree);
+    int adj;
+
+    /*
+     * Freeing memory only raises the lowest oomadj worth killing at, and
+     * victims come in falling oomadj order, so the walk ends at the first
+     * one below it.
+     */
+    for (adj = OOM_ADJUST_MAX; adj >= min_score_adj && count < max; adj--) {
+        struct proc *procp = proc_adj_lru(adj);
+
+        while (procp && adj >= min_score_adj && count < max) {
+            struct proc *next = proc_adj_prev(procp);
+
+            set[count].procp = procp;
+            set[count].other_free = other_free;
+            set[count].other_file = other_file;
+            set[count].minfree = minfree;
+            set[count].min_score_adj = min_score_adj;
+            count++;
+
+            /* An unknown size is left for the kill to find out */
+            if (procp->rss > 0) {
+                other_free += procp->rss;
+                other_file += procp->rss;
+            }
+            min_score_adj = lowmem_min_score_adj(other_free, other_file, &minfree);
+            procp = next;
+        }
+    }
+
+    return count;
+}
+
+int find_and_kill_processes(int other_free, int other_file, bool kill_one,
+                            lmk_kill_func kill_func, void *data)
+{
+    struct kill_target set[MAX_KILL_SET];
+    bool first = true;
+    int kills = 0;
+    int count;
+    int i;
+
+    do {
+        count = select_kill_set(other_free, other_file, set, MAX_KILL_SET);
+
+        for (i = 0; i < count; i++) {
+            struct kill_target *target = &set[i];
+            int killed_size;
+
+            target->other_free = other_free;
+            target->other_file = other_file;
+            target->min_score_adj = lowmem_min_score_adj(other_free, other_file,
+                                                         &target->minfree);
+            if (target->procp->oomadj < target->min_score_adj)
+                return kills;
+
+            killed_size = kill_func(target, first, data);
+            if (killed_size < 0)
+                continue;
+            kills++;
+            if (kill_one)
+                return kills;
+            first = false;
+            other_free += killed_size;
+            other_file += killed_size;
+        }
+        /* Estimates too high, or victims gone: the set may have run short */
+    } while (count);
+
+    return kills;
+}
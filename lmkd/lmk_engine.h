@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LMKD_LMK_ENGINE_H_
+#define _LMKD_LMK_ENGINE_H_
+
+/*
+ * The part of lmkd that decides what to kill: memory state sampling, the
+ * table of processes reported by ActivityManager and the kill policy. It
+ * does no killing and talks to no socket, so traces can be replayed through
+ * it (see tests/lmkd_replay.c).
+ */
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define OOM_DISABLE (-17)
+/* inclusive */
+#define OOM_ADJUST_MIN (-16)
+#define OOM_ADJUST_MAX 15
+
+#define MAX_TARGETS 6
+
+struct sysmeminfo {
+    int nr_free_pages;
+    int nr_file_pages;
+    int nr_shmem;
+    int totalreserve_pages;
+};
+
+struct adjslot_list {
+    struct adjslot_list *next;
+    struct adjslot_list *prev;
+};
+
+struct proc {
+    struct adjslot_list asl;
+    int pid;
+    uid_t uid;
+    int oomadj;
+    int rss;            /* resident pages at the last sample, 0 if unknown */
+    int statm_fd;       /* open /proc/<pid>/statm, or -1 */
+    struct proc *pidhash_next;
+};
+
+/* A process picked to be killed, and the memory state it is killed for */
+struct kill_target {
+    struct proc *procp;
+    int other_free;
+    int other_file;
+    int minfree;
+    int min_score_adj;
+};
+
+extern int lowmem_adj[MAX_TARGETS];
+extern int lowmem_minfree[MAX_TARGETS];
+extern int lowmem_targets_size;
+
+void lmk_engine_init(void);
+
+/*
+ * Opens a /proc/zoneinfo style file, to be sampled with zoneinfo_read().
+ * Returns the fd or -1.
+ */
+int zoneinfo_open(const char *path);
+
+/* Re-reads the zoneinfo file from the start. Returns 0 or -1. */
+int zoneinfo_read(int fd, struct sysmeminfo *mip);
+
+/* Parses len bytes of zoneinfo text, which must be followed by a NUL. */
+void zoneinfo_parse_buf(const char *buf, size_t len, struct sysmeminfo *mip);
+
+struct proc *pid_lookup(int pid);
+
+/*
+ * Adds pid or moves it to a new oomadj, as the most recently used process of
+ * that oomadj. Returns NULL if out of memory.
+ */
+struct proc *proc_update(int pid, uid_t uid, int oomadj);
+
+int pid_remove(int pid);
+
+/*
+ * Samples the resident size of procp. Opens its statm file the first time.
+ * Returns the size in pages, or -1 if the process is gone.
+ */
+int proc_sample_rss(struct proc *procp);
+
+/*
+ * Returns the lowest oomadj to kill at for this memory state, and stores its
+ * minfree. OOM_ADJUST_MAX + 1 if nothing needs to be killed.
+ */
+int lowmem_min_score_adj(int other_free, int other_file, int *minfree);
+
+/*
+ * Picks, in one pass, the processes likely to be killed to get out of the
+ * memory state described by other_free and other_file, in the order they
+ * should die: least recently used first within the highest oomadj. Each
+ * victim's sampled rss is assumed to come back as both free and file pages,
+ * and a process never sampled as freeing nothing. Returns the number of
+ * victims stored in set, at most max.
+ *
+ * The sizes are estimates, find_and_kill_processes() checks each victim
+ * against the memory actually freed before killing it.
+ */
+int select_kill_set(int other_free, int other_file, struct kill_target *set, int max);
+
+/*
+ * Kills target->procp and drops it from the process table. first is false
+ * once an earlier kill changed the memory state, so target's is estimated.
+ * Returns the pages freed, or -1 if the process was already gone.
+ */
+typedef int (*lmk_kill_func)(const struct kill_target *target, bool first, void *data);
+
+/*
+ * Kills the processes needed to leave the memory state described by
+ * other_free and other_file behind, or only the first one if kill_one.
+ * The likely victims come from select_kill_set(). Each kill then counts
+ * what it actually freed, and the next victim only dies if its oomadj is
+ * still at or above the limit for that memory state, as when victims were
+ * picked one kill at a time. Returns the number of processes killed.
+ */
+int find_and_kill_processes(int other_free, int other_file, bool kill_one,
+                            lmk_kill_func kill_func, void *data);
+
+#endif /* _LMKD_LMK_ENGINE_H_ */
@@ -34,6 +34,8 @@
 #include <log/log.h>
 #include <processgroup/processgroup.h>
 
+#include "lmk_engine.h"
+
 #ifndef __unused
 #define __unused __attribute__((__unused__))
 #endif
@@ -54,7 +56,6 @@ enum lmk_cmd {
     LMK_PROCREMOVE,
 };
 
-#define MAX_TARGETS 6
 /*
  * longest is LMK_TARGET followed by MAX_TARGETS each minfree and minkillprio
  * values
@@ -72,51 +73,18 @@ static int ctrl_lfd;
 static int ctrl_dfd = -1;
 static int ctrl_dfd_reopened; /* did we reopen ctrl conn on this loop? */
 
+/* /proc/zoneinfo, kept open and re-read on each event */
+static int zoneinfo_fd = -1;
+
 /* 1 memory pressure level, 1 ctrl listen socket, 1 ctrl data socket */
 #define MAX_EPOLL_EVENTS 3
 static int epollfd;
 static int maxevents;
 
-#define OOM_DISABLE (-17)
-/* inclusive */
-#define OOM_ADJUST_MIN (-16)
-#define OOM_ADJUST_MAX 15
-
 /* kernel OOM score values */
 #define OOM_SCORE_ADJ_MIN       (-1000)
 #define OOM_SCORE_ADJ_MAX       1000
 
-static int lowmem_adj[MAX_TARGETS];
-static int lowmem_minfree[MAX_TARGETS];
-static int lowmem_targets_size;
-
-struct sysmeminfo {
-    int nr_free_pages;
-    int nr_file_pages;
-    int nr_shmem;
-    int totalreserve_pages;
-};
-
-struct adjslot_list {
-    struct adjslot_list *next;
-    struct adjslot_list *prev;
-};
-
-struct proc {
-    struct adjslot_list asl;
-    int pid;
-    uid_t uid;
-    int oomadj;
-    struct proc *pidhash_next;
-};
-
-#define PIDHASH_SZ 1024
-static struct proc *pidhash[PIDHASH_SZ];
-#define pid_hashfn(x) ((((x) >> 8) ^ (x)) & (PIDHASH_SZ - 1))
-
-#define ADJTOSLOT(adj) (adj + -OOM_ADJUST_MIN)
-static struct adjslot_list procadjslot_list[ADJTOSLOT(OOM_ADJUST_MAX) + 1];
-
 /*
  * Wait 1-2 seconds for the death report of a killed process prior to
  * considering killing more processes.
@@ -156,79 +124,6 @@ static int lowmem_oom_adj_to_oom_score_adj(int oom_adj)
         return (oom_adj * OOM_SCORE_ADJ_MAX) / -OOM_DISABLE;
 }
 
-static struct proc *pid_lookup(int pid) {
-    struct proc *procp;
-
-    for (procp = pidhash[pid_hashfn(pid)]; procp && procp->pid != pid;
-         procp = procp->pidhash_next)
-            ;
-
-    return procp;
-}
-
-static void adjslot_insert(struct adjslot_list *head, struct adjslot_list *new)
-{
-    struct adjslot_list *next = head->next;
-    new->prev = head;
-    new->next = next;
-    next->prev = new;
-    head->next = new;
-}
-
-static void adjslot_remove(struct adjslot_list *old)
-{
-    struct adjslot_list *prev = old->prev;
-    struct adjslot_list *next = old->next;
-    next->prev = prev;
-    prev->next = next;
-}
-
-static struct adjslot_list *adjslot_tail(struct adjslot_list *head) {
-    struct adjslot_list *asl = head->prev;
-
-    return asl == head ? NULL : asl;
-}
-
-static void proc_slot(struct proc *procp) {
-    int adjslot = ADJTOSLOT(procp->oomadj);
-
-    adjslot_insert(&procadjslot_list[adjslot], &procp->asl);
-}
-
-static void proc_unslot(struct proc *procp) {
-    adjslot_remove(&procp->asl);
-}
-
-static void proc_insert(struct proc *procp) {
-    int hval = pid_hashfn(procp->pid);
-
-    procp->pidhash_next = pidhash[hval];
-    pidhash[hval] = procp;
-    proc_slot(procp);
-}
-
-static int pid_remove(int pid) {
-    int hval = pid_hashfn(pid);
-    struct proc *procp;
-    struct proc *prevp;
-
-    for (procp = pidhash[hval], prevp = NULL; procp && procp->pid != pid;
-         procp = procp->pidhash_next)
-            prevp = procp;
-
-    if (!procp)
-        return -1;
-
-    if (!prevp)
-        pidhash[hval] = procp->pidhash_next;
-    else
-        prevp->pidhash_next = procp->pidhash_next;
-
-    proc_unslot(procp);
-    free(procp);
-    return 0;
-}
-
 static void writefilestring(char *path, char *s) {
     int fd = open(path, O_WRONLY);
     int len = strlen(s);
@@ -266,23 +161,15 @@ static void cmd_procprio(int pid, int uid, int oomadj) {
     if (use_inkernel_interface)
         return;
 
-    procp = pid_lookup(pid);
+    procp = proc_update(pid, uid, oomadj);
     if (!procp) {
-            procp = malloc(sizeof(struct proc));
-            if (!procp) {
-                // Oh, the irony.  May need to rebuild our state.
-                return;
-            }
-
-            procp->pid = pid;
-            procp->uid = uid;
-            procp->oomadj = oomadj;
-            proc_insert(procp);
-    } else {
-        proc_unslot(procp);
-        procp->oomadj = oomadj;
-        proc_slot(procp);
+        // Oh, the irony.  May need to rebuild our state.
+        return;
     }
+
+    /* Keep the size current, so a kill decision needs no /proc lookups */
+    if (proc_sample_rss(procp) < 0)
+        procp->rss = 0;
 }
 
 static void cmd_procremove(int pid) {
@@ -438,100 +325,6 @@ static void ctrl_connect_handler(uint32_t events __unused) {
     }
 }
 
-static int zoneinfo_parse_protection(char *cp) {
-    int max = 0;
-    int zoneval;
-    char *save_ptr;
-
-    for (cp = strtok_r(cp, "(), ", &save_ptr); cp; cp = strtok_r(NULL, "), ", &save_ptr)) {
-        zoneval = strtol(cp, &cp, 0);
-        if (zoneval > max)
-            max = zoneval;
-    }
-
-    return max;
-}
-
-static void zoneinfo_parse_line(char *line, struct sysmeminfo *mip) {
-    char *cp = line;
-    char *ap;
-    char *save_ptr;
-
-    cp = strtok_r(line, " ", &save_ptr);
-    if (!cp)
-        return;
-
-    ap = strtok_r(NULL, " ", &save_ptr);
-    if (!ap)
-        return;
-
-    if (!strcmp(cp, "nr_free_pages"))
-        mip->nr_free_pages += strtol(ap, NULL, 0);
-    else if (!strcmp(cp, "nr_file_pages"))
-        mip->nr_file_pages += strtol(ap, NULL, 0);
-    else if (!strcmp(cp, "nr_shmem"))
-        mip->nr_shmem += strtol(ap, NULL, 0);
-    else if (!strcmp(cp, "high"))
-        mip->totalreserve_pages += strtol(ap, NULL, 0);
-    else if (!strcmp(cp, "protection:"))
-        mip->totalreserve_pages += zoneinfo_parse_protection(ap);
-}
-
-static int zoneinfo_parse(struct sysmeminfo *mip) {
-    int fd;
-    ssize_t size;
-    char buf[PAGE_SIZE];
-    char *save_ptr;
-    char *line;
-
-    memset(mip, 0, sizeof(struct sysmeminfo));
-
-    fd = open(ZONEINFO_PATH, O_RDONLY);
-    if (fd == -1) {
-        ALOGE("%s open: errno=%d", ZONEINFO_PATH, errno);
-        return -1;
-    }
-
-    size = read_all(fd, buf, sizeof(buf) - 1);
-    if (size < 0) {
-        ALOGE("%s read: errno=%d", ZONEINFO_PATH, errno);
-        close(fd);
-        return -1;
-    }
-    ALOG_ASSERT((size_t)size < sizeof(buf) - 1, "/proc/zoneinfo too large");
-    buf[size] = 0;
-
-    for (line = strtok_r(buf, "\n", &save_ptr); line; line = strtok_r(NULL, "\n", &save_ptr))
-            zoneinfo_parse_line(line, mip);
-
-    close(fd);
-    return 0;
-}
-
-static int proc_get_size(int pid) {
-    char path[PATH_MAX];
-    char line[LINE_MAX];
-    int fd;
-    int rss = 0;
-    int total;
-    ssize_t ret;
-
-    snprintf(path, PATH_MAX, "/proc/%d/statm", pid);
-    fd = open(path, O_RDONLY);
-    if (fd == -1)
-        return -1;
-
-    ret = read_all(fd, line, sizeof(line) - 1);
-    if (ret < 0) {
-        close(fd);
-        return -1;
-    }
-
-    sscanf(line, "%d %d ", &total, &rss);
-    close(fd);
-    return rss;
-}
-
 static char *proc_get_name(int pid) {
     char path[PATH_MAX];
     static char line[LINE_MAX];
@@ -556,28 +349,28 @@ static char *proc_get_name(int pid) {
     return line;
 }
 
-static struct proc *proc_adj_lru(int oomadj) {
-    return (struct proc *)adjslot_tail(&procadjslot_list[ADJTOSLOT(oomadj)]);
-}
-
-/* Kill one process specified by procp.  Returns the size of the process killed */
-static int kill_one_process(struct proc *procp, int other_free, int other_file,
-        int minfree, int min_score_adj, bool first)
+/*
+ * The lmk_kill_func for find_and_kill_processes().  Returns the size of
+ * the process killed, or -1 if it was already gone.
+ */
+static int kill_one_process(const struct kill_target *target, bool first, void *data __unused)
 {
+    struct proc *procp = target->procp;
     int pid = procp->pid;
     uid_t uid = procp->uid;
     char *taskname;
     int tasksize;
     int r;
 
-    taskname = proc_get_name(pid);
-    if (!taskname) {
+    /* The statm fd is already open, this is a single read */
+    tasksize = proc_sample_rss(procp);
+    if (tasksize <= 0) {
         pid_remove(pid);
         return -1;
     }
 
-    tasksize = proc_get_size(pid);
-    if (tasksize <= 0) {
+    taskname = proc_get_name(pid);
+    if (!taskname) {
         pid_remove(pid);
         return -1;
     }
@@ -586,69 +379,25 @@ static int kill_one_process(struct proc *procp, int other_free, int other_file,
           "   to free %ldkB because cache %s%ldkB is below limit %ldkB for oom_adj %d\n"
           "   Free memory is %s%ldkB %s reserved",
           taskname, pid, uid, procp->oomadj, tasksize * page_k,
-          first ? "" : "~", other_file * page_k, minfree * page_k, min_score_adj,
-          first ? "" : "~", other_free * page_k, other_free >= 0 ? "above" : "below");
+          first ? "" : "~", target->other_file * page_k, target->minfree * page_k,
+          target->min_score_adj, first ? "" : "~", target->other_free * page_k,
+          target->other_free >= 0 ? "above" : "below");
     r = kill(pid, SIGKILL);
     killProcessGroup(uid, pid, SIGKILL);
     pid_remove(pid);
 
     if (r) {
-        ALOGE("kill(%d): errno=%d", procp->pid, errno);
+        ALOGE("kill(%d): errno=%d", pid, errno);
         return -1;
     } else {
         return tasksize;
     }
 }
 
-/*
- * Find a process to kill based on the current (possibly estimated) free memory
- * and cached memory sizes.  Returns the size of the killed processes.
- */
-static int find_and_kill_process(int other_free, int other_file, bool first)
-{
-    int i;
-    int min_score_adj = OOM_ADJUST_MAX + 1;
-    int minfree = 0;
-    int killed_size = 0;
-
-    for (i = 0; i < lowmem_targets_size; i++) {
-        minfree = lowmem_minfree[i];
-        if (other_free < minfree && other_file < minfree) {
-            min_score_adj = lowmem_adj[i];
-            break;
-        }
-    }
-
-    if (min_score_adj == OOM_ADJUST_MAX + 1)
-        return 0;
-
-    for (i = OOM_ADJUST_MAX; i >= min_score_adj; i--) {
-        struct proc *procp;
-
-retry:
-        procp = proc_adj_lru(i);
-
-        if (procp) {
-            killed_size = kill_one_process(procp, other_free, other_file, minfree, min_score_adj, first);
-            if (killed_size < 0) {
-                goto retry;
-            } else {
-                return killed_size;
-            }
-        }
-    }
-
-    return 0;
-}
-
 static void mp_event(uint32_t events __unused) {
     int ret;
     unsigned long long evcount;
     struct sysmeminfo mi;
-    int other_free;
-    int other_file;
-    int killed_size;
-    bool first = true;
 
     ret = read(mpevfd, &evcount, sizeof(evcount));
     if (ret < 0)
@@ -658,22 +407,17 @@ static void mp_event(uint32_t events __unused) {
     if (time(NULL) - kill_lasttime < KILL_TIMEOUT)
         return;
 
-    while (zoneinfo_parse(&mi) < 0) {
+    if (zoneinfo_fd < 0)
+        zoneinfo_fd = zoneinfo_open(ZONEINFO_PATH);
+
+    if (zoneinfo_fd < 0 || zoneinfo_read(zoneinfo_fd, &mi) < 0) {
         // Failed to read /proc/zoneinfo, assume ENOMEM and kill something
-        find_and_kill_process(0, 0, true);
+        find_and_kill_processes(0, 0, true, kill_one_process, NULL);
+        return;
     }
 
-    other_free = mi.nr_free_pages - mi.totalreserve_pages;
-    other_file = mi.nr_file_pages - mi.nr_shmem;
-
-    do {
-        killed_size = find_and_kill_process(other_free, other_file, first);
-        if (killed_size > 0) {
-            first = false;
-            other_free += killed_size;
-            other_file += killed_size;
-        }
-    } while (killed_size > 0);
+    find_and_kill_processes(mi.nr_free_pages - mi.totalreserve_pages,
+                            mi.nr_file_pages - mi.nr_shmem, false, kill_one_process, NULL);
 }
 
 static int init_mp(char *levelstr, void *event_handler)
@@ -739,7 +483,6 @@ err_open_mpfd:
 
 static int init(void) {
     struct epoll_event epev;
-    int i;
     int ret;
 
     page_k = sysconf(_SC_PAGESIZE);
@@ -783,10 +526,7 @@ static int init(void) {
             ALOGE("Kernel does not support memory pressure events or in-kernel low memory killer");
     }
 
-    for (i = 0; i <= ADJTOSLOT(OOM_ADJUST_MAX); i++) {
-        procadjslot_list[i].next = &procadjslot_list[i];
-        procadjslot_list[i].prev = &procadjslot_list[i];
-    }
+    lmk_engine_init();
 
     return 0;
 }
@@ -0,0 +1,30 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Replays memory pressure traces through the kill policy. Run with:
+#   adb push sample.trace /data/local/tmp
+#   adb shell lmkd_replay /data/local/tmp/sample.trace 1000
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := lmkd_replay.c ../lmk_engine.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_CFLAGS := -Werror
+
+LOCAL_MODULE := lmkd_replay
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
+# Checks the kill loop against picking one victim per kill. Run with:
+#   adb shell lmkd_kill_test
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := lmkd_kill_test.c ../lmk_engine.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
+LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_CFLAGS := -Werror
+
+LOCAL_MODULE := lmkd_kill_test
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
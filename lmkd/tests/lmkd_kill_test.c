@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks that find_and_kill_processes() kills the same processes, in the
+ * same order, as lmkd did when it picked one victim per kill and looked at
+ * the memory state again after each:
+ *
+ *   lmkd_kill_test [<tables>]
+ *
+ * Each of the random process tables has sampled sizes that are off from
+ * what the kills really free, some unknown, and some processes already
+ * gone. Exits with a failure at the first table where the two disagree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lmk_engine.h"
+
+#define NR_PROCS 60
+
+static int proc_adj[NR_PROCS];
+static int proc_freed[NR_PROCS];   /* what killing it really frees */
+static bool proc_alive[NR_PROCS];
+
+struct kill_log {
+    int pids[NR_PROCS];
+    int count;
+};
+
+/* lmkd's loop before the kill set: least recently used of the highest oomadj */
+static void kill_one_at_a_time(int other_free, int other_file, struct kill_log *log) {
+    for (;;) {
+        int minfree;
+        int min_score_adj = lowmem_min_score_adj(other_free, other_file, &minfree);
+        int victim = -1;
+        int adj;
+        int pid;
+
+        /* pids were added in order, so the lowest one is the LRU */
+        for (adj = OOM_ADJUST_MAX; adj >= min_score_adj && victim < 0; adj--) {
+            for (pid = 0; pid < NR_PROCS; pid++) {
+                if (proc_alive[pid] && proc_adj[pid] == adj) {
+                    victim = pid;
+                    break;
+                }
+            }
+        }
+        if (victim < 0)
+            return;
+
+        proc_alive[victim] = false;
+        if (proc_freed[victim] <= 0)
+            continue;
+        log->pids[log->count++] = victim;
+        other_free += proc_freed[victim];
+        other_file += proc_freed[victim];
+    }
+}
+
+static int logged_kill(const struct kill_target *target, bool first, void *data) {
+    struct kill_log *log = data;
+    int pid = target->procp->pid;
+
+    pid_remove(pid);
+    if (proc_freed[pid] <= 0)
+        return -1;
+    log->pids[log->count++] = pid;
+    return proc_freed[pid];
+}
+
+static void random_table(void) {
+    int pid;
+
+    for (pid = 0; pid < NR_PROCS; pid++) {
+        struct proc *procp;
+        int sampled = rand() % 5 ? rand() % 800 : 0;
+
+        proc_adj[pid] = rand() % (OOM_ADJUST_MAX + 1);
+        if (rand() % 4)
+            proc_freed[pid] = sampled + rand() % 400 - 200;
+        else
+            proc_freed[pid] = rand() % 2 ? 0 : rand() % 800;
+        proc_alive[pid] = true;
+
+        procp = proc_update(pid, 0, proc_adj[pid]);
+        if (!procp) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        procp->rss = sampled;
+    }
+}
+
+int main(int argc, char **argv) {
+    static const int minfree[] = { 1000, 2000, 3000, 4000 };
+    static const int adj[] = { 0, 3, 7, 12 };
+    int tables = 100000;
+    int i;
+
+    if (argc > 1)
+        tables = atoi(argv[1]);
+
+    lmk_engine_init();
+    for (i = 0; i < 4; i++) {
+        lowmem_minfree[i] = minfree[i];
+        lowmem_adj[i] = adj[i];
+    }
+    lowmem_targets_size = 4;
+
+    srand(1);
+    for (i = 0; i < tables; i++) {
+        struct kill_log expected, killed;
+        int other_free = rand() % 4500 - 200;
+        int other_file = rand() % 4500;
+        int pid;
+
+        memset(&expected, 0, sizeof(expected));
+        memset(&killed, 0, sizeof(killed));
+        random_table();
+        kill_one_at_a_time(other_free, other_file, &expected);
+        find_and_kill_processes(other_free, other_file, false, logged_kill, &killed);
+
+        if (expected.count != killed.count ||
+                memcmp(expected.pids, killed.pids, expected.count * sizeof(int))) {
+            fprintf(stderr, "table %d: expected %d kills, got %d\n", i, expected.count,
+                    killed.count);
+            return EXIT_FAILURE;
+        }
+        for (pid = 0; pid < NR_PROCS; pid++)
+            pid_remove(pid);
+    }
+
+    printf("%d tables, same kills\n", tables);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a recorded memory pressure trace through lmkd's kill policy and
+ * reports how long each pressure event took to turn into a kill set.
+ *
+ *   lmkd_replay <trace> [<repeat>]
+ *
+ * A trace is a text file of these lines; '#' starts a comment:
+ *
+ *   target <minfree> <adj> [<minfree> <adj> ...]   as LMK_TARGET
+ *   procprio <pid> <uid> <oomadj> <rss pages>       as LMK_PROCPRIO, plus
+ *                                                   the size lmkd samples
+ *   procremove <pid>                                as LMK_PROCREMOVE
+ *   pressure                                        a pressure event, with
+ *   <the /proc/zoneinfo read at that time>          the zoneinfo that lmkd
+ *   end                                             reads for it
+ *
+ * A reaction is measured from the event to the victims being picked and
+ * dropped from the process table: reading and parsing the zoneinfo, then
+ * choosing the kill set and checking each victim against the memory freed
+ * so far, counting its traced rss as freed. Nothing is killed.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lmk_engine.h"
+
+struct trace_stats {
+    int events;
+    int kills;
+    long long freed_pages;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Stands in for /proc/zoneinfo, rewritten with each event's snapshot */
+static int set_zoneinfo(int fd, const char *text, size_t len) {
+    if (ftruncate(fd, 0) || pwrite(fd, text, len, 0) != (ssize_t)len) {
+        fprintf(stderr, "can't write zoneinfo snapshot: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* Kills nothing, the trace's rss stands in for what the kill frees */
+static int replay_kill(const struct kill_target *target, bool first, void *data) {
+    struct trace_stats *stats = data;
+    int rss = target->procp->rss;
+
+    pid_remove(target->procp->pid);
+    if (rss <= 0)
+        return -1;
+    stats->freed_pages += rss;
+    return rss;
+}
+
+static void replay_pressure(int zoneinfo_fd, struct trace_stats *stats, bool verbose) {
+    struct sysmeminfo mi;
+    uint64_t start, elapsed;
+    int count = 0;
+
+    start = now_ns();
+    if (zoneinfo_read(zoneinfo_fd, &mi) == 0) {
+        count = find_and_kill_processes(mi.nr_free_pages - mi.totalreserve_pages,
+                                        mi.nr_file_pages - mi.nr_shmem, false,
+                                        replay_kill, stats);
+    }
+    elapsed = now_ns() - start;
+
+    if (verbose) {
+        printf("event %d: free %d file %d reserve %d shmem %d -> %d kills in %" PRIu64 "ns\n",
+               stats->events, mi.nr_free_pages, mi.nr_file_pages, mi.totalreserve_pages,
+               mi.nr_shmem, count, elapsed);
+    }
+
+    stats->events++;
+    stats->kills += count;
+    stats->total_ns += elapsed;
+    if (!stats->min_ns || elapsed < stats->min_ns)
+        stats->min_ns = elapsed;
+    if (elapsed > stats->max_ns)
+        stats->max_ns = elapsed;
+}
+
+static void cmd_target(char *args) {
+    char *save_ptr;
+    char *minfree;
+    char *adj;
+    int i = 0;
+
+    for (minfree = strtok_r(args, " \t", &save_ptr); minfree && i < MAX_TARGETS;
+         minfree = strtok_r(NULL, " \t", &save_ptr)) {
+        adj = strtok_r(NULL, " \t", &save_ptr);
+        if (!adj)
+            break;
+        lowmem_minfree[i] = atoi(minfree);
+        lowmem_adj[i] = atoi(adj);
+        i++;
+    }
+    lowmem_targets_size = i;
+}
+
+static int replay(FILE *trace, int zoneinfo_fd, struct trace_stats *stats, bool verbose) {
+    char line[512];
+    char *zoneinfo = NULL;
+    size_t zoneinfo_len = 0;
+    bool in_pressure = false;
+    int lineno = 0;
+
+    while (fgets(line, sizeof(line), trace)) {
+        int pid, uid, oomadj, rss;
+
+        lineno++;
+        if (in_pressure) {
+            if (strcmp(line, "end\n")) {
+                size_t len = strlen(line);
+                char *grown = realloc(zoneinfo, zoneinfo_len + len + 1);
+                if (!grown) {
+                    free(zoneinfo);
+                    return -1;
+                }
+                zoneinfo = grown;
+                memcpy(zoneinfo + zoneinfo_len, line, len + 1);
+                zoneinfo_len += len;
+                continue;
+            }
+            in_pressure = false;
+            if (set_zoneinfo(zoneinfo_fd, zoneinfo ? zoneinfo : "", zoneinfo_len)) {
+                free(zoneinfo);
+                return -1;
+            }
+            replay_pressure(zoneinfo_fd, stats, verbose);
+            zoneinfo_len = 0;
+            continue;
+        }
+
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        } else if (!strncmp(line, "target ", 7)) {
+            cmd_target(line + 7);
+        } else if (sscanf(line, "procprio %d %d %d %d", &pid, &uid, &oomadj, &rss) == 4) {
+            struct proc *procp = proc_update(pid, uid, oomadj);
+            if (procp)
+                procp->rss = rss;
+        } else if (sscanf(line, "procremove %d", &pid) == 1) {
+            pid_remove(pid);
+        } else if (!strcmp(line, "pressure\n")) {
+            in_pressure = true;
+        } else {
+            fprintf(stderr, "line %d: can't parse '%s'\n", lineno, line);
+            free(zoneinfo);
+            return -1;
+        }
+    }
+
+    free(zoneinfo);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct trace_stats stats;
+    FILE *trace;
+    FILE *zoneinfo;
+    int repeat = 1;
+    int i;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace> [<repeat>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc > 2)
+        repeat = atoi(argv[2]);
+
+    trace = fopen(argv[1], "r");
+    if (!trace) {
+        fprintf(stderr, "can't open %s: %s\n", argv[1], strerror(errno));
+        return EXIT_FAILURE;
+    }
+    zoneinfo = tmpfile();
+    if (!zoneinfo) {
+        fprintf(stderr, "can't create zoneinfo file: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    lmk_engine_init();
+    for (i = 0; i < repeat; i++) {
+        rewind(trace);
+        /* Only the first pass is printed, later ones only time */
+        if (replay(trace, fileno(zoneinfo), &stats, i == 0))
+            return EXIT_FAILURE;
+    }
+
+    if (!stats.events) {
+        printf("no pressure events\n");
+        return EXIT_SUCCESS;
+    }
+    printf("%d events, %d kills, %lld pages picked\n"
+           "reaction min %" PRIu64 "ns avg %" PRIu64 "ns max %" PRIu64 "ns\n",
+           stats.events, stats.kills, stats.freed_pages,
+           stats.min_ns, stats.total_ns / stats.events, stats.max_ns);
+    return EXIT_SUCCESS;
+}
@@ -37,6 +37,7 @@
 #include <utils/threads.h>
 
 #define DEFAULT_MAX_ROTATED_LOGS 4
+#define OUTPUT_BUFFER_SIZE (128 * 1024)
 
 static AndroidLogFormat * g_logformat;
 
@@ -74,6 +75,8 @@ static size_t g_maxRotatedLogs = DEFAULT_MAX_ROTATED_LOGS;
 static int g_outFD = -1;
 static size_t g_outByteCount = 0;
 static int g_printBinary = 0;
+static AndroidLogBuffer *g_outBuffer = NULL; // batches text output
+static std::string g_filterTags; // filterspecs pushed down to logd
 static int g_devCount = 0;                              // >1 means multiple
 
 __noreturn static void logcat_panic(bool showHelp, const char *fmt, ...) __printflike(2,3);
@@ -92,6 +95,10 @@ static void rotateLogs()
         return;
     }
 
+    if (g_outBuffer && (android_log_buffer_flush(g_outBuffer, g_outFD) < 0)) {
+        logcat_panic(false, "output error");
+    }
+
     close(g_outFD);
 
     // Compute the maximum number of digits needed to count up to g_maxRotatedLogs in decimal.
@@ -171,7 +178,8 @@ static void processBuffer(log_device_t* dev, struct log_msg *buf)
     }
 
     if (android_log_shouldPrintLine(g_logformat, entry.tag, entry.priority)) {
-        bytesWritten = android_log_printLogLine(g_logformat, g_outFD, &entry);
+        bytesWritten = android_log_bufferLogLine(g_logformat, g_outBuffer,
+                                                 g_outFD, &entry);
 
         if (bytesWritten < 0) {
             logcat_panic(false, "output error");
@@ -198,7 +206,8 @@ static void maybePrintStart(log_device_t* dev, bool printDividers) {
             snprintf(buf, sizeof(buf), "--------- %s %s\n",
                      dev->printed ? "switch to" : "beginning of",
                      dev->device);
-            if (write(g_outFD, buf, strlen(buf)) < 0) {
+            if (android_log_buffer_append(g_outBuffer, g_outFD,
+                                          buf, strlen(buf)) < 0) {
                 logcat_panic(false, "output error");
             }
         }
@@ -246,6 +255,11 @@ static void setupOutput()
 
         g_outByteCount = statbuf.st_size;
     }
+
+    g_outBuffer = android_log_buffer_new(OUTPUT_BUFFER_SIZE);
+    if (!g_outBuffer) {
+        logcat_panic(false, "couldn't allocate output buffer\n");
+    }
 }
 
 static void show_help(const char *cmd)
@@ -320,6 +334,24 @@ static int setLogFormat(const char * formatString)
     return android_log_setPrintFormat(g_logformat, format);
 }
 
+// Mirror of android_log_addFilterString, in the form logd expects
+static void addServerFilter(const char *filterString)
+{
+    const char *cp = filterString;
+    while (*cp) {
+        size_t len = strcspn(cp, " \t\n");
+        if (len) {
+            if (!g_filterTags.empty()) {
+                g_filterTags += ',';
+            }
+            g_filterTags.append(cp, len);
+            cp += len;
+        } else {
+            ++cp;
+        }
+    }
+}
+
 static const char multipliers[][2] = {
     { "" },
     { "K" },
@@ -503,6 +535,7 @@ int main(int argc, char **argv)
             case 's':
                 // default to all silent
                 android_log_addFilterRule(g_logformat, "*:s");
+                addServerFilter("*:s");
             break;
 
             case 'c':
@@ -801,6 +834,7 @@ int main(int argc, char **argv)
         if (err < 0) {
             logcat_panic(false, "Invalid filter expression in logcat args\n");
         }
+        addServerFilter(forceFilters);
     } else if (argc == optind) {
         // Add from environment variable
         char *env_tags_orig = getenv("ANDROID_LOG_TAGS");
@@ -812,6 +846,7 @@ int main(int argc, char **argv)
                 logcat_panic(true,
                             "Invalid filter expression in ANDROID_LOG_TAGS\n");
             }
+            addServerFilter(env_tags_orig);
         }
     } else {
         // Add from commandline
@@ -821,6 +856,7 @@ int main(int argc, char **argv)
             if (err < 0) {
                 logcat_panic(true, "Invalid filter expression '%s'\n", argv[i]);
             }
+            addServerFilter(argv[i]);
         }
     }
 
@@ -830,6 +866,11 @@ int main(int argc, char **argv)
     } else {
         logger_list = android_logger_list_alloc(mode, tail_lines, 0);
     }
+    // Binary output is not filtered, otherwise let logd drop what we would
+    if (!g_printBinary && !g_filterTags.empty()) {
+        std::string filter = "tags=" + g_filterTags;
+        android_logger_list_set_filter(logger_list, filter.c_str());
+    }
     while (dev) {
         dev->logger_list = logger_list;
         dev->logger = android_logger_open(logger_list,
@@ -1003,9 +1044,19 @@ int main(int argc, char **argv)
             printBinary(&log_msg);
         } else {
             processBuffer(dev, &log_msg);
+            // A dump ends with -EAGAIN, anything else may block on the
+            // next read and must not sit in the buffer meanwhile.
+            if (!(mode & ANDROID_LOG_NONBLOCK)
+                    && (android_log_buffer_flush(g_outBuffer, g_outFD) < 0)) {
+                logcat_panic(false, "output error");
+            }
         }
     }
 
+    if (android_log_buffer_flush(g_outBuffer, g_outFD) < 0) {
+        logcat_panic(false, "output error");
+    }
+
     android_logger_list_free(logger_list);
 
     return EXIT_SUCCESS;
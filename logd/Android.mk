@@ -13,9 +13,13 @@ LOCAL_SRC_FILES := \
     FlushCommand.cpp \
     LogBuffer.cpp \
     LogBufferElement.cpp \
+    LogBufferArena.cpp \
+    LogBufferCold.cpp \
+    LogCompress.cpp \
     LogTimes.cpp \
     LogStatistics.cpp \
     LogWhiteBlackList.cpp \
+    LogFilter.cpp \
     libaudit.c \
     LogAudit.cpp \
     LogKlog.cpp \
@@ -18,10 +18,12 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/prctl.h>
 #include <sys/user.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 #include <cutils/properties.h>
@@ -35,6 +37,8 @@
 #define log_buffer_size(id) mMaxSize[id]
 #define LOG_BUFFER_MIN_SIZE (64 * 1024UL)
 #define LOG_BUFFER_MAX_SIZE (256 * 1024 * 1024UL)
+#define LOG_BUFFER_INDEX_INTERVAL 128 // elements between seek checkpoints
+#define LOG_COLD_HOT_SHARE 8 // uncompressed share of the budget is 1/8th
 
 static bool valid_size(unsigned long value) {
     if ((value < LOG_BUFFER_MIN_SIZE) || (LOG_BUFFER_MAX_SIZE < value)) {
@@ -128,40 +132,130 @@ void LogBuffer::init() {
     }
 }
 
-LogBuffer::LogBuffer(LastLogTimes *times) : mTimes(*times) {
+LogBuffer::LogBuffer(LastLogTimes *times) :
+        mPendingCount(0),
+        mPruneDue(0),
+        mIndexCountdown(0),
+        mCompress(false),
+        mColdPending(0),
+        mTimes(*times) {
     pthread_mutex_init(&mLogElementsLock, NULL);
+    sem_init(&mColdSignal, 0, 0);
+    log_id_for_each(i) {
+        pthread_mutex_init(&mPending[i].lock, NULL);
+    }
 
     init();
 }
 
-int LogBuffer::log(log_id_t log_id, log_time realtime,
-                   uid_t uid, pid_t pid, pid_t tid,
-                   const char *msg, unsigned short len) {
+int LogBuffer::queue(log_id_t log_id, log_time realtime,
+                     uid_t uid, pid_t pid, pid_t tid,
+                     const char *msg, unsigned short len) {
     if ((log_id >= LOG_ID_MAX) || (log_id < 0)) {
         return -EINVAL;
     }
 
-    LogBufferElement *elem = new LogBufferElement(log_id, realtime,
-                                                  uid, pid, tid, msg, len);
     int prio = ANDROID_LOG_INFO;
     const char *tag = NULL;
     if (log_id == LOG_ID_EVENTS) {
-        tag = android::tagToName(elem->getTag());
+        tag = android::tagToName(LogBufferElement::getTag(log_id, msg, len));
     } else {
         prio = *msg;
         tag = msg + 1;
     }
-    if (!__android_log_is_loggable(prio, tag, ANDROID_LOG_VERBOSE)) {
+    bool loggable = __android_log_is_loggable(prio, tag, ANDROID_LOG_VERBOSE);
+
+    LogBufferElement *elem = new (mArena[log_id], len)
+        LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
+    if (!elem) {
+        return -ENOMEM;
+    }
+
+    Pending &pending = mPending[log_id];
+    pthread_mutex_lock(&pending.lock);
+    if (loggable) {
+        pending.accepted.push_back(elem);
+    } else {
         // Log traffic received to total
-        pthread_mutex_lock(&mLogElementsLock);
-        stats.add(elem);
-        stats.subtract(elem);
+        pending.rejected.push_back(elem);
+    }
+    mPendingCount.fetch_add(1);
+    pthread_mutex_unlock(&pending.lock);
+
+    return loggable ? len : -EACCES;
+}
+
+void LogBuffer::publish() {
+    // If a reader holds the lock, it will publish our elements on unlock().
+    // Log ids it leaves due for pruning wait for the next publish() that
+    // gets the lock, so the listener never blocks behind a reader.
+    if (pthread_mutex_trylock(&mLogElementsLock)) {
+        return;
+    }
+    publish_Locked();
+    prune_Locked();
+    unlock();
+}
+
+// Release mLogElementsLock, merging in any elements that were published
+// by log() while we held it. Rechecks after release to close the race with
+// a writer whose trylock failed just before we let go.
+void LogBuffer::unlock() {
+    do {
+        if (mPendingCount.load()) {
+            publish_Locked();
+        }
         pthread_mutex_unlock(&mLogElementsLock);
-        delete elem;
-        return -EACCES;
+    } while (mPendingCount.load() && !pthread_mutex_trylock(&mLogElementsLock));
+}
+
+// mLogElementsLock must be held when this function is called.
+void LogBuffer::publish_Locked() {
+    log_id_for_each(i) {
+        LogBufferElementCollection accepted;
+        LogBufferElementCollection rejected;
+
+        Pending &pending = mPending[i];
+        pthread_mutex_lock(&pending.lock);
+        accepted.splice(pending.accepted);
+        rejected.splice(pending.rejected);
+        pthread_mutex_unlock(&pending.lock);
+
+        LogBufferElementCollection::iterator it;
+        for (it = rejected.begin(); it != rejected.end();) {
+            LogBufferElement *elem = *it;
+            it = rejected.erase(it);
+            mPendingCount.fetch_sub(1);
+            stats.add(elem);
+            stats.subtract(elem);
+            delete elem;
+        }
+
+        for (it = accepted.begin(); it != accepted.end();) {
+            LogBufferElement *elem = *it;
+            it = accepted.erase(it);
+            mPendingCount.fetch_sub(1);
+            elem->setSequence();
+            insert_Locked(elem);
+            stats.add(elem);
+            mPruneDue.fetch_or(1 << i);
+        }
+    }
+}
+
+// mLogElementsLock must be held when this function is called.
+void LogBuffer::prune_Locked() {
+    int_fast32_t due = mPruneDue.exchange(0);
+    log_id_for_each(i) {
+        if (due & (1 << i)) {
+            maybePrune(i);
+        }
     }
+}
 
-    pthread_mutex_lock(&mLogElementsLock);
+// mLogElementsLock must be held when this function is called.
+void LogBuffer::insert_Locked(LogBufferElement *elem) {
+    log_time realtime = elem->getRealTime();
 
     // Insert elements in time sorted order if possible
     //  NB: if end is region locked, place element at end of list
@@ -176,7 +270,7 @@ int LogBuffer::log(log_id_t log_id, log_time realtime,
     }
 
     if (last == mLogElements.end()) {
-        mLogElements.push_back(elem);
+        append_Locked(elem);
     } else {
         uint64_t end = 1;
         bool end_set = false;
@@ -202,29 +296,99 @@ int LogBuffer::log(log_id_t log_id, log_time realtime,
 
         if (end_always
                 || (end_set && (end >= (*last)->getSequence()))) {
-            mLogElements.push_back(elem);
+            append_Locked(elem);
         } else {
             mLogElements.insert(last,elem);
         }
 
         LogTimeEntry::unlock();
     }
+}
+
+// mLogElementsLock must be held when this function is called.
+void LogBuffer::append_Locked(LogBufferElement *elem) {
+    mLogElements.push_back(elem);
+    if (mIndexCountdown) {
+        --mIndexCountdown;
+        return;
+    }
+    mIndexCountdown = LOG_BUFFER_INDEX_INTERVAL - 1;
+    elem->setIndexed(true);
+    mIndex.push_back(elem);
+}
+
+static bool sequenceLess(const LogBufferElement *e, uint64_t sequence) {
+    return e->getSequence() < sequence;
+}
+
+// mLogElementsLock must be held when this function is called.
+LogBuffer::LogBufferIndex::iterator LogBuffer::findIndex_Locked(
+        LogBufferElement *e) {
+    LogBufferIndex::iterator it = std::lower_bound(
+        mIndex.begin(), mIndex.end(), e->getSequence(), sequenceLess);
+    if ((it != mIndex.end()) && (*it != e)) {
+        it = mIndex.end();
+    }
+    return it;
+}
+
+// Position at the last checkpoint at or before start, elements following
+// it that are not newer than start are left for the caller to skip.
+//
+// mLogElementsLock must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::seek_Locked(uint64_t start) {
+    LogBufferIndex::iterator it = std::lower_bound(
+        mIndex.begin(), mIndex.end(), start + 1, sequenceLess);
+    if (it == mIndex.begin()) {
+        return mLogElements.begin();
+    }
+    --it;
+    return LogBufferElementCollection::iterator(*it);
+}
 
-    stats.add(elem);
-    maybePrune(log_id);
-    pthread_mutex_unlock(&mLogElementsLock);
+static bool realTimeLess(const LogBufferElement *e, const log_time &realtime) {
+    return e->getRealTime() < realtime;
+}
+
+uint64_t LogBuffer::seekTime(log_time realtime) {
+    uint64_t retval = 1;
+
+    lock();
+    // Checkpoints are near enough time sorted, step back one more for slack
+    LogBufferIndex::iterator it = std::lower_bound(
+        mIndex.begin(), mIndex.end(), realtime, realTimeLess);
+    if ((it != mIndex.begin()) && (--it != mIndex.begin())) {
+        --it;
+        retval = (*it)->getSequence() - 1;
+    }
+    // Cold entries are older, but may still be at or after realtime
+    log_id_for_each(i) {
+        uint64_t sequence = mCold.seekTime(i, realtime);
+        if (sequence && (sequence < retval)) {
+            retval = sequence;
+        }
+    }
+    unlock();
 
-    return len;
+    return retval;
 }
 
 // Prune at most 10% of the log entries or 256, whichever is less.
 //
 // mLogElementsLock must be held when this function is called.
 void LogBuffer::maybePrune(log_id_t id) {
-    size_t sizes = stats.sizes(id);
+    if (freezeDue_Locked(id) && !mColdPending.exchange(1)) {
+        sem_post(&mColdSignal);
+    }
+
+    size_t sizes = sizeUsed_Locked(id);
     unsigned long maxSize = log_buffer_size(id);
     if (sizes > maxSize) {
         size_t sizeOver = sizes - ((maxSize * 9) / 10);
+        // The cold tier holds the oldest entries, expire those first
+        if (pruneCold(id, sizeOver)) {
+            return;
+        }
         size_t elements = stats.elements(id);
         size_t minElements = elements / 10;
         unsigned long pruneRows = elements * sizeOver / sizes;
@@ -238,8 +402,10 @@ void LogBuffer::maybePrune(log_id_t id) {
     }
 }
 
-LogBufferElementCollection::iterator LogBuffer::erase(
-        LogBufferElementCollection::iterator it, bool engageStats) {
+// Take the element at "it" out of mLogElements and everything that refers
+// to it, caller owns the element.
+LogBufferElementCollection::iterator LogBuffer::unlink(
+        LogBufferElementCollection::iterator it) {
     LogBufferElement *e = *it;
     log_id_t id = e->getLogId();
 
@@ -247,7 +413,20 @@ LogBufferElementCollection::iterator LogBuffer::erase(
     if ((f != mLastWorstUid[id].end()) && (it == f->second)) {
         mLastWorstUid[id].erase(f);
     }
-    it = mLogElements.erase(it);
+    if (e->isIndexed()) {
+        LogBufferIndex::iterator i = findIndex_Locked(e);
+        if (i != mIndex.end()) {
+            mIndex.erase(i);
+        }
+    }
+    return mLogElements.erase(it);
+}
+
+LogBufferElementCollection::iterator LogBuffer::erase(
+        LogBufferElementCollection::iterator it, bool engageStats) {
+    LogBufferElement *e = *it;
+
+    it = unlink(it);
     if (engageStats) {
         stats.subtract(e);
     } else {
@@ -258,6 +437,30 @@ LogBufferElementCollection::iterator LogBuffer::erase(
     return it;
 }
 
+// Mark the element at "it" as dropped. Moves it out of its arena chunk into
+// a small heap copy, chatty entries can outlive their neighbours by hours
+// and would otherwise pin the whole chunk.
+LogBufferElementCollection::iterator LogBuffer::setDropped(
+        LogBufferElementCollection::iterator it, unsigned short dropped) {
+    LogBufferElement *e = *it;
+    e->setDropped(dropped);
+
+    LogBufferElement *copy = new (*e) LogBufferElement(*e);
+    if (!copy) {
+        return it; // stays pinned in the arena, still correct
+    }
+    if (e->isIndexed()) {
+        LogBufferIndex::iterator i = findIndex_Locked(e);
+        if (i != mIndex.end()) {
+            *i = copy;
+        }
+    }
+    it = mLogElements.replace(it, copy);
+    delete e;
+
+    return it;
+}
+
 // Define a temporary mechanism to report the last LogBufferElement pointer
 // for the specified uid, pid and tid. Used below to help merge-sort when
 // pruning for worst UID.
@@ -563,7 +766,8 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 it = erase(it);
             } else {
                 stats.drop(e);
-                e->setDropped(1);
+                it = setDropped(it, 1);
+                e = *it;
                 if (last.merge(e, 1)) {
                     it = erase(it, false);
                 } else {
@@ -603,7 +807,7 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 break;
             }
 
-            if (stats.sizes(id) > (2 * log_buffer_size(id))) {
+            if (sizeUsed_Locked(id) > (2 * log_buffer_size(id))) {
                 // kick a misbehaving log reader client off the island
                 oldest->release_Locked();
             } else {
@@ -634,7 +838,7 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
             }
 
             if (oldest && (oldest->mStart <= e->getSequence())) {
-                if (stats.sizes(id) > (2 * log_buffer_size(id))) {
+                if (sizeUsed_Locked(id) > (2 * log_buffer_size(id))) {
                     // kick a misbehaving log reader client off the island
                     oldest->release_Locked();
                 } else {
@@ -653,39 +857,337 @@ void LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
 
 // clear all rows of type "id" from the buffer.
 void LogBuffer::clear(log_id_t id, uid_t uid) {
-    pthread_mutex_lock(&mLogElementsLock);
+    lock();
+    pruneCold(id, ULONG_MAX, uid);
     prune(id, ULONG_MAX, uid);
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlock();
 }
 
-// get the used space associated with "id".
+// get the used space associated with "id", cold entries at their
+// compressed size and the rest at their arena footprint. Statistics report
+// payload sizes.
 unsigned long LogBuffer::getSizeUsed(log_id_t id) {
-    pthread_mutex_lock(&mLogElementsLock);
-    size_t retval = stats.sizes(id);
-    pthread_mutex_unlock(&mLogElementsLock);
+    lock();
+    size_t retval = sizeUsed_Locked(id);
+    unlock();
     return retval;
 }
 
+// The uncompressed entries are charged at what their arena chunks pin, if
+// that is more than their payload: a few long lived entries can hold on to
+// most of a chunk each.
+//
+// mLogElementsLock must be held when this function is called.
+size_t LogBuffer::sizeUsed_Locked(log_id_t id) {
+    size_t hot = stats.sizes(id) - stats.sizesCold(id);
+    size_t allocated = mArena[id].getAllocated();
+    if (allocated > hot) {
+        hot = allocated;
+    }
+    return hot + stats.sizesStored(id);
+}
+
 // set the total space allocated to "id"
 int LogBuffer::setSize(log_id_t id, unsigned long size) {
     // Reasonable limits ...
     if (!valid_size(size)) {
         return -1;
     }
-    pthread_mutex_lock(&mLogElementsLock);
+    lock();
     log_buffer_size(id) = size;
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlock();
     return 0;
 }
 
 // get the total space allocated to "id"
 unsigned long LogBuffer::getSize(log_id_t id) {
-    pthread_mutex_lock(&mLogElementsLock);
+    lock();
     size_t retval = log_buffer_size(id);
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlock();
     return retval;
 }
 
+void LogBuffer::enableCompression() {
+    pthread_attr_t attr;
+
+    lock();
+    if (!mCompress && !pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            pthread_t thread;
+            if (!pthread_create(&thread, &attr,
+                                LogBuffer::freezeThreadStart, this)) {
+                mCompress = true;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+    unlock();
+}
+
+void *LogBuffer::freezeThreadStart(void *obj) {
+    prctl(PR_SET_NAME, "logd.compress");
+
+    LogBuffer *me = reinterpret_cast<LogBuffer *>(obj);
+
+    for (;;) {
+        if (sem_wait(&me->mColdSignal)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        me->mColdPending.store(0);
+        me->expireCold();
+        me->freeze();
+    }
+
+    return NULL;
+}
+
+// Are the uncompressed entries of "id" a block over their share?
+//
+// mLogElementsLock must be held when this function is called.
+bool LogBuffer::freezeDue_Locked(log_id_t id) {
+    if (!mCompress) {
+        return false;
+    }
+    size_t hot = stats.sizes(id) - stats.sizesCold(id);
+    return hot > ((log_buffer_size(id) / LOG_COLD_HOT_SHARE) + LOG_COLD_BLOCK_SIZE);
+}
+
+// Move a block's worth of the oldest entries of "id" to the cold tier,
+// stopping at the reader region lock. Returns the new block, still to be
+// compressed, or NULL if there was nothing to do.
+//
+// mLogElementsLock must be held when this function is called.
+LogColdBlock *LogBuffer::freeze_Locked(log_id_t id) {
+    if (!freezeDue_Locked(id)) {
+        return NULL;
+    }
+
+    LogColdBlock *block = new LogColdBlock(id);
+
+    LogTimeEntry::lock();
+
+    LogTimeEntry *oldest = NULL;
+    LastLogTimes::iterator t = mTimes.begin();
+    while(t != mTimes.end()) {
+        LogTimeEntry *entry = (*t);
+        if (entry->owned_Locked() && entry->isWatching(id)
+                && (!oldest || (oldest->mStart > entry->mStart))) {
+            oldest = entry;
+        }
+        t++;
+    }
+
+    LogBufferElementCollection::iterator it = mLogElements.begin();
+    while (it != mLogElements.end()) {
+        LogBufferElement *e = *it;
+
+        if (oldest && (oldest->mStart <= e->getSequence())) {
+            break;
+        }
+
+        if (e->getLogId() != id) {
+            ++it;
+            continue;
+        }
+
+        if (!block->add(e)) {
+            break;
+        }
+        // stays in the statistics, until expired from the cold tier
+        it = unlink(it);
+        delete e;
+    }
+
+    LogTimeEntry::unlock();
+
+    if (!block->getElements()) {
+        delete block;
+        return NULL;
+    }
+    mCold.push_back(block);
+    stats.addCold(id, block->getMsgSize(), block->getStored());
+
+    return block;
+}
+
+// Compression thread, cut and compress blocks for every log id that is
+// over its uncompressed share. Only the cut holds mLogElementsLock.
+void LogBuffer::freeze() {
+    log_id_for_each(i) {
+        for (;;) {
+            lock();
+            LogColdBlock *block = freeze_Locked(i);
+            size_t size = 0;
+            char *data = block ? block->copy(&size) : NULL;
+            unlock();
+
+            if (!block) {
+                break;
+            }
+
+            size_t stored = 0;
+            char *compressed = NULL;
+            if (data) {
+                compressed = LogColdBlock::compress(data, size, &stored);
+                free(data);
+            }
+            if (!compressed) {
+                continue; // stays uncompressed, still correct
+            }
+
+            lock();
+            // prune may have expired the block while we were at it, and
+            // blocks rewritten by clear are compressed on the spot.
+            if (mCold.contains(block) && !block->isCompressed()) {
+                stats.subtractCold(i, 0, block->getStored());
+                block->setCompressed(compressed, stored);
+                stats.addCold(i, 0, stored);
+            } else {
+                free(compressed);
+            }
+            unlock();
+        }
+    }
+}
+
+// Compression thread, settle the per uid statistics of the blocks that
+// pruneCold() expired. A block that fails to decode has its totals gone
+// already, only its uid, pid, tid and tag detail stays behind.
+void LogBuffer::expireCold() {
+    std::vector<LogColdBlock *> blocks;
+    lock();
+    blocks.swap(mColdExpired);
+    unlock();
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        std::vector<LogBufferElement *> elements;
+        blocks[b]->decode(elements);
+        delete blocks[b];
+
+        lock();
+        for (size_t i = 0; i < elements.size(); ++i) {
+            stats.subtractDetail(elements[i]);
+        }
+        unlock();
+
+        for (size_t i = 0; i < elements.size(); ++i) {
+            delete elements[i];
+        }
+    }
+}
+
+// Expire whole blocks of "id" from the oldest end of the cold tier until
+// "size" bytes of storage are released. An unprivileged clear instead
+// rewrites the blocks without the entries of "caller_uid". Both stop at
+// the reader region lock. Returns true if anything was released.
+//
+// mLogElementsLock must be held when this function is called.
+bool LogBuffer::pruneCold(log_id_t id, unsigned long size, uid_t caller_uid) {
+    if (mCold.empty(id)) {
+        return false;
+    }
+
+    LogTimeEntry::lock();
+
+    LogTimeEntry *oldest = NULL;
+    LastLogTimes::iterator t = mTimes.begin();
+    while(t != mTimes.end()) {
+        LogTimeEntry *entry = (*t);
+        if (entry->owned_Locked() && entry->isWatching(id)
+                && (!oldest || (oldest->mStart > entry->mStart))) {
+            oldest = entry;
+        }
+        t++;
+    }
+
+    bool pruned = false;
+    uint64_t key = 0;
+    LogColdBlock *block;
+    while ((size > 0) && (block = mCold.next(id, key))) {
+        key = block->getLast();
+
+        if (oldest && (oldest->mStart <= block->getLast())) {
+            break;
+        }
+
+        if (caller_uid == AID_ROOT) {
+            // Undecoded, the compression thread settles the per uid detail
+            mCold.pop_front(id);
+            stats.subtractCold(id, block->getMsgSize(), block->getStored());
+            stats.expireCold(id, block->getMsgSize(), block->getElements());
+            size -= std::min(size, (unsigned long) block->getStored());
+            mColdExpired.push_back(block);
+            if (!mColdPending.exchange(1)) {
+                sem_post(&mColdSignal);
+            }
+            pruned = true;
+            continue;
+        }
+
+        // An unprivileged clear is rare, and has to look at every entry
+        std::vector<LogBufferElement *> elements;
+        if (!block->decode(elements)) {
+            for (size_t i = 0; i < elements.size(); ++i) {
+                delete elements[i];
+            }
+            continue;
+        }
+
+        LogColdBlock *rewrite = new LogColdBlock(id);
+        for (size_t i = 0; i < elements.size(); ++i) {
+            LogBufferElement *e = elements[i];
+            if ((e->getUid() != caller_uid) && rewrite->add(e)) {
+                delete e;
+                elements[i] = NULL;
+            }
+        }
+        if (rewrite->getElements() == block->getElements()) {
+            for (size_t i = 0; i < elements.size(); ++i) {
+                delete elements[i];
+            }
+            delete rewrite;
+            continue;
+        }
+
+        if (!rewrite->getElements()) {
+            mCold.erase(block);
+            delete rewrite;
+        } else {
+            size_t len;
+            char *data = rewrite->copy(&len);
+            if (data) {
+                size_t stored;
+                char *compressed = LogColdBlock::compress(data, len, &stored);
+                if (compressed) {
+                    rewrite->setCompressed(compressed, stored);
+                }
+                free(data);
+            }
+            mCold.replace(block, rewrite);
+            stats.addCold(id, rewrite->getMsgSize(), rewrite->getStored());
+        }
+
+        stats.subtractCold(id, block->getMsgSize(), block->getStored());
+        size -= std::min(size, (unsigned long) block->getStored());
+        for (size_t i = 0; i < elements.size(); ++i) {
+            LogBufferElement *e = elements[i];
+            if (e) {
+                stats.subtract(e);
+                delete e;
+            }
+        }
+        delete block;
+        pruned = true;
+    }
+
+    LogTimeEntry::unlock();
+
+    return pruned;
+}
+
 uint64_t LogBuffer::flushTo(
         SocketClient *reader, const uint64_t start, bool privileged,
         int (*filter)(const LogBufferElement *element, void *arg), void *arg) {
@@ -693,26 +1195,36 @@ uint64_t LogBuffer::flushTo(
     uint64_t max = start;
     uid_t uid = reader->getUid();
 
-    pthread_mutex_lock(&mLogElementsLock);
+    lock();
 
     if (start <= 1) {
         // client wants to start from the beginning
         it = mLogElements.begin();
     } else {
-        // Client wants to start from some specified time. Chances are
-        // we are better off starting from the end of the time sorted list.
-        for (it = mLogElements.end(); it != mLogElements.begin(); /* do nothing */) {
-            --it;
-            LogBufferElement *element = *it;
-            if (element->getSequence() <= start) {
-                it++;
-                break;
-            }
-        }
+        // Client wants to start from some specified sequence.
+        it = seek_Locked(start);
     }
 
-    for (; it != mLogElements.end(); ++it) {
-        LogBufferElement *element = *it;
+    // Merge in the older cold entries, they are private decoded copies
+    LogColdCursor cold(mCold, start, false);
+    bool hot = false;
+    for (;;) {
+        // Step past a hot element only now, the reader region lock kept it
+        // from being pruned while we were writing it unlocked.
+        if (hot) {
+            ++it;
+        }
+
+        LogBufferElement *element = cold.get(mCold);
+        hot = (it != mLogElements.end())
+                && (!element || ((*it)->getSequence() < element->getSequence()));
+        if (hot) {
+            element = *it;
+        } else if (element) {
+            cold.next(element);
+        } else {
+            break;
+        }
 
         if (!privileged && (element->getUid() != uid)) {
             continue;
@@ -733,7 +1245,7 @@ uint64_t LogBuffer::flushTo(
             }
         }
 
-        pthread_mutex_unlock(&mLogElementsLock);
+        unlock();
 
         // range locking in LastLogTimes looks after us
         max = element->flushTo(reader, this);
@@ -742,17 +1254,70 @@ uint64_t LogBuffer::flushTo(
             return max;
         }
 
-        pthread_mutex_lock(&mLogElementsLock);
+        lock();
     }
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlock();
 
     return max;
 }
 
+uint64_t LogBuffer::flushToReverse(
+        SocketClient *reader, const uint64_t start, bool privileged,
+        int (*filter)(const LogBufferElement *element, void *arg), void *arg) {
+    uint64_t retval = start;
+    uid_t uid = reader->getUid();
+
+    lock();
+
+    LogBufferElementCollection::iterator it = mLogElements.end();
+    LogColdCursor cold(mCold, start, true);
+    for (;;) {
+        LogBufferElement *element = cold.get(mCold);
+        bool hot = (it != mLogElements.begin());
+        if (hot) {
+            LogBufferElementCollection::iterator prev = it;
+            --prev;
+            hot = !element || ((*prev)->getSequence() > element->getSequence());
+            if (hot) {
+                it = prev;
+                element = *it;
+            }
+        }
+        if (!hot) {
+            if (!element) {
+                break;
+            }
+            cold.next(element);
+        }
+
+        if (element->getSequence() <= start) {
+            break;
+        }
+
+        if (!privileged && (element->getUid() != uid)) {
+            continue;
+        }
+
+        // NB: calling out to another object with mLogElementsLock held (safe)
+        int ret = (*filter)(element, arg);
+        if (ret == false) {
+            continue;
+        }
+        if (ret != true) {
+            break;
+        }
+        retval = element->getSequence() - 1;
+    }
+
+    unlock();
+
+    return retval;
+}
+
 void LogBuffer::formatStatistics(char **strp, uid_t uid, unsigned int logMask) {
-    pthread_mutex_lock(&mLogElementsLock);
+    lock();
 
     stats.format(strp, uid, logMask);
 
-    pthread_mutex_unlock(&mLogElementsLock);
+    unlock();
 }
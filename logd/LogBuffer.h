@@ -17,25 +17,120 @@
 #ifndef _LOGD_LOG_BUFFER_H__
 #define _LOGD_LOG_BUFFER_H__
 
+#include <semaphore.h>
 #include <sys/types.h>
 
-#include <list>
+#include <deque>
+#include <vector>
 
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
 
 #include <private/android_filesystem_config.h>
 
+#include "LogBufferCold.h"
 #include "LogBufferElement.h"
 #include "LogTimes.h"
 #include "LogStatistics.h"
 #include "LogWhiteBlackList.h"
 
-typedef std::list<LogBufferElement *> LogBufferElementCollection;
+// Time sorted, doubly linked list threaded through the elements themselves.
+// Follows the std::list<LogBufferElement *> interface subset we use.
+class LogBufferElementCollection {
+    LogBufferElementLink mHead; // sentinel, end()
+
+    static void link(LogBufferElementLink *pos, LogBufferElementLink *e) {
+        e->mNext = pos;
+        e->mPrev = pos->mPrev;
+        pos->mPrev->mNext = e;
+        pos->mPrev = e;
+    }
+
+public:
+    class iterator {
+        friend class LogBufferElementCollection;
+
+        LogBufferElementLink *mLink;
+
+        iterator(LogBufferElementLink *link) : mLink(link) { }
+
+    public:
+        iterator() : mLink(NULL) { }
+        // e must be a member of the collection
+        explicit iterator(LogBufferElement *e) : mLink(e) { }
+
+        LogBufferElement *operator*() const {
+            return static_cast<LogBufferElement *>(mLink);
+        }
+        iterator &operator++() { mLink = mLink->mNext; return *this; }
+        iterator &operator--() { mLink = mLink->mPrev; return *this; }
+        iterator operator++(int) { iterator t(*this); ++*this; return t; }
+        iterator operator--(int) { iterator t(*this); --*this; return t; }
+        bool operator==(const iterator &rhs) const { return mLink == rhs.mLink; }
+        bool operator!=(const iterator &rhs) const { return mLink != rhs.mLink; }
+    };
+
+    LogBufferElementCollection() { mHead.mPrev = mHead.mNext = &mHead; }
+
+    iterator begin() { return iterator(mHead.mNext); }
+    iterator end() { return iterator(&mHead); }
+
+    void push_back(LogBufferElement *e) { link(&mHead, e); }
+    iterator insert(iterator pos, LogBufferElement *e) {
+        link(pos.mLink, e);
+        return iterator(e);
+    }
+    // Caller owns the removed element
+    iterator erase(iterator pos) {
+        LogBufferElementLink *e = pos.mLink;
+        LogBufferElementLink *next = e->mNext;
+        e->mPrev->mNext = next;
+        next->mPrev = e->mPrev;
+        return iterator(next);
+    }
+    // Move all of the elements of from to our end
+    void splice(LogBufferElementCollection &from) {
+        if (from.mHead.mNext == &from.mHead) {
+            return;
+        }
+        LogBufferElementLink *first = from.mHead.mNext;
+        LogBufferElementLink *last = from.mHead.mPrev;
+        first->mPrev = mHead.mPrev;
+        mHead.mPrev->mNext = first;
+        last->mNext = &mHead;
+        mHead.mPrev = last;
+        from.mHead.mPrev = from.mHead.mNext = &from.mHead;
+    }
+    // Put e in place of the element at pos, caller owns the replaced element
+    iterator replace(iterator pos, LogBufferElement *e) {
+        LogBufferElementLink *o = pos.mLink;
+        e->mPrev = o->mPrev;
+        e->mNext = o->mNext;
+        o->mPrev->mNext = e;
+        o->mNext->mPrev = e;
+        return iterator(e);
+    }
+};
 
 class LogBuffer {
     LogBufferElementCollection mLogElements;
     pthread_mutex_t mLogElementsLock;
+    // per log id element storage
+    LogBufferArena mArena[LOG_ID_MAX];
+
+    // log() does not wait on mLogElementsLock, which readers hold while they
+    // walk the list. New elements are published per log id to the pending
+    // lists, and whoever holds mLogElementsLock merges them on unlock().
+    struct Pending {
+        pthread_mutex_t lock;
+        LogBufferElementCollection accepted;
+        LogBufferElementCollection rejected; // for statistics only
+    } mPending[LOG_ID_MAX];
+    atomic_int_fast32_t mPendingCount;
+    // Log ids that took new elements since they were last checked against
+    // their budget. Only publish() prunes, so that readers merging pending
+    // elements on unlock() never pay for it.
+    atomic_int_fast32_t mPruneDue;
 
     LogStatistics stats;
 
@@ -48,6 +143,26 @@ class LogBuffer {
 
     unsigned long mMaxSize[LOG_ID_MAX];
 
+    // Sparse seek index, a checkpoint every LOG_BUFFER_INDEX_INTERVAL
+    // elements appended to mLogElements. Appended elements always carry the
+    // newest sequence number, so the checkpoints are sorted by sequence.
+    typedef std::deque<LogBufferElement *> LogBufferIndex;
+    LogBufferIndex mIndex;
+    unsigned long mIndexCountdown;
+
+    // Optional compressed second tier. Once the uncompressed entries of a
+    // log id outgrow a share of its budget, the compression thread moves
+    // the oldest of them into cold blocks. The budget covers the entries
+    // left in mLogElements plus the compressed size of the cold blocks.
+    LogBufferCold mCold;
+    bool mCompress;
+    sem_t mColdSignal;
+    atomic_int_fast32_t mColdPending;
+    // Blocks pruned from the cold tier, their sizes already subtracted from
+    // stats. The compression thread decodes them to correct the per uid
+    // statistics, so that prune does not decompress under the lock.
+    std::vector<LogColdBlock *> mColdExpired;
+
 public:
     LastLogTimes &mTimes;
 
@@ -56,11 +171,28 @@ public:
 
     int log(log_id_t log_id, log_time realtime,
             uid_t uid, pid_t pid, pid_t tid,
-            const char *msg, unsigned short len);
+            const char *msg, unsigned short len) {
+        int ret = queue(log_id, realtime, uid, pid, tid, msg, len);
+        publish();
+        return ret;
+    }
+    // Batched form of log(), a run of queue() calls must follow with publish()
+    int queue(log_id_t log_id, log_time realtime,
+              uid_t uid, pid_t pid, pid_t tid,
+              const char *msg, unsigned short len);
+    void publish();
     uint64_t flushTo(SocketClient *writer, const uint64_t start,
                      bool privileged,
                      int (*filter)(const LogBufferElement *element, void *arg) = NULL,
                      void *arg = NULL);
+    // Walks from the newest element back to start. Returns a flushTo start
+    // that covers the oldest element the filter returned true for.
+    uint64_t flushToReverse(SocketClient *writer, const uint64_t start,
+                            bool privileged,
+                            int (*filter)(const LogBufferElement *element, void *arg),
+                            void *arg);
+    // A flushTo start sequence shortly before realtime
+    uint64_t seekTime(log_time realtime);
 
     void clear(log_id_t id, uid_t uid = AID_ROOT);
     unsigned long getSize(log_id_t id);
@@ -72,6 +204,8 @@ public:
     void enableStatistics() {
         stats.enableStatistics();
     }
+    // Starts the compression thread
+    void enableCompression();
 
     int initPrune(char *cp) { return mPrune.init(cp); }
     // *strp uses malloc, use free to release.
@@ -82,13 +216,30 @@ public:
     uid_t pidToUid(pid_t pid) { return stats.pidToUid(pid); }
     char *uidToName(uid_t uid) { return stats.uidToName(uid); }
     void lock() { pthread_mutex_lock(&mLogElementsLock); }
-    void unlock() { pthread_mutex_unlock(&mLogElementsLock); }
+    void unlock();
 
 private:
+    void publish_Locked();
+    void prune_Locked();
+    void insert_Locked(LogBufferElement *elem);
+    void append_Locked(LogBufferElement *elem);
+    LogBufferElementCollection::iterator seek_Locked(uint64_t start);
+    LogBufferIndex::iterator findIndex_Locked(LogBufferElement *e);
     void maybePrune(log_id_t id);
     void prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
+    LogBufferElementCollection::iterator unlink(
+        LogBufferElementCollection::iterator it);
     LogBufferElementCollection::iterator erase(
         LogBufferElementCollection::iterator it, bool engageStats = true);
+    size_t sizeUsed_Locked(log_id_t id);
+    bool freezeDue_Locked(log_id_t id);
+    LogColdBlock *freeze_Locked(log_id_t id);
+    void freeze();
+    void expireCold();
+    static void *freezeThreadStart(void *obj);
+    bool pruneCold(log_id_t id, size_t size, uid_t uid = AID_ROOT);
+    LogBufferElementCollection::iterator setDropped(
+        LogBufferElementCollection::iterator it, unsigned short dropped);
 };
 
 #endif // _LOGD_LOG_BUFFER_H__
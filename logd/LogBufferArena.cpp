@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "LogBufferArena.h"
+
+#define ALIGN(size) (((size) + 7) & ~7)
+
+LogBufferArena::LogBufferArena() :
+        mHead(NULL),
+        mTail(NULL),
+        mSpare(NULL),
+        mChunks(0) {
+    pthread_mutex_init(&mLock, NULL);
+}
+
+LogBufferArena::~LogBufferArena() {
+    while (mHead) {
+        Chunk *chunk = mHead;
+        mHead = chunk->mNext;
+        free(chunk);
+    }
+    free(mSpare);
+    pthread_mutex_destroy(&mLock);
+}
+
+void *LogBufferArena::allocate(size_t size) {
+    size = ALIGN(sizeof(Header) + size);
+    if (size > (LOG_BUFFER_CHUNK_SIZE - sizeof(Chunk))) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mLock);
+
+    Chunk *chunk = mTail;
+    if (!chunk || ((chunk->mUsed + size) > (LOG_BUFFER_CHUNK_SIZE - sizeof(Chunk)))) {
+        if (mSpare) {
+            chunk = mSpare;
+            mSpare = NULL;
+        } else {
+            chunk = static_cast<Chunk *>(malloc(LOG_BUFFER_CHUNK_SIZE));
+            if (!chunk) {
+                pthread_mutex_unlock(&mLock);
+                return NULL;
+            }
+        }
+        chunk->mPrev = mTail;
+        chunk->mNext = NULL;
+        chunk->mArena = this;
+        chunk->mUsed = 0;
+        chunk->mLast = 0;
+        chunk->mLive = 0;
+        if (mTail) {
+            mTail->mNext = chunk;
+        } else {
+            mHead = chunk;
+        }
+        mTail = chunk;
+        ++mChunks;
+    }
+
+    Header *header = reinterpret_cast<Header *>(chunk->data() + chunk->mUsed);
+    header->mChunk = chunk;
+    chunk->mLast = chunk->mUsed;
+    chunk->mUsed += size;
+    ++chunk->mLive;
+
+    pthread_mutex_unlock(&mLock);
+
+    return header + 1;
+}
+
+void *LogBufferArena::allocateHeap(size_t size) {
+    Header *header = static_cast<Header *>(malloc(sizeof(Header) + size));
+    if (!header) {
+        return NULL;
+    }
+    header->mChunk = NULL;
+    return header + 1;
+}
+
+void LogBufferArena::release(void *p) {
+    if (!p) {
+        return;
+    }
+    Header *header = static_cast<Header *>(p) - 1;
+    Chunk *chunk = header->mChunk;
+    if (!chunk) {
+        free(header);
+        return;
+    }
+    LogBufferArena *arena = chunk->mArena;
+    pthread_mutex_lock(&arena->mLock);
+    arena->release_Locked(chunk, header);
+    pthread_mutex_unlock(&arena->mLock);
+}
+
+size_t LogBufferArena::getAllocated() {
+    pthread_mutex_lock(&mLock);
+    size_t allocated = 0;
+    if (mTail) {
+        allocated = ((mChunks - 1) * LOG_BUFFER_CHUNK_SIZE) + sizeof(Chunk) + mTail->mUsed;
+    }
+    pthread_mutex_unlock(&mLock);
+    return allocated;
+}
+
+size_t LogBufferArena::getChunks() {
+    pthread_mutex_lock(&mLock);
+    size_t chunks = mChunks;
+    pthread_mutex_unlock(&mLock);
+    return chunks;
+}
+
+void LogBufferArena::release_Locked(Chunk *chunk, Header *header) {
+    --chunk->mLive;
+
+    // The allocating chunk is never retired, it is recycled in place
+    if (chunk == mTail) {
+        // Rewind if we were the last allocation (eg: rejected by loggable)
+        if (reinterpret_cast<char *>(header) == (chunk->data() + chunk->mLast)) {
+            chunk->mUsed = chunk->mLast;
+        }
+        if (!chunk->mLive) {
+            chunk->mUsed = 0;
+            chunk->mLast = 0;
+        }
+        return;
+    }
+
+    if (!chunk->mLive) {
+        unlink_Locked(chunk);
+    }
+}
+
+void LogBufferArena::unlink_Locked(Chunk *chunk) {
+    if (chunk->mPrev) {
+        chunk->mPrev->mNext = chunk->mNext;
+    } else {
+        mHead = chunk->mNext;
+    }
+    if (chunk->mNext) {
+        chunk->mNext->mPrev = chunk->mPrev;
+    } else {
+        mTail = chunk->mPrev;
+    }
+    --mChunks;
+
+    if (!mSpare) {
+        mSpare = chunk;
+    } else {
+        free(chunk);
+    }
+}
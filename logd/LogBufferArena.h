@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_BUFFER_ARENA_H__
+#define _LOGD_LOG_BUFFER_ARENA_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define LOG_BUFFER_CHUNK_SIZE (64 * 1024) // multiple of maximum payload size
+
+// Storage for the LogBufferElement entries of a single log id. Elements and
+// their payloads are bump allocated back to back into fixed size chunks.
+// Entries are expired roughly in the order they were added, so a chunk
+// drains as a whole and is released as a whole, rather than paying the
+// allocator for each entry on the way in and on the way out.
+//
+// Thread safe, writers allocate without holding LogBuffer's mLogElementsLock.
+class LogBufferArena {
+    struct Chunk {
+        Chunk *mPrev;
+        Chunk *mNext;
+        LogBufferArena *mArena;
+        size_t mUsed; // bump allocator offset
+        size_t mLast; // offset of the most recent allocation
+        size_t mLive; // allocations not yet released
+
+        char *data() { return reinterpret_cast<char *>(this + 1); }
+    };
+
+    // Precedes every allocation, mChunk is NULL for heap allocations
+    struct Header {
+        Chunk *mChunk;
+        size_t mPad; // keep payload 8-byte aligned on 32-bit
+    };
+
+    pthread_mutex_t mLock;
+    Chunk *mHead; // oldest
+    Chunk *mTail; // allocating
+    Chunk *mSpare; // hysteresis, one empty chunk is kept in reserve
+    size_t mChunks;
+
+    void release_Locked(Chunk *chunk, Header *header);
+    void unlink_Locked(Chunk *chunk);
+
+public:
+    LogBufferArena();
+    ~LogBufferArena();
+
+    // Returns NULL if size exceeds a chunk, or memory is exhausted
+    void *allocate(size_t size);
+    // Allocation from the heap, released in turn with release()
+    static void *allocateHeap(size_t size);
+    static void release(void *p);
+
+    // Bytes pinned by chunks: each older chunk in full, however little of it
+    // is still live, and the allocating chunk up to its bump offset. The
+    // spare chunk is not counted.
+    size_t getAllocated();
+    size_t getChunks();
+};
+
+#endif // _LOGD_LOG_BUFFER_ARENA_H__
@@ -0,0 +1,315 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+
+#include "LogBufferCold.h"
+#include "LogCompress.h"
+
+LogColdBlock::LogColdBlock(log_id_t id) :
+        mLogId(id),
+        mFirst(0),
+        mLast(0),
+        mElements(0),
+        mMsgSize(0),
+        mSize(0),
+        mStored(0),
+        mData(NULL),
+        mCompressed(false) {
+}
+
+LogColdBlock::~LogColdBlock() {
+    free(mData);
+}
+
+bool LogColdBlock::add(const LogBufferElement *e) {
+    unsigned short len = e->getMsgLen();
+    if (mCompressed || ((mSize + sizeof(Record) + len) > LOG_COLD_BLOCK_SIZE)) {
+        return false;
+    }
+    if (!mData) {
+        mData = static_cast<char *>(malloc(LOG_COLD_BLOCK_SIZE));
+        if (!mData) {
+            return false;
+        }
+    }
+
+    uint64_t sequence = e->getSequence();
+    Record r;
+    r.sequence = sequence;
+    r.sec = e->getRealTime().tv_sec;
+    r.nsec = e->getRealTime().tv_nsec;
+    r.uid = e->getUid();
+    r.pid = e->getPid();
+    r.tid = e->getTid();
+    r.len = len;
+    r.dropped = e->getDropped();
+    memcpy(mData + mSize, &r, sizeof(r));
+    if (len) {
+        memcpy(mData + mSize + sizeof(r), e->getMsg(), len);
+    }
+
+    if (!mElements) {
+        mFirst = mLast = sequence;
+        mRealTime = mLastRealTime = e->getRealTime();
+    } else {
+        mFirst = std::min(mFirst, sequence);
+        mLast = std::max(mLast, sequence);
+        if (mLastRealTime < e->getRealTime()) {
+            mLastRealTime = e->getRealTime();
+        }
+    }
+    ++mElements;
+    mMsgSize += len;
+    mSize += sizeof(r) + len;
+    mStored = mSize;
+
+    return true;
+}
+
+char *LogColdBlock::copy(size_t *size) const {
+    char *data = static_cast<char *>(malloc(mStored));
+    if (data) {
+        memcpy(data, mData, mStored);
+        *size = mStored;
+    }
+    return data;
+}
+
+char *LogColdBlock::compress(const char *data, size_t size, size_t *stored) {
+    // Not worth a decompression on every read unless we save an eighth
+    size_t limit = size - (size / 8);
+    char *out = static_cast<char *>(malloc(limit));
+    if (!out) {
+        return NULL;
+    }
+    size_t len = lz_compress(reinterpret_cast<const uint8_t *>(data), size,
+                             reinterpret_cast<uint8_t *>(out), limit);
+    if (!len) {
+        free(out);
+        return NULL;
+    }
+    char *shrunk = static_cast<char *>(realloc(out, len));
+    *stored = len;
+    return shrunk ? shrunk : out;
+}
+
+void LogColdBlock::setCompressed(char *data, size_t stored) {
+    free(mData);
+    mData = data;
+    mStored = stored;
+    mCompressed = true;
+}
+
+bool LogColdBlock::decode(std::vector<LogBufferElement *> &out) const {
+    const char *data = mData;
+    char *buffer = NULL;
+    if (mCompressed) {
+        buffer = static_cast<char *>(malloc(mSize));
+        if (!buffer
+                || !lz_decompress(reinterpret_cast<const uint8_t *>(mData),
+                                  mStored,
+                                  reinterpret_cast<uint8_t *>(buffer), mSize)) {
+            free(buffer);
+            return false;
+        }
+        data = buffer;
+    }
+
+    size_t start = out.size();
+    size_t offset = 0;
+    while (offset < mSize) {
+        Record r;
+        if ((mSize - offset) < sizeof(r)) {
+            break;
+        }
+        memcpy(&r, data + offset, sizeof(r));
+        offset += sizeof(r);
+        if (r.len > (mSize - offset)) {
+            break;
+        }
+
+        LogBufferElement *e = new (std::nothrow, r.len)
+            LogBufferElement(mLogId, log_time(r.sec, r.nsec),
+                             r.uid, r.pid, r.tid, data + offset, r.len);
+        if (!e) {
+            break;
+        }
+        if (r.dropped) {
+            e->setDropped(r.dropped);
+        }
+        e->setSequence(r.sequence);
+        out.push_back(e);
+        offset += r.len;
+    }
+    free(buffer);
+
+    if (offset != mSize) {
+        for (size_t i = start; i < out.size(); ++i) {
+            delete out[i];
+        }
+        out.resize(start);
+        return false;
+    }
+    return true;
+}
+
+LogBufferCold::~LogBufferCold() {
+    for (size_t i = 0; i < LOG_ID_MAX; ++i) {
+        for (size_t j = 0; j < mBlocks[i].size(); ++j) {
+            delete mBlocks[i][j];
+        }
+    }
+}
+
+LogColdBlock *LogBufferCold::pop_front(log_id_t id) {
+    if (mBlocks[id].empty()) {
+        return NULL;
+    }
+    LogColdBlock *block = mBlocks[id].front();
+    mBlocks[id].pop_front();
+    return block;
+}
+
+bool LogBufferCold::contains(const LogColdBlock *block) const {
+    const LogColdBlocks &blocks = mBlocks[block->getLogId()];
+    return std::find(blocks.begin(), blocks.end(), block) != blocks.end();
+}
+
+void LogBufferCold::replace(LogColdBlock *old, LogColdBlock *block) {
+    LogColdBlocks &blocks = mBlocks[old->getLogId()];
+    LogColdBlocks::iterator it = std::find(blocks.begin(), blocks.end(), old);
+    if (it != blocks.end()) {
+        *it = block;
+    }
+}
+
+void LogBufferCold::erase(LogColdBlock *block) {
+    LogColdBlocks &blocks = mBlocks[block->getLogId()];
+    LogColdBlocks::iterator it = std::find(blocks.begin(), blocks.end(), block);
+    if (it != blocks.end()) {
+        blocks.erase(it);
+    }
+}
+
+static bool lastLess(const LogColdBlock *block, uint64_t sequence) {
+    return block->getLast() <= sequence;
+}
+
+static bool firstLess(uint64_t sequence, const LogColdBlock *block) {
+    return sequence <= block->getFirst();
+}
+
+static bool realTimeLess(log_time realtime, const LogColdBlock *block) {
+    return realtime <= block->getRealTime();
+}
+
+// Blocks are cut oldest first, so near enough sorted for a binary search
+LogColdBlock *LogBufferCold::next(log_id_t id, uint64_t sequence) const {
+    const LogColdBlocks &blocks = mBlocks[id];
+    LogColdBlocks::const_iterator it = std::lower_bound(
+        blocks.begin(), blocks.end(), sequence, lastLess);
+    return (it == blocks.end()) ? NULL : *it;
+}
+
+LogColdBlock *LogBufferCold::prev(log_id_t id, uint64_t sequence) const {
+    const LogColdBlocks &blocks = mBlocks[id];
+    LogColdBlocks::const_iterator it = std::upper_bound(
+        blocks.begin(), blocks.end(), sequence, firstLess);
+    return (it == blocks.begin()) ? NULL : *--it;
+}
+
+uint64_t LogBufferCold::seekTime(log_id_t id, log_time realtime) const {
+    const LogColdBlocks &blocks = mBlocks[id];
+    if (blocks.empty() || (blocks.back()->getLastRealTime() < realtime)) {
+        return 0;
+    }
+    LogColdBlocks::const_iterator it = std::upper_bound(
+        blocks.begin(), blocks.end(), realtime, realTimeLess);
+    if (it == blocks.begin()) {
+        return 1;
+    }
+    --it;
+    return (*it)->getFirst() - 1;
+}
+
+LogColdCursor::LogColdCursor(const LogBufferCold &cold, uint64_t start,
+                             bool reverse) :
+        mReverse(reverse) {
+    for (size_t i = 0; i < LOG_ID_MAX; ++i) {
+        Position &p = mPosition[i];
+        p.index = 0;
+        p.key = reverse ? UINT64_MAX : start;
+        p.done = cold.empty(static_cast<log_id_t>(i));
+    }
+}
+
+LogColdCursor::~LogColdCursor() {
+    for (size_t i = 0; i < LOG_ID_MAX; ++i) {
+        clear(mPosition[i]);
+    }
+}
+
+void LogColdCursor::clear(Position &p) {
+    for (size_t i = 0; i < p.elements.size(); ++i) {
+        delete p.elements[i];
+    }
+    p.elements.clear();
+    p.index = 0;
+}
+
+LogBufferElement *LogColdCursor::get(const LogBufferCold &cold, log_id_t id) {
+    Position &p = mPosition[id];
+    while (p.index >= p.elements.size()) {
+        if (p.done) {
+            return NULL;
+        }
+        clear(p);
+        LogColdBlock *block = mReverse ? cold.prev(id, p.key)
+                                       : cold.next(id, p.key);
+        if (!block) {
+            p.done = true;
+            return NULL;
+        }
+        p.key = mReverse ? block->getFirst() : block->getLast();
+        // a corrupt block leaves elements empty, and we move past it
+        if (block->decode(p.elements) && mReverse) {
+            std::reverse(p.elements.begin(), p.elements.end());
+        }
+    }
+    return p.elements[p.index];
+}
+
+LogBufferElement *LogColdCursor::get(const LogBufferCold &cold) {
+    LogBufferElement *retval = NULL;
+    for (size_t i = 0; i < LOG_ID_MAX; ++i) {
+        LogBufferElement *e = get(cold, static_cast<log_id_t>(i));
+        if (!e) {
+            continue;
+        }
+        if (!retval
+                || (mReverse ? (e->getSequence() > retval->getSequence())
+                             : (e->getSequence() < retval->getSequence()))) {
+            retval = e;
+        }
+    }
+    return retval;
+}
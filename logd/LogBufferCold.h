@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_BUFFER_COLD_H__
+#define _LOGD_LOG_BUFFER_COLD_H__
+
+#include <sys/types.h>
+
+#include <deque>
+#include <vector>
+
+#include <log/log.h>
+#include <log/log_read.h>
+
+#include "LogBufferElement.h"
+
+#define LOG_COLD_BLOCK_SIZE (64 * 1024) // serialized bytes per block
+
+// A run of the oldest entries of a single log id, serialized back to back
+// and then compressed by the cold tier thread. Immutable once built, other
+// than swapping in the compressed form.
+class LogColdBlock {
+    struct Record {
+        uint64_t sequence;
+        uint32_t sec;
+        uint32_t nsec;
+        uint32_t uid;
+        uint32_t pid;
+        uint32_t tid;
+        uint16_t len;     // payload that follows, 0 if dropped
+        uint16_t dropped;
+    } __packed;
+
+    const log_id_t mLogId;
+    uint64_t mFirst; // sequence range
+    uint64_t mLast;
+    log_time mRealTime; // of the first entry
+    log_time mLastRealTime; // newest of the entries
+    size_t mElements;
+    size_t mMsgSize; // payload bytes, as counted by LogStatistics
+    size_t mSize;    // serialized bytes
+    size_t mStored;  // bytes held, less than mSize once compressed
+    char *mData;
+    bool mCompressed;
+
+public:
+    LogColdBlock(log_id_t id);
+    ~LogColdBlock();
+
+    // Serialize e after the entries already added, false if it does not fit
+    bool add(const LogBufferElement *e);
+
+    // Private copy of the serialized entries, to compress() without locks.
+    // *size is set to the length, free() the result.
+    char *copy(size_t *size) const;
+    // Returns NULL if compression does not pay, free() the result
+    static char *compress(const char *data, size_t size, size_t *stored);
+    // Takes ownership of data
+    void setCompressed(char *data, size_t stored);
+
+    // Appends heap allocated copies of the entries in sequence order,
+    // caller deletes. Returns false on corruption or memory exhaustion.
+    bool decode(std::vector<LogBufferElement *> &out) const;
+
+    log_id_t getLogId() const { return mLogId; }
+    uint64_t getFirst() const { return mFirst; }
+    uint64_t getLast() const { return mLast; }
+    log_time getRealTime() const { return mRealTime; }
+    log_time getLastRealTime() const { return mLastRealTime; }
+    size_t getElements() const { return mElements; }
+    size_t getMsgSize() const { return mMsgSize; }
+    size_t getStored() const { return mStored; }
+    bool isCompressed() const { return mCompressed; }
+};
+
+// Compressed second tier behind LogBuffer's mLogElements. Each log id has
+// its own list of blocks, oldest first, and in sequence order since blocks
+// are only ever cut from the oldest entries still in mLogElements.
+//
+// Must be protected by mLogElementsLock.
+class LogBufferCold {
+    typedef std::deque<LogColdBlock *> LogColdBlocks;
+    LogColdBlocks mBlocks[LOG_ID_MAX];
+
+public:
+    ~LogBufferCold();
+
+    void push_back(LogColdBlock *block) {
+        mBlocks[block->getLogId()].push_back(block);
+    }
+    bool empty(log_id_t id) const { return mBlocks[id].empty(); }
+    LogColdBlock *front(log_id_t id) const {
+        return mBlocks[id].empty() ? NULL : mBlocks[id].front();
+    }
+    // Caller owns the removed block
+    LogColdBlock *pop_front(log_id_t id);
+    bool contains(const LogColdBlock *block) const;
+    // Put block in place of old, caller owns old
+    void replace(LogColdBlock *old, LogColdBlock *block);
+    // Caller owns the removed block
+    void erase(LogColdBlock *block);
+
+    // First block with entries newer than sequence, or NULL
+    LogColdBlock *next(log_id_t id, uint64_t sequence) const;
+    // Last block with entries older than sequence, or NULL
+    LogColdBlock *prev(log_id_t id, uint64_t sequence) const;
+    // A flushTo start sequence shortly before realtime, 0 if there are no
+    // entries for id at or after realtime
+    uint64_t seekTime(log_id_t id, log_time realtime) const;
+};
+
+// Walks the cold entries of all log ids in sequence order, or in reverse,
+// decoding a block per log id at a time. The decoded entries are private
+// copies, they stay valid while mLogElementsLock is dropped to write them
+// to a reader, and blocks pruned meanwhile are simply not revisited.
+//
+// get() and next() must be protected by mLogElementsLock.
+class LogColdCursor {
+    struct Position {
+        std::vector<LogBufferElement *> elements;
+        size_t index;
+        uint64_t key; // sequence bound of the next block to decode
+        bool done;
+    };
+
+    const bool mReverse;
+    Position mPosition[LOG_ID_MAX];
+
+    static void clear(Position &p);
+    LogBufferElement *get(const LogBufferCold &cold, log_id_t id);
+
+public:
+    // Covers the entries newer than start, or all entries if reverse
+    LogColdCursor(const LogBufferCold &cold, uint64_t start, bool reverse);
+    ~LogColdCursor();
+
+    // Oldest remaining entry (newest if reverse), or NULL
+    LogBufferElement *get(const LogBufferCold &cold);
+    // Step past e, the entry get() last returned
+    void next(const LogBufferElement *e) { ++mPosition[e->getLogId()].index; }
+};
+
+#endif // _LOGD_LOG_BUFFER_COLD_H__
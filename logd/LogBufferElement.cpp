@@ -40,21 +40,35 @@ LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
         mPid(pid),
         mTid(tid),
         mMsgLen(len),
-        mSequence(sequence.fetch_add(1, memory_order_relaxed)),
+        mIndexed(false),
+        mSequence(0),
         mRealTime(realtime) {
-    mMsg = new char[len];
+    mMsg = reinterpret_cast<char *>(this + 1);
     memcpy(mMsg, msg, len);
 }
 
+LogBufferElement::LogBufferElement(const LogBufferElement &elem) :
+        LogBufferElementLink(),
+        mLogId(elem.mLogId),
+        mUid(elem.mUid),
+        mPid(elem.mPid),
+        mTid(elem.mTid),
+        mMsg(NULL),
+        mDropped(elem.mDropped),
+        mIndexed(elem.mIndexed),
+        mSequence(elem.mSequence),
+        mRealTime(elem.mRealTime) {
+}
+
 LogBufferElement::~LogBufferElement() {
-    delete [] mMsg;
 }
 
-uint32_t LogBufferElement::getTag() const {
-    if ((mLogId != LOG_ID_EVENTS) || !mMsg || (mMsgLen < sizeof(uint32_t))) {
+uint32_t LogBufferElement::getTag(log_id_t log_id,
+                                  const char *msg, unsigned short len) {
+    if ((log_id != LOG_ID_EVENTS) || !msg || (len < sizeof(uint32_t))) {
         return 0;
     }
-    return le32toh(reinterpret_cast<android_event_header_t *>(mMsg)->tag);
+    return le32toh(reinterpret_cast<const android_event_header_t *>(msg)->tag);
 }
 
 // caller must own and free character string
@@ -21,11 +21,16 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <new>
+
 #include <sysutils/SocketClient.h>
 #include <log/log.h>
 #include <log/log_read.h>
 
+#include "LogBufferArena.h"
+
 class LogBuffer;
+class LogBufferElementCollection;
 
 #define EXPIRE_HOUR_THRESHOLD 24 // Only expire chatty UID logs to preserve
                                  // non-chatty UIDs less than this age in hours
@@ -33,17 +38,27 @@ class LogBuffer;
                                  // chatty for the temporal expire messages
 #define EXPIRE_RATELIMIT 10      // maximum rate in seconds to report expiration
 
-class LogBufferElement {
+// Intrusive links for LogBufferElementCollection, saving a list node
+// allocation for every element.
+class LogBufferElementLink {
+    friend class LogBufferElementCollection;
+
+    LogBufferElementLink *mPrev;
+    LogBufferElementLink *mNext;
+};
+
+class LogBufferElement : public LogBufferElementLink {
     const log_id_t mLogId;
     const uid_t mUid;
     const pid_t mPid;
     const pid_t mTid;
-    char *mMsg;
+    char *mMsg; // inline after this object, or NULL once dropped
     union {
         const unsigned short mMsgLen; // mMSg != NULL
         unsigned short mDropped;      // mMsg == NULL
     };
-    const uint64_t mSequence;
+    bool mIndexed; // checkpoint in LogBuffer's seek index
+    uint64_t mSequence; // assigned when published into the LogBuffer
     const log_time mRealTime;
     static atomic_int_fast64_t sequence;
 
@@ -51,10 +66,41 @@ class LogBufferElement {
     size_t populateDroppedMessage(char *&buffer,
                                   LogBuffer *parent);
 
+    // The message payload is carved out of the same allocation
+    static void *operator new(size_t size) = delete;
+
 public:
+    // Allocates element and its len bytes of payload inline in arena,
+    // new returns NULL on failure.
+    static void *operator new(size_t size,
+                              LogBufferArena &arena, unsigned short len) noexcept {
+        return arena.allocate(size + len);
+    }
+    // Allocates a dropped element copy from the heap
+    static void *operator new(size_t size, const LogBufferElement &) noexcept {
+        return LogBufferArena::allocateHeap(size);
+    }
+    // Allocates element and its len bytes of payload from the heap
+    static void *operator new(size_t size, const std::nothrow_t &,
+                              unsigned short len) noexcept {
+        return LogBufferArena::allocateHeap(size + len);
+    }
+    static void operator delete(void *p) { LogBufferArena::release(p); }
+    static void operator delete(void *p, LogBufferArena &, unsigned short) {
+        LogBufferArena::release(p);
+    }
+    static void operator delete(void *p, const LogBufferElement &) {
+        LogBufferArena::release(p);
+    }
+    static void operator delete(void *p, const std::nothrow_t &, unsigned short) {
+        LogBufferArena::release(p);
+    }
+
     LogBufferElement(log_id_t log_id, log_time realtime,
                      uid_t uid, pid_t pid, pid_t tid,
                      const char *msg, unsigned short len);
+    // assumption: elem.mMsg == NULL, use as new (elem) LogBufferElement(elem)
+    LogBufferElement(const LogBufferElement &elem);
     virtual ~LogBufferElement();
 
     log_id_t getLogId() const { return mLogId; }
@@ -62,19 +108,24 @@ public:
     pid_t getPid(void) const { return mPid; }
     pid_t getTid(void) const { return mTid; }
     unsigned short getDropped(void) const { return mMsg ? 0 : mDropped; }
+    // payload space is reclaimed along with its chunk in the arena
     unsigned short setDropped(unsigned short value) {
-        if (mMsg) {
-            delete [] mMsg;
-            mMsg = NULL;
-        }
+        mMsg = NULL;
         return mDropped = value;
     }
     unsigned short getMsgLen() const { return mMsg ? mMsgLen : 0; }
+    const char *getMsg() const { return mMsg; }
     uint64_t getSequence(void) const { return mSequence; }
+    void setSequence(void) { mSequence = sequence.fetch_add(1, memory_order_relaxed); }
+    // restore the sequence of an entry decoded from the cold tier
+    void setSequence(uint64_t value) { mSequence = value; }
     static uint64_t getCurrentSequence(void) { return sequence.load(memory_order_relaxed); }
     log_time getRealTime(void) const { return mRealTime; }
+    bool isIndexed(void) const { return mIndexed; }
+    void setIndexed(bool value) { mIndexed = value; }
 
-    uint32_t getTag(void) const;
+    uint32_t getTag(void) const { return getTag(mLogId, mMsg, getMsgLen()); }
+    static uint32_t getTag(log_id_t log_id, const char *msg, unsigned short len);
 
     static const uint64_t FLUSH_ERROR;
     uint64_t flushTo(SocketClient *writer, LogBuffer *parent);
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "LogCompress.h"
+
+// A byte oriented LZ77 in the style of the LZ4 block format. Each sequence
+// is a token (literal run length in the high nibble, match length - 4 in
+// the low nibble, 15 meaning more follows in 255 steps), the literals, and
+// a 16-bit little endian match offset. The final sequence has no match.
+
+#define LZ_HASH_LOG 12
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // the tail is always sent as literals
+#define LZ_MATCH_LIMIT 12  // no match may start this close to the end
+#define LZ_MAX_OFFSET 0xFFFF
+
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static uint8_t *lz_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+// Returns the end of the output, or NULL if it does not fit before oend
+static uint8_t *lz_sequence(uint8_t *op, uint8_t *oend,
+                            const uint8_t *literals, size_t lit,
+                            size_t offset, size_t match) {
+    size_t need = 1 + lit + (lit / 255) + 1;
+    if (offset) {
+        need += 2 + ((match - LZ_MIN_MATCH) / 255) + 1;
+    }
+    if (need > (size_t)(oend - op)) {
+        return NULL;
+    }
+
+    uint8_t *token = op++;
+    *token = std::min(lit, (size_t)15) << 4;
+    if (lit >= 15) {
+        op = lz_length(op, lit - 15);
+    }
+    memcpy(op, literals, lit);
+    op += lit;
+
+    if (offset) {
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+        match -= LZ_MIN_MATCH;
+        *token |= std::min(match, (size_t)15);
+        if (match >= 15) {
+            op = lz_length(op, match - 15);
+        }
+    }
+    return op;
+}
+
+size_t lz_compress(const uint8_t *src, size_t size,
+                   uint8_t *dst, size_t dstSize) {
+    uint32_t table[1 << LZ_HASH_LOG];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + size;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstSize;
+
+    if (size > LZ_MATCH_LIMIT) {
+        const uint8_t *mflimit = end - LZ_MATCH_LIMIT;
+        const uint8_t *matchlimit = end - LZ_LAST_LITERALS;
+
+        while (ip < mflimit) {
+            uint32_t h = lz_hash(read32(ip));
+            const uint8_t *ref = src + table[h];
+            table[h] = ip - src;
+
+            if ((ref >= ip) || ((size_t)(ip - ref) > LZ_MAX_OFFSET)
+                    || (read32(ref) != read32(ip))) {
+                ++ip;
+                continue;
+            }
+
+            const uint8_t *m = ip + LZ_MIN_MATCH;
+            ref += LZ_MIN_MATCH;
+            while ((m < matchlimit) && (*m == *ref)) {
+                ++m;
+                ++ref;
+            }
+
+            op = lz_sequence(op, oend, anchor, ip - anchor, m - ref, m - ip);
+            if (!op) {
+                return 0;
+            }
+            ip = anchor = m;
+        }
+    }
+
+    op = lz_sequence(op, oend, anchor, end - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return op - dst;
+}
+
+static bool lz_read_length(const uint8_t *&ip, const uint8_t *iend,
+                           size_t &len) {
+    uint8_t b;
+    do {
+        if (ip >= iend) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+bool lz_decompress(const uint8_t *src, size_t size,
+                   uint8_t *dst, size_t dstSize) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + size;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstSize;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if ((lit == 15) && !lz_read_length(ip, iend, lit)) {
+            return false;
+        }
+        if ((lit > (size_t)(iend - ip)) || (lit > (size_t)(oend - op))) {
+            return false;
+        }
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == iend) {
+            break; // final sequence, literals only
+        }
+
+        if ((iend - ip) < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || (offset > (size_t)(op - dst))) {
+            return false;
+        }
+
+        size_t match = token & 15;
+        if ((match == 15) && !lz_read_length(ip, iend, match)) {
+            return false;
+        }
+        match += LZ_MIN_MATCH;
+        if (match > (size_t)(oend - op)) {
+            return false;
+        }
+        // byte at a time, the source may overlap what we write
+        const uint8_t *ref = op - offset;
+        while (match--) {
+            *op++ = *ref++;
+        }
+    }
+
+    return op == oend;
+}
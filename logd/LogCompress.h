@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_COMPRESS_H__
+#define _LOGD_LOG_COMPRESS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The cold tier's block codec, a byte oriented LZ77 in the style of the LZ4
+// block format.
+
+// Returns compressed size, or 0 if it would not be smaller than dstSize
+size_t lz_compress(const uint8_t *src, size_t size,
+                   uint8_t *dst, size_t dstSize);
+
+// Returns false unless src decompresses to exactly dstSize bytes. Safe on
+// truncated or corrupt input, never reads or writes out of bounds.
+bool lz_decompress(const uint8_t *src, size_t size,
+                   uint8_t *dst, size_t dstSize);
+
+#endif // _LOGD_LOG_COMPRESS_H__
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <log/log.h>
+
+#include "LogFilter.h"
+#include "LogUtils.h"
+
+LogFilterTag::LogFilterTag(const char *tag, size_t len, int pri) :
+        mTag(strndup(tag, len)),
+        mPri(pri) {
+}
+
+LogFilterTag::LogFilterTag(const LogFilterTag &c) :
+        mTag(c.mTag ? strdup(c.mTag) : NULL),
+        mPri(c.mPri) {
+}
+
+LogFilterTag::~LogFilterTag() {
+    free(mTag);
+}
+
+LogFilter::LogFilter() :
+        mGlobalPri(ANDROID_LOG_VERBOSE),
+        mMatch(NULL),
+        mMatchLen(0) {
+}
+
+LogFilter::~LogFilter() {
+    free(mMatch);
+}
+
+// Same letters as logcat filterspecs, returns -1 if invalid
+static int charToPri(char c) {
+    switch (tolower(c)) {
+    case 'v': return ANDROID_LOG_VERBOSE;
+    case 'd': return ANDROID_LOG_DEBUG;
+    case 'i': return ANDROID_LOG_INFO;
+    case 'w': return ANDROID_LOG_WARN;
+    case 'e': return ANDROID_LOG_ERROR;
+    case 'f': return ANDROID_LOG_FATAL;
+    case 's': return ANDROID_LOG_SILENT;
+    case '*': return ANDROID_LOG_DEFAULT;
+    }
+    return -1;
+}
+
+static bool isDelimiter(char c) {
+    return (c == '\0') || (c == ',') || isspace(c);
+}
+
+// Follows android_log_addFilterRule
+int LogFilter::parseTags(const char *cp) {
+    while (*cp && !isspace(*cp)) {
+        size_t len = strcspn(cp, ":, \t\n");
+        if (!len) {
+            return -1;
+        }
+        int pri = ANDROID_LOG_DEFAULT;
+        const char *next = cp + len;
+        if (*next == ':') {
+            pri = charToPri(next[1]);
+            if ((pri < 0) || !isDelimiter(next[2])) {
+                return -1;
+            }
+            next += 2;
+        }
+
+        if ((len == 1) && (*cp == '*')) {
+            mGlobalPri = (pri == ANDROID_LOG_DEFAULT) ? ANDROID_LOG_DEBUG : pri;
+        } else {
+            if (pri == ANDROID_LOG_DEFAULT) {
+                pri = ANDROID_LOG_VERBOSE;
+            }
+            mTags.push_front(LogFilterTag(cp, len, pri));
+        }
+
+        cp = next;
+        if (*cp == ',') {
+            ++cp;
+        }
+    }
+    return 0;
+}
+
+template <typename T>
+static void parseList(const char *cp, std::list<T> &list) {
+    for (;;) {
+        char *ep;
+        unsigned long val = strtoul(cp, &ep, 10);
+        if (ep == cp) {
+            break;
+        }
+        list.push_back(static_cast<T>(val));
+        if (*ep != ',') {
+            break;
+        }
+        cp = ep + 1;
+    }
+}
+
+static int hexval(char c) {
+    if (isdigit(c)) {
+        return c - '0';
+    }
+    c = tolower(c);
+    if (('a' <= c) && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+LogFilter *LogFilter::parse(const char *command) {
+    static const char _tags[] = " tags=";
+    static const char _pids[] = " pids=";
+    static const char _uids[] = " uids=";
+    static const char _match[] = " match=";
+
+    const char *tags = strstr(command, _tags);
+    const char *pids = strstr(command, _pids);
+    const char *uids = strstr(command, _uids);
+    const char *match = strstr(command, _match);
+    if (!tags && !pids && !uids && !match) {
+        return NULL;
+    }
+
+    LogFilter *filter = new LogFilter();
+
+    if (tags && filter->parseTags(tags + sizeof(_tags) - 1)) {
+        // Can not honour it, let the client do the filtering
+        filter->mTags.clear();
+        filter->mGlobalPri = ANDROID_LOG_VERBOSE;
+    }
+    if (pids) {
+        parseList(pids + sizeof(_pids) - 1, filter->mPids);
+    }
+    if (uids) {
+        parseList(uids + sizeof(_uids) - 1, filter->mUids);
+    }
+    if (match) {
+        match += sizeof(_match) - 1;
+        size_t len = strcspn(match, " \t\n");
+        filter->mMatch = static_cast<char *>(malloc(len + 1));
+        if (filter->mMatch) {
+            char *cp = filter->mMatch;
+            for (size_t i = 0; i < len; ++i) {
+                int h, l;
+                if ((match[i] == '%') && ((i + 2) < len)
+                        && ((h = hexval(match[i + 1])) >= 0)
+                        && ((l = hexval(match[i + 2])) >= 0)) {
+                    *cp++ = (h << 4) | l;
+                    i += 2;
+                } else {
+                    *cp++ = match[i];
+                }
+            }
+            *cp = '\0';
+            filter->mMatchLen = cp - filter->mMatch;
+            if (!filter->mMatchLen) {
+                free(filter->mMatch);
+                filter->mMatch = NULL;
+            }
+        }
+    }
+
+    return filter;
+}
+
+int LogFilter::minimumPriority(const char *tag) const {
+    LogFilterTagCollection::const_iterator it;
+    for (it = mTags.begin(); it != mTags.end(); ++it) {
+        if (!fast<strcmp>(tag, it->mTag)) {
+            return it->mPri;
+        }
+    }
+    return mGlobalPri;
+}
+
+bool LogFilter::match(const LogBufferElement *element) const {
+    if (!mPids.empty()) {
+        std::list<pid_t>::const_iterator it;
+        for (it = mPids.begin(); it != mPids.end(); ++it) {
+            if (*it == element->getPid()) {
+                break;
+            }
+        }
+        if (it == mPids.end()) {
+            return false;
+        }
+    }
+
+    if (!mUids.empty()) {
+        std::list<uid_t>::const_iterator it;
+        for (it = mUids.begin(); it != mUids.end(); ++it) {
+            if (*it == element->getUid()) {
+                break;
+            }
+        }
+        if (it == mUids.end()) {
+            return false;
+        }
+    }
+
+    if (mTags.empty() && (mGlobalPri <= ANDROID_LOG_VERBOSE) && !mMatch) {
+        return true;
+    }
+
+    const char *msg = element->getMsg();
+    unsigned short len = element->getMsgLen();
+
+    // Chatty, or binary entries
+    if (!msg || (element->getLogId() == LOG_ID_EVENTS)) {
+        const char *tag = msg ? android::tagToName(element->getTag()) : "chatty";
+        return ANDROID_LOG_INFO >= minimumPriority(tag ? tag : "");
+    }
+
+    // <priority:1><tag:N>\0<message:N>\0
+    if (len < 3) {
+        return false;
+    }
+    const char *tag = msg + 1;
+    const char *end = static_cast<const char *>(memchr(tag, '\0', len - 1));
+    if (!end) {
+        return false;
+    }
+    if (*msg < minimumPriority(tag)) {
+        return false;
+    }
+
+    if (mMatch) {
+        const char *text = end + 1;
+        size_t textLen = len - (text - msg);
+        if (!memmem(text, textLen, mMatch, mMatchLen)
+                && !memmem(tag, end - tag, mMatch, mMatchLen)) {
+            return false;
+        }
+    }
+
+    return true;
+}
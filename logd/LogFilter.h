@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_FILTER_H__
+#define _LOGD_LOG_FILTER_H__
+
+#include <sys/types.h>
+
+#include <list>
+
+#include "LogBufferElement.h"
+
+// Reader side filter pushed down by the client, so that entries it would
+// throw away are never sent over the logdr socket. Parsed from the reader
+// command, all fields are optional:
+//
+//   tags=<tag>:<pri>[,<tag>:<pri>...]  logcat filterspecs, *:<pri> default
+//   pids=<pid>[,<pid>...]
+//   uids=<uid>[,<uid>...]
+//   match=<text>                        %XX escaped substring of the message
+//
+// Binary (events) entries are checked by tag name at ANDROID_LOG_INFO and
+// are not subject to match. Chatty entries are checked as tag "chatty".
+
+class LogFilterTag {
+    friend class LogFilter;
+
+    char *mTag;
+    int mPri;
+
+public:
+    LogFilterTag(const char *tag, size_t len, int pri);
+    LogFilterTag(const LogFilterTag &c);
+    ~LogFilterTag();
+};
+
+typedef std::list<LogFilterTag> LogFilterTagCollection;
+
+class LogFilter {
+    LogFilterTagCollection mTags; // newest rule first, first match wins
+    int mGlobalPri;
+    std::list<pid_t> mPids;
+    std::list<uid_t> mUids;
+    char *mMatch;
+    size_t mMatchLen;
+
+    LogFilter();
+
+    int parseTags(const char *cp);
+    int minimumPriority(const char *tag) const;
+
+public:
+    ~LogFilter();
+
+    // Returns NULL if there are no filter fields in command
+    static LogFilter *parse(const char *command);
+
+    bool match(const LogBufferElement *element) const;
+};
+
+#endif // _LOGD_LOG_FILTER_H__
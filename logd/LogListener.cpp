@@ -41,39 +41,63 @@ bool LogListener::onDataAvailable(SocketClient *cli) {
         name_set = true;
     }
 
-    char buffer[sizeof_log_id_t + sizeof(uint16_t) + sizeof(log_time)
-        + LOGGER_ENTRY_MAX_PAYLOAD];
-    struct iovec iov = { buffer, sizeof(buffer) };
-    memset(buffer, 0, sizeof(buffer));
-
-    char control[CMSG_SPACE(sizeof(struct ucred))];
-    struct msghdr hdr = {
-        NULL,
-        0,
-        &iov,
-        1,
-        control,
-        sizeof(control),
-        0,
-    };
+    for (int i = 0; i < LOG_LISTENER_BATCH; ++i) {
+        mIov[i].iov_base = mBuffer[i];
+        mIov[i].iov_len = sizeof(mBuffer[i]) - 1;
+        struct msghdr &hdr = mHdr[i].msg_hdr;
+        hdr.msg_name = NULL;
+        hdr.msg_namelen = 0;
+        hdr.msg_iov = &mIov[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = mControl[i];
+        hdr.msg_controllen = sizeof(mControl[i]);
+        hdr.msg_flags = 0;
+        mHdr[i].msg_len = 0;
+    }
 
     int socket = cli->getSocket();
 
-    ssize_t n = recvmsg(socket, &hdr, 0);
+    // We were woken up because at least one datagram is waiting, pick up
+    // the rest of the burst without blocking.
+    int count = recvmmsg(socket, mHdr, LOG_LISTENER_BATCH, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+        return false;
+    }
+
+    bool notify = false;
+    for (int i = 0; i < count; ++i) {
+        // The buffers are reused: without this a shorter datagram's tag or
+        // message could run on into what an earlier, longer one left behind
+        mBuffer[i][mHdr[i].msg_len] = '\0';
+        if (queue(&mHdr[i].msg_hdr, mHdr[i].msg_len)) {
+            notify = true;
+        }
+    }
+
+    // One merge into the buffer and one reader wakeup for the whole batch
+    logbuf->publish();
+    if (notify) {
+        reader->notifyNewLog();
+    }
+
+    return true;
+}
+
+bool LogListener::queue(struct msghdr *hdr, ssize_t n) {
     if (n <= (ssize_t)(sizeof(android_log_header_t))) {
         return false;
     }
 
     struct ucred *cred = NULL;
 
-    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
     while (cmsg != NULL) {
         if (cmsg->cmsg_level == SOL_SOCKET
                 && cmsg->cmsg_type  == SCM_CREDENTIALS) {
             cred = (struct ucred *)CMSG_DATA(cmsg);
             break;
         }
-        cmsg = CMSG_NXTHDR(&hdr, cmsg);
+        cmsg = CMSG_NXTHDR(hdr, cmsg);
     }
 
     if (cred == NULL) {
@@ -87,24 +111,21 @@ bool LogListener::onDataAvailable(SocketClient *cli) {
         return false;
     }
 
+    char *buffer = static_cast<char *>(hdr->msg_iov->iov_base);
     android_log_header_t *header = reinterpret_cast<android_log_header_t *>(buffer);
     if (/* header->id < LOG_ID_MIN || */ header->id >= LOG_ID_MAX || header->id == LOG_ID_KERNEL) {
         return false;
     }
 
-    char *msg = ((char *)buffer) + sizeof(android_log_header_t);
+    char *msg = buffer + sizeof(android_log_header_t);
     n -= sizeof(android_log_header_t);
 
-    // NB: hdr.msg_flags & MSG_TRUNC is not tested, silently passing a
+    // NB: hdr->msg_flags & MSG_TRUNC is not tested, silently passing a
     // truncated message to the logs.
 
-    if (logbuf->log((log_id_t)header->id, header->realtime,
+    return logbuf->queue((log_id_t)header->id, header->realtime,
             cred->uid, cred->pid, header->tid, msg,
-            ((size_t) n <= USHRT_MAX) ? (unsigned short) n : USHRT_MAX) >= 0) {
-        reader->notifyNewLog();
-    }
-
-    return true;
+            ((size_t) n <= USHRT_MAX) ? (unsigned short) n : USHRT_MAX) >= 0;
 }
 
 int LogListener::getLogSocket() {
@@ -17,13 +17,28 @@
 #ifndef _LOGD_LOG_LISTENER_H__
 #define _LOGD_LOG_LISTENER_H__
 
+#include <sys/socket.h>
+
+#include <log/logger.h>
+#include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
 #include "LogReader.h"
 
+// Maximum datagrams drained from the logdw socket per wakeup
+#define LOG_LISTENER_BATCH 32
+
 class LogListener : public SocketListener {
     LogBuffer *logbuf;
     LogReader *reader;
 
+    // recvmmsg landing area, only touched by the listener thread. Each
+    // buffer keeps a spare byte to NUL terminate the datagram received.
+    struct mmsghdr mHdr[LOG_LISTENER_BATCH];
+    struct iovec mIov[LOG_LISTENER_BATCH];
+    char mControl[LOG_LISTENER_BATCH][CMSG_SPACE(sizeof(struct ucred))];
+    char mBuffer[LOG_LISTENER_BATCH][sizeof(android_log_header_t)
+                                     + LOGGER_ENTRY_MAX_PAYLOAD + 1];
+
 public:
     LogListener(LogBuffer *buf, LogReader *reader);
 
@@ -32,6 +47,8 @@ protected:
 
 private:
     static int getLogSocket();
+    // returns true if msg was accepted by logbuf
+    bool queue(struct msghdr *hdr, ssize_t n);
 };
 
 #endif
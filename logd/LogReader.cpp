@@ -43,7 +43,7 @@ bool LogReader::onDataAvailable(SocketClient *cli) {
         name_set = true;
     }
 
-    char buffer[255];
+    char buffer[LOGD_READER_COMMAND_MAX];
 
     int len = read(cli->getSocket(), buffer, sizeof(buffer) - 1);
     if (len <= 0) {
@@ -146,7 +146,11 @@ bool LogReader::onDataAvailable(SocketClient *cli) {
             }
 
             bool found() { return startTimeSet; }
-        } logFindStart(logMask, pid, start, sequence);
+        };
+
+        // Skip ahead to a checkpoint shortly before start
+        sequence = logbuf().seekTime(start);
+        LogFindStart logFindStart(logMask, pid, start, sequence);
 
         logbuf().flushTo(cli, sequence, FlushCommand::hasReadLogs(cli),
                          logFindStart.callback, &logFindStart);
@@ -160,7 +164,8 @@ bool LogReader::onDataAvailable(SocketClient *cli) {
         }
     }
 
-    FlushCommand command(*this, nonBlock, tail, logMask, pid, sequence);
+    FlushCommand command(*this, nonBlock, tail, logMask, pid, sequence,
+                         LogFilter::parse(buffer));
     command.runSocketCommand(cli);
     return true;
 }
@@ -21,6 +21,9 @@
 #include "LogBuffer.h"
 #include "LogTimes.h"
 
+// Room for the reader command and any filter pushed down with it
+#define LOGD_READER_COMMAND_MAX 1024
+
 class LogReader : public SocketListener {
     LogBuffer &mLogbuf;
 
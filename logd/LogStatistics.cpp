@@ -32,6 +32,8 @@ LogStatistics::LogStatistics() : enable(false) {
         mElements[id] = 0;
         mSizesTotal[id] = 0;
         mElementsTotal[id] = 0;
+        mSizesCold[id] = 0;
+        mSizesStored[id] = 0;
     }
 }
 
@@ -76,7 +78,8 @@ void LogStatistics::add(LogBufferElement *e) {
         return;
     }
 
-    uidTable[log_id].add(e->getUid(), e);
+    uidTable_t::iterator it = uidTable[log_id].add(e->getUid(), e);
+    uidHeap[log_id].update(&it->second);
 
     if (!enable) {
         return;
@@ -97,11 +100,24 @@ void LogStatistics::subtract(LogBufferElement *e) {
     mSizes[log_id] -= size;
     --mElements[log_id];
 
+    subtractDetail(e);
+}
+
+void LogStatistics::subtractDetail(LogBufferElement *e) {
+    log_id_t log_id = e->getLogId();
     if (log_id == LOG_ID_KERNEL) {
         return;
     }
 
-    uidTable[log_id].subtract(e->getUid(), e);
+    uidTable_t::iterator it = uidTable[log_id].find(e->getUid());
+    if (it != uidTable[log_id].end()) {
+        if (it->second.subtract(e)) {
+            uidHeap[log_id].remove(&it->second);
+            uidTable[log_id].erase(it);
+        } else {
+            uidHeap[log_id].update(&it->second);
+        }
+    }
 
     if (!enable) {
         return;
@@ -123,7 +139,11 @@ void LogStatistics::drop(LogBufferElement *e) {
     unsigned short size = e->getMsgLen();
     mSizes[log_id] -= size;
 
-    uidTable[log_id].drop(e->getUid(), e);
+    uidTable_t::iterator it = uidTable[log_id].find(e->getUid());
+    if (it != uidTable[log_id].end()) {
+        it->second.drop(e);
+        uidHeap[log_id].update(&it->second);
+    }
 
     if (!enable) {
         return;
@@ -264,6 +284,35 @@ void LogStatistics::format(char **buf, uid_t uid, unsigned int logMask) {
         spaces += spaces_total;
     }
 
+    // Raw and compressed bytes of the cold tier, part of Now above
+    bool cold = false;
+    log_id_for_each(id) {
+        if ((logMask & (1 << id)) && sizesStored(id)) {
+            cold = true;
+        }
+    }
+    if (cold) {
+        spaces = 5;
+        output.appendFormat("\nCold");
+
+        log_id_for_each(id) {
+            if (!(logMask & (1 << id))) {
+                continue;
+            }
+
+            if (sizesStored(id)) {
+                oldLength = output.length();
+                if (spaces < 0) {
+                    spaces = 0;
+                }
+                output.appendFormat("%*s%zu/%zu", spaces, "",
+                                    sizesCold(id), sizesStored(id));
+                spaces -= output.length() - oldLength;
+            }
+            spaces += spaces_total;
+        }
+    }
+
     // Report on Chattiest
 
     // Chattiest by application (UID)
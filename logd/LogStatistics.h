@@ -22,6 +22,7 @@
 #include <sys/types.h>
 
 #include <unordered_map>
+#include <vector>
 
 #include <log/log.h>
 
@@ -111,11 +112,134 @@ public:
         }
     }
 
+    inline iterator find(TKey key) { return map.find(key); }
+    inline void erase(iterator it) { map.erase(it); }
+
     inline iterator begin() { return map.begin(); }
     inline iterator end() { return map.end(); }
 
 };
 
+// Max heap of hash table entries ordered by getSizes(), maintained as the
+// entries change so that the worst offenders can be found without sorting
+// the whole table. TEntry provides a size_t heapIndex member for our use.
+// Pointers remain valid because unordered_map never relocates its values.
+template <typename TEntry>
+class LogSizeHeap {
+    static const size_t npos = (size_t) -1;
+
+    std::vector<TEntry *> heap;
+
+    void set(size_t i, TEntry *e) {
+        heap[i] = e;
+        e->heapIndex = i;
+    }
+
+    void up(size_t i) {
+        TEntry *e = heap[i];
+        size_t s = e->getSizes();
+        while (i) {
+            size_t parent = (i - 1) / 2;
+            if (heap[parent]->getSizes() >= s) {
+                break;
+            }
+            set(i, heap[parent]);
+            i = parent;
+        }
+        set(i, e);
+    }
+
+    void down(size_t i) {
+        TEntry *e = heap[i];
+        size_t s = e->getSizes();
+        size_t n = heap.size();
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= n) {
+                break;
+            }
+            if (((child + 1) < n)
+                    && (heap[child + 1]->getSizes() > heap[child]->getSizes())) {
+                ++child;
+            }
+            if (heap[child]->getSizes() <= s) {
+                break;
+            }
+            set(i, heap[child]);
+            i = child;
+        }
+        set(i, e);
+    }
+
+public:
+    static void init(TEntry *e) { e->heapIndex = npos; }
+
+    // Insert e, or restore order after its size changed. O(log n)
+    void update(TEntry *e) {
+        size_t i = e->heapIndex;
+        if (i == npos) {
+            heap.push_back(e);
+            up(heap.size() - 1);
+            return;
+        }
+        if (i && (heap[(i - 1) / 2]->getSizes() < e->getSizes())) {
+            up(i);
+        } else {
+            down(i);
+        }
+    }
+
+    // Must be called before e is erased from its table. O(log n)
+    void remove(TEntry *e) {
+        size_t i = e->heapIndex;
+        if (i == npos) {
+            return;
+        }
+        e->heapIndex = npos;
+        TEntry *last = heap.back();
+        heap.pop_back();
+        if (last != e) {
+            set(i, last);
+            update(last);
+        }
+    }
+
+    // Same result as LogHashtable::sort, in O(n log n) rather than
+    // O(n * table size). Walks the heap best first along a frontier.
+    std::unique_ptr<const TEntry *[]> sort(size_t n) {
+        if (!n) {
+            std::unique_ptr<const TEntry *[]> sorted(NULL);
+            return sorted;
+        }
+
+        const TEntry **retval = new const TEntry* [n];
+        memset(retval, 0, sizeof(*retval) * n);
+
+        std::vector<size_t> frontier;
+        if (!heap.empty()) {
+            frontier.push_back(0);
+        }
+        for (size_t count = 0; (count < n) && !frontier.empty(); ++count) {
+            size_t best = 0;
+            for (size_t f = 1; f < frontier.size(); ++f) {
+                if (heap[frontier[f]]->getSizes() > heap[frontier[best]]->getSizes()) {
+                    best = f;
+                }
+            }
+            size_t i = frontier[best];
+            frontier[best] = frontier.back();
+            frontier.pop_back();
+            retval[count] = heap[i];
+            for (size_t child = 2 * i + 1; (child <= (2 * i + 2)) && (child < heap.size()); ++child) {
+                frontier.push_back(child);
+            }
+        }
+
+        std::unique_ptr<const TEntry *[]> sorted(retval);
+        return sorted;
+    }
+};
+
 struct EntryBase {
     size_t size;
 
@@ -152,8 +276,11 @@ struct EntryBaseDropped : public EntryBase {
 
 struct UidEntry : public EntryBaseDropped {
     const uid_t uid;
+    size_t heapIndex; // LogSizeHeap position
 
-    UidEntry(LogBufferElement *e):EntryBaseDropped(e),uid(e->getUid()) { }
+    UidEntry(LogBufferElement *e):EntryBaseDropped(e),uid(e->getUid()) {
+        LogSizeHeap<UidEntry>::init(this);
+    }
 
     inline const uid_t&getKey() const { return uid; }
 };
@@ -294,11 +421,16 @@ class LogStatistics {
     size_t mElements[LOG_ID_MAX];
     size_t mSizesTotal[LOG_ID_MAX];
     size_t mElementsTotal[LOG_ID_MAX];
+    size_t mSizesCold[LOG_ID_MAX];   // of mSizes, moved to the cold tier
+    size_t mSizesStored[LOG_ID_MAX]; // bytes the cold tier holds them in
     bool enable;
 
     // uid to size list
     typedef LogHashtable<uid_t, UidEntry> uidTable_t;
     uidTable_t uidTable[LOG_ID_MAX];
+    // uid by size, for prune to find the worst offender
+    typedef LogSizeHeap<UidEntry> uidHeap_t;
+    uidHeap_t uidHeap[LOG_ID_MAX];
 
     // pid to uid list
     typedef LogHashtable<pid_t, PidEntry> pidTable_t;
@@ -319,18 +451,37 @@ public:
 
     void add(LogBufferElement *entry);
     void subtract(LogBufferElement *entry);
+    // The per uid, pid, tid and tag part of subtract(), for cold entries
+    // whose sizes already went with expireCold()
+    void subtractDetail(LogBufferElement *entry);
     // entry->setDropped(1) must follow this call
     void drop(LogBufferElement *entry);
     // Correct for merging two entries referencing dropped content
     void erase(LogBufferElement *e) { --mElements[e->getLogId()]; }
+    // Entries stay accounted for above while in the cold tier
+    void addCold(log_id_t id, size_t sizes, size_t stored) {
+        mSizesCold[id] += sizes;
+        mSizesStored[id] += stored;
+    }
+    void subtractCold(log_id_t id, size_t sizes, size_t stored) {
+        mSizesCold[id] -= sizes;
+        mSizesStored[id] -= stored;
+    }
+    // A cold block leaves the buffer, its entries are subtract()ed in bulk
+    void expireCold(log_id_t id, size_t sizes, size_t elements) {
+        mSizes[id] -= sizes;
+        mElements[id] -= elements;
+    }
 
-    std::unique_ptr<const UidEntry *[]> sort(size_t n, log_id i) { return uidTable[i].sort(n); }
+    std::unique_ptr<const UidEntry *[]> sort(size_t n, log_id i) { return uidHeap[i].sort(n); }
 
     // fast track current value by id only
     size_t sizes(log_id_t id) const { return mSizes[id]; }
     size_t elements(log_id_t id) const { return mElements[id]; }
     size_t sizesTotal(log_id_t id) const { return mSizesTotal[id]; }
     size_t elementsTotal(log_id_t id) const { return mElementsTotal[id]; }
+    size_t sizesCold(log_id_t id) const { return mSizesCold[id]; }
+    size_t sizesStored(log_id_t id) const { return mSizesStored[id]; }
 
     // *strp = malloc, balance with free
     void format(char **strp, uid_t uid, unsigned int logMask);
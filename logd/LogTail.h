@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_TAIL_H__
+#define _LOGD_LOG_TAIL_H__
+
+// Counts off the entries of a tail read, offered one at a time from the
+// newest back. Chatty dropped entries at the very start of the range are
+// neither sent nor counted. Walking backwards, a run of them is only known
+// to lead the range once nothing older turns up, so it is held back until
+// then.
+class LogTailCount {
+    const unsigned long mTail;
+    unsigned long mCount;   // entries that will be sent
+    unsigned long mDropped; // run of dropped entries older than those
+
+public:
+    explicit LogTailCount(unsigned long tail) :
+            mTail(tail),
+            mCount(0),
+            mDropped(0) {
+    }
+
+    // As a flushToReverse filter: true to take the entry, false to pass
+    // over it, -1 once the tail is complete. match tells whether the
+    // reader wants the entry at all.
+    int add(bool dropped, bool match) {
+        if (!dropped) {
+            // An older entry, so the run was not leading after all
+            mCount += mDropped;
+            mDropped = 0;
+        }
+        if ((mCount + mDropped) >= mTail) {
+            // Look past a run that may still turn out to be leading
+            return (dropped && mDropped) ? false : -1;
+        }
+        if (!match) {
+            return false;
+        }
+        if (dropped) {
+            ++mDropped;
+        } else {
+            ++mCount;
+        }
+        return true;
+    }
+
+    unsigned long count() const { return mCount; }
+    // Whether the oldest entries taken are dropped ones leading the range
+    bool leadingDropped() const { return mDropped != 0; }
+};
+
+#endif // _LOGD_LOG_TAIL_H__
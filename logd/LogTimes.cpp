@@ -26,7 +26,7 @@ pthread_mutex_t LogTimeEntry::timesLock = PTHREAD_MUTEX_INITIALIZER;
 LogTimeEntry::LogTimeEntry(LogReader &reader, SocketClient *client,
                            bool nonBlock, unsigned long tail,
                            unsigned int logMask, pid_t pid,
-                           uint64_t start) :
+                           uint64_t start, LogFilter *filter) :
         mRefCount(1),
         mRelease(false),
         mError(false),
@@ -35,7 +35,8 @@ LogTimeEntry::LogTimeEntry(LogReader &reader, SocketClient *client,
         mReader(reader),
         mLogMask(logMask),
         mPid(pid),
-        mCount(0),
+        mFilter(filter),
+        mTailCount(tail),
         mTail(tail),
         mIndex(0),
         mClient(client),
@@ -134,8 +135,9 @@ void *LogTimeEntry::threadStart(void *obj) {
         unlock();
 
         if (me->mTail) {
-            logbuf.flushTo(client, start, privileged, FilterFirstPass, me);
-            me->leadingDropped = true;
+            start = logbuf.flushToReverse(client, start, privileged,
+                                          FilterFirstPass, me);
+            me->leadingDropped = me->mTailCount.leadingDropped();
         }
         start = logbuf.flushTo(client, start, privileged, FilterSecondPass, me);
 
@@ -164,32 +166,26 @@ void *LogTimeEntry::threadStart(void *obj) {
     return NULL;
 }
 
-// A first pass to count the number of elements
+// A first pass, from the newest element back, to count off the tail
 int LogTimeEntry::FilterFirstPass(const LogBufferElement *element, void *obj) {
     LogTimeEntry *me = reinterpret_cast<LogTimeEntry *>(obj);
 
-    LogTimeEntry::lock();
-
-    if (me->leadingDropped) {
-        if (element->getDropped()) {
-            LogTimeEntry::unlock();
-            return false;
-        }
-        me->leadingDropped = false;
+    bool match = (!me->mPid || (me->mPid == element->getPid()))
+            && me->isWatching(element->getLogId())
+            && (!me->mFilter || me->mFilter->match(element));
+    int ret = me->mTailCount.add(element->getDropped(), match);
+    if (ret != true) {
+        return ret;
     }
 
-    if (me->mCount == 0) {
-        me->mStart = element->getSequence();
-    }
+    LogTimeEntry::lock();
 
-    if ((!me->mPid || (me->mPid == element->getPid()))
-            && (me->isWatching(element->getLogId()))) {
-        ++me->mCount;
-    }
+    // hold off prune of the region we are about to send
+    me->mStart = element->getSequence();
 
     LogTimeEntry::unlock();
 
-    return false;
+    return true;
 }
 
 // A second pass to send the selected elements
@@ -213,7 +209,7 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement *element, void *obj) {
     }
 
     // Truncate to close race between first and second pass
-    if (me->mNonBlock && me->mTail && (me->mIndex >= me->mCount)) {
+    if (me->mNonBlock && me->mTail && (me->mIndex >= me->mTailCount.count())) {
         goto stop;
     }
 
@@ -225,6 +221,10 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement *element, void *obj) {
         goto skip;
     }
 
+    if (me->mFilter && !me->mFilter->match(element)) {
+        goto skip;
+    }
+
     if (me->isError_Locked()) {
         goto stop;
     }
@@ -235,7 +235,8 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement *element, void *obj) {
 
     ++me->mIndex;
 
-    if ((me->mCount > me->mTail) && (me->mIndex <= (me->mCount - me->mTail))) {
+    if ((me->mTailCount.count() > me->mTail)
+            && (me->mIndex <= (me->mTailCount.count() - me->mTail))) {
         goto skip;
     }
 
@@ -26,6 +26,9 @@
 #include <sysutils/SocketClient.h>
 #include <log/log.h>
 
+#include "LogFilter.h"
+#include "LogTail.h"
+
 class LogReader;
 
 class LogTimeEntry {
@@ -42,15 +45,18 @@ class LogTimeEntry {
     static void threadStop(void *me);
     const unsigned int mLogMask;
     const pid_t mPid;
+    LogFilter *mFilter;
     unsigned int skipAhead[LOG_ID_MAX];
-    unsigned long mCount;
+    LogTailCount mTailCount;
     unsigned long mTail;
     unsigned long mIndex;
 
 public:
+    // Takes ownership of filter
     LogTimeEntry(LogReader &reader, SocketClient *client, bool nonBlock,
                  unsigned long tail, unsigned int logMask, pid_t pid,
-                 uint64_t start);
+                 uint64_t start, LogFilter *filter = NULL);
+    ~LogTimeEntry() { delete mFilter; }
 
     SocketClient *mClient;
     uint64_t mStart;
@@ -414,10 +414,16 @@ int main(int argc, char *argv[]) {
         logBuf->enableStatistics();
     }
 
+    if (property_get_bool("logd.compress", false)) {
+        logBuf->enableCompression();
+    }
+
     // LogReader listens on /dev/socket/logdr. When a client
     // connects, log entries in the LogBuffer are written to the client.
 
     LogReader *reader = new LogReader(logBuf);
+    // Every reader is a client, there can be more than select() handles
+    reader->useEpoll(0);
     if (reader->startListener()) {
         exit(1);
     }
@@ -39,7 +39,12 @@ test_c_flags += -DTARGET_USES_LOGD=1
 endif
 
 test_src_files := \
-    logd_test.cpp
+    logd_test.cpp \
+    LogBufferArena_test.cpp \
+    LogCompress_test.cpp \
+    LogTail_test.cpp \
+    ../LogBufferArena.cpp \
+    ../LogCompress.cpp
 
 # Build tests for the logger. Run with:
 #   adb shell /data/nativetest/logd-unit-tests/logd-unit-tests
@@ -47,6 +52,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := $(test_module_prefix)unit-tests
 LOCAL_MODULE_TAGS := $(test_tags)
 LOCAL_CFLAGS += $(test_c_flags)
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/..
 LOCAL_SHARED_LIBRARIES := libcutils
 LOCAL_SRC_FILES := $(test_src_files)
 include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LogBufferArena.h"
+
+// About a log entry with a short message
+static const size_t entry_size = 100;
+
+// Allocates until the arena has started chunk number "chunks"
+static std::vector<void *> fill(LogBufferArena &arena, size_t chunks) {
+    std::vector<void *> entries;
+    while (arena.getChunks() < chunks) {
+        void *p = arena.allocate(entry_size);
+        EXPECT_TRUE(NULL != p);
+        if (!p) {
+            break;
+        }
+        entries.push_back(p);
+    }
+    return entries;
+}
+
+TEST(LogBufferArena, allocate) {
+    LogBufferArena arena;
+
+    EXPECT_EQ(0U, arena.getAllocated());
+    EXPECT_TRUE(NULL == arena.allocate(LOG_BUFFER_CHUNK_SIZE));
+
+    char *a = static_cast<char *>(arena.allocate(entry_size));
+    char *b = static_cast<char *>(arena.allocate(entry_size));
+    ASSERT_TRUE(NULL != a);
+    ASSERT_TRUE(NULL != b);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(a) & 7);
+    EXPECT_EQ(0U, reinterpret_cast<uintptr_t>(b) & 7);
+    EXPECT_LE(a + entry_size, b);
+    memset(a, 'a', entry_size);
+    memset(b, 'b', entry_size);
+    EXPECT_EQ('a', a[entry_size - 1]);
+
+    EXPECT_EQ(1U, arena.getChunks());
+    EXPECT_LT(2 * entry_size, arena.getAllocated());
+    EXPECT_GT(LOG_BUFFER_CHUNK_SIZE, arena.getAllocated());
+
+    LogBufferArena::release(a);
+    LogBufferArena::release(b);
+}
+
+TEST(LogBufferArena, release_rewinds_last) {
+    LogBufferArena arena;
+
+    void *a = arena.allocate(entry_size);
+    void *b = arena.allocate(entry_size);
+    size_t allocated = arena.getAllocated();
+
+    // eg: an entry rejected after allocation gives its space straight back
+    LogBufferArena::release(b);
+    EXPECT_GT(allocated, arena.getAllocated());
+    EXPECT_EQ(b, arena.allocate(entry_size));
+    EXPECT_EQ(allocated, arena.getAllocated());
+
+    // the allocating chunk restarts from the beginning once empty
+    LogBufferArena::release(b);
+    LogBufferArena::release(a);
+    EXPECT_EQ(a, arena.allocate(entry_size));
+    LogBufferArena::release(a);
+}
+
+TEST(LogBufferArena, heap) {
+    void *p = LogBufferArena::allocateHeap(entry_size);
+    ASSERT_TRUE(NULL != p);
+    memset(p, 0, entry_size);
+    LogBufferArena::release(p);
+    LogBufferArena::release(NULL);
+}
+
+TEST(LogBufferArena, chunk_reuse) {
+    LogBufferArena arena;
+
+    std::vector<void *> entries = fill(arena, 2);
+    void *first = entries.front();
+    void *second_chunk = entries.back();
+    entries.pop_back();
+
+    // Draining the oldest chunk retires it, it is kept as the spare
+    for (size_t i = 0; i < entries.size(); ++i) {
+        LogBufferArena::release(entries[i]);
+    }
+    EXPECT_EQ(1U, arena.getChunks());
+    EXPECT_GT(LOG_BUFFER_CHUNK_SIZE, arena.getAllocated());
+
+    // and the next chunk needed is the spare
+    std::vector<void *> more = fill(arena, 2);
+    EXPECT_EQ(first, more.back());
+
+    LogBufferArena::release(second_chunk);
+    for (size_t i = 0; i < more.size(); ++i) {
+        LogBufferArena::release(more[i]);
+    }
+    EXPECT_EQ(1U, arena.getChunks());
+}
+
+TEST(LogBufferArena, fragmentation) {
+    LogBufferArena arena;
+    static const size_t chunks = 4;
+
+    // Every entry but the first of each chunk expires
+    std::vector<void *> entries = fill(arena, chunks + 1);
+    std::vector<void *> pinned;
+    size_t per_chunk = (entries.size() - 1) / chunks;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if ((i % per_chunk) == 0) {
+            pinned.push_back(entries[i]);
+        } else {
+            LogBufferArena::release(entries[i]);
+        }
+    }
+
+    // A handful of live bytes still pin whole chunks
+    size_t live = pinned.size() * entry_size;
+    EXPECT_LT(live * 100, arena.getAllocated());
+    EXPECT_LE((chunks - 1) * LOG_BUFFER_CHUNK_SIZE, arena.getAllocated());
+
+    for (size_t i = 0; i < pinned.size(); ++i) {
+        LogBufferArena::release(pinned[i]);
+    }
+    EXPECT_EQ(1U, arena.getChunks());
+    EXPECT_GT(LOG_BUFFER_CHUNK_SIZE, arena.getAllocated());
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LogCompress.h"
+
+// Something like a cold block: fixed size headers with slowly changing
+// fields, each followed by a tag and a message that repeat with variations.
+static std::vector<uint8_t> log_like(size_t size) {
+    std::vector<uint8_t> data;
+    for (unsigned i = 0; data.size() < size; ++i) {
+        char line[128];
+        int len = snprintf(line, sizeof(line),
+                           "%c%08x%05u%05u" "ActivityManager" "%c"
+                           "Displayed com.example.app/.Main: +%ums\n",
+                           4, 1000 + i * 3, 1234, 1234 + (i % 7), 0, i % 500);
+        data.insert(data.end(), line, line + len);
+    }
+    data.resize(size);
+    return data;
+}
+
+static std::vector<uint8_t> compress(const std::vector<uint8_t> &in) {
+    std::vector<uint8_t> out(in.size());
+    size_t len = lz_compress(&in[0], in.size(), &out[0], out.size());
+    out.resize(len);
+    return out;
+}
+
+static void round_trip(const std::vector<uint8_t> &in) {
+    std::vector<uint8_t> packed = compress(in);
+    ASSERT_LT(0U, packed.size());
+    ASSERT_GT(in.size(), packed.size());
+
+    std::vector<uint8_t> out(in.size());
+    ASSERT_TRUE(lz_decompress(&packed[0], packed.size(), &out[0], out.size()));
+    EXPECT_TRUE(in == out);
+}
+
+TEST(LogCompress, round_trip) {
+    round_trip(log_like(64 * 1024));
+    round_trip(log_like(1000));
+    // a single byte repeated, matches overlapping their own output
+    round_trip(std::vector<uint8_t>(64 * 1024, 'x'));
+    // long literal and match length runs
+    std::vector<uint8_t> runs = log_like(4096);
+    runs.insert(runs.end(), 1000, 'y');
+    std::vector<uint8_t> tail = log_like(4096);
+    runs.insert(runs.end(), tail.begin(), tail.end());
+    round_trip(runs);
+}
+
+TEST(LogCompress, incompressible) {
+    std::vector<uint8_t> in(4096);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < in.size(); ++i) {
+        seed = seed * 1103515245 + 12345;
+        in[i] = seed >> 24;
+    }
+    std::vector<uint8_t> out(in.size());
+    EXPECT_EQ(0U, lz_compress(&in[0], in.size(), &out[0], out.size()));
+}
+
+TEST(LogCompress, decoder) {
+    // "abcd", a 16 byte match at offset 4, then "efghi"
+    static const uint8_t stream[] = {
+        0x4C, 'a', 'b', 'c', 'd', 4, 0,
+        0x50, 'e', 'f', 'g', 'h', 'i',
+    };
+    static const char expect[] = "abcdabcdabcdabcdabcdefghi";
+    uint8_t out[sizeof(expect) - 1];
+
+    ASSERT_TRUE(lz_decompress(stream, sizeof(stream), out, sizeof(out)));
+    EXPECT_EQ(0, memcmp(expect, out, sizeof(out)));
+
+    // output size must match exactly
+    uint8_t bigger[sizeof(out) + 1];
+    EXPECT_FALSE(lz_decompress(stream, sizeof(stream), bigger, sizeof(bigger)));
+    EXPECT_FALSE(lz_decompress(stream, sizeof(stream), out, sizeof(out) - 1));
+}
+
+TEST(LogCompress, truncated) {
+    std::vector<uint8_t> in = log_like(16 * 1024);
+    std::vector<uint8_t> packed = compress(in);
+    ASSERT_LT(0U, packed.size());
+
+    for (size_t len = 0; len < packed.size(); ++len) {
+        // exact size, so any overrun shows up under ASan
+        std::vector<uint8_t> cut(packed.begin(), packed.begin() + len);
+        std::vector<uint8_t> out(in.size());
+        EXPECT_FALSE(lz_decompress(len ? &cut[0] : NULL, len, &out[0], out.size()))
+            << "length " << len;
+    }
+}
+
+TEST(LogCompress, corrupt) {
+    // match offsets of 0, or reaching back before the output
+    static const uint8_t zero_offset[] = {
+        0x40, 'a', 'b', 'c', 'd', 0, 0, 0x50, 'e', 'f', 'g', 'h', 'i',
+    };
+    static const uint8_t far_offset[] = {
+        0x40, 'a', 'b', 'c', 'd', 5, 0, 0x50, 'e', 'f', 'g', 'h', 'i',
+    };
+    // an extended literal length with nothing left to read
+    static const uint8_t no_length[] = { 0xF0 };
+    uint8_t out[13];
+    EXPECT_FALSE(lz_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)));
+    EXPECT_FALSE(lz_decompress(far_offset, sizeof(far_offset), out, sizeof(out)));
+    EXPECT_FALSE(lz_decompress(no_length, sizeof(no_length), out, sizeof(out)));
+
+    // Any single corrupt byte either fails or decodes to the right size,
+    // without touching memory outside either buffer
+    std::vector<uint8_t> in = log_like(4096);
+    std::vector<uint8_t> packed = compress(in);
+    ASSERT_LT(0U, packed.size());
+    for (size_t i = 0; i < packed.size(); ++i) {
+        static const uint8_t values[] = { 0x00, 0x0F, 0xF0, 0xFF };
+        for (size_t v = 0; v < sizeof(values); ++v) {
+            std::vector<uint8_t> bad(packed);
+            bad[i] = values[v];
+            std::vector<uint8_t> out(in.size());
+            lz_decompress(&bad[0], bad.size(), &out[0], out.size());
+        }
+    }
+}
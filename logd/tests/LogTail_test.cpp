@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LogTail.h"
+
+struct entry {
+    bool dropped;
+    bool match; // wanted by the reader
+};
+
+// The entries a tail read sends, by index: the tail counted off walking
+// back, then a second pass from the oldest one taken, as LogTimeEntry does.
+static std::vector<size_t> tail_read(const std::vector<entry> &range,
+                                     unsigned long tail) {
+    LogTailCount count(tail);
+    size_t start = range.size();
+    for (size_t i = range.size(); i-- > 0;) {
+        int ret = count.add(range[i].dropped, range[i].match);
+        if (ret == -1) {
+            break;
+        }
+        if (ret == true) {
+            start = i;
+        }
+    }
+
+    std::vector<size_t> sent;
+    bool leadingDropped = count.leadingDropped();
+    for (size_t i = start; i < range.size(); ++i) {
+        if (leadingDropped) {
+            if (range[i].dropped) {
+                continue;
+            }
+            leadingDropped = false;
+        }
+        if (sent.size() >= count.count()) {
+            break;
+        }
+        if (range[i].match) {
+            sent.push_back(i);
+        }
+    }
+    return sent;
+}
+
+// The same read as a forward first pass counted it: dropped entries
+// leading the range are skipped, then the last tail wanted entries are sent
+static std::vector<size_t> forward_tail_read(const std::vector<entry> &range,
+                                             unsigned long tail) {
+    std::vector<size_t> counted;
+    bool leadingDropped = true;
+    for (size_t i = 0; i < range.size(); ++i) {
+        if (leadingDropped) {
+            if (range[i].dropped) {
+                continue;
+            }
+            leadingDropped = false;
+        }
+        if (range[i].match) {
+            counted.push_back(i);
+        }
+    }
+    if (counted.size() > tail) {
+        counted.erase(counted.begin(), counted.end() - tail);
+    }
+    return counted;
+}
+
+static const entry dropped = { true, true };
+static const entry message = { false, true };
+static const entry other = { false, false };
+
+TEST(LogTail, leading_dropped) {
+    // Only the messages after the leading chatty entries are counted
+    LogTailCount count(10);
+    EXPECT_EQ(true, count.add(false, true));
+    EXPECT_EQ(true, count.add(true, true));
+    EXPECT_EQ(true, count.add(true, true));
+    EXPECT_EQ(1U, count.count());
+    EXPECT_TRUE(count.leadingDropped());
+
+    // or sent
+    std::vector<entry> range = { dropped, dropped, message, message };
+    std::vector<size_t> expect = { 2, 3 };
+    EXPECT_EQ(expect, tail_read(range, 10));
+    EXPECT_EQ(expect, tail_read(range, 2));
+
+    // A tail that ends inside the leading run still sends no dropped entry
+    expect = { 3 };
+    EXPECT_EQ(expect, tail_read({ dropped, dropped, dropped, message }, 2));
+    expect = { 2, 3 };
+    EXPECT_EQ(expect, tail_read({ dropped, dropped, message, message }, 3));
+
+    // Nothing but dropped entries
+    EXPECT_TRUE(tail_read({ dropped, dropped }, 1).empty());
+    EXPECT_TRUE(tail_read({ dropped, dropped }, 5).empty());
+}
+
+TEST(LogTail, dropped_inside) {
+    // Dropped entries that something precedes are sent like any other
+    std::vector<size_t> expect = { 1, 2, 3 };
+    EXPECT_EQ(expect, tail_read({ message, dropped, dropped, message }, 3));
+    EXPECT_EQ(expect, tail_read({ other, dropped, dropped, message }, 3));
+
+    expect = { 2, 3 };
+    EXPECT_EQ(expect, tail_read({ dropped, message, dropped, message }, 2));
+}
+
+TEST(LogTail, same_as_forward) {
+    // Every range of up to 8 entries, each a dropped entry, a message, or
+    // either of them unwanted by the reader
+    static const entry kinds[] = { dropped, message, other, { true, false } };
+    for (size_t len = 0; len <= 8; ++len) {
+        for (unsigned pattern = 0; pattern < (1U << (2 * len)); ++pattern) {
+            std::vector<entry> range;
+            for (size_t i = 0; i < len; ++i) {
+                range.push_back(kinds[(pattern >> (2 * i)) & 3]);
+            }
+            for (unsigned long tail = 1; tail <= len + 1; ++tail) {
+                ASSERT_EQ(forward_tail_read(range, tail), tail_read(range, tail))
+                    << "pattern " << pattern << " length " << len << " tail " << tail;
+            }
+        }
+    }
+}
@@ -19,3 +19,5 @@ LOCAL_CFLAGS := -Wall -Wno-unused-parameter -Werror
 LOCAL_STATIC_LIBRARIES := libsdcard
 LOCAL_SHARED_LIBRARIES := libc libcutils
 include $(BUILD_EXECUTABLE)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -155,9 +155,18 @@ struct node {
     bool under_android;
 
     struct node *next;          /* per-dir sibling list */
+    struct node *prev;
     struct node *child;         /* first contained file by this dir */
     struct node *parent;        /* containing directory */
 
+    /* Index of the children by exact name, built once a directory has
+     * CHILD_HASH_MIN of them. Chained through hash_next. */
+    struct node **child_hash;
+    size_t child_hash_size;     /* power of two */
+    size_t child_count;
+    struct node *hash_next;
+    __u32 name_hash;            /* of name when added to the parent */
+
     size_t namelen;
     char *name;
     /* If non-null, this is the real name of the file in the underlying storage.
@@ -186,11 +195,15 @@ static bool str_icase_equals(void *keyA, void *keyB) {
 
 /* Global data for all FUSE mounts */
 struct fuse_global {
-    pthread_mutex_t lock;
+    /* Guards the node tree. Lookups take it for reading, and may then
+     * take node references through acquire_node_shared_locked(). Anything
+     * changing the tree takes it for writing. */
+    pthread_rwlock_t lock;
 
     uid_t uid;
     gid_t gid;
     bool multi_user;
+    bool use_splice;
 
     char source_path[PATH_MAX];
     char obb_path[PATH_MAX];
@@ -242,13 +255,29 @@ struct fuse_handler {
     int token;
 
     /* To save memory, we never use the contents of the request buffer and the read
-     * buffer at the same time.  This allows us to share the underlying storage. */
+     * buffer at the same time.  This allows us to share the underlying storage.
+     * Requests are read at an offset making WRITE payloads page aligned, see
+     * get_request_buffer(). */
     union {
-        __u8 request_buffer[MAX_REQUEST_SIZE];
+        __u8 request_buffer[MAX_REQUEST_SIZE + PAGESIZE];
         __u8 read_buffer[MAX_READ + PAGESIZE];
     };
+
+    /* Pipe that READ replies are spliced through, see handle_read_splice().
+     * splice_pipe_size is 0 until it is created. */
+    int splice_pipe[2];
+    size_t splice_pipe_size;
+    bool splice_unsupported;
 };
 
+static __u8* get_request_buffer(struct fuse_handler* handler)
+{
+    const size_t payload = sizeof(struct fuse_in_header) + sizeof(struct fuse_write_in);
+    uintptr_t aligned = ((uintptr_t) handler->request_buffer + payload + PAGESIZE - 1)
+            & ~((uintptr_t) PAGESIZE - 1);
+    return (__u8*) (aligned - payload);
+}
+
 static inline void *id_to_ptr(__u64 nid)
 {
     return (void *) (uintptr_t) nid;
@@ -265,6 +294,15 @@ static void acquire_node_locked(struct node* node)
     TRACE("ACQUIRE %p (%s) rc=%d\n", node, node->name, node->refcount);
 }
 
+/* Same as acquire_node_locked() for callers holding the lock for reading
+ * only. Releases need it for writing, so this can only race with itself.
+ */
+static void acquire_node_shared_locked(struct node* node)
+{
+    __sync_fetch_and_add(&node->refcount, 1);
+    TRACE("ACQUIRE %p (%s) rc=%d\n", node, node->name, node->refcount);
+}
+
 static void remove_node_from_parent_locked(struct node* node);
 
 static void release_node_locked(struct node* node)
@@ -280,6 +318,7 @@ static void release_node_locked(struct node* node)
             memset(node->name, 0xef, node->namelen);
             free(node->name);
             free(node->actual_name);
+            free(node->child_hash);
             memset(node, 0xfc, sizeof(*node));
             free(node);
         }
@@ -288,28 +327,91 @@ static void release_node_locked(struct node* node)
     }
 }
 
+/* Directories smaller than this are searched through the sibling list */
+#define CHILD_HASH_MIN 16
+
+static __u32 child_name_hash(const char* name, size_t namelen)
+{
+    return hashmapHash((void*) name, namelen);
+}
+
+static void child_hash_insert_locked(struct node* parent, struct node* node)
+{
+    struct node** bucket = &parent->child_hash[node->name_hash & (parent->child_hash_size - 1)];
+    node->hash_next = *bucket;
+    *bucket = node;
+}
+
+/* (Re)builds the index of parent with room for its children. Returns
+ * false, leaving the current index alone, if memory runs out. */
+static bool child_hash_resize_locked(struct node* parent, size_t size)
+{
+    struct node** table = calloc(size, sizeof(*table));
+    struct node* node;
+
+    if (!table) {
+        return false;
+    }
+    free(parent->child_hash);
+    parent->child_hash = table;
+    parent->child_hash_size = size;
+    for (node = parent->child; node; node = node->next) {
+        child_hash_insert_locked(parent, node);
+    }
+    return true;
+}
+
 static void add_node_to_parent_locked(struct node *node, struct node *parent) {
     node->parent = parent;
     node->next = parent->child;
+    node->prev = NULL;
+    if (parent->child) {
+        parent->child->prev = node;
+    }
     parent->child = node;
+    parent->child_count++;
+
+    node->name_hash = child_name_hash(node->name, node->namelen);
+    if (parent->child_count >= CHILD_HASH_MIN
+            && parent->child_count > parent->child_hash_size * 2
+            && child_hash_resize_locked(parent, parent->child_hash_size ?
+                    parent->child_hash_size * 4 : CHILD_HASH_MIN * 2)) {
+        /* node went in with the others */
+    } else if (parent->child_hash) {
+        child_hash_insert_locked(parent, node);
+    }
     acquire_node_locked(parent);
 }
 
 static void remove_node_from_parent_locked(struct node* node)
 {
     if (node->parent) {
-        if (node->parent->child == node) {
-            node->parent->child = node->parent->child->next;
+        struct node* parent = node->parent;
+
+        if (node->prev) {
+            node->prev->next = node->next;
         } else {
-            struct node *node2;
-            node2 = node->parent->child;
-            while (node2->next != node)
-                node2 = node2->next;
-            node2->next = node->next;
+            parent->child = node->next;
+        }
+        if (node->next) {
+            node->next->prev = node->prev;
+        }
+        parent->child_count--;
+
+        if (parent->child_hash) {
+            struct node** link = &parent->child_hash[
+                    node->name_hash & (parent->child_hash_size - 1)];
+            while (*link != node) {
+                link = &(*link)->hash_next;
+            }
+            *link = node->hash_next;
         }
-        release_node_locked(node->parent);
+
+        release_node_locked(parent);
         node->parent = NULL;
         node->next = NULL;
+        node->prev = NULL;
+        node->hash_next = NULL;
     }
 }
 
@@ -655,6 +757,20 @@ static struct node* lookup_node_and_path_by_id_locked(struct fuse* fuse, __u64 n
 
 static struct node *lookup_child_by_name_locked(struct node *node, const char *name)
 {
+    if (node->child_hash) {
+        size_t namelen = strlen(name);
+        __u32 hash = child_name_hash(name, namelen);
+
+        for (node = node->child_hash[hash & (node->child_hash_size - 1)]; node;
+                node = node->hash_next) {
+            if (node->name_hash == hash && node->namelen == namelen
+                    && !strcmp(name, node->name) && !node->deleted) {
+                return node;
+            }
+        }
+        return 0;
+    }
+
     for (node = node->child; node; node = node->next) {
         /* use exact string comparison, nodes that differ by case
          * must be considered distinct even if they refer to the same
@@ -680,6 +796,28 @@ static struct node* acquire_or_create_child_locked(
     return child;
 }
 
+/* acquire_or_create_child_locked() taking the lock itself, only for
+ * reading when the child already exists. Returns with the lock held,
+ * in either mode; the caller unlocks.
+ */
+static struct node* acquire_or_create_child(
+        struct fuse* fuse, struct node* parent,
+        const char* name, const char* actual_name)
+{
+    struct node* child;
+
+    pthread_rwlock_rdlock(&fuse->global->lock);
+    child = lookup_child_by_name_locked(parent, name);
+    if (child) {
+        acquire_node_shared_locked(child);
+        return child;
+    }
+    pthread_rwlock_unlock(&fuse->global->lock);
+
+    pthread_rwlock_wrlock(&fuse->global->lock);
+    return acquire_or_create_child_locked(fuse, parent, name, actual_name);
+}
+
 static void fuse_status(struct fuse *fuse, __u64 unique, int err)
 {
     struct fuse_out_header hdr;
@@ -722,10 +860,9 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
         return -errno;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
-    node = acquire_or_create_child_locked(fuse, parent, name, actual_name);
+    node = acquire_or_create_child(fuse, parent, name, actual_name);
     if (!node) {
-        pthread_mutex_unlock(&fuse->global->lock);
+        pthread_rwlock_unlock(&fuse->global->lock);
         return -ENOMEM;
     }
     memset(&out, 0, sizeof(out));
@@ -734,7 +871,7 @@ static int fuse_reply_entry(struct fuse* fuse, __u64 unique,
     out.entry_valid = 10;
     out.nodeid = node->nid;
     out.generation = node->gen;
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     fuse_reply(fuse, unique, &out, sizeof(out));
     return NO_STATUS;
 }
@@ -794,12 +931,12 @@ static int handle_lookup(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     TRACE("[%d] LOOKUP %s @ %"PRIx64" (%s)\n", handler->token, name, hdr->nodeid,
         parent_node ? parent_node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -817,7 +954,7 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
 {
     struct node* node;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     node = lookup_node_by_id_locked(fuse, hdr->nodeid);
     TRACE("[%d] FORGET #%"PRIu64" @ %"PRIx64" (%s)\n", handler->token, req->nlookup,
             hdr->nodeid, node ? node->name : "?");
@@ -827,7 +964,29 @@ static int handle_forget(struct fuse* fuse, struct fuse_handler* handler,
             release_node_locked(node);
         }
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
+    return NO_STATUS; /* no reply */
+}
+
+static int handle_batch_forget(struct fuse* fuse, struct fuse_handler* handler,
+        const struct fuse_in_header *hdr, const struct fuse_batch_forget_in *req)
+{
+    const struct fuse_forget_one *forgets = (const struct fuse_forget_one*) (req + 1);
+    struct node* node;
+    __u32 i;
+
+    TRACE("[%d] BATCH_FORGET %u\n", handler->token, req->count);
+    pthread_rwlock_wrlock(&fuse->global->lock);
+    for (i = 0; i < req->count; i++) {
+        node = lookup_node_by_id_locked(fuse, forgets[i].nodeid);
+        if (node) {
+            __u64 n = forgets[i].nlookup;
+            while (n--) {
+                release_node_locked(node);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&fuse->global->lock);
     return NO_STATUS; /* no reply */
 }
 
@@ -837,11 +996,11 @@ static int handle_getattr(struct fuse* fuse, struct fuse_handler* handler,
     struct node* node;
     char path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     TRACE("[%d] GETATTR flags=%x fh=%"PRIx64" @ %"PRIx64" (%s)\n", handler->token,
             req->getattr_flags, req->fh, hdr->nodeid, node ? node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -860,11 +1019,11 @@ static int handle_setattr(struct fuse* fuse, struct fuse_handler* handler,
     char path[PATH_MAX];
     struct timespec times[2];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     TRACE("[%d] SETATTR fh=%"PRIx64" valid=%x @ %"PRIx64" (%s)\n", handler->token,
             req->fh, req->valid, hdr->nodeid, node ? node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -924,12 +1083,12 @@ static int handle_mknod(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     TRACE("[%d] MKNOD %s 0%o @ %"PRIx64" (%s)\n", handler->token,
             name, req->mode, hdr->nodeid, parent_node ? parent_node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -953,12 +1112,12 @@ static int handle_mkdir(struct fuse* fuse, struct fuse_handler* handler,
     char child_path[PATH_MAX];
     const char* actual_name;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     TRACE("[%d] MKDIR %s 0%o @ %"PRIx64" (%s)\n", handler->token,
             name, req->mode, hdr->nodeid, parent_node ? parent_node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !(actual_name = find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1))) {
@@ -1001,12 +1160,12 @@ static int handle_unlink(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     TRACE("[%d] UNLINK %s @ %"PRIx64" (%s)\n", handler->token,
             name, hdr->nodeid, parent_node ? parent_node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1)) {
@@ -1018,12 +1177,12 @@ static int handle_unlink(struct fuse* fuse, struct fuse_handler* handler,
     if (unlink(child_path) < 0) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         TRACE("[%d] fuse_notify_delete parent=%"PRIx64", child=%"PRIx64", name=%s\n",
@@ -1049,12 +1208,12 @@ static int handle_rmdir(struct fuse* fuse, struct fuse_handler* handler,
     char parent_path[PATH_MAX];
     char child_path[PATH_MAX];
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             parent_path, sizeof(parent_path));
     TRACE("[%d] RMDIR %s @ %"PRIx64" (%s)\n", handler->token,
             name, hdr->nodeid, parent_node ? parent_node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!parent_node || !find_file_within(parent_path, name,
             child_path, sizeof(child_path), 1)) {
@@ -1066,12 +1225,12 @@ static int handle_rmdir(struct fuse* fuse, struct fuse_handler* handler,
     if (rmdir(child_path) < 0) {
         return -errno;
     }
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     child_node = lookup_child_by_name_locked(parent_node, name);
     if (child_node) {
         child_node->deleted = true;
     }
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (parent_node && child_node) {
         /* Tell all other views that node is gone */
         TRACE("[%d] fuse_notify_delete parent=%"PRIx64", child=%"PRIx64", name=%s\n",
@@ -1103,7 +1262,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
     const char* new_actual_name;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     old_parent_node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
             old_parent_path, sizeof(old_parent_path));
     new_parent_node = lookup_node_and_path_by_id_locked(fuse, req->newdir,
@@ -1131,7 +1290,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto lookup_error;
     }
     acquire_node_locked(child_node);
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     /* Special case for renaming a file where destination is same path
      * differing only by case.  In this case we don't want to look for a case
@@ -1152,7 +1311,7 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
         goto io_error;
     }
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
     res = rename_node_locked(child_node, new_name, new_actual_name);
     if (!res) {
         remove_node_from_parent_locked(child_node);
@@ -1163,11 +1322,11 @@ static int handle_rename(struct fuse* fuse, struct fuse_handler* handler,
     goto done;
 
 io_error:
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_wrlock(&fuse->global->lock);
 done:
     release_node_locked(child_node);
 lookup_error:
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     return res;
 }
 
@@ -1190,11 +1349,11 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out;
     struct handle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     TRACE("[%d] OPEN 0%o @ %"PRIx64" (%s)\n", handler->token,
             req->flags, hdr->nodeid, node ? node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -1226,6 +1385,111 @@ static int handle_open(struct fuse* fuse, struct fuse_handler* handler,
     return NO_STATUS;
 }
 
+/* Reads smaller than this are copied, as the extra syscalls of splicing
+ * them cost more than the copies saved. */
+#define SPLICE_MIN_READ (16 * 1024)
+
+/* Returned by handle_read_splice() when the data has to be copied */
+#define SPLICE_FALLBACK 2
+
+static void splice_pipe_close(struct fuse_handler* handler)
+{
+    if (handler->splice_pipe_size) {
+        close(handler->splice_pipe[0]);
+        close(handler->splice_pipe[1]);
+        handler->splice_pipe_size = 0;
+    }
+}
+
+/* Creates the handler's pipe, big enough for a whole READ reply if the
+ * kernel lets us. Returns false if there is no pipe to use. */
+static bool splice_pipe_open(struct fuse_handler* handler)
+{
+    int size;
+
+    if (handler->splice_pipe_size) {
+        return true;
+    }
+    if (pipe2(handler->splice_pipe, O_CLOEXEC)) {
+        return false;
+    }
+    size = fcntl(handler->splice_pipe[1], F_SETPIPE_SZ, MAX_READ + PAGESIZE);
+    if (size < 0) {
+        size = fcntl(handler->splice_pipe[1], F_GETPIPE_SZ);
+    }
+    if (size <= (int) sizeof(struct fuse_out_header)) {
+        close(handler->splice_pipe[0]);
+        close(handler->splice_pipe[1]);
+        return false;
+    }
+    handler->splice_pipe_size = size;
+    return true;
+}
+
+/* Replies to a READ by splicing the file's pages through a pipe into
+ * /dev/fuse, without copying them through our buffer. */
+static int handle_read_splice(struct fuse* fuse, struct fuse_handler* handler,
+        __u64 unique, struct handle* h, __u32 size, __u64 offset)
+{
+    struct fuse_out_header hdr;
+    struct stat s;
+    loff_t off = offset;
+    size_t len;
+    size_t left;
+    ssize_t res;
+
+    if (!fuse->global->use_splice || handler->splice_unsupported
+            || size < SPLICE_MIN_READ || !splice_pipe_open(handler)) {
+        return SPLICE_FALLBACK;
+    }
+
+    /* The reply header goes into the pipe ahead of the data, so the length
+     * has to be known up front. */
+    if (fstat(h->fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+        return SPLICE_FALLBACK;
+    }
+    len = (__u64) s.st_size > offset ? MIN(size, (__u64) s.st_size - offset) : 0;
+    if (len < SPLICE_MIN_READ || sizeof(hdr) + len > handler->splice_pipe_size) {
+        return SPLICE_FALLBACK;
+    }
+
+    hdr.len = sizeof(hdr) + len;
+    hdr.error = 0;
+    hdr.unique = unique;
+    if (write(handler->splice_pipe[1], &hdr, sizeof(hdr)) != sizeof(hdr)) {
+        splice_pipe_close(handler);
+        return SPLICE_FALLBACK;
+    }
+    for (left = len; left; left -= res) {
+        res = splice(h->fd, &off, handler->splice_pipe[1], NULL, left, 0);
+        if (res <= 0) {
+            /* The file shrank or cannot be spliced, drop what we have. */
+            if (res < 0 && errno == EINVAL) {
+                handler->splice_unsupported = true;
+            }
+            splice_pipe_close(handler);
+            return SPLICE_FALLBACK;
+        }
+    }
+
+    /* No SPLICE_F_MOVE: the kernel would only act on it for page cache
+     * reads, by stealing the lower filesystem's cached pages. */
+    res = splice(handler->splice_pipe[0], NULL, fuse->fd, NULL, hdr.len, 0);
+    if (res != (ssize_t) hdr.len) {
+        ERROR("*** REPLY FAILED *** %d\n", errno);
+        /* Leftovers would corrupt the next reply. */
+        splice_pipe_close(handler);
+        if (res < 0) {
+            /* Nothing reached the kernel, try again without splice. */
+            if (errno == EINVAL) {
+                handler->splice_unsupported = true;
+            }
+            return SPLICE_FALLBACK;
+        }
+    }
+    return NO_STATUS;
+}
+
 static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
         const struct fuse_in_header* hdr, const struct fuse_read_in* req)
 {
@@ -1245,6 +1509,10 @@ static int handle_read(struct fuse* fuse, struct fuse_handler* handler,
     if (size > MAX_READ) {
         return -EINVAL;
     }
+    res = handle_read_splice(fuse, handler, unique, h, size, offset);
+    if (res != SPLICE_FALLBACK) {
+        return res;
+    }
     res = pread64(h->fd, read_buffer, size, offset);
     if (res < 0) {
         return -errno;
@@ -1262,7 +1530,8 @@ static int handle_write(struct fuse* fuse, struct fuse_handler* handler,
     int res;
     __u8 aligned_buffer[req->size] __attribute__((__aligned__(PAGESIZE)));
 
-    if (req->flags & O_DIRECT) {
+    /* The payload is normally page aligned already, see get_request_buffer() */
+    if ((req->flags & O_DIRECT) && ((uintptr_t) buffer & (PAGESIZE - 1))) {
         memcpy(aligned_buffer, buffer, req->size);
         buffer = (const __u8*) aligned_buffer;
     }
@@ -1287,10 +1556,10 @@ static int handle_statfs(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_statfs_out out;
     int res;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     TRACE("[%d] STATFS\n", handler->token);
     res = get_node_path_locked(&fuse->global->root, path, sizeof(path));
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
     if (res < 0) {
         return -ENOENT;
     }
@@ -1361,11 +1630,11 @@ static int handle_opendir(struct fuse* fuse, struct fuse_handler* handler,
     struct fuse_open_out out;
     struct dirhandle *h;
 
-    pthread_mutex_lock(&fuse->global->lock);
+    pthread_rwlock_rdlock(&fuse->global->lock);
     node = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid, path, sizeof(path));
     TRACE("[%d] OPENDIR @ %"PRIx64" (%s)\n", handler->token,
             hdr->nodeid, node ? node->name : "?");
-    pthread_mutex_unlock(&fuse->global->lock);
+    pthread_rwlock_unlock(&fuse->global->lock);
 
     if (!node) {
         return -ENOENT;
@@ -1396,32 +1665,158 @@ static int handle_opendir(struct fuse* fuse, struct fuse_handler* handler,
     return NO_STATUS;
 }
 
+/* Positions h->d for a READDIR(PLUS) at offset, which is 0 or the telldir()
+ * cookie following the last entry the kernel consumed. The kernel drops the
+ * entries of a reply that do not fit the caller's buffer, so offsets have
+ * to be honored rather than just reading on.
+ */
+static void seek_dirhandle(struct dirhandle* h, __u64 offset)
+{
+    if (offset == 0) {
+        /* rewinddir() might have been called above us, so rewind here too */
+        rewinddir(h->d);
+    } else if ((__u64) telldir(h->d) != offset) {
+        seekdir(h->d, offset);
+    }
+}
+
 static int handle_readdir(struct fuse* fuse, struct fuse_handler* handler,
         const struct fuse_in_header* hdr, const struct fuse_read_in* req)
 {
     char buffer[8192];
-    struct fuse_dirent *fde = (struct fuse_dirent*) buffer;
+    size_t size = MIN(req->size, sizeof(buffer));
+    size_t used = 0;
+    struct node* parent;
     struct dirent *de;
     struct dirhandle *h = id_to_ptr(req->fh);
 
     TRACE("[%d] READDIR %p\n", handler->token, h);
-    if (req->offset == 0) {
-        /* rewinddir() might have been called above us, so rewind here too */
-        TRACE("[%d] calling rewinddir()\n", handler->token);
-        rewinddir(h->d);
+    seek_dirhandle(h, req->offset);
+
+    pthread_rwlock_rdlock(&fuse->global->lock);
+    parent = lookup_node_by_id_locked(fuse, hdr->nodeid);
+    pthread_rwlock_unlock(&fuse->global->lock);
+
+    for (;;) {
+        struct fuse_dirent *fde = (struct fuse_dirent*) (buffer + used);
+        long pos = telldir(h->d);
+        struct node* child;
+        size_t len;
+
+        de = readdir(h->d);
+        if (!de) {
+            break;
+        }
+        len = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET + strlen(de->d_name));
+        if (used + len > size) {
+            /* leave it for the next request */
+            seekdir(h->d, pos);
+            break;
+        }
+
+        /* Report the inode number stat() would give, when known. */
+        pthread_rwlock_rdlock(&fuse->global->lock);
+        child = parent ? lookup_child_by_name_locked(parent, de->d_name) : NULL;
+        fde->ino = child ? child->ino : FUSE_UNKNOWN_INO;
+        pthread_rwlock_unlock(&fuse->global->lock);
+        fde->off = telldir(h->d);
+        fde->type = de->d_type;
+        fde->namelen = strlen(de->d_name);
+        memcpy(fde->name, de->d_name, fde->namelen);
+        memset(fde->name + fde->namelen, 0, len - FUSE_NAME_OFFSET - fde->namelen);
+        used += len;
     }
-    de = readdir(h->d);
-    if (!de) {
-        return 0;
+
+    fuse_reply(fuse, hdr->unique, buffer, used);
+    return NO_STATUS;
+}
+
+/* READDIR with the LOOKUP of each entry folded in. Each entry given a
+ * nodeid counts as one lookup of that node on the kernel side.
+ */
+static int handle_readdirplus(struct fuse* fuse, struct fuse_handler* handler,
+        const struct fuse_in_header* hdr, const struct fuse_read_in* req)
+{
+    char buffer[8192];
+    size_t size = MIN(req->size, sizeof(buffer));
+    size_t used = 0;
+    struct node* parent;
+    char parent_path[PATH_MAX];
+    char child_path[PATH_MAX];
+    size_t parent_len;
+    struct dirent *de;
+    struct dirhandle *h = id_to_ptr(req->fh);
+
+    pthread_rwlock_rdlock(&fuse->global->lock);
+    parent = lookup_node_and_path_by_id_locked(fuse, hdr->nodeid,
+            parent_path, sizeof(parent_path));
+    TRACE("[%d] READDIRPLUS %p @ %"PRIx64" (%s)\n", handler->token, h, hdr->nodeid,
+            parent ? parent->name : "?");
+    pthread_rwlock_unlock(&fuse->global->lock);
+
+    if (!parent) {
+        return -ENOENT;
     }
-    fde->ino = FUSE_UNKNOWN_INO;
-    /* increment the offset so we can detect when rewinddir() seeks back to the beginning */
-    fde->off = req->offset + 1;
-    fde->type = de->d_type;
-    fde->namelen = strlen(de->d_name);
-    memcpy(fde->name, de->d_name, fde->namelen + 1);
-    fuse_reply(fuse, hdr->unique, fde,
-            FUSE_DIRENT_ALIGN(sizeof(struct fuse_dirent) + fde->namelen));
+    parent_len = strlen(parent_path);
+    seek_dirhandle(h, req->offset);
+
+    for (;;) {
+        struct fuse_direntplus *fdp = (struct fuse_direntplus*) (buffer + used);
+        long pos = telldir(h->d);
+        size_t namelen;
+        size_t len;
+        struct stat s;
+        struct node* node;
+
+        de = readdir(h->d);
+        if (!de) {
+            break;
+        }
+        namelen = strlen(de->d_name);
+        len = FUSE_DIRENT_ALIGN(FUSE_NAME_OFFSET_DIRENTPLUS + namelen);
+        if (used + len > size) {
+            /* leave it for the next request */
+            seekdir(h->d, pos);
+            break;
+        }
+
+        memset(fdp, 0, len);
+        fdp->dirent.ino = FUSE_UNKNOWN_INO;
+        fdp->dirent.off = telldir(h->d);
+        fdp->dirent.type = de->d_type;
+        fdp->dirent.namelen = namelen;
+        memcpy(fdp->dirent.name, de->d_name, namelen);
+        used += len;
+
+        /* A zero nodeid lists the name without an entry, which is what the
+         * kernel expects for "." and "..", and what entries the caller may
+         * not look up or that vanished meanwhile get.
+         */
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")
+                || parent_len + 1 + namelen >= sizeof(child_path)
+                || !check_caller_access_to_name(fuse, hdr, parent, de->d_name, R_OK)) {
+            continue;
+        }
+        memcpy(child_path, parent_path, parent_len);
+        child_path[parent_len] = '/';
+        memcpy(child_path + parent_len + 1, de->d_name, namelen + 1);
+        if (lstat(child_path, &s) < 0) {
+            continue;
+        }
+
+        node = acquire_or_create_child(fuse, parent, de->d_name, de->d_name);
+        if (node) {
+            attr_from_stat(fuse, &fdp->entry_out.attr, &s, node);
+            fdp->entry_out.attr_valid = 10;
+            fdp->entry_out.entry_valid = 10;
+            fdp->entry_out.nodeid = node->nid;
+            fdp->entry_out.generation = node->gen;
+            fdp->dirent.ino = node->ino;
+        }
+        pthread_rwlock_unlock(&fuse->global->lock);
+    }
+
+    fuse_reply(fuse, hdr->unique, buffer, used);
     return NO_STATUS;
 }
 
@@ -1456,8 +1851,17 @@ static int handle_init(struct fuse* fuse, struct fuse_handler* handler,
         return -1;
     }
 
-    /* We limit ourselves to 15 because we don't handle BATCH_FORGET yet */
-    out.minor = MIN(req->minor, 15);
+    /* We limit ourselves to 21, the first with READDIRPLUS. What the minors
+     * since 15 ask of us:
+     *  16: FUSE_BATCH_FORGET, handled; 32-bit and retried ioctls, no ioctls
+     *  17: flock() locks, only with FUSE_FLOCK_LOCKS, which we don't set
+     *  18: ioctls on directories, no ioctls; FUSE_NOTIFY_DELETE, already used
+     *  19: FUSE_FALLOCATE, ENOSYS like any other unhandled opcode, after
+     *      which the kernel stops sending it
+     *  20: FUSE_AUTO_INVAL_DATA, which we don't set
+     *  21: FUSE_READDIRPLUS, handled
+     */
+    out.minor = MIN(req->minor, 21);
     fuse_struct_size = sizeof(out);
 #if defined(FUSE_COMPAT_22_INIT_OUT_SIZE)
     /* FUSE_KERNEL_VERSION >= 23. */
@@ -1473,6 +1877,7 @@ static int handle_init(struct fuse* fuse, struct fuse_handler* handler,
     out.major = FUSE_KERNEL_VERSION;
     out.max_readahead = req->max_readahead;
     out.flags = FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES;
+    out.flags |= req->flags & (FUSE_DO_READDIRPLUS | FUSE_READDIRPLUS_AUTO);
 
 #ifdef FUSE_SHORTCIRCUIT
      out.flags |= FUSE_SHORTCIRCUIT;
@@ -1502,6 +1907,17 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
         return handle_forget(fuse, handler, hdr, req);
     }
 
+    case FUSE_BATCH_FORGET: {
+        const struct fuse_batch_forget_in *req = data;
+        if (data_len < sizeof(*req) || (data_len - sizeof(*req)) /
+                sizeof(struct fuse_forget_one) < req->count) {
+            ERROR("[%d] malformed batch forget: count=%u len=%zu\n",
+                    handler->token, req->count, data_len);
+            return NO_STATUS; /* no reply */
+        }
+        return handle_batch_forget(fuse, handler, hdr, req);
+    }
+
     case FUSE_GETATTR: { /* getattr_in -> attr_out */
         const struct fuse_getattr_in *req = data;
         return handle_getattr(fuse, handler, hdr, req);
@@ -1593,6 +2009,11 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
         return handle_readdir(fuse, handler, hdr, req);
     }
 
+    case FUSE_READDIRPLUS: {
+        const struct fuse_read_in *req = data;
+        return handle_readdirplus(fuse, handler, hdr, req);
+    }
+
     case FUSE_RELEASEDIR: { /* release_in -> */
         const struct fuse_release_in *req = data;
         return handle_releasedir(fuse, handler, hdr, req);
@@ -1614,9 +2035,10 @@ static int handle_fuse_request(struct fuse *fuse, struct fuse_handler* handler,
 static void handle_fuse_requests(struct fuse_handler* handler)
 {
     struct fuse* fuse = handler->fuse;
+    __u8* request_buffer = get_request_buffer(handler);
     for (;;) {
         ssize_t len = TEMP_FAILURE_RETRY(read(fuse->fd,
-                handler->request_buffer, sizeof(handler->request_buffer)));
+                request_buffer, MAX_REQUEST_SIZE));
         if (len < 0) {
             if (errno == ENODEV) {
                 ERROR("[%d] someone stole our marbles!\n", handler->token);
@@ -1631,14 +2053,14 @@ static void handle_fuse_requests(struct fuse_handler* handler)
             continue;
         }
 
-        const struct fuse_in_header *hdr = (void*)handler->request_buffer;
+        const struct fuse_in_header *hdr = (void*)request_buffer;
         if (hdr->len != (size_t)len) {
             ERROR("[%d] malformed header: len=%zu, hdr->len=%u\n",
                     handler->token, (size_t)len, hdr->len);
             continue;
         }
 
-        const void *data = handler->request_buffer + sizeof(struct fuse_in_header);
+        const void *data = request_buffer + sizeof(struct fuse_in_header);
         size_t data_len = len - sizeof(struct fuse_in_header);
         __u64 unique = hdr->unique;
         int res = handle_fuse_request(fuse, handler, hdr, data, data_len);
@@ -1670,14 +2092,14 @@ static bool remove_str_to_int(void *key, void *value, void *context) {
 }
 
 static int read_package_list(struct fuse_global* global) {
-    pthread_mutex_lock(&global->lock);
+    pthread_rwlock_wrlock(&global->lock);
 
     hashmapForEach(global->package_to_appid, remove_str_to_int, global->package_to_appid);
 
     FILE* file = fopen(kPackagesListFile, "r");
     if (!file) {
         ERROR("failed to open package list: %s\n", strerror(errno));
-        pthread_mutex_unlock(&global->lock);
+        pthread_rwlock_unlock(&global->lock);
         return -1;
     }
 
@@ -1700,7 +2122,7 @@ static int read_package_list(struct fuse_global* global) {
     /* Regenerate ownership details using newly loaded mapping */
     derive_permissions_recursive_locked(global->fuse_default, &global->root);
 
-    pthread_mutex_unlock(&global->lock);
+    pthread_rwlock_unlock(&global->lock);
     return 0;
 }
 
@@ -1773,6 +2195,7 @@ static int usage() {
             "    -U: specify user ID that owns device\n"
             "    -m: source_path is multi-user\n"
             "    -w: runtime write mount has full write access\n"
+            "    -c: copy read data through the daemon rather than splice() it\n"
             "\n");
     return 1;
 }
@@ -1819,7 +2242,8 @@ static int fuse_setup(struct fuse* fuse, gid_t gid, mode_t mask, bool use_sdcard
 }
 
 static void run(const char* source_path, const char* label, uid_t uid,
-        gid_t gid, userid_t userid, bool multi_user, bool full_write, bool use_sdcardfs) {
+        gid_t gid, userid_t userid, bool multi_user, bool full_write, bool use_sdcardfs,
+        bool use_splice) {
     struct fuse_global global;
     struct fuse fuse_default;
     struct fuse fuse_read;
@@ -1839,11 +2263,12 @@ static void run(const char* source_path, const char* label, uid_t uid,
     memset(&handler_read, 0, sizeof(handler_read));
     memset(&handler_write, 0, sizeof(handler_write));
 
-    pthread_mutex_init(&global.lock, NULL);
+    pthread_rwlock_init(&global.lock, NULL);
     global.package_to_appid = hashmapCreate(256, str_hash, str_icase_equals);
     global.uid = uid;
     global.gid = gid;
     global.multi_user = multi_user;
+    global.use_splice = use_splice;
     global.next_generation = 0;
     global.inode_ctr = 1;
 
@@ -1952,12 +2377,13 @@ int sdcard_main(int argc, char **argv) {
     userid_t userid = 0;
     bool multi_user = false;
     bool full_write = false;
+    bool use_splice = true;
     int i;
     struct rlimit rlim;
     int fs_version;
 
     int opt;
-    while ((opt = getopt(argc, argv, "u:g:U:mw")) != -1) {
+    while ((opt = getopt(argc, argv, "u:g:U:mwc")) != -1) {
         switch (opt) {
             case 'u':
                 uid = strtoul(optarg, NULL, 10);
@@ -1974,6 +2400,9 @@ int sdcard_main(int argc, char **argv) {
             case 'w':
                 full_write = true;
                 break;
+            case 'c':
+                use_splice = false;
+                break;
             case '?':
             default:
                 return usage();
@@ -2018,6 +2447,7 @@ int sdcard_main(int argc, char **argv) {
 
     bool use_sdcardfs = property_get_bool("ro.sdcardfs.enable", false);
 
-    run(source_path, label, uid, gid, userid, multi_user, full_write, use_sdcardfs);
+    run(source_path, label, uid, gid, userid, multi_user, full_write, use_sdcardfs,
+            use_splice);
     return 1;
 }
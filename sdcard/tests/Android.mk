@@ -0,0 +1,36 @@
+#
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+LOCAL_PATH := $(call my-dir)
+
+# -----------------------------------------------------------------------------
+# Benchmarks, sharing liblog's benchmark harness.
+# -----------------------------------------------------------------------------
+
+# Build benchmarks for the device. Run with:
+#   adb shell SDCARD_BENCHMARK_DIR=/sdcard sdcard-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := sdcard-benchmarks
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS += \
+    -Wall -Wextra \
+    -Werror \
+    -std=gnu++11
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../liblog/tests
+LOCAL_SRC_FILES := \
+    ../../liblog/tests/benchmark_main.cpp \
+    sdcard_benchmark.cpp
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * File data throughput through an sdcard mount. O_DIRECT keeps the kernel
+ * page cache out of the way, so every read and write reaches the daemon with
+ * the size asked for. Reads of 16K and up take the daemon's splice path,
+ * 8K and 16K bracket where it starts.
+ *
+ * Point SDCARD_BENCHMARK_DIR at a mount served by the daemon as is (splice)
+ * and then started with -c (copy), or at the backing directory for the
+ * cost without FUSE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "benchmark.h"
+
+static const off_t kFileSize = 64 * 1024 * 1024;
+static const size_t kMaxIoSize = 128 * 1024;
+
+static const std::string& test_file() {
+    static std::string path;
+    if (path.empty()) {
+        const char* dir = getenv("SDCARD_BENCHMARK_DIR");
+        path = std::string(dir ? dir : "/sdcard") + "/sdcard_benchmark.dat";
+    }
+    return path;
+}
+
+static void* io_buffer() {
+    static void* buffer;
+    if (!buffer) {
+        if (posix_memalign(&buffer, 4096, kMaxIoSize)) {
+            abort();
+        }
+        memset(buffer, 0x5a, kMaxIoSize);
+    }
+    return buffer;
+}
+
+// Creates the file once, so that read benchmarks find data.
+static int open_test_file(int flags) {
+    struct stat st;
+    if (stat(test_file().c_str(), &st) || st.st_size < kFileSize) {
+        int fd = open(test_file().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0660);
+        if (fd < 0) {
+            fprintf(stderr, "can't create %s\n", test_file().c_str());
+            exit(EXIT_FAILURE);
+        }
+        for (off_t off = 0; off < kFileSize; off += kMaxIoSize) {
+            if (write(fd, io_buffer(), kMaxIoSize) != (ssize_t) kMaxIoSize) {
+                fprintf(stderr, "can't fill %s\n", test_file().c_str());
+                exit(EXIT_FAILURE);
+            }
+        }
+        fsync(fd);
+        close(fd);
+    }
+
+    int fd = open(test_file().c_str(), flags | O_DIRECT);
+    if (fd < 0) {
+        fprintf(stderr, "can't open %s\n", test_file().c_str());
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Fixed seed, so that every run and every daemon sees the same offsets.
+static off_t next_offset(int i, size_t size, bool random) {
+    off_t blocks = kFileSize / size;
+    if (random) {
+        return (off_t) (rand_r((unsigned*) &i) % blocks) * size;
+    }
+    return (off_t) (i % blocks) * size;
+}
+
+static void run_io(int iters, size_t size, bool random, bool write) {
+    int fd = open_test_file(write ? O_WRONLY : O_RDONLY);
+    void* buffer = io_buffer();
+
+    StartBenchmarkTiming();
+    for (int i = 0; i < iters; ++i) {
+        off_t off = next_offset(i, size, random);
+        ssize_t res = write ? pwrite(fd, buffer, size, off) : pread(fd, buffer, size, off);
+        if (res != (ssize_t) size) {
+            fprintf(stderr, "%s of %zu at %lld failed\n", write ? "write" : "read",
+                    size, (long long) off);
+            exit(EXIT_FAILURE);
+        }
+    }
+    StopBenchmarkTiming();
+
+    SetBenchmarkBytesProcessed((uint64_t) iters * size);
+    close(fd);
+}
+
+static void BM_sdcard_read_sequential(int iters, int size) {
+    run_io(iters, size, false, false);
+}
+BENCHMARK(BM_sdcard_read_sequential)->Arg(4096)->Arg(8192)->Arg(16384)->Arg(32768)
+    ->Arg(131072);
+
+static void BM_sdcard_read_random(int iters, int size) {
+    run_io(iters, size, true, false);
+}
+BENCHMARK(BM_sdcard_read_random)->Arg(4096)->Arg(8192)->Arg(16384)->Arg(32768)
+    ->Arg(131072);
+
+static void BM_sdcard_write_sequential(int iters, int size) {
+    run_io(iters, size, false, true);
+}
+BENCHMARK(BM_sdcard_write_sequential)->Arg(4096)->Arg(32768)->Arg(131072);
+
+static void BM_sdcard_write_random(int iters, int size) {
+    run_io(iters, size, true, true);
+}
+BENCHMARK(BM_sdcard_write_random)->Arg(4096)->Arg(32768)->Arg(131072);